@@ -36,11 +36,18 @@ TEST_DEPS += $(TARGET_LIB)/libmod_lua.a
 ###############################################################################
 
 TEST_PLANS =
+TEST_PLANS += bytes/bytes_udf
 TEST_PLANS += list/list_udf
 TEST_PLANS += record/record_udf
+TEST_PLANS += set/set_udf
+TEST_PLANS += sketch/sketch_udf
 TEST_PLANS += stream/stream_udf
 TEST_PLANS += validation/validation_basics
 TEST_PLANS += hash/hash_udf
+TEST_PLANS += vector/vector_udf
+
+PERF_PLANS =
+PERF_PLANS += perf/perf_udf
 
 TEST_UTIL =
 TEST_UTIL += util/consumer_stream
@@ -54,6 +61,10 @@ TEST_MOD_LUA = mod_lua_test
 TEST_MOD_LUA += $(TEST_UTIL)
 TEST_MOD_LUA += $(TEST_PLANS)
 
+PERF_MOD_LUA = mod_lua_perf
+PERF_MOD_LUA += $(TEST_UTIL)
+PERF_MOD_LUA += $(PERF_PLANS)
+
 ###############################################################################
 ##  TEST TARGETS                                                             ##
 ###############################################################################
@@ -69,6 +80,13 @@ test-valgrind: test-build
 .PHONY: test-build
 test-build: $(TEST_DEPS) test/mod_lua_test
 
+.PHONY: perf
+perf: perf-build
+	$(TARGET_BIN)/test/mod_lua_perf
+
+.PHONY: perf-build
+perf-build: $(TEST_DEPS) test/mod_lua_perf
+
 .PHONY: test-clean
 test-clean:
 	@rm -rf $(TARGET_BIN)/test
@@ -90,3 +108,10 @@ $(TARGET_BIN)/test/mod_lua_test: CFLAGS = $(TEST_CFLAGS)
 $(TARGET_BIN)/test/mod_lua_test: LDFLAGS = $(TEST_DEPS) $(TEST_LDFLAGS)
 $(TARGET_BIN)/test/mod_lua_test: $(TEST_MOD_LUA:%=$(TARGET_OBJ)/test/%.o) $(TARGET_OBJ)/test/test.o $(wildcard $(TARGET_OBJ)/*) | modules build prepare
 	$(executable)
+
+.PHONY: test/mod_lua_perf
+test/mod_lua_perf: $(TARGET_BIN)/test/mod_lua_perf
+$(TARGET_BIN)/test/mod_lua_perf: CFLAGS = $(TEST_CFLAGS)
+$(TARGET_BIN)/test/mod_lua_perf: LDFLAGS = $(TEST_DEPS) $(TEST_LDFLAGS)
+$(TARGET_BIN)/test/mod_lua_perf: $(PERF_MOD_LUA:%=$(TARGET_OBJ)/test/%.o) $(TARGET_OBJ)/test/test.o $(wildcard $(TARGET_OBJ)/*) | modules build prepare
+	$(executable)
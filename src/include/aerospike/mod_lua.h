@@ -30,3 +30,61 @@ extern as_module mod_lua;
 void mod_lua_rdlock(as_module* m);
 void mod_lua_wrlock(as_module* m);
 void mod_lua_unlock(as_module* m);
+
+
+/**
+ * Apply a stream UDF to several input streams on up to n_threads threads (0
+ * for one per input, at most 64), each input on its own pooled state.
+ *
+ * On the server, inputs are e.g. partitions. Each runs the server-scope ops,
+ * then the partial results are combined with the pipeline's reduce, if it
+ * has one, and written to ostream.
+ *
+ * On the client, inputs are the results of each node. Each is reduced with
+ * the pipeline's reduce, then the client-scope ops run on the reductions.
+ *
+ * udf_ctx is shared by the threads, so its as_aerospike and timer must be
+ * safe to use from several threads at once.
+ */
+int mod_lua_apply_stream_parallel(as_udf_context* udf_ctx,
+		const char* filename, const char* function, as_stream** istreams,
+		uint32_t n_istreams, as_list* args, as_stream* ostream,
+		as_result* res, uint32_t n_threads);
+
+
+/**
+ * Returned by mod_lua_apply_stream_begin() and mod_lua_resume() while the UDF
+ * has yielded, and is yet to finish.
+ */
+#define MOD_LUA_IN_PROGRESS 100
+
+/**
+ * A stream UDF applied by mod_lua_apply_stream_begin(), which yields back to
+ * the caller to be resumed later.
+ */
+typedef struct mod_lua_job_s mod_lua_job;
+
+/**
+ * Apply a stream UDF on a coroutine, which yields after every budget Lua
+ * instructions (0 for no budget), and whenever istream's read returns
+ * MOD_LUA_STREAM_PENDING. Returns MOD_LUA_IN_PROGRESS, with *job set, if the
+ * UDF yielded, or else its result, as apply_stream would.
+ *
+ * A job holds a pooled state until it finishes, and udf_ctx, the streams and
+ * res must outlive it. It may be resumed on any thread, but by one at a time.
+ */
+int mod_lua_apply_stream_begin(as_udf_context* udf_ctx,
+		const char* filename, const char* function, as_stream* istream,
+		as_list* args, as_stream* ostream, as_result* res, uint32_t budget,
+		mod_lua_job** job);
+
+/**
+ * Run a job until it yields again or finishes. Returns MOD_LUA_IN_PROGRESS,
+ * or the UDF's result, having freed the job.
+ */
+int mod_lua_resume(mod_lua_job* job);
+
+/**
+ * Give up on a job which is in progress.
+ */
+void mod_lua_job_destroy(mod_lua_job* job);
@@ -26,3 +26,16 @@ int mod_lua_bytes_register(lua_State *);
 as_bytes * mod_lua_pushbytes(lua_State *, as_bytes * );
 
 as_bytes * mod_lua_tobytes(lua_State *, int);
+
+/**
+ * The bytes at the index, or a view of the range of the bytes.slice() there,
+ * which is only valid until the slice is collected or its bytes change. NULL
+ * if the value there is neither.
+ */
+as_bytes * mod_lua_toview(lua_State *, int);
+
+/**
+ * A new copy of the range viewed by the bytes.slice() at the index, or NULL if
+ * the value there isn't a slice.
+ */
+as_bytes * mod_lua_slice_tobytes(lua_State *, int);
@@ -26,7 +26,9 @@ struct mod_lua_config_s;
 typedef struct mod_lua_config_s mod_lua_config;
 
 struct mod_lua_config_s {
-    bool    server_mode;
-    bool    cache_enabled;
-    char    user_path[256];
+    bool        server_mode;
+    bool        cache_enabled;
+    char        user_path[256];
+    // Identifies the node, so stream samples drawn on each differ. Optional.
+    uint64_t    node_id;
 };
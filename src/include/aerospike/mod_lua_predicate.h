@@ -0,0 +1,36 @@
+/*
+ * Copyright 2008-2024 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#pragma once
+
+#include <lua.h>
+#include <stdbool.h>
+
+#include <aerospike/as_val.h>
+
+typedef struct mod_lua_predicate_s mod_lua_predicate;
+
+int mod_lua_predicate_register(lua_State *);
+
+/**
+ * The predicate at index, or NULL if the value isn't one.
+ */
+mod_lua_predicate * mod_lua_topredicate(lua_State *, int);
+
+/**
+ * Whether a record or map satisfies the predicate, without calling into Lua.
+ */
+bool mod_lua_predicate_match(const mod_lua_predicate *, const as_val *);
@@ -0,0 +1,36 @@
+/*
+ * Copyright 2008-2024 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#pragma once
+
+#include <lua.h>
+
+#include <aerospike/as_map.h>
+#include <aerospike/as_val.h>
+
+typedef struct mod_lua_projection_s mod_lua_projection;
+
+int mod_lua_projection_register(lua_State *);
+
+/**
+ * The projection at index, or NULL if the value isn't one.
+ */
+mod_lua_projection * mod_lua_toprojection(lua_State *, int);
+
+/**
+ * A new map of the projected bins of a record, or keys of a map.
+ */
+as_map * mod_lua_projection_apply(const mod_lua_projection *, const as_val *);
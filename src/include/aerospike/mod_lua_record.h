@@ -21,8 +21,43 @@
 #include <aerospike/as_rec.h>
 #include <aerospike/mod_lua_val.h>
 
+/**
+ * Optional bin id hooks for records, used by record.bin() handles. A host
+ * that can address bins by a small integer id registers these alongside its
+ * as_rec_hooks, so a bin name is resolved once rather than on every access.
+ * Records whose hooks have no bin hooks registered fall back to name lookup.
+ */
+typedef struct mod_lua_bin_hooks_s {
+    /**
+     * Token for the bin id mapping used by the record. Records returning the
+     * same non-NULL token map names to the same ids, so resolved handles stay
+     * valid across records and invocations. NULL means ids are only valid for
+     * this record during the current invocation.
+     */
+    const void * (*id_space)(const as_rec * rec);
+
+    /**
+     * Resolve a bin name to an id. Return false if the name can't be resolved
+     * (e.g. the bin doesn't exist yet) to use name lookup instead.
+     */
+    bool (*resolve)(const as_rec * rec, const char * name, uint32_t * id);
+
+    /**
+     * Same contract as as_rec_hooks get/set, but addressed by bin id.
+     */
+    as_val * (*get)(const as_rec * rec, uint32_t id);
+    int (*set)(const as_rec * rec, uint32_t id, const as_val * value);
+} mod_lua_bin_hooks;
+
 int mod_lua_record_register(lua_State *);
 
+/**
+ * Associate bin id hooks with records using rec_hooks, or remove the
+ * association if bin_hooks is NULL. Not thread safe - call before running
+ * UDFs. Returns false if the table of registered hooks is full.
+ */
+bool mod_lua_record_set_bin_hooks(const as_rec_hooks * rec_hooks, const mod_lua_bin_hooks * bin_hooks);
+
 as_rec * mod_lua_pushrecord(lua_State *, as_rec * );
 
 as_rec * mod_lua_torecord(lua_State *, int);
@@ -0,0 +1,29 @@
+/*
+ * Copyright 2008-2024 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#pragma once
+
+#include <lua.h>
+
+#include <aerospike/as_list.h>
+
+int mod_lua_set_register(lua_State *);
+
+/**
+ * A new list of the elements of the set at the index, or NULL if the value
+ * there isn't a set.
+ */
+as_list * mod_lua_set_tolist(lua_State *, int);
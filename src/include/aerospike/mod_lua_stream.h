@@ -19,6 +19,15 @@
 #include <lua.h>
 #include <aerospike/as_stream.h>
 
+/**
+ * A stream's read may return MOD_LUA_STREAM_PENDING when it has no value
+ * ready, but hasn't ended. A UDF applied by mod_lua_apply_stream_begin()
+ * yields until it is resumed, and any other reads again.
+ */
+extern const as_val mod_lua_stream_pending;
+
+#define MOD_LUA_STREAM_PENDING ((as_val *) &mod_lua_stream_pending)
+
 int mod_lua_stream_register(lua_State *);
 
 as_stream * mod_lua_pushstream(lua_State *, as_stream *);
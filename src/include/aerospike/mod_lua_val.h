@@ -34,9 +34,22 @@ struct mod_lua_box_s {
     void * value;
 };
 
+/**
+ * Caller-provided storage for mod_lua_toval_tmp(), so a val which is only
+ * needed for the duration of a call (e.g. a map lookup key) isn't allocated.
+ */
+typedef union mod_lua_tmpval_u {
+    as_val      val;
+    as_boolean  boolean;
+    as_integer  integer;
+    as_double   dbl;
+    as_string   string;
+} mod_lua_tmpval;
+
 as_val * mod_lua_takeval(lua_State * l, int i);
 as_val * mod_lua_retval(lua_State * l);
 as_val * mod_lua_toval(lua_State *, int);
+as_val * mod_lua_toval_tmp(lua_State *, int, mod_lua_tmpval *);
 int mod_lua_pushval(lua_State *, const as_val *);
 
 mod_lua_box * mod_lua_newbox(lua_State *, mod_lua_scope, void *, const char *);
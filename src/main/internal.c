@@ -28,3 +28,56 @@ void __log_append(const char * file, int line, const char * fmt, ...) {
     va_end(ap);
     printf("%s:%d – %s\n",file,line,msg);
 }
+
+// Registry key for the invocation counter.
+static const char g_invocation_key = 0;
+
+lua_Integer mod_lua_invocation(lua_State * l) {
+    lua_rawgetp(l, LUA_REGISTRYINDEX, &g_invocation_key);
+    lua_Integer n = lua_tointeger(l, -1);
+    lua_pop(l, 1);
+    return n;
+}
+
+void mod_lua_invocation_begin(lua_State * l) {
+    lua_Integer n = mod_lua_invocation(l);
+    lua_pushinteger(l, n + 1);
+    lua_rawsetp(l, LUA_REGISTRYINDEX, &g_invocation_key);
+}
+
+void mod_lua_invocation_end(lua_State * l) {
+    mod_lua_nbytes_release(l);
+}
+
+void mod_lua_pushcalltable(lua_State * l, const void * key, const char * mode,
+        lua_CFunction gc) {
+    lua_Integer invocation = mod_lua_invocation(l);
+
+    if ( lua_rawgetp(l, LUA_REGISTRYINDEX, key) == LUA_TTABLE ) {
+        lua_rawgeti(l, -1, 0);
+        lua_Integer cached = lua_tointeger(l, -1);
+        lua_pop(l, 1);
+        if ( cached == invocation ) {
+            return;
+        }
+    }
+    lua_pop(l, 1);
+
+    lua_newtable(l);
+    lua_pushinteger(l, invocation);
+    lua_rawseti(l, -2, 0);
+    if ( mode || gc ) {
+        lua_createtable(l, 0, 2);
+        if ( mode ) {
+            lua_pushstring(l, mode);
+            lua_setfield(l, -2, "__mode");
+        }
+        if ( gc ) {
+            lua_pushcfunction(l, gc);
+            lua_setfield(l, -2, "__gc");
+        }
+        lua_setmetatable(l, -2);
+    }
+    lua_pushvalue(l, -1);
+    lua_rawsetp(l, LUA_REGISTRYINDEX, key);
+}
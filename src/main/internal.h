@@ -17,8 +17,11 @@
 
 #pragma once
 
+#include <aerospike/as_val.h>
 #include <lauxlib.h>
 #include <lua.h>
+#include <stdbool.h>
+#include <stdint.h>
 
 struct lua_State;
 
@@ -40,5 +43,55 @@ mod_lua_typerror(struct lua_State *L, int narg, const char *tname)
 	return luaL_argerror(L, narg, msg);
 }
 
+//
+// invocations
+//
+
+// Number of UDF calls started on the state. Per-state caches use it to tell
+// whether something they hold was produced during the current call.
+lua_Integer mod_lua_invocation(struct lua_State *L);
+
+// Called before each UDF call on the state.
+void mod_lua_invocation_begin(struct lua_State *L);
+
+// Called once a UDF call is over, before the state goes back to the pool.
+// Releases host values the call was holding on to.
+void mod_lua_invocation_end(struct lua_State *L);
+
+// Push the table stored in the registry under key for the current UDF call.
+// A new table is made the first time it is asked for in each call, as host
+// values (e.g. on the stack) may reuse an address once the call is over. The
+// table gets the given __mode and __gc, either of which may be NULL. Key 0 is
+// taken.
+void mod_lua_pushcalltable(struct lua_State *L, const void *key,
+		const char *mode, lua_CFunction gc);
+
+//
+// serialized sizes
+//
+
+// Serialized size of a list or map. The first call in a UDF call walks the
+// collection; after that the size is kept current by the list and map
+// bindings through mod_lua_nbytes_adjust() and mod_lua_nbytes_forget(),
+// until mod_lua_nbytes_release() at the end of the call.
+// Collections holding other collections or bytes are walked every time, as
+// those can change without the bindings seeing it.
+uint32_t mod_lua_nbytes(struct lua_State *L, const as_val *c);
+
+// Whether the size of c is being tracked, i.e. whether it is worth calling
+// mod_lua_nbytes_adjust() for a change that needs a lookup to describe.
+bool mod_lua_nbytes_tracked(struct lua_State *L, const as_val *c);
+
+// Account for added and/or removed elements (map keys and values count
+// separately). Either may be NULL.
+void mod_lua_nbytes_adjust(struct lua_State *L, const as_val *c,
+		const as_val *added, const as_val *removed);
+
+// Stop tracking c, for changes too broad to adjust for.
+void mod_lua_nbytes_forget(struct lua_State *L, const as_val *c);
+
+// Stop tracking everything, releasing the tracked collections.
+void mod_lua_nbytes_release(struct lua_State *L);
+
 #define DO_PRAGMA(x) _Pragma (#x)
 #define TODO(x) DO_PRAGMA(message ("TODO - " #x))
@@ -23,6 +23,7 @@
 #include "aerospike/mod_lua.h"
 
 #include <lauxlib.h>
+#include <limits.h>
 #include <lua.h>
 #include <lualib.h>
 #include <pthread.h>
@@ -34,11 +35,13 @@
 #include <sys/types.h>
 
 #include <aerospike/as_aerospike.h>
+#include <aerospike/as_arraylist.h>
 #include <aerospike/as_atomic.h>
 #include <aerospike/as_dir.h>
 #include <aerospike/as_log_macros.h>
 #include <aerospike/as_types.h>
 #include <citrusleaf/alloc.h>
+#include <citrusleaf/cf_clock.h>
 #include <citrusleaf/cf_hash_math.h>
 #include <citrusleaf/cf_queue.h>
 
@@ -46,12 +49,20 @@
 #include "aerospike/mod_lua_bytes.h"
 #include "aerospike/mod_lua_config.h"
 #include "aerospike/mod_lua_geojson.h"
+#include "aerospike/mod_lua_hash.h"
 #include "aerospike/mod_lua_iterator.h"
 #include "aerospike/mod_lua_list.h"
 #include "aerospike/mod_lua_map.h"
 #include "aerospike/mod_lua_record.h"
 #include "aerospike/mod_lua_stream.h"
 #include "aerospike/mod_lua_val.h"
+#include "aerospike/mod_lua_vector.h"
+#include "aerospike/mod_lua_set.h"
+#include "aerospike/mod_lua_sketch.h"
+#include "aerospike/mod_lua_topk.h"
+#include "aerospike/mod_lua_predicate.h"
+#include "aerospike/mod_lua_projection.h"
+#include "aerospike/mod_lua_spill.h"
 
 #include "internal.h"
 
@@ -78,6 +89,14 @@ extern size_t as_lua_aerospike_size;
 
 #define MOD_LUA_CONFIG_USRPATH "/opt/aerospike/usr/udf/lua"
 
+// Scopes passed to apply_stream() in Lua - see StreamOps_select().
+#define STREAM_SCOPE_SERVER 1
+#define STREAM_SCOPE_CLIENT 2
+#define STREAM_SCOPE_MERGE 5 // only the reduce ending the server ops
+#define STREAM_SCOPE_PARTIAL 6 // only the reduce starting the client ops
+
+#define PARALLEL_THREADS_MAX 64
+
 typedef struct cache_entry_s {
 	uint64_t cache_miss;
 	uint64_t total;
@@ -95,6 +114,37 @@ typedef struct pushargs_data_s {
 	uint32_t count;
 } pushargs_data;
 
+// Values written by one part of a parallel stream apply, read back in order.
+typedef struct stream_buffer_s {
+	as_arraylist values;
+	uint32_t pos;
+} stream_buffer;
+
+typedef struct parallel_apply_s {
+	as_udf_context* udf_ctx;
+	const char* filename;
+	const char* function;
+	as_stream** istreams;
+	uint32_t n_istreams;
+	as_list* args;
+	int scope;
+	uint32_t next; // next istream for a worker to take
+	stream_buffer* partials; // one per istream
+	int* rcs;
+	as_result** results;
+} parallel_apply;
+
+// A stream UDF running on a coroutine of a pooled state.
+struct mod_lua_job_s {
+	char filename[CACHE_ENTRY_KEY_MAX];
+	cache_item citem;
+	lua_State* co;
+	int ref; // keeps co from being collected
+	int nargs; // passed to apply_stream() by the first resume
+	as_result* res;
+	as_timer* timer; // checked by the hooks of every slice
+};
+
 typedef struct lua_hash_ele_s {
 	char key[CACHE_ENTRY_KEY_MAX];
 	cache_entry* value;
@@ -130,7 +180,12 @@ static mod_lua_config g_lua_cfg = {
 		.user_path = MOD_LUA_CONFIG_USRPATH
 };
 
-static as_timer g_timer = { 0 };
+// Registry key of the timer checked by the hooks of a state's call.
+static const char g_timer_key = 0;
+
+// Mixed into the partial number of each stream apply, so partials on
+// different nodes are told apart - see stream_partial().
+static uint64_t g_partial_salt = 0;
 
 
 //==========================================================
@@ -141,6 +196,7 @@ static int update(as_module* m, as_module_event* e);
 static int validate(as_module* m, as_aerospike* as, const char* filename, const char* content, uint32_t size, as_module_error* err);
 static int apply_record(as_module* m, as_udf_context* udf_ctx, const char* filename, const char* function, as_rec* r, as_list* args, as_result* res);
 static int apply_stream(as_module* m, as_udf_context* udf_ctx, const char* filename, const char* function, as_stream* istream, as_list* args, as_stream* ostream, as_result* res);
+static int apply_stream_scope(as_udf_context* udf_ctx, const char* filename, const char* function, as_stream* istream, as_list* args, as_stream* ostream, as_result* res, int scope, uint32_t partial);
 
 static int cache_scan_dir(const char* user_path);
 static int cache_add_file(const char* user_path, const char* filename);
@@ -163,8 +219,15 @@ static lua_State* create_state(const char* user_path, const char* filename);
 static bool load_buffer(lua_State* l, const char* script, size_t size, const char* name);
 static bool is_native_module(const char* user_path, const char* filename);
 
+static void stream_buffer_init(stream_buffer* b, as_stream* s);
+static void stream_buffer_destroy(stream_buffer* b);
+static void* parallel_worker(void* udata);
+
 static int handle_error(lua_State* l);
+static void set_timer(lua_State* l, as_timer* timer);
 static void check_timer(lua_State* l, lua_Debug* ar);
+static void end_slice(lua_State* l, lua_Debug* ar);
+static void end_slice_timed(lua_State* l, lua_Debug* ar);
 
 lua_hash* lua_hash_create(uint32_t n_rows);
 void lua_hash_destroy(lua_hash* h); // for unit test only
@@ -199,6 +262,23 @@ dropext(char* name, size_t name_len, const char* ext, size_t ext_len)
 	return false;
 }
 
+// The splitmix64 finalizer.
+static inline uint64_t
+mix64(uint64_t z)
+{
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+// Partial i of a stream apply on this node, for ops such as sample() which
+// must draw differently on each.
+static inline lua_Integer
+stream_partial(uint32_t i)
+{
+	return (lua_Integer)(g_partial_salt + i);
+}
+
 static inline void
 cache_entry_cleanup(cache_entry* centry)
 {
@@ -261,6 +341,261 @@ mod_lua_unlock(as_module* m)
 	pthread_rwlock_unlock(&g_lock);
 }
 
+// Called by server, per node, and by client, over the nodes' results. The
+// calling thread is one of the workers.
+int
+mod_lua_apply_stream_parallel(as_udf_context* udf_ctx, const char* filename,
+		const char* function, as_stream** istreams, uint32_t n_istreams,
+		as_list* args, as_stream* ostream, as_result* res, uint32_t n_threads)
+{
+	// The server runs its ops per input and merges with the reduce ending
+	// them. The client reduces per input and runs its ops on the reductions.
+	int scope = g_lua_cfg.server_mode ?
+			STREAM_SCOPE_SERVER : STREAM_SCOPE_PARTIAL;
+	int merge_scope = g_lua_cfg.server_mode ?
+			STREAM_SCOPE_MERGE : STREAM_SCOPE_CLIENT;
+
+	if (n_istreams == 1) {
+		return apply_stream_scope(udf_ctx, filename, function, istreams[0],
+				args, ostream, res, g_lua_cfg.server_mode ?
+						STREAM_SCOPE_SERVER : STREAM_SCOPE_CLIENT, 0);
+	}
+
+	if (n_threads == 0 || n_threads > n_istreams) {
+		n_threads = n_istreams;
+	}
+
+	if (n_threads > PARALLEL_THREADS_MAX) {
+		n_threads = PARALLEL_THREADS_MAX;
+	}
+
+	parallel_apply job = {
+			.udf_ctx = udf_ctx,
+			.filename = filename,
+			.function = function,
+			.istreams = istreams,
+			.n_istreams = n_istreams,
+			.args = args,
+			.scope = scope,
+			.next = 0,
+			.partials = cf_malloc(n_istreams * sizeof(stream_buffer)),
+			.rcs = cf_calloc(n_istreams, sizeof(int)),
+			.results = cf_calloc(n_istreams, sizeof(as_result*))
+	};
+
+	if (n_istreams != 0 && (job.partials == NULL || job.rcs == NULL ||
+			job.results == NULL)) {
+		as_log_error("lua apply: failed to allocate %u partials", n_istreams);
+		cf_free(job.partials);
+		cf_free(job.rcs);
+		cf_free(job.results);
+		return 2;
+	}
+
+	pthread_t threads[PARALLEL_THREADS_MAX];
+	uint32_t n_started = 0;
+
+	// The calling thread works too, so start one less.
+	for (uint32_t i = 1; i < n_threads; i++) {
+		if (pthread_create(&threads[n_started], NULL, parallel_worker,
+				&job) != 0) {
+			break;
+		}
+
+		n_started++;
+	}
+
+	parallel_worker(&job);
+
+	for (uint32_t i = 0; i < n_started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	int rc = 0;
+
+	for (uint32_t i = 0; i < n_istreams; i++) {
+		if (job.rcs[i] != 0 && rc == 0) {
+			rc = job.rcs[i];
+
+			if (res != NULL && job.results[i]->value != NULL) {
+				as_val_reserve(job.results[i]->value);
+				as_result_setfailure(res, job.results[i]->value);
+			}
+		}
+
+		as_result_destroy(job.results[i]);
+	}
+
+	// Read all partial results, in input order, through one stream.
+	as_stream merged;
+	stream_buffer all;
+
+	stream_buffer_init(&all, &merged);
+
+	for (uint32_t i = 0; i < n_istreams; i++) {
+		as_arraylist* values = &job.partials[i].values;
+
+		for (uint32_t j = 0; j < values->size; j++) {
+			as_arraylist_append(&all.values, values->elements[j]);
+			values->elements[j] = NULL;
+		}
+
+		stream_buffer_destroy(&job.partials[i]);
+	}
+
+	if (rc == 0) {
+		rc = apply_stream_scope(udf_ctx, filename, function, &merged, args,
+				ostream, res, merge_scope, 0);
+	}
+
+	as_stream_destroy(&merged);
+
+	cf_free(job.partials);
+	cf_free(job.rcs);
+	cf_free(job.results);
+
+	return rc;
+}
+
+// Called by server or client, from a scheduler which gives each job a slice
+// of a worker at a time.
+int
+mod_lua_apply_stream_begin(as_udf_context* udf_ctx, const char* filename,
+		const char* function, as_stream* istream, as_list* args,
+		as_stream* ostream, as_result* res, uint32_t budget, mod_lua_job** job_r)
+{
+	*job_r = NULL;
+
+	mod_lua_job* job = cf_calloc(1, sizeof(mod_lua_job));
+
+	if (as_strncpy(job->filename, filename, sizeof(job->filename))) {
+		as_log_error("lua apply: filename too long %s", filename);
+		cf_free(job);
+		return 1;
+	}
+
+	// Get a state, which the job keeps until it finishes.
+	int rc = get_state(job->filename, &job->citem);
+
+	if (rc != 0) {
+		cf_free(job);
+		return rc;
+	}
+
+	lua_State* l = job->citem.state;
+
+	// Push as_aerospike object into the global scope.
+	mod_lua_pushaerospike(l, udf_ctx->as);
+	lua_setglobal(l, "aerospike");
+
+	job->co = lua_newthread(l);
+	job->ref = luaL_ref(l, LUA_REGISTRYINDEX);
+	job->res = res;
+	job->timer = udf_ctx->timer;
+
+	lua_State* co = job->co;
+
+	// Push apply_stream(), function, scope, istream and ostream.
+	lua_getglobal(co, "apply_stream");
+	lua_getglobal(co, function);
+	lua_pushinteger(co, g_lua_cfg.server_mode ?
+			STREAM_SCOPE_SERVER : STREAM_SCOPE_CLIENT);
+	lua_pushinteger(co, stream_partial(0));
+	mod_lua_pushstream(co, istream);
+	mod_lua_pushstream(co, ostream);
+
+	// Push each argument onto the stack.
+	int argc = pushargs(co, args);
+
+	if (argc < 0) {
+		mod_lua_job_destroy(job);
+		return 2;
+	}
+
+	if (argc > LUA_PARAM_COUNT_THRESHOLD) {
+		as_log_error("large number of lua function arguments (%d)", argc);
+	}
+
+	job->nargs = 5 + argc; // function + scope + partial + istream + ostream + arglist
+
+	// The hooks are the coroutine's own, so are gone with it.
+	if (budget != 0) {
+		lua_sethook(co, udf_ctx->timer != NULL ? &end_slice_timed : &end_slice,
+				LUA_MASKCOUNT, budget > INT_MAX ? INT_MAX : (int)budget);
+	}
+	else if (udf_ctx->timer != NULL) {
+		lua_sethook(co, &check_timer, LUA_MASKCOUNT,
+				(int)as_timer_timeslice(udf_ctx->timer));
+	}
+
+	mod_lua_invocation_begin(l);
+
+	rc = mod_lua_resume(job);
+
+	if (rc == MOD_LUA_IN_PROGRESS) {
+		*job_r = job;
+	}
+
+	return rc;
+}
+
+int
+mod_lua_resume(mod_lua_job* job)
+{
+	lua_State* co = job->co;
+	int nres = 0;
+
+	// Each slice may run on a different thread, so is given the job's timer.
+	set_timer(job->citem.state, job->timer);
+
+	int rc = lua_resume(co, job->citem.state, job->nargs, &nres);
+
+	job->nargs = 0;
+
+	if (rc == LUA_YIELD) {
+		lua_pop(co, nres);
+		return MOD_LUA_IN_PROGRESS;
+	}
+
+	// A coroutine has no message handler, so log as handle_error() would.
+	if (rc != LUA_OK) {
+		const char* msg = lua_tostring(co, -1);
+
+		as_log_error("lua runtime error: %s", msg != NULL ? msg : "(null)");
+
+		if (job->res != NULL) {
+			as_result_setfailure(job->res, mod_lua_retval(co));
+		}
+	}
+
+	mod_lua_job_destroy(job);
+
+	return rc;
+}
+
+void
+mod_lua_job_destroy(mod_lua_job* job)
+{
+	lua_State* l = job->citem.state;
+
+	// Close the coroutine's pending to-be-closed variables and let go of its
+	// stack, so a job given up on leaves nothing behind in the state. Not in
+	// a slice, it mustn't yield or time out while doing so.
+	lua_sethook(job->co, NULL, 0, 0);
+
+#if LUA_VERSION_RELEASE_NUM >= 50406
+	lua_closethread(job->co, l);
+#else
+	lua_resetthread(job->co);
+#endif
+
+	// The coroutine is left for the state's collector.
+	luaL_unref(l, LUA_REGISTRYINDEX, job->ref);
+	set_timer(l, NULL);
+	release_state(job->filename, &job->citem);
+	cf_free(job);
+}
+
 char*
 as_module_err_string(int err_no)
 {
@@ -322,6 +657,11 @@ update(as_module* m, as_module_event* e)
 		g_lua_cfg.server_mode = config->server_mode;
 		g_lua_cfg.cache_enabled = config->cache_enabled;
 
+		// Without a node id, partials on different nodes are still told
+		// apart, though not the same way from one run to the next.
+		g_partial_salt = mix64(config->node_id != 0 ? config->node_id :
+				cf_getns() ^ (uint64_t)(uintptr_t)&g_partial_salt);
+
 		if (g_lua_hash == NULL && g_lua_cfg.cache_enabled) {
 			g_lua_hash = lua_hash_create(64);
 		}
@@ -424,6 +764,14 @@ validate(as_module* m, as_aerospike* as, const char* filename,
 	mod_lua_map_register(l);
 	mod_lua_bytes_register(l);
 	mod_lua_geojson_register(l);
+	mod_lua_hash_register(l);
+	mod_lua_vector_register(l);
+	mod_lua_set_register(l);
+	mod_lua_sketch_register(l);
+	mod_lua_topk_register(l);
+	mod_lua_predicate_register(l);
+	mod_lua_projection_register(l);
+	mod_lua_spill_register(l);
 
 	if (! load_buffer_validate(l, filename, as_lua_as, as_lua_as_size, "as.lua",
 			err)) {
@@ -535,6 +883,18 @@ apply_stream(as_module* m, as_udf_context* udf_ctx, const char* filename,
 {
 	(void)m;
 
+	return apply_stream_scope(udf_ctx, filename, function, istream, args,
+			ostream, res, g_lua_cfg.server_mode ?
+					STREAM_SCOPE_SERVER : STREAM_SCOPE_CLIENT, 0);
+}
+
+// Apply the ops of a stream UDF which run in scope, on the given partial of
+// a parallel apply, or 0.
+static int
+apply_stream_scope(as_udf_context* udf_ctx, const char* filename,
+		const char* function, as_stream* istream, as_list* args,
+		as_stream* ostream, as_result* res, int scope, uint32_t partial)
+{
 	cache_item citem = { 0 };
 
 	// Get a state.
@@ -561,8 +921,9 @@ apply_stream(as_module* m, as_udf_context* udf_ctx, const char* filename,
 	// Push function onto the stack.
 	lua_getglobal(l, function);
 
-	// Push the scope onto the stack.
-	lua_pushinteger(l, g_lua_cfg.server_mode ? 1 : 2);
+	// Push the scope and partial onto the stack.
+	lua_pushinteger(l, scope);
+	lua_pushinteger(l, stream_partial(partial));
 
 	// Push the istream onto the stack.
 	mod_lua_pushstream(l, istream);
@@ -582,7 +943,7 @@ apply_stream(as_module* m, as_udf_context* udf_ctx, const char* filename,
 		as_log_error("large number of lua function arguments (%d)", argc);
 	}
 
-	argc = 4 + argc; // function + scope + istream + ostream + arglist
+	argc = 5 + argc; // function + scope + partial + istream + ostream + arglist
 
 	// Call apply_stream(f, s, ...).
 	rc = apply(l, udf_ctx, err, argc, res, true);
@@ -1015,15 +1376,15 @@ apply(lua_State* l, as_udf_context* udf_ctx, int err, int argc, as_result* res,
 		bool is_stream)
 {
 	if (udf_ctx->timer != NULL) {
-		// Lazily set timer hooks (which never change) on first ever UDF call.
-		if (g_timer.hooks == NULL) {
-			g_timer.hooks = udf_ctx->timer->hooks;
-		}
+		// The hook may run on any thread, so is given the caller's timer.
+		set_timer(l, udf_ctx->timer);
 
 		lua_sethook(l, &check_timer, LUA_MASKCOUNT,
 				(int)as_timer_timeslice(udf_ctx->timer));
 	}
 
+	mod_lua_invocation_begin(l);
+
 	// Call the lua function.
 	int rc = lua_pcall(l, argc, 1, err);
 
@@ -1057,6 +1418,7 @@ apply(lua_State* l, as_udf_context* udf_ctx, int err, int argc, as_result* res,
 	// Disable the hook.
 	if (udf_ctx->timer != NULL) {
 		lua_sethook(l, &check_timer, 0, 0);
+		set_timer(l, NULL);
 	}
 
 	// Pop the return value off the stack.
@@ -1068,6 +1430,8 @@ apply(lua_State* l, as_udf_context* udf_ctx, int err, int argc, as_result* res,
 static void
 release_state(const char* filename, cache_item* citem)
 {
+	mod_lua_invocation_end(citem->state);
+
 	pthread_rwlock_rdlock(&g_lock);
 
 	if (g_lua_cfg.cache_enabled) {
@@ -1131,6 +1495,14 @@ create_state(const char* user_path, const char* filename)
 	mod_lua_map_register(l);
 	mod_lua_bytes_register(l);
 	mod_lua_geojson_register(l);
+	mod_lua_hash_register(l);
+	mod_lua_vector_register(l);
+	mod_lua_set_register(l);
+	mod_lua_sketch_register(l);
+	mod_lua_topk_register(l);
+	mod_lua_predicate_register(l);
+	mod_lua_projection_register(l);
+	mod_lua_spill_register(l);
 
 	if (! load_buffer(l, as_lua_as, as_lua_as_size, "as.lua")) {
 		return NULL;
@@ -1190,6 +1562,96 @@ is_native_module(const char* user_path, const char* filename)
 }
 
 
+//==========================================================
+// Local helpers - parallel stream apply.
+//
+
+static as_val*
+stream_buffer_read(const as_stream* s)
+{
+	stream_buffer* b = (stream_buffer*)as_stream_source(s);
+
+	if (b->pos >= b->values.size) {
+		return NULL;
+	}
+
+	as_val* v = b->values.elements[b->pos];
+
+#ifdef AS_MOD_LUA_CLIENT
+	// The reader destroys what it reads - see mod_lua_stream_read().
+	b->values.elements[b->pos] = NULL;
+#endif
+
+	b->pos++;
+
+	return v;
+}
+
+static as_stream_status
+stream_buffer_write(const as_stream* s, as_val* v)
+{
+	stream_buffer* b = (stream_buffer*)as_stream_source(s);
+
+	// NULL ends the stream.
+	if (v != NULL) {
+		as_arraylist_append(&b->values, v);
+	}
+
+	return AS_STREAM_OK;
+}
+
+static int
+stream_buffer_release(as_stream* s)
+{
+	stream_buffer_destroy((stream_buffer*)as_stream_source(s));
+	return 0;
+}
+
+static const as_stream_hooks stream_buffer_hooks = {
+		.destroy = stream_buffer_release,
+		.read = stream_buffer_read,
+		.write = stream_buffer_write
+};
+
+static void
+stream_buffer_init(stream_buffer* b, as_stream* s)
+{
+	as_arraylist_init(&b->values, 64, 64);
+	b->pos = 0;
+
+	if (s != NULL) {
+		as_stream_init(s, b, &stream_buffer_hooks);
+	}
+}
+
+static void
+stream_buffer_destroy(stream_buffer* b)
+{
+	as_arraylist_destroy(&b->values);
+}
+
+// Runs the ops of the job's scope on inputs until none are left.
+static void*
+parallel_worker(void* udata)
+{
+	parallel_apply* job = (parallel_apply*)udata;
+	uint32_t i;
+
+	while ((i = as_aaf_uint32(&job->next, 1) - 1) < job->n_istreams) {
+		as_stream partial;
+
+		stream_buffer_init(&job->partials[i], &partial);
+		job->results[i] = as_success_new(NULL);
+
+		job->rcs[i] = apply_stream_scope(job->udf_ctx, job->filename,
+				job->function, job->istreams[i], job->args, &partial,
+				job->results[i], job->scope, i);
+	}
+
+	return NULL;
+}
+
+
 //==========================================================
 // Local helpers - miscellaneous.
 //
@@ -1204,17 +1666,54 @@ handle_error(lua_State* l)
 	return 1;
 }
 
+static void
+set_timer(lua_State* l, as_timer* timer)
+{
+	if (timer != NULL) {
+		lua_pushlightuserdata(l, timer);
+	}
+	else {
+		lua_pushnil(l);
+	}
+
+	lua_rawsetp(l, LUA_REGISTRYINDEX, &g_timer_key);
+}
+
 // Lua debug hook to check for a timeout.
 static void
 check_timer(lua_State* l, lua_Debug* ar)
 {
 	if (ar->event == LUA_HOOKCOUNT) {
-		if (as_timer_timedout(&g_timer)) {
+		lua_rawgetp(l, LUA_REGISTRYINDEX, &g_timer_key);
+
+		as_timer* timer = (as_timer*)lua_touserdata(l, -1);
+
+		lua_pop(l, 1);
+
+		if (timer != NULL && as_timer_timedout(timer)) {
 			luaL_error(l, "UDF Execution Timeout");
 		}
 	}
 }
 
+// Lua debug hook to yield a job at the end of its instruction budget. Within
+// a C call, e.g. a sort's comparison, it can't, so goes on to the next hook.
+static void
+end_slice(lua_State* l, lua_Debug* ar)
+{
+	if (ar->event == LUA_HOOKCOUNT && lua_isyieldable(l)) {
+		lua_yield(l, 0);
+	}
+}
+
+// As end_slice(), for a job which also has a timer.
+static void
+end_slice_timed(lua_State* l, lua_Debug* ar)
+{
+	check_timer(l, ar);
+	end_slice(l, ar);
+}
+
 
 //==========================================================
 // Simple hashmap for lua configuration.
@@ -32,6 +32,11 @@
 
 #define OBJECT_NAME "bytes"
 #define CLASS_NAME  "Bytes"
+#define BUILDER_CLASS_NAME "BytesBuilder"
+#define SLICE_CLASS_NAME "BytesSlice"
+
+// Smallest capacity a bytes grows to when it has to grow.
+#define BYTES_MIN_CAPACITY 16
 
 /*******************************************************************************
  * BOX FUNCTIONS
@@ -57,19 +62,118 @@ static int mod_lua_bytes_gc(lua_State * l) {
 	return 0;
 }
 
+/**
+ *	Make room for n bytes at pos. Capacity grows geometrically, so a run of
+ *	small appends or sets doesn't reallocate and copy the buffer each time.
+ */
+static bool mod_lua_bytes_grow(as_bytes * b, uint32_t pos, uint32_t n)
+{
+	uint64_t need = (uint64_t) pos + n;
+
+	if ( need <= b->capacity ) {
+		return true;
+	}
+
+	if ( need > UINT32_MAX ) {
+		return false;
+	}
+
+	uint64_t capacity = b->capacity < BYTES_MIN_CAPACITY ?
+			BYTES_MIN_CAPACITY : b->capacity;
+
+	while ( capacity < need ) {
+		capacity *= 2;
+	}
+
+	if ( capacity > UINT32_MAX ) {
+		capacity = UINT32_MAX;
+	}
+
+	return as_bytes_ensure(b, (uint32_t) capacity, true);
+}
+
+/**
+ *	A read-only view of a range of another bytes, which it holds a reference
+ *	to. Reads see later writes to the parent, and a range the parent has been
+ *	truncated below reads as shorter.
+ */
+typedef struct {
+	// Value is NULL; mod_lua_toval() copies the range instead, as the view
+	// can't outlive this userdata.
+	mod_lua_box	box;
+	as_bytes *	parent;
+	uint32_t	offset;
+	uint32_t	size;
+	as_bytes	view;
+} mod_lua_slice;
+
+/**
+ *	Point the slice's view at its range of the parent. The parent's buffer may
+ *	have moved or shrunk since the last time.
+ */
+static as_bytes * mod_lua_slice_view(mod_lua_slice * s)
+{
+	uint32_t avail = s->parent->size > s->offset ? s->parent->size - s->offset : 0;
+	uint32_t n = s->size < avail ? s->size : avail;
+
+	as_bytes_init_wrap(&s->view, n ? s->parent->value + s->offset : s->parent->value, n, false);
+	s->view.type = s->parent->type;
+	return &s->view;
+}
+
+/**
+ *	A bytes or slice to read from.
+ */
+static as_bytes * mod_lua_checkview(lua_State * l, int index)
+{
+	mod_lua_slice * s = (mod_lua_slice *) luaL_testudata(l, index, SLICE_CLASS_NAME);
+	return s ? mod_lua_slice_view(s) : mod_lua_checkbytes(l, index);
+}
+
+as_bytes * mod_lua_toview(lua_State * l, int index)
+{
+	mod_lua_slice * s = (mod_lua_slice *) luaL_testudata(l, index, SLICE_CLASS_NAME);
+
+	if ( s ) {
+		return mod_lua_slice_view(s);
+	}
+
+	mod_lua_box * box = (mod_lua_box *) luaL_testudata(l, index, CLASS_NAME);
+	return (as_bytes *) mod_lua_box_value(box);
+}
+
+as_bytes * mod_lua_slice_tobytes(lua_State * l, int index)
+{
+	mod_lua_slice * s = (mod_lua_slice *) luaL_testudata(l, index, SLICE_CLASS_NAME);
+
+	if ( !s ) {
+		return NULL;
+	}
+
+	as_bytes * v = mod_lua_slice_view(s);
+	as_bytes * b = as_bytes_new(v->size);
+
+	if ( b ) {
+		memcpy(b->value, v->value, v->size);
+		b->size = v->size;
+		b->type = v->type;
+	}
+	return b;
+}
+
 /*******************************************************************************
  * FUNCTIONS
  ******************************************************************************/
 
 static int mod_lua_bytes_size(lua_State * l)
 {
-	// we expect 1 arg
-	if ( lua_gettop(l) != 1 ) {
+	// we expect 1 arg (2 when called for the # operator)
+	if ( lua_gettop(l) < 1 ) {
 		lua_pushinteger(l, 0);
 		return 1;
 	}
 
-	as_bytes * b = mod_lua_checkbytes(l, 1);
+	as_bytes * b = mod_lua_checkview(l, 1);
 	
 	// check preconditions:
 	//	- b != NULL
@@ -225,7 +329,7 @@ static int mod_lua_bytes_get_type(lua_State * l)
 		return 0;
 	}
 
-	as_bytes * b = mod_lua_checkbytes(l, 1);
+	as_bytes * b = mod_lua_checkview(l, 1);
 
 	// check preconditions:
 	//	- b != NULL
@@ -309,7 +413,7 @@ static int mod_lua_bytes_append_byte(lua_State * l)
 	uint32_t 	size = 1;
 
 	// ensure we have capacity, if not, then resize
-	if ( as_bytes_ensure(b, pos + size, true) == true ) {
+	if ( mod_lua_bytes_grow(b, pos, size) == true ) {
 		// write the bytes
 		res	= as_bytes_append_byte(b, (uint8_t)v);
 	}
@@ -355,7 +459,7 @@ static int mod_lua_bytes_append_int16_be(lua_State * l)
 	uint32_t 	size = 2;
 
 	// ensure we have capacity, if not, then resize
-	if ( as_bytes_ensure(b, pos + size, true) == true ) {
+	if ( mod_lua_bytes_grow(b, pos, size) == true ) {
 		// write the bytes
 		int16_t	val	= cf_swap_to_be16((int16_t) v);
 		res	= as_bytes_append_int16(b, val);
@@ -402,7 +506,7 @@ static int mod_lua_bytes_append_int16_le(lua_State * l)
 	uint32_t 	size = 2;
 	
 	// ensure we have capacity, if not, then resize
-	if ( as_bytes_ensure(b, pos + size, true) == true ) {
+	if ( mod_lua_bytes_grow(b, pos, size) == true ) {
 		// write the bytes
 		int16_t	val	= cf_swap_to_le16((int16_t) v);
 		res	= as_bytes_append_int16(b, val);
@@ -449,7 +553,7 @@ static int mod_lua_bytes_append_int32_be(lua_State * l)
 	uint32_t 	size = 4;
 
 	// ensure we have capacity, if not, then resize
-	if ( as_bytes_ensure(b, pos + size, true) == true ) {
+	if ( mod_lua_bytes_grow(b, pos, size) == true ) {
 		// write the bytes
 		int32_t	val	= cf_swap_to_be32((int32_t) v);
 		res	= as_bytes_append_int32(b, val);
@@ -496,7 +600,7 @@ static int mod_lua_bytes_append_int32_le(lua_State * l)
 	uint32_t 	size = 4;
 	
 	// ensure we have capacity, if not, then resize
-	if ( as_bytes_ensure(b, pos + size, true) == true ) {
+	if ( mod_lua_bytes_grow(b, pos, size) == true ) {
 		// write the bytes
 		int32_t	val	= cf_swap_to_le32((int32_t) v);
 		res	= as_bytes_append_int32(b, val);
@@ -541,7 +645,7 @@ static int mod_lua_bytes_append_int64_be(lua_State * l)
 	uint32_t 	size = 8;
 
 	// ensure we have capacity, if not, then resize
-	if ( as_bytes_ensure(b, pos + size, true) == true ) {
+	if ( mod_lua_bytes_grow(b, pos, size) == true ) {
 		// write the bytes
 		int64_t	val	= cf_swap_to_be64((int64_t) v);
 		res = as_bytes_append_int64(b, val);
@@ -586,7 +690,7 @@ static int mod_lua_bytes_append_int64_le(lua_State * l)
 	uint32_t 	size = 8;
 	
 	// ensure we have capacity, if not, then resize
-	if ( as_bytes_ensure(b, pos + size, true) == true ) {
+	if ( mod_lua_bytes_grow(b, pos, size) == true ) {
 		// write the bytes
 		int64_t	val	= cf_swap_to_le64((int64_t) v);
 		res = as_bytes_append_int64(b, val);
@@ -633,7 +737,7 @@ static int mod_lua_bytes_append_var_int(lua_State * l)
 	uint32_t pos = b->size;
 	
 	// ensure we have capacity, if not, then resize
-	if ( as_bytes_ensure(b, pos + 5, true) == true ) {
+	if ( mod_lua_bytes_grow(b, pos, 5) == true ) {
 		size = as_bytes_set_var_int(b, pos, (uint32_t)v);
 	}
 	
@@ -679,7 +783,7 @@ static int mod_lua_bytes_append_string(lua_State * l)
 	uint32_t 	size = (uint32_t)n;
 
 	// ensure we have capacity, if not, then resize
-	if ( as_bytes_ensure(b, pos + size, true) == true ) {
+	if ( mod_lua_bytes_grow(b, pos, size) == true ) {
 		// write the bytes
 		res = as_bytes_append(b, (uint8_t *) v, size);
 	}
@@ -710,7 +814,7 @@ static int mod_lua_bytes_append_bytes(lua_State * l)
 	}
 
 	as_bytes * 	b = mod_lua_checkbytes(l, 1);
-	as_bytes * 	v = mod_lua_checkbytes(l, 2);
+	as_bytes * 	v = mod_lua_checkview(l, 2);
 	lua_Integer	n = luaL_optinteger(l, 3, 0); 
 
 	// check preconditions:
@@ -729,7 +833,9 @@ static int mod_lua_bytes_append_bytes(lua_State * l)
 	uint32_t 	size = n > v->size ? v->size : (uint32_t)n;
 
 	// ensure we have capacity, if not, then resize
-	if ( as_bytes_ensure(b, pos + size, true) == true ) {
+	if ( mod_lua_bytes_grow(b, pos, size) == true ) {
+		// a slice of b moves with it
+		v = mod_lua_checkview(l, 2);
 		// write the bytes
 		res = as_bytes_append(b, (uint8_t *) v->value, size);
 	}
@@ -783,7 +889,7 @@ static int mod_lua_bytes_set_byte(lua_State * l)
 	uint32_t	size = 1;
 
 	// ensure we have capacity, if not, then resize
-	if ( as_bytes_ensure(b, pos + size, true) == true ) {
+	if ( mod_lua_bytes_grow(b, pos, size) == true ) {
 		// write the bytes
 		res	= as_bytes_set_byte(b, pos, (uint8_t)v);
 	}
@@ -833,7 +939,7 @@ static int mod_lua_bytes_set_int16_be(lua_State * l)
 	uint32_t	size = 2;
 
 	// ensure we have capacity, if not, then resize
-	if ( as_bytes_ensure(b, pos + size, true) == true ) {
+	if ( mod_lua_bytes_grow(b, pos, size) == true ) {
 		// write the bytes
 		int16_t	val	= cf_swap_to_be16((int16_t) v);
 		res	= as_bytes_set_int16(b, pos, val);
@@ -884,7 +990,7 @@ static int mod_lua_bytes_set_int16_le(lua_State * l)
 	uint32_t	size = 2;
 	
 	// ensure we have capacity, if not, then resize
-	if ( as_bytes_ensure(b, pos + size, true) == true ) {
+	if ( mod_lua_bytes_grow(b, pos, size) == true ) {
 		// write the bytes
 		int16_t	val	= cf_swap_to_le16((int16_t) v);
 		res	= as_bytes_set_int16(b, pos, val);
@@ -935,7 +1041,7 @@ static int mod_lua_bytes_set_int32_be(lua_State * l)
 	uint32_t	size = 4;
 
 	// ensure we have capacity, if not, then resize
-	if ( as_bytes_ensure(b, pos + size, true) == true ) {
+	if ( mod_lua_bytes_grow(b, pos, size) == true ) {
 		// write the bytes
 		int32_t	val	= cf_swap_to_be32((int32_t) v);
 		res	= as_bytes_set_int32(b, pos, val);
@@ -986,7 +1092,7 @@ static int mod_lua_bytes_set_int32_le(lua_State * l)
 	uint32_t	size = 4;
 	
 	// ensure we have capacity, if not, then resize
-	if ( as_bytes_ensure(b, pos + size, true) == true ) {
+	if ( mod_lua_bytes_grow(b, pos, size) == true ) {
 		// write the bytes
 		int32_t	val	= cf_swap_to_le32((int32_t) v);
 		res	= as_bytes_set_int32(b, pos, val);
@@ -1035,7 +1141,7 @@ static int mod_lua_bytes_set_int64_be(lua_State * l)
 	uint32_t	size = 8;
 
 	// ensure we have capacity, if not, then resize
-	if ( as_bytes_ensure(b, pos + size, true) == true ) {
+	if ( mod_lua_bytes_grow(b, pos, size) == true ) {
 		// write the bytes
 		int64_t	val	= cf_swap_to_be64((int64_t) v);
 		res = as_bytes_set_int64(b, pos, val);
@@ -1084,7 +1190,7 @@ static int mod_lua_bytes_set_int64_le(lua_State * l)
 	uint32_t	size = 8;
 	
 	// ensure we have capacity, if not, then resize
-	if ( as_bytes_ensure(b, pos + size, true) == true ) {
+	if ( mod_lua_bytes_grow(b, pos, size) == true ) {
 		// write the bytes
 		int64_t	val	= cf_swap_to_le64((int64_t) v);
 		res = as_bytes_set_int64(b, pos, val);
@@ -1135,7 +1241,7 @@ static int mod_lua_bytes_set_var_int(lua_State * l)
 	uint32_t pos = (uint32_t)(i - 1);
 	
 	// ensure we have capacity, if not, then resize
-	if ( as_bytes_ensure(b, pos + 5, true) == true ) {
+	if ( mod_lua_bytes_grow(b, pos, 5) == true ) {
 		size = as_bytes_set_var_int(b, pos, (uint32_t)v);
 	}
 	
@@ -1185,7 +1291,7 @@ static int mod_lua_bytes_set_string(lua_State * l)
 	uint32_t	size = (uint32_t)n;
 
 	// ensure we have capacity, if not, then resize
-	if ( as_bytes_ensure(b, pos + size, true) == true ) {
+	if ( mod_lua_bytes_grow(b, pos, size) == true ) {
 		// write the bytes
 		res = as_bytes_set(b, pos, (uint8_t *) v, size);
 	}
@@ -1218,7 +1324,7 @@ static int mod_lua_bytes_set_bytes(lua_State * l)
 
 	as_bytes * 	b = mod_lua_checkbytes(l, 1);
 	lua_Integer	i = luaL_optinteger(l, 2, 0); 
-	as_bytes * 	v = mod_lua_checkbytes(l, 3);
+	as_bytes * 	v = mod_lua_checkview(l, 3);
 	lua_Integer	n = luaL_optinteger(l, 4, 0); 
 
 	// check preconditions:
@@ -1239,9 +1345,14 @@ static int mod_lua_bytes_set_bytes(lua_State * l)
 	uint32_t 	size = n > v->size ? v->size : (uint32_t)n;
 
 	// ensure we have capacity, if not, then resize
-	if ( as_bytes_ensure(b, pos + size, true) == true ) {
-		// write the bytes
-		res = as_bytes_set(b, pos, (uint8_t *) v->value, (uint32_t) n);
+	if ( mod_lua_bytes_grow(b, pos, size) == true ) {
+		// a slice of b moves with it, and may overlap the target
+		v = mod_lua_checkview(l, 3);
+		memmove(b->value + pos, v->value, size);
+		if ( pos + size > b->size ) {
+			b->size = pos + size;
+		}
+		res = true;
 	}
 
 	lua_pushboolean(l, res);
@@ -1271,7 +1382,7 @@ static int mod_lua_bytes_get_byte(lua_State * l)
 		return 0;
 	}
 
-	as_bytes *	b = mod_lua_checkbytes(l, 1);
+	as_bytes *	b = mod_lua_checkview(l, 1);
 	lua_Integer	i = luaL_optinteger(l, 2, 0);
 
 	// check preconditions:
@@ -1313,7 +1424,7 @@ static int mod_lua_bytes_get_int16_be(lua_State * l)
 		return 0;
 	}
 
-	as_bytes *	b = mod_lua_checkbytes(l, 1);
+	as_bytes *	b = mod_lua_checkview(l, 1);
 	lua_Integer	i = luaL_optinteger(l, 2, 0); 
 
 	// check preconditions:
@@ -1356,7 +1467,7 @@ static int mod_lua_bytes_get_int16_le(lua_State * l)
 		return 0;
 	}
 	
-	as_bytes *	b = mod_lua_checkbytes(l, 1);
+	as_bytes *	b = mod_lua_checkview(l, 1);
 	lua_Integer	i = luaL_optinteger(l, 2, 0);
 	
 	// check preconditions:
@@ -1399,7 +1510,7 @@ static int mod_lua_bytes_get_int32_be(lua_State * l)
 		return 0;
 	}
 
-	as_bytes *	b = mod_lua_checkbytes(l, 1);
+	as_bytes *	b = mod_lua_checkview(l, 1);
 	lua_Integer	i = luaL_optinteger(l, 2, 0);
 
 	// check preconditions:
@@ -1442,7 +1553,7 @@ static int mod_lua_bytes_get_int32_le(lua_State * l)
 		return 0;
 	}
 	
-	as_bytes *	b = mod_lua_checkbytes(l, 1);
+	as_bytes *	b = mod_lua_checkview(l, 1);
 	lua_Integer	i = luaL_optinteger(l, 2, 0);
 	
 	// check preconditions:
@@ -1485,7 +1596,7 @@ static int mod_lua_bytes_get_int64_be(lua_State * l)
 		return 0;
 	}
 
-	as_bytes *	b = mod_lua_checkbytes(l, 1);
+	as_bytes *	b = mod_lua_checkview(l, 1);
 	lua_Integer	i = luaL_optinteger(l, 2, 0);
 
 	// check preconditions:
@@ -1528,7 +1639,7 @@ static int mod_lua_bytes_get_int64_le(lua_State * l)
 		return 0;
 	}
 	
-	as_bytes *	b = mod_lua_checkbytes(l, 1);
+	as_bytes *	b = mod_lua_checkview(l, 1);
 	lua_Integer	i = luaL_optinteger(l, 2, 0);
 	
 	// check preconditions:
@@ -1552,6 +1663,27 @@ static int mod_lua_bytes_get_int64_le(lua_State * l)
 	return 1;
 }
 
+/**
+ *	Decode an integer in variable 7-bit format from the n bytes at src, as
+ *	as_bytes_get_var_int() does, without reading past them.
+ *
+ *	@return The number of bytes read, or 0 if the value is truncated or
+ *	longer than the 5 bytes a uint32_t takes.
+ */
+static uint32_t bytes_get_var_int(const uint8_t * src, uint32_t n, uint32_t * value)
+{
+	uint32_t v = 0;
+
+	for ( uint32_t i = 0; i < n && i < 5; i++ ) {
+		v |= (uint32_t) (src[i] & 0x7F) << (7 * i);
+		if ( (src[i] & 0x80) == 0 ) {
+			*value = v;
+			return i + 1;
+		}
+	}
+	return 0;
+}
+
 /**
  *	Decode an integer in variable 7-bit format.
  *	The high bit indicates if more bytes are used.
@@ -1572,7 +1704,7 @@ static int mod_lua_bytes_get_var_int(lua_State * l)
 		return 0;
 	}
 	
-	as_bytes *	b = mod_lua_checkbytes(l, 1);
+	as_bytes *	b = mod_lua_checkview(l, 1);
 	lua_Integer	i = luaL_optinteger(l, 2, 0);
 	
 	// check preconditions:
@@ -1585,8 +1717,13 @@ static int mod_lua_bytes_get_var_int(lua_State * l)
 	
 	uint32_t pos = (uint32_t)(i - 1);
 	uint32_t val = 0;
-	uint32_t size = as_bytes_get_var_int(b, pos, &val);
-		
+	uint32_t size = pos < b->size ?
+			bytes_get_var_int(b->value + pos, b->size - pos, &val) : 0;
+
+	if ( size == 0 ) {
+		return 0;
+	}
+
 	lua_pushinteger(l, val);
 	lua_pushinteger(l, size);
 	return 2;
@@ -1613,7 +1750,7 @@ static int mod_lua_bytes_get_string(lua_State * l)
 		return 0;
 	}
 
-	as_bytes *	b = mod_lua_checkbytes(l, 1);
+	as_bytes *	b = mod_lua_checkview(l, 1);
 	lua_Integer	i = luaL_optinteger(l, 2, 0);
 	lua_Integer	n = luaL_optinteger(l, 3, 0);
 
@@ -1629,18 +1766,13 @@ static int mod_lua_bytes_get_string(lua_State * l)
 
 	uint32_t pos = (uint32_t)(i - 1);
 	uint32_t len = (uint32_t) n;
-	char *   val = (char *) cf_calloc(len + 1, sizeof(char));
 
-	if ( !val ) {
+	if ( (uint64_t) pos + len > b->size ) {
 		return 0;
 	}
 
-	// copy into the the string
-	memcpy(val, b->value + pos, len);
-	val[len] = '\0';
-	
-	lua_pushlstring(l, val, len);
-	cf_free(val);
+	// Lua copies the string straight out of the buffer.
+	lua_pushlstring(l, (const char *) b->value + pos, len);
 	return 1;
 }
 
@@ -1665,7 +1797,7 @@ static int mod_lua_bytes_get_bytes(lua_State * l)
 		return 0;
 	}
 
-	as_bytes *	b = mod_lua_checkbytes(l, 1);
+	as_bytes *	b = mod_lua_checkview(l, 1);
 	lua_Integer	i = luaL_optinteger(l, 2, 0);
 	lua_Integer	n = luaL_optinteger(l, 3, 0);
 
@@ -1681,6 +1813,11 @@ static int mod_lua_bytes_get_bytes(lua_State * l)
 
 	uint32_t pos = (uint32_t)(i - 1);
 	uint32_t len = (uint32_t) n;
+
+	if ( (uint64_t) pos + len > b->size ) {
+		return 0;
+	}
+
 	uint8_t * raw = (uint8_t *) cf_calloc(len, sizeof(uint8_t));
 
 	if ( !raw ) {
@@ -1702,84 +1839,1960 @@ static int mod_lua_bytes_get_bytes(lua_State * l)
 }
 
 /******************************************************************************
- * OBJECT TABLE
+ *	BIT FUNCTIONS
  *****************************************************************************/
 
-static const luaL_Reg bytes_object_table[] = {
+/**
+ *	These treat bytes as bitmaps. Bits are numbered from 1, starting at the
+ *	most significant bit of the first byte, as in the server's bit operations.
+ *
+ *	The kernels are plain loops left for the compiler to vectorize, which
+ *	gives SSE2 on x86_64 and NEON on aarch64, both baseline there. On x86_64
+ *	an AVX2 build of the same loops is chosen at runtime when the CPU has it.
+ */
 
-	{"size",			mod_lua_bytes_size},
-	{"set_size",		mod_lua_bytes_ensure},
+#if defined(__x86_64__) && defined(__GNUC__)
+#define BYTES_BIT_AVX2 1
+#endif
 
-	{"get_type",		mod_lua_bytes_get_type},
-	{"set_type",		mod_lua_bytes_set_type},
-	
-	{"get_string",		mod_lua_bytes_get_string},
-	{"get_bytes",		mod_lua_bytes_get_bytes},
-	{"get_byte",		mod_lua_bytes_get_byte},
-	{"get_int16",		mod_lua_bytes_get_int16_be},
-	{"get_int16_be",	mod_lua_bytes_get_int16_be},
-	{"get_int16_le",	mod_lua_bytes_get_int16_le},
-	{"get_int32",		mod_lua_bytes_get_int32_be},
-	{"get_int32_be",	mod_lua_bytes_get_int32_be},
-	{"get_int32_le",	mod_lua_bytes_get_int32_le},
-	{"get_int64",		mod_lua_bytes_get_int64_be},
-	{"get_int64_be",	mod_lua_bytes_get_int64_be},
-	{"get_int64_le",	mod_lua_bytes_get_int64_le},
-	{"get_var_int",		mod_lua_bytes_get_var_int},
+typedef enum {
+	BYTES_BIT_AND,
+	BYTES_BIT_OR,
+	BYTES_BIT_XOR,
+	BYTES_BIT_ANDNOT
+} bytes_bit_op;
 
-	{"set_string",		mod_lua_bytes_set_string},
-	{"set_bytes",		mod_lua_bytes_set_bytes},
-	{"set_byte",		mod_lua_bytes_set_byte},
-	{"set_int16",		mod_lua_bytes_set_int16_be},
-	{"set_int16_be",	mod_lua_bytes_set_int16_be},
-	{"set_int16_le",	mod_lua_bytes_set_int16_le},
-	{"set_int32",		mod_lua_bytes_set_int32_be},
-	{"set_int32_be",	mod_lua_bytes_set_int32_be},
-	{"set_int32_le",	mod_lua_bytes_set_int32_le},
-	{"set_int64",		mod_lua_bytes_set_int64_be},
-	{"set_int64_be",	mod_lua_bytes_set_int64_be},
-	{"set_int64_le",	mod_lua_bytes_set_int64_le},
-	{"set_var_int",		mod_lua_bytes_set_var_int},
-	
-	{"append_string",	mod_lua_bytes_append_string},
-	{"append_bytes",	mod_lua_bytes_append_bytes},
-	{"append_byte",		mod_lua_bytes_append_byte},
-	{"append_int16",	mod_lua_bytes_append_int16_be},
-	{"append_int16_be",	mod_lua_bytes_append_int16_be},
-	{"append_int16_le",	mod_lua_bytes_append_int16_le},
-	{"append_int32",	mod_lua_bytes_append_int32_be},
-	{"append_int32_be",	mod_lua_bytes_append_int32_be},
-	{"append_int32_le",	mod_lua_bytes_append_int32_le},
-	{"append_int64",	mod_lua_bytes_append_int64_be},
-	{"append_int64_be",	mod_lua_bytes_append_int64_be},
-	{"append_int64_le",	mod_lua_bytes_append_int64_le},
-	{"append_var_int",	mod_lua_bytes_append_var_int},
-		
-	{0, 0}
-};
+static inline uint32_t bytes_popcount64(uint64_t v)
+{
+#if defined(__GNUC__)
+	return (uint32_t) __builtin_popcountll(v);
+#else
+	v = v - ((v >> 1) & 0x5555555555555555ULL);
+	v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+	v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+	return (uint32_t) ((v * 0x0101010101010101ULL) >> 56);
+#endif
+}
 
-static const luaL_Reg bytes_object_metatable[] = {
-	{"__call",          mod_lua_bytes_new},
-	{0, 0}
-};
+/**
+ *	dst = dst <op> src, over n bytes. src may overlap dst.
+ */
+static inline void bytes_bitop_loop(bytes_bit_op op, uint8_t * dst,
+		const uint8_t * src, uint32_t n)
+{
+	switch ( op ) {
+		case BYTES_BIT_AND:
+			for ( uint32_t i = 0; i < n; i++ ) {
+				dst[i] &= src[i];
+			}
+			break;
+		case BYTES_BIT_OR:
+			for ( uint32_t i = 0; i < n; i++ ) {
+				dst[i] |= src[i];
+			}
+			break;
+		case BYTES_BIT_XOR:
+			for ( uint32_t i = 0; i < n; i++ ) {
+				dst[i] ^= src[i];
+			}
+			break;
+		case BYTES_BIT_ANDNOT:
+			for ( uint32_t i = 0; i < n; i++ ) {
+				dst[i] &= ~src[i];
+			}
+			break;
+	}
+}
 
-/******************************************************************************
- * CLASS TABLE
- *****************************************************************************/
+/**
+ *	Number of set bits in n bytes.
+ */
+static inline uint64_t bytes_bitcount_loop(const uint8_t * src, uint32_t n)
+{
+	uint64_t	count = 0;
+	uint32_t	i = 0;
 
-/*
-static const luaL_Reg bytes_class_table[] = {
-	{"putX",            mod_lua_bytes_tostring},
-	{0, 0}
-};
-*/
+	for ( ; i + 8 <= n; i += 8 ) {
+		uint64_t w;
+		memcpy(&w, src + i, sizeof(w));
+		count += bytes_popcount64(w);
+	}
 
-static const luaL_Reg bytes_class_metatable[] = {
-	{"__index",         mod_lua_bytes_get_byte},
-	{"__newindex",      mod_lua_bytes_set_byte},
-	{"__len",           mod_lua_bytes_size},
-	{"__tostring",      mod_lua_bytes_tostring},
-	{"__gc",            mod_lua_bytes_gc},
+	for ( ; i < n; i++ ) {
+		count += bytes_popcount64(src[i]);
+	}
+
+	return count;
+}
+
+#ifdef BYTES_BIT_AVX2
+
+__attribute__((target("avx2")))
+static void bytes_bitop_avx2(bytes_bit_op op, uint8_t * dst,
+		const uint8_t * src, uint32_t n)
+{
+	bytes_bitop_loop(op, dst, src, n);
+}
+
+__attribute__((target("avx2,popcnt")))
+static uint64_t bytes_bitcount_avx2(const uint8_t * src, uint32_t n)
+{
+	return bytes_bitcount_loop(src, n);
+}
+
+#endif
+
+static void bytes_bitop(bytes_bit_op op, uint8_t * dst, const uint8_t * src,
+		uint32_t n)
+{
+#ifdef BYTES_BIT_AVX2
+	if ( __builtin_cpu_supports("avx2") ) {
+		bytes_bitop_avx2(op, dst, src, n);
+		return;
+	}
+#endif
+	bytes_bitop_loop(op, dst, src, n);
+}
+
+static uint64_t bytes_bitcount(const uint8_t * src, uint32_t n)
+{
+#ifdef BYTES_BIT_AVX2
+	if ( __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt") ) {
+		return bytes_bitcount_avx2(src, n);
+	}
+#endif
+	return bytes_bitcount_loop(src, n);
+}
+
+/**
+ *	Index of the first byte at or after from that is not zero, or n if none.
+ */
+static uint32_t bytes_bit_nonzero(const uint8_t * src, uint32_t from, uint32_t n)
+{
+	uint32_t i = from;
+
+	for ( ; i + 8 <= n; i += 8 ) {
+		uint64_t w;
+		memcpy(&w, src + i, sizeof(w));
+		if ( w != 0 ) {
+			break;
+		}
+	}
+
+	while ( i < n && src[i] == 0 ) {
+		i++;
+	}
+
+	return i;
+}
+
+/**
+ *	Apply op to the bitmaps b and v, storing the result in b. Where v is
+ *	shorter, it is treated as padded with zeros. OR and XOR extend b to the
+ *	size of v.
+ */
+static int mod_lua_bytes_bitop(lua_State * l, bytes_bit_op op)
+{
+	as_bytes * 	b = mod_lua_checkbytes(l, 1);
+	as_bytes * 	v = mod_lua_checkview(l, 2);
+
+	if ( !b || !v ) {
+		lua_pushboolean(l, false);
+		return 1;
+	}
+
+	uint32_t size = b->size;
+
+	if ( (op == BYTES_BIT_OR || op == BYTES_BIT_XOR) && v->size > size ) {
+		if ( mod_lua_bytes_grow(b, 0, v->size) == false ) {
+			lua_pushboolean(l, false);
+			return 1;
+		}
+		// a slice of b moves with it
+		v = mod_lua_checkview(l, 2);
+		memset(b->value + size, 0, v->size - size);
+		b->size = v->size;
+	}
+
+	uint32_t n = b->size < v->size ? b->size : v->size;
+
+	bytes_bitop(op, b->value, v->value, n);
+
+	if ( op == BYTES_BIT_AND && b->size > n ) {
+		memset(b->value + n, 0, b->size - n);
+	}
+
+	lua_pushboolean(l, true);
+	return 1;
+}
+
+/**
+ *	Bitwise AND another bitmap into b.
+ *
+ *	----------{.c}
+ *	bool bytes.bit_and(bytes b, bytes v)
+ *	----------
+ *
+ *	@param b 	The bytes to update.
+ *	@param v	The bytes or slice to AND into b. Bits of b past the end of v
+ *				are cleared.
+ *
+ *	@return On success, true. Otherwise, false on error.
+ */
+static int mod_lua_bytes_bit_and(lua_State * l)
+{
+	return mod_lua_bytes_bitop(l, BYTES_BIT_AND);
+}
+
+/**
+ *	Bitwise OR another bitmap into b.
+ *
+ *	----------{.c}
+ *	bool bytes.bit_or(bytes b, bytes v)
+ *	----------
+ *
+ *	@param b 	The bytes to update. It is extended to the size of v.
+ *	@param v	The bytes or slice to OR into b.
+ *
+ *	@return On success, true. Otherwise, false on error.
+ */
+static int mod_lua_bytes_bit_or(lua_State * l)
+{
+	return mod_lua_bytes_bitop(l, BYTES_BIT_OR);
+}
+
+/**
+ *	Bitwise XOR another bitmap into b.
+ *
+ *	----------{.c}
+ *	bool bytes.bit_xor(bytes b, bytes v)
+ *	----------
+ *
+ *	@param b 	The bytes to update. It is extended to the size of v.
+ *	@param v	The bytes or slice to XOR into b.
+ *
+ *	@return On success, true. Otherwise, false on error.
+ */
+static int mod_lua_bytes_bit_xor(lua_State * l)
+{
+	return mod_lua_bytes_bitop(l, BYTES_BIT_XOR);
+}
+
+/**
+ *	Clear the bits of b that are set in another bitmap.
+ *
+ *	----------{.c}
+ *	bool bytes.bit_andnot(bytes b, bytes v)
+ *	----------
+ *
+ *	@param b 	The bytes to update.
+ *	@param v	The bytes or slice of bits to clear.
+ *
+ *	@return On success, true. Otherwise, false on error.
+ */
+static int mod_lua_bytes_bit_andnot(lua_State * l)
+{
+	return mod_lua_bytes_bitop(l, BYTES_BIT_ANDNOT);
+}
+
+/**
+ *	Count the set bits.
+ *
+ *	----------{.c}
+ *	uint64 bytes.bit_count(bytes b)
+ *	----------
+ *
+ *	@param b 	The bytes or slice to count the bits of.
+ *
+ *	@return On success, the number of set bits. Otherwise nil on failure.
+ */
+static int mod_lua_bytes_bit_count(lua_State * l)
+{
+	as_bytes * b = mod_lua_checkview(l, 1);
+
+	if ( !b ) {
+		return 0;
+	}
+
+	lua_pushinteger(l, (lua_Integer) bytes_bitcount(b->value, b->size));
+	return 1;
+}
+
+/**
+ *	Count the set bits up to and including bit i.
+ *
+ *	----------{.c}
+ *	uint64 bytes.bit_rank(bytes b, uint64 i)
+ *	----------
+ *
+ *	@param b 	The bytes or slice to count the bits of.
+ *	@param i	The last bit to count, from 0 to the number of bits in b.
+ *
+ *	@return On success, the number of set bits. Otherwise nil on failure.
+ */
+static int mod_lua_bytes_bit_rank(lua_State * l)
+{
+	as_bytes *	b = mod_lua_checkview(l, 1);
+	lua_Integer	i = luaL_optinteger(l, 2, 0);
+
+	// check preconditions:
+	//	- b != NULL
+	//	- 0 <= i <= bits in b
+	if ( !b ||
+		 i < 0 || i > (lua_Integer) b->size * 8 ) {
+		return 0;
+	}
+
+	uint32_t	full = (uint32_t) (i / 8);
+	uint32_t	rest = (uint32_t) (i % 8);
+	uint64_t	count = bytes_bitcount(b->value, full);
+
+	if ( rest != 0 ) {
+		count += bytes_popcount64(b->value[full] & (0xff00 >> rest));
+	}
+
+	lua_pushinteger(l, (lua_Integer) count);
+	return 1;
+}
+
+/**
+ *	Find the k-th set bit.
+ *
+ *	----------{.c}
+ *	uint64 bytes.bit_select(bytes b, uint64 k)
+ *	----------
+ *
+ *	@param b 	The bytes or slice to search.
+ *	@param k	Which set bit to find, from 1.
+ *
+ *	@return On success, the bit's index. Otherwise nil if b has fewer than k
+ *			bits set.
+ */
+static int mod_lua_bytes_bit_select(lua_State * l)
+{
+	as_bytes *	b = mod_lua_checkview(l, 1);
+	lua_Integer	k = luaL_optinteger(l, 2, 0);
+
+	if ( !b || k < 1 ) {
+		return 0;
+	}
+
+	uint64_t	left = (uint64_t) k;
+	uint32_t	i = 0;
+
+	// skip whole blocks with the counting kernel, then narrow to the byte
+	for ( ; i + 64 <= b->size; i += 64 ) {
+		uint64_t count = bytes_bitcount(b->value + i, 64);
+		if ( count >= left ) {
+			break;
+		}
+		left -= count;
+	}
+
+	for ( ; i < b->size; i++ ) {
+		uint32_t count = bytes_popcount64(b->value[i]);
+		if ( count >= left ) {
+			break;
+		}
+		left -= count;
+	}
+
+	if ( i == b->size ) {
+		return 0;
+	}
+
+	uint8_t		v = b->value[i];
+	uint32_t	bit = 0;
+
+	for ( ; bit < 8; bit++ ) {
+		if ( (v & (0x80 >> bit)) != 0 && --left == 0 ) {
+			break;
+		}
+	}
+
+	lua_pushinteger(l, (lua_Integer) i * 8 + bit + 1);
+	return 1;
+}
+
+/**
+ *	Find the first set bit at or after bit i.
+ *
+ *	----------{.c}
+ *	uint64 bytes.bit_next(bytes b [, uint64 i])
+ *	----------
+ *
+ *	@param b 	The bytes or slice to search.
+ *	@param i	The bit to start from, 1 by default.
+ *
+ *	@return On success, the bit's index. Otherwise nil if there is none.
+ */
+static int mod_lua_bytes_bit_next(lua_State * l)
+{
+	as_bytes *	b = mod_lua_checkview(l, 1);
+	lua_Integer	i = luaL_optinteger(l, 2, 1);
+
+	if ( !b || i < 1 || i > (lua_Integer) b->size * 8 ) {
+		return 0;
+	}
+
+	uint32_t	pos = (uint32_t) ((i - 1) / 8);
+	uint32_t	bit = (uint32_t) ((i - 1) % 8);
+	uint8_t		v = b->value[pos] & (0xff >> bit);
+
+	if ( v == 0 ) {
+		pos = bytes_bit_nonzero(b->value, pos + 1, b->size);
+		if ( pos == b->size ) {
+			return 0;
+		}
+		v = b->value[pos];
+		bit = 0;
+	}
+
+	while ( (v & (0x80 >> bit)) == 0 ) {
+		bit++;
+	}
+
+	lua_pushinteger(l, (lua_Integer) pos * 8 + bit + 1);
+	return 1;
+}
+
+/**
+ *	Find the range of set bits.
+ *
+ *	----------{.c}
+ *	uint64, uint64 bytes.bit_range(bytes b)
+ *	----------
+ *
+ *	@param b 	The bytes or slice to search.
+ *
+ *	@return On success, the first and last set bits. Otherwise nil if no bits
+ *			are set.
+ */
+static int mod_lua_bytes_bit_range(lua_State * l)
+{
+	as_bytes * b = mod_lua_checkview(l, 1);
+
+	if ( !b ) {
+		return 0;
+	}
+
+	uint32_t first = bytes_bit_nonzero(b->value, 0, b->size);
+
+	if ( first == b->size ) {
+		return 0;
+	}
+
+	uint32_t last = b->size - 1;
+
+	while ( b->value[last] == 0 ) {
+		last--;
+	}
+
+	uint32_t hi = 0;
+	uint32_t lo = 7;
+
+	while ( (b->value[first] & (0x80 >> hi)) == 0 ) {
+		hi++;
+	}
+
+	while ( (b->value[last] & (0x80 >> lo)) == 0 ) {
+		lo--;
+	}
+
+	lua_pushinteger(l, (lua_Integer) first * 8 + hi + 1);
+	lua_pushinteger(l, (lua_Integer) last * 8 + lo + 1);
+	return 2;
+}
+
+/******************************************************************************
+ *	FORMAT FUNCTIONS
+ *****************************************************************************/
+
+/**
+ *	Fields are described by a format string, modeled on Lua's string.pack():
+ *
+ *		<	little endian
+ *		>	big endian (the default, as for the other bytes functions)
+ *		=	native endian
+ *		b B	signed, unsigned 8-bit integer
+ *		h H	signed, unsigned 16-bit integer
+ *		i[n] I[n]	signed, unsigned n-byte integer (default 4, n is 1-8)
+ *		l L j J	signed, unsigned 64-bit integer
+ *		f	float
+ *		d n	double
+ *		v	integer in the variable 7-bit format of append_var_int()
+ *		s[n]	string or bytes, preceded by its length as an n-byte unsigned
+ *			integer (default 4)
+ *		c[n]	string or bytes of exactly n bytes, zero padded
+ *		z	zero-terminated string
+ *		x	one zero byte of padding (takes no value, and is skipped when
+ *			reading)
+ *
+ *	Spaces are ignored. The same format reads back what put() wrote, with
+ *	unpack().
+ */
+
+typedef enum {
+	BYTES_FIELD_NONE,
+	BYTES_FIELD_INT,
+	BYTES_FIELD_UINT,
+	BYTES_FIELD_FLOAT,
+	BYTES_FIELD_DOUBLE,
+	BYTES_FIELD_VAR_INT,
+	BYTES_FIELD_STRING,
+	BYTES_FIELD_FIXED,
+	BYTES_FIELD_ZSTRING,
+	BYTES_FIELD_PAD
+} bytes_field_type;
+
+typedef struct {
+	lua_State *		l;
+	int				arg;	// stack index of the format string
+	const char *	p;
+	bool			little;
+} bytes_format;
+
+static inline bool bytes_native_little(void)
+{
+	const uint16_t one = 1;
+	return *(const uint8_t *) &one == 1;
+}
+
+static void bytes_format_init(bytes_format * f, lua_State * l, int arg)
+{
+	f->l = l;
+	f->arg = arg;
+	f->p = luaL_checkstring(l, arg);
+	f->little = false;
+}
+
+static uint32_t bytes_format_size(bytes_format * f, uint32_t dflt)
+{
+	if ( *f->p < '0' || *f->p > '9' ) {
+		return dflt;
+	}
+
+	uint32_t n = 0;
+
+	while ( *f->p >= '0' && *f->p <= '9' && n < 1000000 ) {
+		n = n * 10 + (uint32_t) (*f->p++ - '0');
+	}
+
+	return n;
+}
+
+/**
+ *	Read the next field of the format, raising an error for an invalid one.
+ *	Returns BYTES_FIELD_NONE at the end of the format.
+ */
+static bytes_field_type bytes_format_next(bytes_format * f, uint32_t * size)
+{
+	while ( true ) {
+		char c = *f->p;
+
+		if ( c == '\0' ) {
+			return BYTES_FIELD_NONE;
+		}
+
+		f->p++;
+
+		switch ( c ) {
+			case ' ':
+				continue;
+			case '<':
+				f->little = true;
+				continue;
+			case '>':
+				f->little = false;
+				continue;
+			case '=':
+				f->little = bytes_native_little();
+				continue;
+			case 'b':
+				*size = 1;
+				return BYTES_FIELD_INT;
+			case 'B':
+				*size = 1;
+				return BYTES_FIELD_UINT;
+			case 'h':
+				*size = 2;
+				return BYTES_FIELD_INT;
+			case 'H':
+				*size = 2;
+				return BYTES_FIELD_UINT;
+			case 'i':
+			case 'I':
+				*size = bytes_format_size(f, 4);
+				if ( *size < 1 || *size > 8 ) {
+					luaL_argerror(f->l, f->arg, "integer size out of limits [1,8]");
+				}
+				return c == 'i' ? BYTES_FIELD_INT : BYTES_FIELD_UINT;
+			case 'l':
+			case 'j':
+				*size = 8;
+				return BYTES_FIELD_INT;
+			case 'L':
+			case 'J':
+				*size = 8;
+				return BYTES_FIELD_UINT;
+			case 'f':
+				*size = 4;
+				return BYTES_FIELD_FLOAT;
+			case 'd':
+			case 'n':
+				*size = 8;
+				return BYTES_FIELD_DOUBLE;
+			case 'v':
+				*size = 5;
+				return BYTES_FIELD_VAR_INT;
+			case 's':
+				*size = bytes_format_size(f, 4);
+				if ( *size < 1 || *size > 8 ) {
+					luaL_argerror(f->l, f->arg, "length size out of limits [1,8]");
+				}
+				return BYTES_FIELD_STRING;
+			case 'c':
+				*size = bytes_format_size(f, UINT32_MAX);
+				if ( *size == UINT32_MAX ) {
+					luaL_argerror(f->l, f->arg, "missing size for format option 'c'");
+				}
+				return BYTES_FIELD_FIXED;
+			case 'z':
+				*size = 0;
+				return BYTES_FIELD_ZSTRING;
+			case 'x':
+				*size = 1;
+				return BYTES_FIELD_PAD;
+			default:
+				luaL_argerror(f->l, f->arg,
+						lua_pushfstring(f->l, "invalid format option '%c'", c));
+				return BYTES_FIELD_NONE;
+		}
+	}
+}
+
+/**
+ *	Store the low size bytes of v at dst in the given byte order.
+ */
+static inline void bytes_store(uint8_t * dst, uint64_t v, uint32_t size, bool little)
+{
+	for ( uint32_t i = 0; i < size; i++ ) {
+		dst[little ? i : size - 1 - i] = (uint8_t) (v >> (8 * i));
+	}
+}
+
+/**
+ *	A string or bytes value, for the s, c and z fields.
+ */
+static const uint8_t * bytes_checkdata(lua_State * l, int arg, size_t * len)
+{
+	if ( lua_type(l, arg) == LUA_TSTRING ) {
+		return (const uint8_t *) lua_tolstring(l, arg, len);
+	}
+
+	as_bytes * v = mod_lua_checkview(l, arg);
+	*len = v->size;
+	return v->value;
+}
+
+static void bytes_checkint(lua_State * l, int arg, lua_Integer v,
+		bytes_field_type type, uint32_t size)
+{
+	if ( size >= 8 ) {
+		return;
+	}
+
+	lua_Integer lim = (lua_Integer) 1 << (size * 8 - 1);
+	bool ok = type == BYTES_FIELD_INT ?
+			-lim <= v && v < lim :
+			(lua_Unsigned) v < ((lua_Unsigned) lim << 1);
+
+	if ( ! ok ) {
+		luaL_argerror(l, arg, "integer overflow");
+	}
+}
+
+/**
+ *	Check the values at stack index arg and on against the format at stack
+ *	index fmt, raising an error for a value which doesn't fit its field.
+ *
+ *	@return The most bytes the fields can take.
+ */
+static uint64_t bytes_put_check(lua_State * l, int fmt, int arg)
+{
+	bytes_format		f;
+	bytes_field_type	type;
+	uint32_t			size;
+	uint64_t			need = 0;
+
+	bytes_format_init(&f, l, fmt);
+
+	while ( (type = bytes_format_next(&f, &size)) != BYTES_FIELD_NONE ) {
+		switch ( type ) {
+			case BYTES_FIELD_INT:
+			case BYTES_FIELD_UINT: {
+				lua_Integer v = luaL_checkinteger(l, arg);
+				bytes_checkint(l, arg++, v, type, size);
+				need += size;
+				break;
+			}
+			case BYTES_FIELD_FLOAT:
+			case BYTES_FIELD_DOUBLE:
+				luaL_checknumber(l, arg++);
+				need += size;
+				break;
+			case BYTES_FIELD_VAR_INT: {
+				lua_Integer v = luaL_checkinteger(l, arg);
+				if ( v < INT32_MIN || v > INT32_MAX ) {
+					luaL_argerror(l, arg, "integer overflow");
+				}
+				arg++;
+				need += size;
+				break;
+			}
+			case BYTES_FIELD_STRING: {
+				size_t len = 0;
+				bytes_checkdata(l, arg, &len);
+				if ( size < 8 && (uint64_t) len >> (size * 8) != 0 ) {
+					luaL_argerror(l, arg, "string length does not fit in given size");
+				}
+				arg++;
+				need += size + (uint64_t) len;
+				break;
+			}
+			case BYTES_FIELD_FIXED: {
+				size_t len = 0;
+				bytes_checkdata(l, arg, &len);
+				if ( len > size ) {
+					luaL_argerror(l, arg, "string longer than given size");
+				}
+				arg++;
+				need += size;
+				break;
+			}
+			case BYTES_FIELD_ZSTRING: {
+				size_t len = 0;
+				const uint8_t * v = bytes_checkdata(l, arg, &len);
+				if ( memchr(v, 0, len) != NULL ) {
+					luaL_argerror(l, arg, "string contains zeros");
+				}
+				arg++;
+				need += (uint64_t) len + 1;
+				break;
+			}
+			default:
+				need += size;
+				break;
+		}
+	}
+
+	return need;
+}
+
+/**
+ *	Append the values at stack index arg and on, as described by the format at
+ *	stack index fmt, to the end of b. Every value is checked, and room made for
+ *	all of them, before any is written, so a put which fails leaves b as it was.
+ *
+ *	@return false if b could not grow, otherwise true.
+ */
+static bool bytes_put(lua_State * l, as_bytes * b, int fmt, int arg)
+{
+	bytes_format		f;
+	bytes_field_type	type;
+	uint32_t			size;
+	uint32_t			pos = b->size;
+	uint64_t			need = bytes_put_check(l, fmt, arg);
+
+	if ( need > UINT32_MAX || ! mod_lua_bytes_grow(b, pos, (uint32_t) need) ) {
+		return false;
+	}
+
+	bytes_format_init(&f, l, fmt);
+
+	while ( (type = bytes_format_next(&f, &size)) != BYTES_FIELD_NONE ) {
+		switch ( type ) {
+			case BYTES_FIELD_INT:
+			case BYTES_FIELD_UINT:
+				bytes_store(b->value + pos, (uint64_t) lua_tointeger(l, arg++), size, f.little);
+				pos += size;
+				break;
+			case BYTES_FIELD_FLOAT: {
+				float v = (float) lua_tonumber(l, arg++);
+				uint32_t bits;
+				memcpy(&bits, &v, sizeof(bits));
+				bytes_store(b->value + pos, bits, size, f.little);
+				pos += size;
+				break;
+			}
+			case BYTES_FIELD_DOUBLE: {
+				double v = (double) lua_tonumber(l, arg++);
+				uint64_t bits;
+				memcpy(&bits, &v, sizeof(bits));
+				bytes_store(b->value + pos, bits, size, f.little);
+				pos += size;
+				break;
+			}
+			case BYTES_FIELD_VAR_INT:
+				pos += as_bytes_set_var_int(b, pos, (uint32_t) lua_tointeger(l, arg++));
+				break;
+			case BYTES_FIELD_STRING: {
+				// Read after growing b, which moves it and any slice of it.
+				size_t len = 0;
+				const uint8_t * v = bytes_checkdata(l, arg++, &len);
+				bytes_store(b->value + pos, (uint64_t) len, size, f.little);
+				memcpy(b->value + pos + size, v, len);
+				pos += size + (uint32_t) len;
+				break;
+			}
+			case BYTES_FIELD_FIXED: {
+				size_t len = 0;
+				const uint8_t * v = bytes_checkdata(l, arg++, &len);
+				memcpy(b->value + pos, v, len);
+				memset(b->value + pos + len, 0, size - len);
+				pos += size;
+				break;
+			}
+			case BYTES_FIELD_ZSTRING: {
+				size_t len = 0;
+				const uint8_t * v = bytes_checkdata(l, arg++, &len);
+				memcpy(b->value + pos, v, len);
+				b->value[pos + len] = 0;
+				pos += (uint32_t) len + 1;
+				break;
+			}
+			case BYTES_FIELD_PAD:
+				b->value[pos] = 0;
+				pos += size;
+				break;
+			default:
+				break;
+		}
+	}
+
+	b->size = pos;
+	return true;
+}
+
+/**
+ *	Load size bytes at src in the given byte order.
+ */
+static inline uint64_t bytes_load(const uint8_t * src, uint32_t size, bool little)
+{
+	uint64_t v = 0;
+	for ( uint32_t i = 0; i < size; i++ ) {
+		v |= (uint64_t) src[little ? i : size - 1 - i] << (8 * i);
+	}
+	return v;
+}
+
+/**
+ *	Push the values described by the format at stack index fmt, read from b
+ *	starting at *pos. On return *pos is just past the last field read.
+ *
+ *	@return false if a field runs past the end of b, otherwise true.
+ */
+static bool bytes_get(lua_State * l, as_bytes * b, int fmt, uint32_t * pos)
+{
+	bytes_format		f;
+	bytes_field_type	type;
+	uint32_t			size;
+	uint32_t			p = *pos;
+
+	bytes_format_init(&f, l, fmt);
+
+	while ( (type = bytes_format_next(&f, &size)) != BYTES_FIELD_NONE ) {
+		luaL_checkstack(l, 2, "too many results");
+
+		if ( type != BYTES_FIELD_VAR_INT && type != BYTES_FIELD_ZSTRING &&
+				(uint64_t) p + size > b->size ) {
+			return false;
+		}
+
+		switch ( type ) {
+			case BYTES_FIELD_INT: {
+				uint64_t v = bytes_load(b->value + p, size, f.little);
+				if ( size < 8 ) {
+					// sign extend
+					uint64_t m = (uint64_t) 1 << (size * 8 - 1);
+					v = (v ^ m) - m;
+				}
+				lua_pushinteger(l, (lua_Integer) v);
+				p += size;
+				break;
+			}
+			case BYTES_FIELD_UINT:
+				lua_pushinteger(l, (lua_Integer) bytes_load(b->value + p, size, f.little));
+				p += size;
+				break;
+			case BYTES_FIELD_FLOAT: {
+				uint32_t bits = (uint32_t) bytes_load(b->value + p, size, f.little);
+				float v;
+				memcpy(&v, &bits, sizeof(v));
+				lua_pushnumber(l, (lua_Number) v);
+				p += size;
+				break;
+			}
+			case BYTES_FIELD_DOUBLE: {
+				uint64_t bits = bytes_load(b->value + p, size, f.little);
+				double v;
+				memcpy(&v, &bits, sizeof(v));
+				lua_pushnumber(l, (lua_Number) v);
+				p += size;
+				break;
+			}
+			case BYTES_FIELD_VAR_INT: {
+				uint32_t v = 0;
+				uint32_t n = p < b->size ?
+						bytes_get_var_int(b->value + p, b->size - p, &v) : 0;
+				if ( n == 0 ) {
+					return false;
+				}
+				lua_pushinteger(l, v);
+				p += n;
+				break;
+			}
+			case BYTES_FIELD_STRING: {
+				uint64_t len = bytes_load(b->value + p, size, f.little);
+				// p + size <= b->size was checked above.
+				if ( len > b->size - p - size ) {
+					return false;
+				}
+				lua_pushlstring(l, (const char *) b->value + p + size, (size_t) len);
+				p += size + (uint32_t) len;
+				break;
+			}
+			case BYTES_FIELD_FIXED:
+				lua_pushlstring(l, (const char *) b->value + p, size);
+				p += size;
+				break;
+			case BYTES_FIELD_ZSTRING: {
+				const uint8_t * end = p < b->size ?
+						memchr(b->value + p, 0, b->size - p) : NULL;
+				if ( end == NULL ) {
+					return false;
+				}
+				uint32_t len = (uint32_t) (end - (b->value + p));
+				lua_pushlstring(l, (const char *) b->value + p, len);
+				p += len + 1;
+				break;
+			}
+			case BYTES_FIELD_PAD:
+				p += size;
+				break;
+			default:
+				break;
+		}
+	}
+
+	*pos = p;
+	return true;
+}
+
+/******************************************************************************
+ *	BUILDER FUNCTIONS
+ *****************************************************************************/
+
+/**
+ *	Accumulates fields into a bytes, which bytes.finish() hands over as is.
+ */
+typedef struct {
+	// Value is NULL, so mod_lua_toval() turns a builder into nil.
+	mod_lua_box	box;
+	as_bytes *	bytes;
+} mod_lua_builder;
+
+static mod_lua_builder * mod_lua_checkbuilder(lua_State * l, int index)
+{
+	return (mod_lua_builder *) luaL_checkudata(l, index, BUILDER_CLASS_NAME);
+}
+
+static int mod_lua_bytes_builder_gc(lua_State * l)
+{
+	mod_lua_builder * bb = mod_lua_checkbuilder(l, 1);
+	if ( bb->bytes ) {
+		as_bytes_destroy(bb->bytes);
+		bb->bytes = NULL;
+	}
+	return 0;
+}
+
+static int mod_lua_bytes_builder_len(lua_State * l)
+{
+	mod_lua_builder * bb = mod_lua_checkbuilder(l, 1);
+	lua_pushinteger(l, bb->bytes ? bb->bytes->size : 0);
+	return 1;
+}
+
+static int mod_lua_bytes_builder_tostring(lua_State * l)
+{
+	mod_lua_builder * bb = mod_lua_checkbuilder(l, 1);
+	lua_pushfstring(l, "BytesBuilder(%d)", bb->bytes ? (int) bb->bytes->size : 0);
+	return 1;
+}
+
+/**
+ *	Create a builder.
+ *
+ *	----------{.c}
+ *	BytesBuilder bytes.builder([uint32 capacity])
+ *	----------
+ *
+ *	@param capacity	The initial capacity, in bytes.
+ *
+ *	@return The builder.
+ */
+static int mod_lua_bytes_builder(lua_State * l)
+{
+	lua_Integer n = luaL_optinteger(l, 1, 0);
+
+	if ( n < 0 || n > UINT32_MAX ) {
+		return 0;
+	}
+
+	mod_lua_builder * bb = (mod_lua_builder *)
+			lua_newuserdata(l, sizeof(mod_lua_builder));
+	bb->box.scope = MOD_LUA_SCOPE_LUA;
+	bb->box.value = NULL;
+	bb->bytes = NULL;
+	luaL_getmetatable(l, BUILDER_CLASS_NAME);
+	lua_setmetatable(l, -2);
+
+	bb->bytes = as_bytes_new((uint32_t) n);
+	return bb->bytes ? 1 : 0;
+}
+
+/**
+ *	Append fields described by a format string. See FORMAT FUNCTIONS above.
+ *
+ *	----------{.c}
+ *	bool bytes.put(bytes|BytesBuilder b, string format, ...)
+ *	bool bytes.pack(bytes|BytesBuilder b, string format, ...)
+ *	----------
+ *
+ *	@param b 		The bytes or builder to append to.
+ *	@param format	The format of the fields.
+ *	@param ...		The field values.
+ *
+ *	@return On success, true. Otherwise, false on error.
+ */
+static int mod_lua_bytes_put(lua_State * l)
+{
+	as_bytes * b = NULL;
+	mod_lua_builder * bb = (mod_lua_builder *)
+			luaL_testudata(l, 1, BUILDER_CLASS_NAME);
+
+	if ( bb ) {
+		if ( ! bb->bytes ) {
+			// Start over after bytes.finish().
+			bb->bytes = as_bytes_new(0);
+		}
+		b = bb->bytes;
+	}
+	else {
+		b = mod_lua_checkbytes(l, 1);
+	}
+
+	lua_pushboolean(l, b && bytes_put(l, b, 2, 3));
+	return 1;
+}
+
+/**
+ *	Read many fields in one call, as described by a format string. See FORMAT
+ *	FUNCTIONS above.
+ *
+ *	----------{.c}
+ *	... bytes.unpack(bytes b, string format [, uint32 i])
+ *	----------
+ *
+ *	@param b 		The bytes or slice to read from.
+ *	@param format	The format of the fields.
+ *	@param i		The index in b of the first field, 1 by default.
+ *
+ *	@return On success, the field values followed by the index just past
+ *			the last field. Otherwise nil if a field runs past the end of b.
+ */
+static int mod_lua_bytes_unpack(lua_State * l)
+{
+	as_bytes *	b = mod_lua_checkview(l, 1);
+	lua_Integer	i = luaL_optinteger(l, 3, 1);
+
+	// check preconditions:
+	//	- b != NULL
+	//	- 1 <= i <= UINT32_MAX
+	if ( !b ||
+		 i < 1 || i > UINT32_MAX ) {
+		return 0;
+	}
+
+	int top = lua_gettop(l);
+	uint32_t pos = (uint32_t)(i - 1);
+
+	if ( !bytes_get(l, b, 2, &pos) ) {
+		lua_settop(l, top);
+		lua_pushnil(l);
+		return 1;
+	}
+
+	lua_pushinteger(l, (lua_Integer) pos + 1);
+	return lua_gettop(l) - top;
+}
+
+/**
+ *	Take the bytes accumulated by a builder, without copying them. The builder
+ *	is left empty.
+ *
+ *	----------{.c}
+ *	bytes bytes.finish(BytesBuilder b)
+ *	----------
+ *
+ *	@param b 	The builder.
+ *
+ *	@return The bytes.
+ */
+static int mod_lua_bytes_finish(lua_State * l)
+{
+	mod_lua_builder * bb = mod_lua_checkbuilder(l, 1);
+	as_bytes * b = bb->bytes ? bb->bytes : as_bytes_new(0);
+
+	if ( ! b ) {
+		return 0;
+	}
+
+	bb->bytes = NULL;
+	mod_lua_pushbytes(l, b);
+	return 1;
+}
+
+/******************************************************************************
+ *	SLICE FUNCTIONS
+ *****************************************************************************/
+
+static mod_lua_slice * mod_lua_checkslice(lua_State * l, int index)
+{
+	return (mod_lua_slice *) luaL_checkudata(l, index, SLICE_CLASS_NAME);
+}
+
+static int mod_lua_bytes_slice_gc(lua_State * l)
+{
+	mod_lua_slice * s = mod_lua_checkslice(l, 1);
+	if ( s->parent ) {
+		as_bytes_destroy(s->parent);
+		s->parent = NULL;
+	}
+	return 0;
+}
+
+static int mod_lua_bytes_slice_tostring(lua_State * l)
+{
+	mod_lua_slice * s = mod_lua_checkslice(l, 1);
+	char * str = as_val_tostring(mod_lua_slice_view(s));
+
+	if ( str ) {
+		lua_pushstring(l, str);
+		cf_free(str);
+	}
+	else {
+		lua_pushstring(l, "Bytes()");
+	}
+
+	return 1;
+}
+
+/**
+ *	Get a read-only view of a range of bytes, without copying them.
+ *
+ *	The slice can be passed to the get_* functions, size(), and as the source
+ *	of append_bytes(), set_bytes() and put(). Storing it in a list, map or bin,
+ *	or returning it, stores a copy.
+ *
+ *	----------{.c}
+ *	BytesSlice bytes.slice(bytes b, uint32 i, uint32 n)
+ *	----------
+ *
+ *	@param b 	The bytes or slice to view.
+ *	@param i	The index in b of the first byte.
+ *	@param n	The number of bytes.
+ *
+ *	@return On success, the slice. Otherwise nil on failure.
+ */
+static int mod_lua_bytes_slice(lua_State * l)
+{
+	// we expect exactly 3 args
+	if ( lua_gettop(l) != 3 ) {
+		return 0;
+	}
+
+	mod_lua_slice *	from = (mod_lua_slice *) luaL_testudata(l, 1, SLICE_CLASS_NAME);
+	as_bytes *		b = mod_lua_checkview(l, 1);
+	lua_Integer		i = luaL_optinteger(l, 2, 0);
+	lua_Integer		n = luaL_optinteger(l, 3, 0);
+
+	// check preconditions:
+	//	- b != NULL
+	//	- 1 <= i <= UINT32_MAX
+	//	- 0 <= n <= UINT32_MAX
+	//	- the range is within b
+	if ( !b ||
+		 i < 1 || i > UINT32_MAX ||
+		 n < 0 || n > UINT32_MAX ||
+		 (uint64_t) i - 1 + (uint64_t) n > b->size ) {
+		return 0;
+	}
+
+	// A slice of a slice views the same parent.
+	as_bytes * parent = from ? from->parent : b;
+	uint32_t offset = (from ? from->offset : 0) + (uint32_t)(i - 1);
+
+	mod_lua_slice * s = (mod_lua_slice *) lua_newuserdata(l, sizeof(mod_lua_slice));
+	s->box.scope = MOD_LUA_SCOPE_LUA;
+	s->box.value = NULL;
+	s->parent = (as_bytes *) as_val_reserve(parent);
+	s->offset = offset;
+	s->size = (uint32_t) n;
+	luaL_getmetatable(l, SLICE_CLASS_NAME);
+	lua_setmetatable(l, -2);
+	return 1;
+}
+
+/******************************************************************************
+ *	ENCODING FUNCTIONS
+ *****************************************************************************/
+
+/**
+ *	The kernels map each byte or character with branchless arithmetic rather
+ *	than table lookups, so the compiler can vectorize the loops.
+ */
+
+/**
+ *	Lower case hex digit for a nibble.
+ */
+static inline uint8_t bytes_hex_digit(uint8_t n)
+{
+	// 'a' - '0' - 10 is added for nibbles above 9
+	return (uint8_t) (n + '0' + (((uint8_t) (9 - n) >> 7) * 39));
+}
+
+static void bytes_hex_encode(char * dst, const uint8_t * src, uint32_t n)
+{
+	for ( uint32_t i = 0; i < n; i++ ) {
+		dst[2 * i] = (char) bytes_hex_digit(src[i] >> 4);
+		dst[2 * i + 1] = (char) bytes_hex_digit(src[i] & 0x0f);
+	}
+}
+
+/**
+ *	Value of a hex digit of either case, with bit 4 set if c isn't one.
+ */
+static inline uint8_t bytes_hex_value(uint8_t c)
+{
+	uint8_t d = (uint8_t) (c - '0');
+	uint8_t a = (uint8_t) ((c | 0x20) - 'a');
+	uint8_t is_d = d < 10;
+	uint8_t is_a = a < 6;
+
+	return (uint8_t) ((is_d ? d : (uint8_t) (a + 10)) | ((is_d | is_a) ^ 1) << 4);
+}
+
+/**
+ *	@return false if src has a character that isn't a hex digit.
+ */
+static bool bytes_hex_decode(uint8_t * dst, const uint8_t * src, uint32_t n)
+{
+	uint8_t bad = 0;
+
+	for ( uint32_t i = 0; i < n; i++ ) {
+		uint8_t hi = bytes_hex_value(src[2 * i]);
+		uint8_t lo = bytes_hex_value(src[2 * i + 1]);
+		bad |= hi | lo;
+		dst[i] = (uint8_t) (hi << 4 | (lo & 0x0f));
+	}
+
+	return (bad & 0x10) == 0;
+}
+
+/**
+ *	Base64 character for a sextet.
+ */
+static inline uint8_t bytes_b64_char(uint8_t v)
+{
+	// 'A'-'Z', then 'a'-'z', '0'-'9', '+' and '/'
+	return (uint8_t) (v + 'A' + (v >= 26) * 6 - (v >= 52) * 75 -
+			(v >= 62) * 15 + (v >= 63) * 3);
+}
+
+/**
+ *	Value of a base64 character, with bit 6 set if c isn't one.
+ */
+static inline uint8_t bytes_b64_value(uint8_t c)
+{
+	uint8_t upper = (uint8_t) (c - 'A') < 26;
+	uint8_t lower = (uint8_t) (c - 'a') < 26;
+	uint8_t digit = (uint8_t) (c - '0') < 10;
+	uint8_t plus = c == '+';
+	uint8_t slash = c == '/';
+
+	uint8_t v = (uint8_t) (upper * (c - 'A') + lower * (c - 'a' + 26) +
+			digit * (c - '0' + 52) + plus * 62 + slash * 63);
+
+	return (uint8_t) (v | ((upper | lower | digit | plus | slash) ^ 1) << 6);
+}
+
+static void bytes_b64_encode(char * dst, const uint8_t * src, uint32_t n)
+{
+	uint32_t i = 0;
+
+	for ( ; i + 3 <= n; i += 3, dst += 4 ) {
+		uint32_t v = (uint32_t) src[i] << 16 | (uint32_t) src[i + 1] << 8 | src[i + 2];
+		dst[0] = (char) bytes_b64_char((v >> 18) & 0x3f);
+		dst[1] = (char) bytes_b64_char((v >> 12) & 0x3f);
+		dst[2] = (char) bytes_b64_char((v >> 6) & 0x3f);
+		dst[3] = (char) bytes_b64_char(v & 0x3f);
+	}
+
+	if ( i < n ) {
+		uint32_t v = (uint32_t) src[i] << 16;
+		if ( i + 1 < n ) {
+			v |= (uint32_t) src[i + 1] << 8;
+		}
+		dst[0] = (char) bytes_b64_char((v >> 18) & 0x3f);
+		dst[1] = (char) bytes_b64_char((v >> 12) & 0x3f);
+		dst[2] = i + 1 < n ? (char) bytes_b64_char((v >> 6) & 0x3f) : '=';
+		dst[3] = '=';
+	}
+}
+
+/**
+ *	Decode len characters (a multiple of 4) into *size bytes.
+ *
+ *	@return false if src isn't padded base64.
+ */
+static bool bytes_b64_decode(uint8_t * dst, const uint8_t * src, size_t len,
+		uint32_t * size)
+{
+	if ( len == 0 ) {
+		*size = 0;
+		return true;
+	}
+
+	uint32_t pad = (src[len - 1] == '=') + (src[len - 2] == '=');
+	size_t full = len - 4;
+	uint8_t bad = 0;
+	uint32_t n = 0;
+
+	for ( size_t i = 0; i < full; i += 4, n += 3 ) {
+		uint8_t a = bytes_b64_value(src[i]);
+		uint8_t b = bytes_b64_value(src[i + 1]);
+		uint8_t c = bytes_b64_value(src[i + 2]);
+		uint8_t d = bytes_b64_value(src[i + 3]);
+		bad |= a | b | c | d;
+		uint32_t v = (uint32_t) (a & 0x3f) << 18 | (uint32_t) (b & 0x3f) << 12 |
+				(uint32_t) (c & 0x3f) << 6 | (d & 0x3f);
+		dst[n] = (uint8_t) (v >> 16);
+		dst[n + 1] = (uint8_t) (v >> 8);
+		dst[n + 2] = (uint8_t) v;
+	}
+
+	// the last group, which may be padded
+	const uint8_t * last = src + full;
+	uint8_t a = bytes_b64_value(last[0]);
+	uint8_t b = bytes_b64_value(last[1]);
+	uint8_t c = pad < 2 ? bytes_b64_value(last[2]) : 0;
+	uint8_t d = pad < 1 ? bytes_b64_value(last[3]) : 0;
+	bad |= a | b | c | d;
+
+	if ( (bad & 0x40) != 0 ) {
+		return false;
+	}
+
+	uint32_t v = (uint32_t) a << 18 | (uint32_t) b << 12 | (uint32_t) c << 6 | d;
+	dst[n++] = (uint8_t) (v >> 16);
+	if ( pad < 2 ) {
+		dst[n++] = (uint8_t) (v >> 8);
+	}
+	if ( pad < 1 ) {
+		dst[n++] = (uint8_t) v;
+	}
+
+	*size = n;
+	return true;
+}
+
+/**
+ *	Encode bytes as lower case hex.
+ *
+ *	----------{.c}
+ *	string bytes.to_hex(bytes b)
+ *	----------
+ *
+ *	@param b 	The bytes or slice to encode.
+ *
+ *	@return On success, the string. Otherwise nil on failure.
+ */
+static int mod_lua_bytes_to_hex(lua_State * l)
+{
+	as_bytes * b = mod_lua_checkview(l, 1);
+
+	if ( !b ) {
+		return 0;
+	}
+
+	size_t len = (size_t) b->size * 2;
+	luaL_Buffer buf;
+	char * dst = luaL_buffinitsize(l, &buf, len);
+
+	// the buffer may be a new userdata, so fetch the view after it
+	b = mod_lua_checkview(l, 1);
+	bytes_hex_encode(dst, b->value, b->size);
+	luaL_pushresultsize(&buf, len);
+	return 1;
+}
+
+/**
+ *	Decode hex, of either case, into new bytes.
+ *
+ *	----------{.c}
+ *	bytes bytes.from_hex(string s)
+ *	----------
+ *
+ *	@param s 	The hex string, or bytes or slice holding it.
+ *
+ *	@return On success, the bytes. Otherwise nil if s isn't hex.
+ */
+static int mod_lua_bytes_from_hex(lua_State * l)
+{
+	size_t len;
+	const uint8_t * src = bytes_checkdata(l, 1, &len);
+
+	if ( len % 2 != 0 || len / 2 > UINT32_MAX ) {
+		return 0;
+	}
+
+	uint32_t size = (uint32_t) (len / 2);
+	as_bytes * b = as_bytes_new(size);
+
+	if ( !b ) {
+		return 0;
+	}
+
+	if ( !bytes_hex_decode(b->value, src, size) ) {
+		as_bytes_destroy(b);
+		return 0;
+	}
+
+	b->size = size;
+	mod_lua_pushbytes(l, b);
+	return 1;
+}
+
+/**
+ *	Encode bytes as padded base64, with the standard alphabet.
+ *
+ *	----------{.c}
+ *	string bytes.to_base64(bytes b)
+ *	----------
+ *
+ *	@param b 	The bytes or slice to encode.
+ *
+ *	@return On success, the string. Otherwise nil on failure.
+ */
+static int mod_lua_bytes_to_base64(lua_State * l)
+{
+	as_bytes * b = mod_lua_checkview(l, 1);
+
+	if ( !b ) {
+		return 0;
+	}
+
+	size_t len = ((size_t) b->size + 2) / 3 * 4;
+	luaL_Buffer buf;
+	char * dst = luaL_buffinitsize(l, &buf, len);
+
+	// the buffer may be a new userdata, so fetch the view after it
+	b = mod_lua_checkview(l, 1);
+	bytes_b64_encode(dst, b->value, b->size);
+	luaL_pushresultsize(&buf, len);
+	return 1;
+}
+
+/**
+ *	Decode padded base64, with the standard alphabet, into new bytes.
+ *
+ *	----------{.c}
+ *	bytes bytes.from_base64(string s)
+ *	----------
+ *
+ *	@param s 	The base64 string, or bytes or slice holding it.
+ *
+ *	@return On success, the bytes. Otherwise nil if s isn't base64.
+ */
+static int mod_lua_bytes_from_base64(lua_State * l)
+{
+	size_t len;
+	const uint8_t * src = bytes_checkdata(l, 1, &len);
+
+	if ( len % 4 != 0 || len / 4 * 3 > UINT32_MAX ) {
+		return 0;
+	}
+
+	uint32_t size = 0;
+	as_bytes * b = as_bytes_new((uint32_t) (len / 4 * 3));
+
+	if ( !b ) {
+		return 0;
+	}
+
+	if ( !bytes_b64_decode(b->value, src, len, &size) ) {
+		as_bytes_destroy(b);
+		return 0;
+	}
+
+	b->size = size;
+	mod_lua_pushbytes(l, b);
+	return 1;
+}
+
+/******************************************************************************
+ *	COMPRESSION FUNCTIONS
+ *****************************************************************************/
+
+/**
+ *	Compressed bytes are an LZ4 block, after a header of the magic below and
+ *	the size of the original bytes as a big endian uint32. The bytes type is
+ *	kept, so compressed bytes store like the original.
+ */
+
+static const uint8_t bytes_lz4_magic[4] = { 'L', 'Z', '4', 0x01 };
+
+#define LZ4_HEADER_SIZE 8
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5		// a block ends with at least this many literals
+#define LZ4_MF_LIMIT 12			// and no match starts closer than this to the end
+#define LZ4_MAX_DISTANCE 65535
+#define LZ4_HASH_LOG 12
+
+static inline uint32_t lz4_read32(const uint8_t * p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t lz4_hash(uint32_t v)
+{
+	return (v * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+/**
+ *	Largest compressed size of n bytes.
+ */
+static inline uint64_t lz4_bound(uint32_t n)
+{
+	return (uint64_t) n + n / 255 + 16;
+}
+
+static inline uint8_t * lz4_put_length(uint8_t * op, uint32_t len)
+{
+	for ( ; len >= 255; len -= 255 ) {
+		*op++ = 255;
+	}
+	*op++ = (uint8_t) len;
+	return op;
+}
+
+static uint8_t * lz4_put_sequence(uint8_t * op, const uint8_t * lit,
+		uint32_t lit_len, uint32_t offset, uint32_t match_len)
+{
+	uint8_t * token = op++;
+	uint32_t ml = match_len - LZ4_MIN_MATCH;
+
+	*token = (uint8_t) ((lit_len < 15 ? lit_len : 15) << 4);
+
+	if ( lit_len >= 15 ) {
+		op = lz4_put_length(op, lit_len - 15);
+	}
+
+	memcpy(op, lit, lit_len);
+	op += lit_len;
+
+	if ( match_len == 0 ) {
+		// the last literals
+		return op;
+	}
+
+	*op++ = (uint8_t) offset;
+	*op++ = (uint8_t) (offset >> 8);
+	*token |= (uint8_t) (ml < 15 ? ml : 15);
+
+	if ( ml >= 15 ) {
+		op = lz4_put_length(op, ml - 15);
+	}
+
+	return op;
+}
+
+/**
+ *	Compress n bytes into an LZ4 block at dst, which has room for
+ *	lz4_bound(n) bytes.
+ *
+ *	@return The size of the block.
+ */
+static uint32_t lz4_compress(uint8_t * dst, const uint8_t * src, uint32_t n)
+{
+	uint32_t	table[1 << LZ4_HASH_LOG];
+	uint8_t *	op = dst;
+	uint32_t	anchor = 0;
+	uint32_t	ip = 1;
+
+	memset(table, 0, sizeof(table));
+
+	if ( n > LZ4_MF_LIMIT ) {
+		uint32_t	limit = n - LZ4_MF_LIMIT;
+		uint32_t	match_end = n - LZ4_LAST_LITERALS;
+		uint32_t	misses = 0;
+
+		while ( ip < limit ) {
+			uint32_t seq = lz4_read32(src + ip);
+			uint32_t h = lz4_hash(seq);
+			uint32_t ref = table[h];
+
+			table[h] = ip;
+
+			if ( ip - ref > LZ4_MAX_DISTANCE || lz4_read32(src + ref) != seq ) {
+				// skip ahead faster through data that doesn't compress
+				ip += 1 + (misses++ >> 6);
+				continue;
+			}
+
+			misses = 0;
+
+			while ( ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1] ) {
+				ip--;
+				ref--;
+			}
+
+			uint32_t len = LZ4_MIN_MATCH;
+
+			while ( ip + len < match_end && src[ip + len] == src[ref + len] ) {
+				len++;
+			}
+
+			op = lz4_put_sequence(op, src + anchor, ip - anchor, ip - ref, len);
+			ip += len;
+			anchor = ip;
+
+			if ( ip < limit ) {
+				table[lz4_hash(lz4_read32(src + ip - 2))] = ip - 2;
+			}
+		}
+	}
+
+	op = lz4_put_sequence(op, src + anchor, n - anchor, 0, 0);
+	return (uint32_t) (op - dst);
+}
+
+static inline bool lz4_get_length(const uint8_t ** ip, const uint8_t * end,
+		size_t * len)
+{
+	uint8_t b;
+
+	do {
+		if ( *ip >= end ) {
+			return false;
+		}
+		b = *(*ip)++;
+		*len += b;
+	} while ( b == 255 );
+
+	return true;
+}
+
+/**
+ *	Decompress the LZ4 block src into exactly n bytes at dst.
+ *
+ *	@return false if the block is malformed or doesn't decompress to n bytes.
+ */
+static bool lz4_decompress(uint8_t * dst, uint32_t n, const uint8_t * src,
+		uint32_t len)
+{
+	const uint8_t *	ip = src;
+	const uint8_t *	end = src + len;
+	uint8_t *		op = dst;
+	uint8_t *		op_end = dst + n;
+
+	while ( ip < end ) {
+		uint8_t token = *ip++;
+		size_t lit_len = token >> 4;
+
+		if ( lit_len == 15 && ! lz4_get_length(&ip, end, &lit_len) ) {
+			return false;
+		}
+
+		if ( lit_len > (size_t) (end - ip) || lit_len > (size_t) (op_end - op) ) {
+			return false;
+		}
+
+		memcpy(op, ip, lit_len);
+		op += lit_len;
+		ip += lit_len;
+
+		if ( ip == end ) {
+			break;
+		}
+
+		if ( end - ip < 2 ) {
+			return false;
+		}
+
+		size_t offset = ip[0] | (size_t) ip[1] << 8;
+		ip += 2;
+
+		if ( offset == 0 || offset > (size_t) (op - dst) ) {
+			return false;
+		}
+
+		size_t match_len = token & 0x0f;
+
+		if ( match_len == 15 && ! lz4_get_length(&ip, end, &match_len) ) {
+			return false;
+		}
+
+		match_len += LZ4_MIN_MATCH;
+
+		if ( match_len > (size_t) (op_end - op) ) {
+			return false;
+		}
+
+		const uint8_t * ref = op - offset;
+
+		if ( offset >= match_len ) {
+			memcpy(op, ref, match_len);
+			op += match_len;
+		}
+		else {
+			// the match overlaps what it writes
+			for ( size_t i = 0; i < match_len; i++ ) {
+				*op++ = *ref++;
+			}
+		}
+	}
+
+	return op == op_end;
+}
+
+/**
+ *	Compress bytes. The result has the same type as b.
+ *
+ *	----------{.c}
+ *	bytes bytes.compress(bytes b)
+ *	----------
+ *
+ *	@param b 	The bytes or slice to compress.
+ *
+ *	@return On success, the compressed bytes. Otherwise nil on failure.
+ */
+static int mod_lua_bytes_compress(lua_State * l)
+{
+	as_bytes * b = mod_lua_checkview(l, 1);
+
+	if ( !b ) {
+		return 0;
+	}
+
+	uint64_t capacity = LZ4_HEADER_SIZE + lz4_bound(b->size);
+
+	if ( capacity > UINT32_MAX ) {
+		return 0;
+	}
+
+	as_bytes * c = as_bytes_new((uint32_t) capacity);
+
+	if ( !c ) {
+		return 0;
+	}
+
+	uint32_t size = cf_swap_to_be32(b->size);
+
+	memcpy(c->value, bytes_lz4_magic, sizeof(bytes_lz4_magic));
+	memcpy(c->value + sizeof(bytes_lz4_magic), &size, sizeof(size));
+
+	c->size = LZ4_HEADER_SIZE + lz4_compress(c->value + LZ4_HEADER_SIZE, b->value, b->size);
+	c->type = b->type;
+
+	mod_lua_pushbytes(l, c);
+	return 1;
+}
+
+/**
+ *	Decompress bytes made by compress(). The result has the same type as b.
+ *
+ *	----------{.c}
+ *	bytes bytes.decompress(bytes b)
+ *	----------
+ *
+ *	@param b 	The bytes or slice to decompress.
+ *
+ *	@return On success, the original bytes. Otherwise nil if b isn't
+ *			compressed bytes.
+ */
+static int mod_lua_bytes_decompress(lua_State * l)
+{
+	as_bytes * b = mod_lua_checkview(l, 1);
+
+	if ( !b ||
+		 b->size < LZ4_HEADER_SIZE ||
+		 memcmp(b->value, bytes_lz4_magic, sizeof(bytes_lz4_magic)) != 0 ) {
+		return 0;
+	}
+
+	uint32_t size;
+	uint32_t len = b->size - LZ4_HEADER_SIZE;
+
+	memcpy(&size, b->value + sizeof(bytes_lz4_magic), sizeof(size));
+	size = cf_swap_from_be32(size);
+
+	// a block can't expand by more than this, so don't trust a larger size
+	if ( (uint64_t) size > (uint64_t) len * 255 ) {
+		return 0;
+	}
+
+	as_bytes * d = as_bytes_new(size);
+
+	if ( !d ) {
+		return 0;
+	}
+
+	if ( !lz4_decompress(d->value, size, b->value + LZ4_HEADER_SIZE, len) ) {
+		as_bytes_destroy(d);
+		return 0;
+	}
+
+	d->size = size;
+	d->type = b->type;
+
+	mod_lua_pushbytes(l, d);
+	return 1;
+}
+
+/******************************************************************************
+ * OBJECT TABLE
+ *****************************************************************************/
+
+static const luaL_Reg bytes_object_table[] = {
+
+	{"size",			mod_lua_bytes_size},
+	{"set_size",		mod_lua_bytes_ensure},
+
+	{"get_type",		mod_lua_bytes_get_type},
+	{"set_type",		mod_lua_bytes_set_type},
+	
+	{"get_string",		mod_lua_bytes_get_string},
+	{"get_bytes",		mod_lua_bytes_get_bytes},
+	{"slice",			mod_lua_bytes_slice},
+	{"get_byte",		mod_lua_bytes_get_byte},
+	{"get_int16",		mod_lua_bytes_get_int16_be},
+	{"get_int16_be",	mod_lua_bytes_get_int16_be},
+	{"get_int16_le",	mod_lua_bytes_get_int16_le},
+	{"get_int32",		mod_lua_bytes_get_int32_be},
+	{"get_int32_be",	mod_lua_bytes_get_int32_be},
+	{"get_int32_le",	mod_lua_bytes_get_int32_le},
+	{"get_int64",		mod_lua_bytes_get_int64_be},
+	{"get_int64_be",	mod_lua_bytes_get_int64_be},
+	{"get_int64_le",	mod_lua_bytes_get_int64_le},
+	{"get_var_int",		mod_lua_bytes_get_var_int},
+
+	{"set_string",		mod_lua_bytes_set_string},
+	{"set_bytes",		mod_lua_bytes_set_bytes},
+	{"set_byte",		mod_lua_bytes_set_byte},
+	{"set_int16",		mod_lua_bytes_set_int16_be},
+	{"set_int16_be",	mod_lua_bytes_set_int16_be},
+	{"set_int16_le",	mod_lua_bytes_set_int16_le},
+	{"set_int32",		mod_lua_bytes_set_int32_be},
+	{"set_int32_be",	mod_lua_bytes_set_int32_be},
+	{"set_int32_le",	mod_lua_bytes_set_int32_le},
+	{"set_int64",		mod_lua_bytes_set_int64_be},
+	{"set_int64_be",	mod_lua_bytes_set_int64_be},
+	{"set_int64_le",	mod_lua_bytes_set_int64_le},
+	{"set_var_int",		mod_lua_bytes_set_var_int},
+	
+	{"append_string",	mod_lua_bytes_append_string},
+	{"append_bytes",	mod_lua_bytes_append_bytes},
+	{"append_byte",		mod_lua_bytes_append_byte},
+	{"append_int16",	mod_lua_bytes_append_int16_be},
+	{"append_int16_be",	mod_lua_bytes_append_int16_be},
+	{"append_int16_le",	mod_lua_bytes_append_int16_le},
+	{"append_int32",	mod_lua_bytes_append_int32_be},
+	{"append_int32_be",	mod_lua_bytes_append_int32_be},
+	{"append_int32_le",	mod_lua_bytes_append_int32_le},
+	{"append_int64",	mod_lua_bytes_append_int64_be},
+	{"append_int64_be",	mod_lua_bytes_append_int64_be},
+	{"append_int64_le",	mod_lua_bytes_append_int64_le},
+	{"append_var_int",	mod_lua_bytes_append_var_int},
+
+	{"bit_and",			mod_lua_bytes_bit_and},
+	{"bit_or",			mod_lua_bytes_bit_or},
+	{"bit_xor",			mod_lua_bytes_bit_xor},
+	{"bit_andnot",		mod_lua_bytes_bit_andnot},
+	{"bit_count",		mod_lua_bytes_bit_count},
+	{"bit_rank",		mod_lua_bytes_bit_rank},
+	{"bit_select",		mod_lua_bytes_bit_select},
+	{"bit_next",		mod_lua_bytes_bit_next},
+	{"bit_range",		mod_lua_bytes_bit_range},
+
+	{"to_hex",			mod_lua_bytes_to_hex},
+	{"from_hex",		mod_lua_bytes_from_hex},
+	{"to_base64",		mod_lua_bytes_to_base64},
+	{"from_base64",		mod_lua_bytes_from_base64},
+
+	{"compress",		mod_lua_bytes_compress},
+	{"decompress",		mod_lua_bytes_decompress},
+
+	{"builder",			mod_lua_bytes_builder},
+	{"put",				mod_lua_bytes_put},
+	{"pack",			mod_lua_bytes_put},
+	{"unpack",			mod_lua_bytes_unpack},
+	{"finish",			mod_lua_bytes_finish},
+		
+	{0, 0}
+};
+
+static const luaL_Reg bytes_object_metatable[] = {
+	{"__call",          mod_lua_bytes_new},
+	{0, 0}
+};
+
+/******************************************************************************
+ * CLASS TABLE
+ *****************************************************************************/
+
+/*
+static const luaL_Reg bytes_class_table[] = {
+	{"putX",            mod_lua_bytes_tostring},
+	{0, 0}
+};
+*/
+
+static const luaL_Reg bytes_class_metatable[] = {
+	{"__index",         mod_lua_bytes_get_byte},
+	{"__newindex",      mod_lua_bytes_set_byte},
+	{"__len",           mod_lua_bytes_size},
+	{"__tostring",      mod_lua_bytes_tostring},
+	{"__gc",            mod_lua_bytes_gc},
+	{0, 0}
+};
+
+static const luaL_Reg bytes_slice_class_metatable[] = {
+	{"__index",         mod_lua_bytes_get_byte},
+	{"__len",           mod_lua_bytes_size},
+	{"__tostring",      mod_lua_bytes_slice_tostring},
+	{"__gc",            mod_lua_bytes_slice_gc},
+	{0, 0}
+};
+
+static const luaL_Reg bytes_builder_class_metatable[] = {
+	{"__len",           mod_lua_bytes_builder_len},
+	{"__tostring",      mod_lua_bytes_builder_tostring},
+	{"__gc",            mod_lua_bytes_builder_gc},
 	{0, 0}
 };
 
@@ -1790,5 +3803,7 @@ static const luaL_Reg bytes_class_metatable[] = {
 int mod_lua_bytes_register(lua_State * l) {
 	mod_lua_reg_object(l, OBJECT_NAME, bytes_object_table, bytes_object_metatable);
 	mod_lua_reg_class(l, CLASS_NAME, NULL, bytes_class_metatable);
+	mod_lua_reg_class(l, SLICE_CLASS_NAME, NULL, bytes_slice_class_metatable);
+	mod_lua_reg_class(l, BUILDER_CLASS_NAME, NULL, bytes_builder_class_metatable);
 	return 1;
 }
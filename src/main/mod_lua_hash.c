@@ -0,0 +1,581 @@
+/*
+ * Copyright 2008-2024 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#include <aerospike/mod_lua_hash.h>
+#include <aerospike/as_bytes.h>
+#include <aerospike/mod_lua_bytes.h>
+#include <aerospike/mod_lua_reg.h>
+#include <citrusleaf/cf_byte_order.h>
+#include <citrusleaf/cf_hash_math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define HASH_CRC32C_SSE42 1
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define HASH_CRC32C_ARM 1
+#endif
+
+#include "internal.h"
+
+/*******************************************************************************
+ * MACROS
+ ******************************************************************************/
+
+#define OBJECT_NAME "hash"
+
+/*******************************************************************************
+ * READS
+ ******************************************************************************/
+
+static inline uint64_t hash_r64(const uint8_t * p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return cf_swap_from_le64(v);
+}
+
+static inline uint32_t hash_r32(const uint8_t * p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return cf_swap_from_le32(v);
+}
+
+static inline uint64_t hash_rotl64(uint64_t v, int r)
+{
+	return (v << r) | (v >> (64 - r));
+}
+
+static inline uint32_t hash_rotl32(uint32_t v, int r)
+{
+	return (v << r) | (v >> (32 - r));
+}
+
+/*******************************************************************************
+ * WYHASH
+ ******************************************************************************/
+
+static const uint64_t wyhash_secret[4] = {
+	0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL,
+	0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL
+};
+
+/**
+ *	128-bit product of a and b, low half in a and high half in b.
+ */
+static inline void wyhash_mum(uint64_t * a, uint64_t * b)
+{
+#if defined(__SIZEOF_INT128__)
+	__uint128_t r = (__uint128_t) *a * *b;
+	*a = (uint64_t) r;
+	*b = (uint64_t) (r >> 64);
+#else
+	uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t) *a, lb = (uint32_t) *b;
+	uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	uint64_t t = rl + (rm0 << 32), c = t < rl;
+	uint64_t lo = t + (rm1 << 32);
+	c += lo < t;
+	*a = lo;
+	*b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t wyhash_mix(uint64_t a, uint64_t b)
+{
+	wyhash_mum(&a, &b);
+	return a ^ b;
+}
+
+static inline uint64_t wyhash_r3(const uint8_t * p, size_t k)
+{
+	return ((uint64_t) p[0] << 16) | ((uint64_t) p[k >> 1] << 8) | p[k - 1];
+}
+
+/**
+ *	wyhash (final version 4.2), with the default secret.
+ */
+uint64_t mod_lua_wyhash64(const uint8_t * p, size_t len, uint64_t seed)
+{
+	const uint64_t * s = wyhash_secret;
+	uint64_t a, b;
+
+	seed ^= wyhash_mix(seed ^ s[0], s[1]);
+
+	if ( len <= 16 ) {
+		if ( len >= 4 ) {
+			a = ((uint64_t) hash_r32(p) << 32) | hash_r32(p + ((len >> 3) << 2));
+			b = ((uint64_t) hash_r32(p + len - 4) << 32) |
+					hash_r32(p + len - 4 - ((len >> 3) << 2));
+		}
+		else if ( len > 0 ) {
+			a = wyhash_r3(p, len);
+			b = 0;
+		}
+		else {
+			a = b = 0;
+		}
+	}
+	else {
+		size_t i = len;
+
+		if ( i > 48 ) {
+			uint64_t see1 = seed;
+			uint64_t see2 = seed;
+
+			do {
+				seed = wyhash_mix(hash_r64(p) ^ s[1], hash_r64(p + 8) ^ seed);
+				see1 = wyhash_mix(hash_r64(p + 16) ^ s[2], hash_r64(p + 24) ^ see1);
+				see2 = wyhash_mix(hash_r64(p + 32) ^ s[3], hash_r64(p + 40) ^ see2);
+				p += 48;
+				i -= 48;
+			} while ( i > 48 );
+
+			seed ^= see1 ^ see2;
+		}
+
+		while ( i > 16 ) {
+			seed = wyhash_mix(hash_r64(p) ^ s[1], hash_r64(p + 8) ^ seed);
+			i -= 16;
+			p += 16;
+		}
+
+		a = hash_r64(p + i - 16);
+		b = hash_r64(p + i - 8);
+	}
+
+	a ^= s[1];
+	b ^= seed;
+	wyhash_mum(&a, &b);
+	return wyhash_mix(a ^ s[0] ^ len, b ^ s[1]);
+}
+
+/*******************************************************************************
+ * MURMUR3
+ ******************************************************************************/
+
+static inline uint32_t murmur3_fmix32(uint32_t h)
+{
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+}
+
+/**
+ *	MurmurHash3_x86_32.
+ */
+static uint32_t murmur3_32(const uint8_t * p, size_t len, uint32_t seed)
+{
+	const uint32_t c1 = 0xcc9e2d51;
+	const uint32_t c2 = 0x1b873593;
+
+	uint32_t	h = seed;
+	size_t		nblocks = len / 4;
+
+	for ( size_t i = 0; i < nblocks; i++ ) {
+		uint32_t k = hash_r32(p + i * 4);
+
+		k *= c1;
+		k = hash_rotl32(k, 15);
+		k *= c2;
+
+		h ^= k;
+		h = hash_rotl32(h, 13);
+		h = h * 5 + 0xe6546b64;
+	}
+
+	const uint8_t * tail = p + nblocks * 4;
+	uint32_t k = 0;
+
+	switch ( len & 3 ) {
+		case 3:
+			k ^= (uint32_t) tail[2] << 16;
+			// fall through
+		case 2:
+			k ^= (uint32_t) tail[1] << 8;
+			// fall through
+		case 1:
+			k ^= tail[0];
+			k *= c1;
+			k = hash_rotl32(k, 15);
+			k *= c2;
+			h ^= k;
+	}
+
+	return murmur3_fmix32(h ^ (uint32_t) len);
+}
+
+/*******************************************************************************
+ * XXHASH64
+ ******************************************************************************/
+
+#define XXH_P1 0x9E3779B185EBCA87ULL
+#define XXH_P2 0xC2B2AE3D27D4EB4FULL
+#define XXH_P3 0x165667B19E3779F9ULL
+#define XXH_P4 0x85EBCA77C2B2AE63ULL
+#define XXH_P5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t xxh64_round(uint64_t acc, uint64_t v)
+{
+	acc += v * XXH_P2;
+	acc = hash_rotl64(acc, 31);
+	return acc * XXH_P1;
+}
+
+static inline uint64_t xxh64_merge(uint64_t acc, uint64_t v)
+{
+	acc ^= xxh64_round(0, v);
+	return acc * XXH_P1 + XXH_P4;
+}
+
+static uint64_t xxhash64(const uint8_t * p, size_t len, uint64_t seed)
+{
+	const uint8_t * end = p + len;
+	uint64_t h;
+
+	if ( len >= 32 ) {
+		const uint8_t * limit = end - 32;
+		uint64_t v1 = seed + XXH_P1 + XXH_P2;
+		uint64_t v2 = seed + XXH_P2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - XXH_P1;
+
+		do {
+			v1 = xxh64_round(v1, hash_r64(p));
+			v2 = xxh64_round(v2, hash_r64(p + 8));
+			v3 = xxh64_round(v3, hash_r64(p + 16));
+			v4 = xxh64_round(v4, hash_r64(p + 24));
+			p += 32;
+		} while ( p <= limit );
+
+		h = hash_rotl64(v1, 1) + hash_rotl64(v2, 7) +
+				hash_rotl64(v3, 12) + hash_rotl64(v4, 18);
+		h = xxh64_merge(h, v1);
+		h = xxh64_merge(h, v2);
+		h = xxh64_merge(h, v3);
+		h = xxh64_merge(h, v4);
+	}
+	else {
+		h = seed + XXH_P5;
+	}
+
+	h += (uint64_t) len;
+
+	for ( ; p + 8 <= end; p += 8 ) {
+		h ^= xxh64_round(0, hash_r64(p));
+		h = hash_rotl64(h, 27) * XXH_P1 + XXH_P4;
+	}
+
+	if ( p + 4 <= end ) {
+		h ^= (uint64_t) hash_r32(p) * XXH_P1;
+		h = hash_rotl64(h, 23) * XXH_P2 + XXH_P3;
+		p += 4;
+	}
+
+	for ( ; p < end; p++ ) {
+		h ^= *p * XXH_P5;
+		h = hash_rotl64(h, 11) * XXH_P1;
+	}
+
+	h ^= h >> 33;
+	h *= XXH_P2;
+	h ^= h >> 29;
+	h *= XXH_P3;
+	h ^= h >> 32;
+	return h;
+}
+
+/*******************************************************************************
+ * CRC32C
+ ******************************************************************************/
+
+// Castagnoli polynomial, reflected (0x82f63b78).
+static const uint32_t crc32c_table[256] = {
+	0x00000000, 0xf26b8303, 0xe13b70f7, 0x1350f3f4,
+	0xc79a971f, 0x35f1141c, 0x26a1e7e8, 0xd4ca64eb,
+	0x8ad958cf, 0x78b2dbcc, 0x6be22838, 0x9989ab3b,
+	0x4d43cfd0, 0xbf284cd3, 0xac78bf27, 0x5e133c24,
+	0x105ec76f, 0xe235446c, 0xf165b798, 0x030e349b,
+	0xd7c45070, 0x25afd373, 0x36ff2087, 0xc494a384,
+	0x9a879fa0, 0x68ec1ca3, 0x7bbcef57, 0x89d76c54,
+	0x5d1d08bf, 0xaf768bbc, 0xbc267848, 0x4e4dfb4b,
+	0x20bd8ede, 0xd2d60ddd, 0xc186fe29, 0x33ed7d2a,
+	0xe72719c1, 0x154c9ac2, 0x061c6936, 0xf477ea35,
+	0xaa64d611, 0x580f5512, 0x4b5fa6e6, 0xb93425e5,
+	0x6dfe410e, 0x9f95c20d, 0x8cc531f9, 0x7eaeb2fa,
+	0x30e349b1, 0xc288cab2, 0xd1d83946, 0x23b3ba45,
+	0xf779deae, 0x05125dad, 0x1642ae59, 0xe4292d5a,
+	0xba3a117e, 0x4851927d, 0x5b016189, 0xa96ae28a,
+	0x7da08661, 0x8fcb0562, 0x9c9bf696, 0x6ef07595,
+	0x417b1dbc, 0xb3109ebf, 0xa0406d4b, 0x522bee48,
+	0x86e18aa3, 0x748a09a0, 0x67dafa54, 0x95b17957,
+	0xcba24573, 0x39c9c670, 0x2a993584, 0xd8f2b687,
+	0x0c38d26c, 0xfe53516f, 0xed03a29b, 0x1f682198,
+	0x5125dad3, 0xa34e59d0, 0xb01eaa24, 0x42752927,
+	0x96bf4dcc, 0x64d4cecf, 0x77843d3b, 0x85efbe38,
+	0xdbfc821c, 0x2997011f, 0x3ac7f2eb, 0xc8ac71e8,
+	0x1c661503, 0xee0d9600, 0xfd5d65f4, 0x0f36e6f7,
+	0x61c69362, 0x93ad1061, 0x80fde395, 0x72966096,
+	0xa65c047d, 0x5437877e, 0x4767748a, 0xb50cf789,
+	0xeb1fcbad, 0x197448ae, 0x0a24bb5a, 0xf84f3859,
+	0x2c855cb2, 0xdeeedfb1, 0xcdbe2c45, 0x3fd5af46,
+	0x7198540d, 0x83f3d70e, 0x90a324fa, 0x62c8a7f9,
+	0xb602c312, 0x44694011, 0x5739b3e5, 0xa55230e6,
+	0xfb410cc2, 0x092a8fc1, 0x1a7a7c35, 0xe811ff36,
+	0x3cdb9bdd, 0xceb018de, 0xdde0eb2a, 0x2f8b6829,
+	0x82f63b78, 0x709db87b, 0x63cd4b8f, 0x91a6c88c,
+	0x456cac67, 0xb7072f64, 0xa457dc90, 0x563c5f93,
+	0x082f63b7, 0xfa44e0b4, 0xe9141340, 0x1b7f9043,
+	0xcfb5f4a8, 0x3dde77ab, 0x2e8e845f, 0xdce5075c,
+	0x92a8fc17, 0x60c37f14, 0x73938ce0, 0x81f80fe3,
+	0x55326b08, 0xa759e80b, 0xb4091bff, 0x466298fc,
+	0x1871a4d8, 0xea1a27db, 0xf94ad42f, 0x0b21572c,
+	0xdfeb33c7, 0x2d80b0c4, 0x3ed04330, 0xccbbc033,
+	0xa24bb5a6, 0x502036a5, 0x4370c551, 0xb11b4652,
+	0x65d122b9, 0x97baa1ba, 0x84ea524e, 0x7681d14d,
+	0x2892ed69, 0xdaf96e6a, 0xc9a99d9e, 0x3bc21e9d,
+	0xef087a76, 0x1d63f975, 0x0e330a81, 0xfc588982,
+	0xb21572c9, 0x407ef1ca, 0x532e023e, 0xa145813d,
+	0x758fe5d6, 0x87e466d5, 0x94b49521, 0x66df1622,
+	0x38cc2a06, 0xcaa7a905, 0xd9f75af1, 0x2b9cd9f2,
+	0xff56bd19, 0x0d3d3e1a, 0x1e6dcdee, 0xec064eed,
+	0xc38d26c4, 0x31e6a5c7, 0x22b65633, 0xd0ddd530,
+	0x0417b1db, 0xf67c32d8, 0xe52cc12c, 0x1747422f,
+	0x49547e0b, 0xbb3ffd08, 0xa86f0efc, 0x5a048dff,
+	0x8ecee914, 0x7ca56a17, 0x6ff599e3, 0x9d9e1ae0,
+	0xd3d3e1ab, 0x21b862a8, 0x32e8915c, 0xc083125f,
+	0x144976b4, 0xe622f5b7, 0xf5720643, 0x07198540,
+	0x590ab964, 0xab613a67, 0xb831c993, 0x4a5a4a90,
+	0x9e902e7b, 0x6cfbad78, 0x7fab5e8c, 0x8dc0dd8f,
+	0xe330a81a, 0x115b2b19, 0x020bd8ed, 0xf0605bee,
+	0x24aa3f05, 0xd6c1bc06, 0xc5914ff2, 0x37faccf1,
+	0x69e9f0d5, 0x9b8273d6, 0x88d28022, 0x7ab90321,
+	0xae7367ca, 0x5c18e4c9, 0x4f48173d, 0xbd23943e,
+	0xf36e6f75, 0x0105ec76, 0x12551f82, 0xe03e9c81,
+	0x34f4f86a, 0xc69f7b69, 0xd5cf889d, 0x27a40b9e,
+	0x79b737ba, 0x8bdcb4b9, 0x988c474d, 0x6ae7c44e,
+	0xbe2da0a5, 0x4c4623a6, 0x5f16d052, 0xad7d5351,
+};
+
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t * p, size_t len)
+{
+	for ( size_t i = 0; i < len; i++ ) {
+		crc = crc32c_table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+	}
+	return crc;
+}
+
+#if defined(HASH_CRC32C_SSE42)
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t * p, size_t len)
+{
+	uint64_t c = crc;
+
+	for ( ; len >= 8; len -= 8, p += 8 ) {
+		uint64_t v;
+		memcpy(&v, p, sizeof(v));
+		c = _mm_crc32_u64(c, v);
+	}
+
+	uint32_t c32 = (uint32_t) c;
+
+	for ( ; len > 0; len--, p++ ) {
+		c32 = _mm_crc32_u8(c32, *p);
+	}
+
+	return c32;
+}
+
+#elif defined(HASH_CRC32C_ARM)
+
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t * p, size_t len)
+{
+	for ( ; len >= 8; len -= 8, p += 8 ) {
+		uint64_t v;
+		memcpy(&v, p, sizeof(v));
+		crc = __crc32cd(crc, v);
+	}
+
+	for ( ; len > 0; len--, p++ ) {
+		crc = __crc32cb(crc, *p);
+	}
+
+	return crc;
+}
+
+#endif
+
+/**
+ *	Continue crc (a finished CRC-32C, 0 to start) over len more bytes. Uses the
+ *	CPU's CRC32 instructions where there are any.
+ */
+static uint32_t crc32c(uint32_t crc, const uint8_t * p, size_t len)
+{
+	crc = ~crc;
+
+#if defined(HASH_CRC32C_SSE42)
+	if ( __builtin_cpu_supports("sse4.2") ) {
+		return ~crc32c_hw(crc, p, len);
+	}
+#elif defined(HASH_CRC32C_ARM)
+	return ~crc32c_hw(crc, p, len);
+#endif
+
+	return ~crc32c_sw(crc, p, len);
+}
+
+/*******************************************************************************
+ * FUNCTIONS
+ ******************************************************************************/
+
+/**
+ *	The data at index, which may be a string, bytes or a bytes slice. Nothing
+ *	is copied.
+ */
+static const uint8_t * mod_lua_hash_checkdata(lua_State * l, int index, size_t * len)
+{
+	if ( lua_type(l, index) == LUA_TSTRING ) {
+		return (const uint8_t *) lua_tolstring(l, index, len);
+	}
+
+	as_bytes * b = mod_lua_toview(l, index);
+
+	if ( !b ) {
+		mod_lua_typerror(l, index, "string or bytes");
+		return NULL;
+	}
+
+	*len = b->size;
+	return b->value;
+}
+
+/**
+ *	The 32-bit wyhash the server uses.
+ *
+ *	----------{.c}
+ *	uint32 hash.wyhash32(string|bytes data)
+ *	----------
+ */
+static int mod_lua_hash_wyhash32(lua_State * l)
+{
+	size_t len;
+	const uint8_t * p = mod_lua_hash_checkdata(l, 1, &len);
+
+	lua_pushinteger(l, (lua_Integer) cf_wyhash32(p, len));
+	return 1;
+}
+
+/**
+ *	64-bit wyhash. 64-bit results are returned as the integer with the same
+ *	bits, so may be negative.
+ *
+ *	----------{.c}
+ *	int64 hash.wyhash64(string|bytes data [, int64 seed])
+ *	----------
+ */
+static int mod_lua_hash_wyhash64(lua_State * l)
+{
+	size_t len;
+	const uint8_t * p = mod_lua_hash_checkdata(l, 1, &len);
+	uint64_t seed = (uint64_t) luaL_optinteger(l, 2, 0);
+
+	lua_pushinteger(l, (lua_Integer) mod_lua_wyhash64(p, len, seed));
+	return 1;
+}
+
+/**
+ *	32-bit MurmurHash3 (x86_32).
+ *
+ *	----------{.c}
+ *	uint32 hash.murmur3(string|bytes data [, uint32 seed])
+ *	----------
+ */
+static int mod_lua_hash_murmur3(lua_State * l)
+{
+	size_t len;
+	const uint8_t * p = mod_lua_hash_checkdata(l, 1, &len);
+	uint32_t seed = (uint32_t) luaL_optinteger(l, 2, 0);
+
+	lua_pushinteger(l, (lua_Integer) murmur3_32(p, len, seed));
+	return 1;
+}
+
+/**
+ *	XXH64.
+ *
+ *	----------{.c}
+ *	int64 hash.xxhash64(string|bytes data [, int64 seed])
+ *	----------
+ */
+static int mod_lua_hash_xxhash64(lua_State * l)
+{
+	size_t len;
+	const uint8_t * p = mod_lua_hash_checkdata(l, 1, &len);
+	uint64_t seed = (uint64_t) luaL_optinteger(l, 2, 0);
+
+	lua_pushinteger(l, (lua_Integer) xxhash64(p, len, seed));
+	return 1;
+}
+
+/**
+ *	CRC-32C. Pass the result for earlier data as crc to continue it.
+ *
+ *	----------{.c}
+ *	uint32 hash.crc32c(string|bytes data [, uint32 crc])
+ *	----------
+ */
+static int mod_lua_hash_crc32c(lua_State * l)
+{
+	size_t len;
+	const uint8_t * p = mod_lua_hash_checkdata(l, 1, &len);
+	uint32_t crc = (uint32_t) luaL_optinteger(l, 2, 0);
+
+	lua_pushinteger(l, (lua_Integer) crc32c(crc, p, len));
+	return 1;
+}
+
+/******************************************************************************
+ * OBJECT TABLE
+ *****************************************************************************/
+
+static const luaL_Reg object_table[] = {
+	{"wyhash32",        mod_lua_hash_wyhash32},
+	{"wyhash64",        mod_lua_hash_wyhash64},
+	{"murmur3",         mod_lua_hash_murmur3},
+	{"xxhash64",        mod_lua_hash_xxhash64},
+	{"crc32c",          mod_lua_hash_crc32c},
+	{0, 0}
+};
+
+static const luaL_Reg object_metatable[] = {
+	{0, 0}
+};
+
+/******************************************************************************
+ * REGISTER
+ *****************************************************************************/
+
+int mod_lua_hash_register(lua_State * l) {
+	mod_lua_reg_object(l, OBJECT_NAME, object_table, object_metatable);
+	return 1;
+}
@@ -15,16 +15,18 @@
  * the License.
  */
 #include <aerospike/mod_lua_list.h>
+#include <aerospike/as_arraylist.h>
 #include <aerospike/as_iterator.h>
 #include <aerospike/as_list.h>
 #include <aerospike/as_list_iterator.h>
 #include <aerospike/as_msgpack.h>
-#include <aerospike/as_serializer.h>
+#include <aerospike/as_nil.h>
 #include <aerospike/as_val.h>
 #include <aerospike/mod_lua_val.h>
 #include <aerospike/mod_lua_iterator.h>
 #include <aerospike/mod_lua_reg.h>
 #include <citrusleaf/alloc.h>
+#include <string.h>
 
 #include "internal.h"
 
@@ -34,6 +36,7 @@
 
 #define OBJECT_NAME "list"
 #define CLASS_NAME  "List"
+#define HELD_CLASS_NAME "ListHeld"
 
 /*******************************************************************************
  * FUNCTIONS
@@ -78,7 +81,14 @@ static int mod_lua_list_insert(lua_State * l) {
 			// increases ref, correct - held by box and this list
 			as_val * value = valid_list_val(mod_lua_toval(l, 3));
 			if (value) {
-				as_list_insert(list, (uint32_t)idx - 1, value);
+				// Inserting past the end pads the list with nils.
+				bool padded = (uint32_t)idx - 1 > as_list_size(list);
+				if (as_list_insert(list, (uint32_t)idx - 1, value) == 0 && ! padded) {
+					mod_lua_nbytes_adjust(l, (as_val *) list, value, NULL);
+				}
+				else {
+					mod_lua_nbytes_forget(l, (as_val *) list);
+				}
 			}
 		}
 	}
@@ -90,8 +100,8 @@ static int mod_lua_list_append(lua_State * l) {
 	if ( list ) {
 		// increases ref, correct - held by box and this list
 		as_val * value = valid_list_val(mod_lua_toval(l, 2));
-		if ( value ) {
-			as_list_append(list,value);
+		if ( value && as_list_append(list,value) == 0 ) {
+			mod_lua_nbytes_adjust(l, (as_val *) list, value, NULL);
 		}
 	}
 	return 0;
@@ -101,8 +111,8 @@ static int mod_lua_list_prepend(lua_State * l) {
 	as_list * list = mod_lua_checklist(l, 1);
 	if ( list ) {
 		as_val * value = valid_list_val(mod_lua_toval(l, 2));
-		if ( value ) {
-			as_list_prepend(list,value);
+		if ( value && as_list_prepend(list,value) == 0 ) {
+			mod_lua_nbytes_adjust(l, (as_val *) list, value, NULL);
 		}
 	}
 	return 0;
@@ -114,7 +124,13 @@ static int mod_lua_list_remove(lua_State * l) {
 		lua_Integer idx = luaL_optinteger(l, 2, 0);
 		// Lua index is 1-based.
 		if (idx > 0) {
-			as_list_remove(list, (uint32_t)idx - 1);
+			as_val * old = as_list_get(list, (uint32_t)idx - 1);
+			if (old) {
+				mod_lua_nbytes_adjust(l, (as_val *) list, NULL, old);
+			}
+			if (as_list_remove(list, (uint32_t)idx - 1) != 0) {
+				mod_lua_nbytes_forget(l, (as_val *) list);
+			}
 		}
 	}
 	return 0;
@@ -126,6 +142,7 @@ static int mod_lua_list_concat(lua_State * l) {
 		as_list * list2 = mod_lua_checklist(l, 2);
 		if (list2) {
 			as_list_concat(list, list2);
+			mod_lua_nbytes_forget(l, (as_val *) list);
 		}
 	}
 	return 0;
@@ -138,6 +155,7 @@ static int mod_lua_list_trim(lua_State * l) {
 		// Lua index is 1-based.
 		if (idx > 0) {
 			as_list_trim(list, (uint32_t)idx - 1);
+			mod_lua_nbytes_forget(l, (as_val *) list);
 		}
 	}
 	return 0;
@@ -204,10 +222,7 @@ static int mod_lua_list_nbytes(lua_State * l) {
 	uint32_t nbytes = 0;
 
 	if ( list ) {
-		as_serializer s;
-		as_msgpack_init(&s);
-		nbytes = as_serializer_serialize_getsize(&s, (as_val *) list);
-		as_serializer_destroy(&s);
+		nbytes = mod_lua_nbytes(l, (as_val *) list);
 	}
 	lua_pushinteger(l, nbytes);
 	return 1;
@@ -290,7 +305,18 @@ static int mod_lua_list_newindex(lua_State * l) {
 		if (idx > 0) { // Lua is 1 index, C is 0
 			as_val * val = valid_list_val(mod_lua_takeval(l, 3));
 			if ( val ) {
-				as_list_set(list, idx - 1, val);
+				// Setting past the end pads the list with nils.
+				uint32_t size = as_list_size(list);
+				as_val * old = idx - 1 < size ? as_list_get(list, idx - 1) : NULL;
+				if ( idx - 1 <= size && mod_lua_nbytes_tracked(l, (as_val *) list) ) {
+					mod_lua_nbytes_adjust(l, (as_val *) list, val, old);
+				}
+				else {
+					mod_lua_nbytes_forget(l, (as_val *) list);
+				}
+				if ( as_list_set(list, idx - 1, val) != 0 ) {
+					mod_lua_nbytes_forget(l, (as_val *) list);
+				}
 			}
 		}
 	}
@@ -364,6 +390,610 @@ static int mod_lua_list_iterator(lua_State * l) {
 }
 
 
+/******************************************************************************
+ * REDUCTIONS
+ *****************************************************************************/
+
+/**
+ * Call fn for each element of list, stopping if it returns false. An
+ * arraylist's storage is walked directly, rather than through its hooks.
+ */
+static void mod_lua_list_walk(const as_list * list, as_list_foreach_callback fn, void * udata) {
+	if ( list->hooks == &as_arraylist_list_hooks ) {
+		const as_arraylist * a = (const as_arraylist *) list;
+		for ( uint32_t i = 0; i < a->size; i++ ) {
+			if ( ! fn(a->elements[i], udata) ) {
+				return;
+			}
+		}
+		return;
+	}
+	as_list_foreach(list, fn, udata);
+}
+
+/**
+ * Running totals of the numbers in a list. Elements that aren't integers or
+ * doubles are skipped.
+ */
+typedef struct {
+	uint32_t        count;
+	bool            is_double;  // the sum is in dsum
+	int64_t         isum;
+	double          dsum;
+	const as_val *  min;
+	const as_val *  max;
+} list_stats;
+
+static inline double list_num_todouble(const as_val * v) {
+	return as_val_type(v) == AS_INTEGER ?
+			(double) ((as_integer *) v)->value : ((as_double *) v)->value;
+}
+
+/**
+ * Compare two numbers, exactly if both are integers.
+ */
+static inline int list_num_cmp(const as_val * a, const as_val * b) {
+	if ( as_val_type(a) == AS_INTEGER && as_val_type(b) == AS_INTEGER ) {
+		int64_t x = ((as_integer *) a)->value;
+		int64_t y = ((as_integer *) b)->value;
+		return x < y ? -1 : x > y;
+	}
+	double x = list_num_todouble(a);
+	double y = list_num_todouble(b);
+	return x < y ? -1 : x > y;
+}
+
+static bool list_stats_add(as_val * v, void * udata) {
+	list_stats * s = (list_stats *) udata;
+
+	if ( v == NULL ) {
+		return true;
+	}
+
+	switch ( as_val_type(v) ) {
+		case AS_INTEGER: {
+			int64_t x = ((as_integer *) v)->value;
+			if ( s->is_double ) {
+				s->dsum += (double) x;
+			}
+			else if ( (x > 0 && s->isum > INT64_MAX - x) ||
+					(x < 0 && s->isum < INT64_MIN - x) ) {
+				// the integer sum would overflow, so carry on in double
+				s->is_double = true;
+				s->dsum = (double) s->isum + (double) x;
+			}
+			else {
+				s->isum += x;
+			}
+			break;
+		}
+		case AS_DOUBLE: {
+			double x = ((as_double *) v)->value;
+			if ( x != x ) {
+				// NaN has no place in min/max
+				return true;
+			}
+			if ( ! s->is_double ) {
+				s->is_double = true;
+				s->dsum = (double) s->isum;
+			}
+			s->dsum += x;
+			break;
+		}
+		default:
+			return true;
+	}
+
+	if ( s->count == 0 || list_num_cmp(v, s->min) < 0 ) {
+		s->min = v;
+	}
+	if ( s->count == 0 || list_num_cmp(v, s->max) > 0 ) {
+		s->max = v;
+	}
+	s->count++;
+	return true;
+}
+
+static list_stats * mod_lua_list_stats(lua_State * l, list_stats * s) {
+	as_list * list = mod_lua_checklist(l, 1);
+	memset(s, 0, sizeof(list_stats));
+	if ( list ) {
+		mod_lua_list_walk(list, list_stats_add, s);
+	}
+	return s;
+}
+
+/**
+ * USAGE:
+ *	list.sum(l)
+ *
+ * Sum of the numbers in the list, an integer if all are integers and the sum
+ * fits. Other elements are skipped.
+ */
+static int mod_lua_list_sum(lua_State * l) {
+	list_stats s;
+	mod_lua_list_stats(l, &s);
+	if ( s.is_double ) {
+		lua_pushnumber(l, s.dsum);
+	}
+	else {
+		lua_pushinteger(l, s.isum);
+	}
+	return 1;
+}
+
+/**
+ * USAGE:
+ *	list.mean(l)
+ *
+ * Mean of the numbers in the list, or nil if there are none.
+ */
+static int mod_lua_list_mean(lua_State * l) {
+	list_stats s;
+	mod_lua_list_stats(l, &s);
+	if ( s.count == 0 ) {
+		return 0;
+	}
+	lua_pushnumber(l, (s.is_double ? s.dsum : (double) s.isum) / s.count);
+	return 1;
+}
+
+/**
+ * USAGE:
+ *	list.min(l)
+ *
+ * Smallest number in the list, or nil if there are none.
+ */
+static int mod_lua_list_min(lua_State * l) {
+	list_stats s;
+	mod_lua_list_stats(l, &s);
+	if ( s.count == 0 ) {
+		return 0;
+	}
+	return mod_lua_pushval(l, s.min);
+}
+
+/**
+ * USAGE:
+ *	list.max(l)
+ *
+ * Largest number in the list, or nil if there are none.
+ */
+static int mod_lua_list_max(lua_State * l) {
+	list_stats s;
+	mod_lua_list_stats(l, &s);
+	if ( s.count == 0 ) {
+		return 0;
+	}
+	return mod_lua_pushval(l, s.max);
+}
+
+/**
+ * USAGE:
+ *	local lo, hi = list.minmax(l)
+ *
+ * Smallest and largest numbers in the list, from one pass, or nil if there
+ * are none.
+ */
+static int mod_lua_list_minmax(lua_State * l) {
+	list_stats s;
+	mod_lua_list_stats(l, &s);
+	if ( s.count == 0 ) {
+		return 0;
+	}
+	mod_lua_pushval(l, s.min);
+	mod_lua_pushval(l, s.max);
+	return 2;
+}
+
+typedef struct {
+	const double *  bounds;
+	uint32_t        n_bounds;
+	int64_t *       counts;
+} list_histogram;
+
+static bool list_histogram_add(as_val * v, void * udata) {
+	list_histogram * h = (list_histogram *) udata;
+
+	if ( v == NULL || (as_val_type(v) != AS_INTEGER && as_val_type(v) != AS_DOUBLE) ) {
+		return true;
+	}
+
+	double x = list_num_todouble(v);
+	if ( x != x ) {
+		return true;
+	}
+
+	// the bucket is the number of bounds <= x
+	uint32_t lo = 0;
+	uint32_t hi = h->n_bounds;
+	while ( lo < hi ) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if ( h->bounds[mid] <= x ) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+
+	h->counts[lo]++;
+	return true;
+}
+
+/**
+ * USAGE:
+ *	list.histogram(l, bounds)
+ *
+ * Count the numbers in the list by bucket. bounds is a table or list of n
+ * ascending numbers, and the result is a list of n + 1 counts: the numbers
+ * below bounds[1], those from bounds[i] up to bounds[i + 1], and those from
+ * bounds[n] up. Returns nil if bounds isn't ascending.
+ */
+static int mod_lua_list_histogram(lua_State * l) {
+	as_list * list = mod_lua_checklist(l, 1);
+	as_list * blist = NULL;
+	uint32_t n = 0;
+
+	if ( lua_type(l, 2) == LUA_TTABLE ) {
+		lua_Integer len = luaL_len(l, 2);
+		if ( len < 0 || len >= UINT32_MAX ) {
+			return 0;
+		}
+		n = (uint32_t) len;
+	}
+	else {
+		blist = mod_lua_checklist(l, 2);
+		n = blist ? as_list_size(blist) : 0;
+	}
+
+	double * bounds = (double *) cf_malloc(sizeof(double) * (n ? n : 1));
+	int64_t * counts = (int64_t *) cf_calloc(n + 1, sizeof(int64_t));
+	bool ok = bounds && counts && list;
+
+	for ( uint32_t i = 0; ok && i < n; i++ ) {
+		if ( blist ) {
+			as_val * b = as_list_get(blist, i);
+			ok = b && (as_val_type(b) == AS_INTEGER || as_val_type(b) == AS_DOUBLE);
+			bounds[i] = ok ? list_num_todouble(b) : 0;
+		}
+		else {
+			lua_rawgeti(l, 2, i + 1);
+			ok = lua_type(l, -1) == LUA_TNUMBER;
+			bounds[i] = (double) lua_tonumber(l, -1);
+			lua_pop(l, 1);
+		}
+		ok = ok && (i == 0 || bounds[i - 1] < bounds[i]);
+	}
+
+	if ( ok ) {
+		list_histogram h = { bounds, n, counts };
+		mod_lua_list_walk(list, list_histogram_add, &h);
+
+		as_arraylist * result = as_arraylist_new(n + 1, 0);
+		for ( uint32_t i = 0; i <= n; i++ ) {
+			as_arraylist_append_int64(result, counts[i]);
+		}
+		mod_lua_pushlist(l, (as_list *) result);
+	}
+
+	cf_free(bounds);
+	cf_free(counts);
+	return ok ? 1 : 0;
+}
+
+/******************************************************************************
+ * ORDERING
+ *****************************************************************************/
+
+/**
+ * How list elements are ordered: natively, or by a Lua function at stack
+ * index fn returning true when its first argument goes before its second.
+ */
+typedef struct {
+	lua_State *     l;
+	int             fn;
+} list_order;
+
+static inline bool list_order_less(const list_order * o, const as_val * a, const as_val * b) {
+	if ( a == NULL ) {
+		a = (const as_val *) &as_nil;
+	}
+	if ( b == NULL ) {
+		b = (const as_val *) &as_nil;
+	}
+	if ( o->fn == 0 ) {
+		return as_val_cmp(a, b) == MSGPACK_COMPARE_LESS;
+	}
+	lua_pushvalue(o->l, o->fn);
+	mod_lua_pushval(o->l, a);
+	mod_lua_pushval(o->l, b);
+	lua_call(o->l, 2, 1);
+	bool less = lua_toboolean(o->l, -1);
+	lua_pop(o->l, 1);
+	return less;
+}
+
+/**
+ * References to values, held while a Lua comparison runs. The userdata is a
+ * to-be-closed variable, so the values are released however the call ends.
+ */
+typedef struct {
+	uint32_t        n;
+	as_val *        vals[];
+} list_held;
+
+static int list_held_close(lua_State * l) {
+	list_held * h = (list_held *) luaL_checkudata(l, 1, HELD_CLASS_NAME);
+	for ( uint32_t i = 0; i < h->n; i++ ) {
+		as_val_destroy(h->vals[i]);
+	}
+	h->n = 0;
+	return 0;
+}
+
+/**
+ * Push a to-be-closed list_held with room for size values, holding none.
+ */
+static list_held * list_pushheld(lua_State * l, uint32_t size) {
+	list_held * h = (list_held *) lua_newuserdatauv(l, sizeof(list_held) + size * sizeof(as_val *), 0);
+	h->n = 0;
+	luaL_setmetatable(l, HELD_CLASS_NAME);
+	lua_toclose(l, -1);
+	return h;
+}
+
+/**
+ * Stable merge sort of vals, with tmp as scratch space of the same size.
+ * A Lua comparison may raise an error at any point, so vals is only ever
+ * changed by whole moves, and always holds every element exactly once.
+ */
+static void list_sort_range(const list_order * o, as_val ** vals, as_val ** tmp, uint32_t n) {
+	if ( n <= 16 ) {
+		// binary insertion sort, comparing before moving anything
+		for ( uint32_t i = 1; i < n; i++ ) {
+			as_val * v = vals[i];
+			uint32_t lo = 0;
+			uint32_t hi = i;
+			while ( lo < hi ) {
+				uint32_t mid = lo + (hi - lo) / 2;
+				if ( list_order_less(o, v, vals[mid]) ) {
+					hi = mid;
+				}
+				else {
+					lo = mid + 1;
+				}
+			}
+			if ( lo < i ) {
+				memmove(&vals[lo + 1], &vals[lo], (i - lo) * sizeof(as_val *));
+				vals[lo] = v;
+			}
+		}
+		return;
+	}
+
+	uint32_t mid = n / 2;
+	list_sort_range(o, vals, tmp, mid);
+	list_sort_range(o, vals + mid, tmp, n - mid);
+
+	// already in order, as when an ordered list has had a few appends
+	if ( ! list_order_less(o, vals[mid], vals[mid - 1]) ) {
+		return;
+	}
+
+	uint32_t i = 0;
+	uint32_t j = mid;
+	uint32_t k = 0;
+	while ( i < mid && j < n ) {
+		if ( list_order_less(o, vals[j], vals[i]) ) {
+			tmp[k++] = vals[j++];
+		}
+		else {
+			tmp[k++] = vals[i++];
+		}
+	}
+	// what's left of the left half goes last, and of the right is in place
+	memcpy(&tmp[k], &vals[i], (mid - i) * sizeof(as_val *));
+	memcpy(vals, tmp, (k + mid - i) * sizeof(as_val *));
+}
+
+/**
+ * USAGE:
+ *	list.sort(l [, cmp])
+ *
+ * Sort the list in place, in the server's native order of values (by type,
+ * then by value), or by cmp as with table.sort(). The sort is stable. An
+ * error is raised if cmp changes the size of the list.
+ */
+static int mod_lua_list_sort(lua_State * l) {
+	as_list * list = mod_lua_checklist(l, 1);
+	list_order o = { l, 0 };
+
+	if ( ! lua_isnoneornil(l, 2) ) {
+		luaL_checktype(l, 2, LUA_TFUNCTION);
+		o.fn = 2;
+	}
+
+	uint32_t n = list ? as_list_size(list) : 0;
+	if ( n < 2 ) {
+		return 0;
+	}
+
+	if ( o.fn != 0 ) {
+		// cmp may change the list, so sort held references to its elements
+		list_held * h = list_pushheld(l, n * 2);
+		as_val ** vals = h->vals;
+		for ( ; h->n < n; h->n++ ) {
+			vals[h->n] = as_list_get(list, h->n);
+			as_val_reserve(vals[h->n]);
+		}
+		list_sort_range(&o, vals, vals + n, n);
+		if ( as_list_size(list) != n ) {
+			return luaL_error(l, "list changed size during sort");
+		}
+		// each set takes over a reference
+		for ( uint32_t i = 0; i < n; i++ ) {
+			if ( as_list_set(list, i, vals[i]) != 0 ) {
+				as_val_destroy(vals[i]);
+			}
+		}
+		h->n = 0;
+		// cmp may have changed elements the sort has now put back
+		mod_lua_nbytes_forget(l, (as_val *) list);
+		lua_pop(l, 1);
+		return 0;
+	}
+
+	// nothing else runs during a native sort, so elements can be borrowed
+	bool direct = list->hooks == &as_arraylist_list_hooks;
+	as_val ** tmp = (as_val **) lua_newuserdatauv(l, (direct ? n : n * 2) * sizeof(as_val *), 0);
+
+	if ( direct ) {
+		list_sort_range(&o, ((as_arraylist *) list)->elements, tmp, n);
+	}
+	else {
+		// sort borrowed elements, then put them back in their new order
+		as_val ** vals = tmp + n;
+		for ( uint32_t i = 0; i < n; i++ ) {
+			vals[i] = as_list_get(list, i);
+		}
+		list_sort_range(&o, vals, tmp, n);
+		for ( uint32_t i = 0; i < n; i++ ) {
+			as_val_reserve(vals[i]);
+		}
+		for ( uint32_t i = 0; i < n; i++ ) {
+			as_list_set(list, i, vals[i]);
+		}
+	}
+
+	lua_pop(l, 1);
+	return 0;
+}
+
+/**
+ * USAGE:
+ *	local i, found = list.bsearch(l, v [, cmp])
+ *
+ * Binary search a sorted list for v, in the same order as list.sort(). The
+ * index returned is that of the first element not before v, which is where
+ * v would be inserted, and found is true if that element is equal to v. An
+ * error is raised if cmp changes the size of the list.
+ */
+static int mod_lua_list_bsearch(lua_State * l) {
+	as_list * list = mod_lua_checklist(l, 1);
+	list_order o = { l, 0 };
+
+	luaL_checkany(l, 2);
+	if ( ! lua_isnoneornil(l, 3) ) {
+		luaL_checktype(l, 3, LUA_TFUNCTION);
+		o.fn = 3;
+	}
+
+	uint32_t n = list ? as_list_size(list) : 0;
+	mod_lua_tmpval tmp;
+	as_val * v = NULL;
+	as_val ** vals = NULL;
+
+	if ( o.fn != 0 ) {
+		// cmp may raise an error, so hold v, and may change the list, so
+		// look each element up afresh
+		v = mod_lua_toval(l, 2);
+		if ( v == NULL ) {
+			return 0;
+		}
+		list_held * h = list_pushheld(l, 1);
+		h->vals[h->n++] = v;
+	}
+	else {
+		v = mod_lua_toval_tmp(l, 2, &tmp);
+		if ( v == NULL ) {
+			return 0;
+		}
+		if ( n > 0 && list->hooks == &as_arraylist_list_hooks ) {
+			vals = ((as_arraylist *) list)->elements;
+		}
+	}
+
+	uint32_t lo = 0;
+	uint32_t hi = n;
+	while ( lo < hi ) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		as_val * e = vals ? vals[mid] : as_list_get(list, mid);
+		bool less = list_order_less(&o, e, v);
+		if ( o.fn != 0 && as_list_size(list) != n ) {
+			return luaL_error(l, "list changed size during bsearch");
+		}
+		if ( less ) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+
+	bool found = lo < n &&
+			! list_order_less(&o, v, vals ? vals[lo] : as_list_get(list, lo));
+
+	if ( o.fn != 0 ) {
+		// releases v
+		lua_pop(l, 1);
+	}
+	else {
+		as_val_destroy(v);
+	}
+
+	// Lua index is 1-based.
+	lua_pushinteger(l, (lua_Integer) lo + 1);
+	lua_pushboolean(l, found);
+	return 2;
+}
+
+/**
+ * USAGE:
+ *	list.slice(l, i [, j])
+ *
+ * A new list of elements i through j of l, which defaults to the end of the
+ * list. Negative indexes count back from the end, as with string.sub(). The
+ * new list shares the elements of l rather than copying them.
+ */
+static int mod_lua_list_slice(lua_State * l) {
+	as_list * list = mod_lua_checklist(l, 1);
+	lua_Integer n = list ? (lua_Integer) as_list_size(list) : 0;
+	lua_Integer i = luaL_checkinteger(l, 2);
+	lua_Integer j = luaL_optinteger(l, 3, -1);
+
+	if ( i < 0 ) {
+		i = i < -n ? 1 : n + i + 1;
+	}
+	else if ( i == 0 ) {
+		i = 1;
+	}
+	if ( j < 0 ) {
+		j = n + j + 1;
+	}
+	else if ( j > n ) {
+		j = n;
+	}
+
+	uint32_t count = i <= j ? (uint32_t) (j - i + 1) : 0;
+	as_arraylist * sub = as_arraylist_new(count, 10);
+
+	if ( count > 0 ) {
+		as_val ** vals = NULL;
+		if ( list->hooks == &as_arraylist_list_hooks ) {
+			vals = ((as_arraylist *) list)->elements;
+		}
+		for ( uint32_t k = (uint32_t) i - 1; k < (uint32_t) j; k++ ) {
+			as_val * v = vals ? vals[k] : as_list_get(list, k);
+			as_val_reserve(v);
+			as_arraylist_append(sub, v);
+		}
+	}
+
+	mod_lua_pushlist(l, (as_list *) sub);
+	return 1;
+}
+
 /******************************************************************************
  * OBJECT TABLE
  *****************************************************************************/
@@ -381,6 +1011,15 @@ static const luaL_Reg object_table[] = {
 	{"drop",            mod_lua_list_drop},
 	{"size",            mod_lua_list_size},
 	{"nbytes",          mod_lua_list_nbytes},
+	{"sum",             mod_lua_list_sum},
+	{"mean",            mod_lua_list_mean},
+	{"min",             mod_lua_list_min},
+	{"max",             mod_lua_list_max},
+	{"minmax",          mod_lua_list_minmax},
+	{"histogram",       mod_lua_list_histogram},
+	{"sort",            mod_lua_list_sort},
+	{"bsearch",         mod_lua_list_bsearch},
+	{"slice",           mod_lua_list_slice},
 	{"iterator",        mod_lua_list_iterator},
 	{"tostring",        mod_lua_list_tostring},
 	{0, 0}
@@ -410,6 +1049,11 @@ static const luaL_Reg class_metatable[] = {
 	{0, 0}
 };
 
+static const luaL_Reg held_class_metatable[] = {
+	{"__close",         list_held_close},
+	{0, 0}
+};
+
 /******************************************************************************
  * REGISTER
  *****************************************************************************/
@@ -417,5 +1061,6 @@ static const luaL_Reg class_metatable[] = {
 int mod_lua_list_register(lua_State * l) {
 	mod_lua_reg_object(l, OBJECT_NAME, object_table, object_metatable);
 	mod_lua_reg_class(l, CLASS_NAME, NULL, class_metatable);
+	mod_lua_reg_class(l, HELD_CLASS_NAME, NULL, held_class_metatable);
 	return 1;
 }
@@ -17,8 +17,6 @@
 #include <aerospike/mod_lua_map.h>
 #include <aerospike/as_iterator.h>
 #include <aerospike/as_map_iterator.h>
-#include <aerospike/as_msgpack.h>
-#include <aerospike/as_serializer.h>
 #include <aerospike/as_val.h>
 #include <aerospike/mod_lua_iterator.h>
 #include <aerospike/mod_lua_reg.h>
@@ -59,6 +57,22 @@ static int mod_lua_map_gc(lua_State * l) {
 
 
 
+/**
+ * Remove key from the map, keeping its tracked size current.
+ */
+static void mod_lua_map_unset(lua_State * l, as_map * map, const as_val * key) {
+	if ( mod_lua_nbytes_tracked(l, (as_val *) map) ) {
+		as_val * old = as_map_get(map, key);
+		if ( old ) {
+			mod_lua_nbytes_adjust(l, (as_val *) map, NULL, key);
+			mod_lua_nbytes_adjust(l, (as_val *) map, NULL, old);
+		}
+	}
+	if ( as_map_remove(map, key) != 0 ) {
+		mod_lua_nbytes_forget(l, (as_val *) map);
+	}
+}
+
 static int mod_lua_map_size(lua_State * l) {
 	as_map *    map     = mod_lua_checkmap(l, 1);
 	uint32_t    size    = as_map_size(map);
@@ -70,10 +84,7 @@ static int mod_lua_map_nbytes(lua_State * l) {
 	as_map *    map     = mod_lua_checkmap(l, 1);
 	uint32_t    nbytes  = 0;
 	if ( map ) {
-		as_serializer s;
-		as_msgpack_init(&s);
-		nbytes = as_serializer_serialize_getsize(&s, (as_val *) map);
-		as_serializer_destroy(&s);
+		nbytes = mod_lua_nbytes(l, (as_val *) map);
 	}
 	lua_pushinteger(l, nbytes);
 	return 1;
@@ -123,7 +134,8 @@ static int mod_lua_map_index(lua_State * l) {
 	as_val *        val     = NULL;
 
 	if ( map ) {
-		as_val * key = mod_lua_takeval(l, 2);
+		mod_lua_tmpval tmp;
+		as_val * key = mod_lua_toval_tmp(l, 2, &tmp);
 		if ( key ) {
 			val = as_map_get(map, key);
 			as_val_destroy(key);
@@ -150,12 +162,21 @@ static int mod_lua_map_newindex(lua_State * l) {
 			as_val_destroy(val);
 		}
 		else if ( !val ) {
-			as_map_remove(map, key);
+			mod_lua_map_unset(l, map, key);
 			as_val_destroy(key);
 		}
-		else if (as_map_set(map, key, val) != 0) {
-			as_val_destroy(key);
-			as_val_destroy(val);
+		else {
+			if ( mod_lua_nbytes_tracked(l, (as_val *) map) ) {
+				// The entry's old value is freed by the set.
+				as_val * old = as_map_get(map, key);
+				mod_lua_nbytes_adjust(l, (as_val *) map, old ? NULL : key, NULL);
+				mod_lua_nbytes_adjust(l, (as_val *) map, val, old);
+			}
+			if (as_map_set(map, key, val) != 0) {
+				mod_lua_nbytes_forget(l, (as_val *) map);
+				as_val_destroy(key);
+				as_val_destroy(val);
+			}
 		}
 	}
 	return 0;
@@ -164,9 +185,10 @@ static int mod_lua_map_newindex(lua_State * l) {
 static int mod_lua_map_remove(lua_State * l) {
 	as_map * map = mod_lua_checkmap(l, 1);
 	if ( map ) {
-		as_val * key = mod_lua_takeval(l, 2);
+		mod_lua_tmpval tmp;
+		as_val * key = mod_lua_toval_tmp(l, 2, &tmp);
 		if ( key ) {
-			as_map_remove(map, key);
+			mod_lua_map_unset(l, map, key);
 			as_val_destroy(key);
 		}
 	}
@@ -0,0 +1,255 @@
+/*
+ * Copyright 2008-2024 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#include <aerospike/as_list.h>
+#include <aerospike/as_map.h>
+#include <aerospike/as_msgpack.h>
+#include <aerospike/as_serializer.h>
+#include <aerospike/as_val.h>
+
+#include "internal.h"
+
+/*******************************************************************************
+ * CONSTANTS
+ ******************************************************************************/
+
+// Registry key for the table of sizes tracked in the current call.
+static const char g_nbytes_key = 0;
+
+// The table counts its entries at this key.
+#define NBYTES_COUNT 1
+
+// Most collections a single call will track. Each tracked collection is held
+// until the call is over, so this bounds what a stream UDF can pin.
+#define NBYTES_MAX 1024
+
+/*******************************************************************************
+ * STATIC FUNCTIONS
+ ******************************************************************************/
+
+/**
+ * The size of a msgpack array or map header for n elements.
+ */
+static inline uint32_t nbytes_header(uint32_t n) {
+	return n < 16 ? 1 : n < 65536 ? 3 : 5;
+}
+
+/**
+ * Only immutable values have a size that can't change behind our back.
+ */
+static inline bool nbytes_fixed(const as_val * v) {
+	switch ( as_val_type(v) ) {
+		case AS_NIL:
+		case AS_BOOLEAN:
+		case AS_INTEGER:
+		case AS_DOUBLE:
+		case AS_STRING:
+		case AS_GEOJSON:
+			return true;
+		default:
+			return false;
+	}
+}
+
+static inline uint32_t nbytes_val(const as_val * v) {
+	as_serializer s;
+	as_msgpack_init(&s);
+	uint32_t n = as_serializer_serialize_getsize(&s, (as_val *) v);
+	as_serializer_destroy(&s);
+	return n;
+}
+
+static inline uint32_t nbytes_count(const as_val * c) {
+	return as_val_type(c) == AS_LIST ?
+			as_list_size((as_list *) c) : as_map_size((as_map *) c);
+}
+
+typedef struct {
+	uint64_t	payload;
+	bool		fixed;
+} nbytes_walk;
+
+static bool nbytes_list_walk(as_val * v, void * udata) {
+	nbytes_walk * w = (nbytes_walk *) udata;
+	if ( v && ! nbytes_fixed(v) ) {
+		w->fixed = false;
+		return false;
+	}
+	w->payload += v ? nbytes_val(v) : 1;
+	return true;
+}
+
+static bool nbytes_map_walk(const as_val * k, const as_val * v, void * udata) {
+	return nbytes_list_walk((as_val *) k, udata) &&
+			nbytes_list_walk((as_val *) v, udata);
+}
+
+/**
+ * Push the table of tracked sizes, if anything is tracked. The table is only
+ * made once mod_lua_nbytes() is called, so until then mutations cost a single
+ * registry lookup.
+ */
+static bool nbytes_table(lua_State * l) {
+	if ( lua_rawgetp(l, LUA_REGISTRYINDEX, &g_nbytes_key) == LUA_TTABLE ) {
+		return true;
+	}
+	lua_pop(l, 1);
+	return false;
+}
+
+/**
+ * Push the table of tracked sizes and the payload tracked for c, returning
+ * true, or push nothing and return false if c isn't tracked. The payload is
+ * the size of the elements, without the header.
+ */
+static bool nbytes_get(lua_State * l, const as_val * c) {
+	if ( ! nbytes_table(l) ) {
+		return false;
+	}
+	if ( lua_rawgetp(l, -1, c) != LUA_TNUMBER ) {
+		lua_pop(l, 2);
+		return false;
+	}
+	return true;
+}
+
+static void nbytes_set(lua_State * l, const as_val * c, lua_Integer payload) {
+	lua_pushinteger(l, payload);
+	lua_rawsetp(l, -2, c);
+}
+
+static void nbytes_untrack(lua_State * l, const as_val * c) {
+	lua_pushnil(l);
+	lua_rawsetp(l, -2, c);
+	as_val_destroy((as_val *) c);
+	lua_rawgeti(l, -1, NBYTES_COUNT);
+	lua_Integer n = lua_tointeger(l, -1);
+	lua_pop(l, 1);
+	lua_pushinteger(l, n - 1);
+	lua_rawseti(l, -2, NBYTES_COUNT);
+}
+
+/**
+ * Start tracking c, if fewer than NBYTES_MAX collections are tracked.
+ */
+static void nbytes_track(lua_State * l, const as_val * c, lua_Integer payload) {
+	if ( ! nbytes_table(l) ) {
+		lua_newtable(l);
+		lua_pushvalue(l, -1);
+		lua_rawsetp(l, LUA_REGISTRYINDEX, &g_nbytes_key);
+	}
+	lua_rawgeti(l, -1, NBYTES_COUNT);
+	lua_Integer n = lua_tointeger(l, -1);
+	lua_pop(l, 1);
+	if ( n < NBYTES_MAX ) {
+		as_val_reserve((as_val *) c);
+		nbytes_set(l, c, payload);
+		lua_pushinteger(l, n + 1);
+		lua_rawseti(l, -2, NBYTES_COUNT);
+	}
+	lua_pop(l, 1);
+}
+
+/*******************************************************************************
+ * FUNCTIONS
+ ******************************************************************************/
+
+uint32_t mod_lua_nbytes(lua_State * l, const as_val * c) {
+	if ( nbytes_get(l, c) ) {
+		uint32_t n = nbytes_header(nbytes_count(c)) +
+				(uint32_t) lua_tointeger(l, -1);
+		lua_pop(l, 2);
+		return n;
+	}
+
+	// Map flags add an extension entry to the header.
+	if ( as_val_type(c) == AS_MAP && ((as_map *) c)->flags != 0 ) {
+		return nbytes_val(c);
+	}
+
+	nbytes_walk w = { .payload = 0, .fixed = true };
+	if ( as_val_type(c) == AS_LIST ) {
+		as_list_foreach((as_list *) c, nbytes_list_walk, &w);
+	}
+	else {
+		as_map_foreach((as_map *) c, nbytes_map_walk, &w);
+	}
+
+	if ( ! w.fixed ) {
+		// Nested collections can change without us seeing it.
+		return nbytes_val(c);
+	}
+
+	nbytes_track(l, c, (lua_Integer) w.payload);
+
+	return nbytes_header(nbytes_count(c)) + (uint32_t) w.payload;
+}
+
+bool mod_lua_nbytes_tracked(lua_State * l, const as_val * c) {
+	if ( nbytes_get(l, c) ) {
+		lua_pop(l, 2);
+		return true;
+	}
+	return false;
+}
+
+void mod_lua_nbytes_adjust(lua_State * l, const as_val * c,
+		const as_val * added, const as_val * removed) {
+	if ( ! nbytes_get(l, c) ) {
+		return;
+	}
+	lua_Integer payload = lua_tointeger(l, -1);
+	lua_pop(l, 1);
+
+	if ( (added && ! nbytes_fixed(added)) ||
+			(removed && ! nbytes_fixed(removed)) ) {
+		nbytes_untrack(l, c);
+	}
+	else {
+		if ( added ) {
+			payload += nbytes_val(added);
+		}
+		if ( removed ) {
+			payload -= nbytes_val(removed);
+		}
+		nbytes_set(l, c, payload);
+	}
+	lua_pop(l, 1);
+}
+
+void mod_lua_nbytes_forget(lua_State * l, const as_val * c) {
+	if ( nbytes_get(l, c) ) {
+		lua_pop(l, 1);
+		nbytes_untrack(l, c);
+		lua_pop(l, 1);
+	}
+}
+
+void mod_lua_nbytes_release(lua_State * l) {
+	if ( ! nbytes_table(l) ) {
+		return;
+	}
+	lua_pushnil(l);
+	while ( lua_next(l, -2) != 0 ) {
+		if ( lua_type(l, -2) == LUA_TLIGHTUSERDATA ) {
+			as_val_destroy((as_val *) lua_touserdata(l, -2));
+		}
+		lua_pop(l, 1);
+	}
+	lua_pop(l, 1);
+	lua_pushnil(l);
+	lua_rawsetp(l, LUA_REGISTRYINDEX, &g_nbytes_key);
+}
@@ -0,0 +1,551 @@
+/*
+ * Copyright 2008-2024 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#include <aerospike/mod_lua_predicate.h>
+#include <aerospike/as_boolean.h>
+#include <aerospike/as_double.h>
+#include <aerospike/as_integer.h>
+#include <aerospike/as_map.h>
+#include <aerospike/as_rec.h>
+#include <aerospike/as_string.h>
+#include <aerospike/as_val.h>
+#include <aerospike/mod_lua_val.h>
+#include <aerospike/mod_lua_reg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+/*******************************************************************************
+ * MACROS
+ ******************************************************************************/
+
+#define OBJECT_NAME "predicate"
+#define CLASS_NAME  "Predicate"
+
+// Deepest nesting of and/or/not accepted in a spec.
+#define PRED_MAX_DEPTH 32
+
+/*******************************************************************************
+ * TYPES
+ ******************************************************************************/
+
+typedef enum {
+	PRED_AND,
+	PRED_OR,
+	PRED_NOT,
+	PRED_EQ,
+	PRED_NE,
+	PRED_LT,
+	PRED_LE,
+	PRED_GT,
+	PRED_GE,
+	PRED_BETWEEN,
+	PRED_IN,
+	PRED_EXISTS
+} pred_kind;
+
+// Classes of comparable values, in the order "in" sorts them.
+typedef enum {
+	PRED_NUMBER,
+	PRED_STRING,
+	PRED_BOOLEAN
+} pred_class;
+
+typedef struct {
+	pred_class		cls;
+	bool			is_int;
+	int64_t			i;
+	double			d;
+	const char *	s;
+	size_t			len;
+} pred_const;
+
+typedef struct pred_node_s {
+	pred_kind				kind;
+	uint32_t				n;			// children or constants
+	struct pred_node_s **	children;
+	pred_const *			consts;		// sorted for PRED_IN
+	const char *			bin;
+	as_string				key;		// bin name, to look up in maps
+} pred_node;
+
+/**
+ *	A compiled predicate. Nodes, constants and strings are allocated as Lua
+ *	objects and anchored in a table held as the userdata's uservalue, so they
+ *	live as long as the predicate and are matched without touching Lua. The
+ *	box has no value, as a predicate isn't an as_val.
+ */
+struct mod_lua_predicate_s {
+	mod_lua_box		box;		// value is always NULL
+	pred_node *		root;
+};
+
+static const struct {
+	const char *	name;
+	pred_kind		kind;
+	int				nargs;
+} pred_ops[] = {
+	{ "==",         PRED_EQ,        1 },
+	{ "~=",         PRED_NE,        1 },
+	{ "<",          PRED_LT,        1 },
+	{ "<=",         PRED_LE,        1 },
+	{ ">",          PRED_GT,        1 },
+	{ ">=",         PRED_GE,        1 },
+	{ "between",    PRED_BETWEEN,   2 },
+	{ "in",         PRED_IN,        1 },
+	{ "exists",     PRED_EXISTS,    0 }
+};
+
+/*******************************************************************************
+ * VALUES
+ ******************************************************************************/
+
+static bool pred_value(const as_val * v, pred_const * out)
+{
+	switch ( as_val_type(v) ) {
+		case AS_INTEGER:
+			out->cls = PRED_NUMBER;
+			out->is_int = true;
+			out->i = ((as_integer *) v)->value;
+			out->d = (double) out->i;
+			return true;
+		case AS_DOUBLE:
+			out->cls = PRED_NUMBER;
+			out->is_int = false;
+			out->d = ((as_double *) v)->value;
+			return out->d == out->d;
+		case AS_STRING:
+			out->cls = PRED_STRING;
+			out->s = ((as_string *) v)->value;
+			out->len = as_string_len((as_string *) v);
+			return true;
+		case AS_BOOLEAN:
+			out->cls = PRED_BOOLEAN;
+			out->i = as_boolean_get((as_boolean *) v) ? 1 : 0;
+			return true;
+		default:
+			return false;
+	}
+}
+
+static int pred_cmp(const pred_const * a, const pred_const * b)
+{
+	if ( a->cls != b->cls ) {
+		return a->cls < b->cls ? -1 : 1;
+	}
+
+	switch ( a->cls ) {
+		case PRED_NUMBER:
+			if ( a->is_int && b->is_int ) {
+				return a->i < b->i ? -1 : a->i > b->i;
+			}
+			return a->d < b->d ? -1 : a->d > b->d;
+		case PRED_STRING: {
+			int c = memcmp(a->s, b->s, a->len < b->len ? a->len : b->len);
+			if ( c != 0 ) {
+				return c;
+			}
+			return a->len < b->len ? -1 : a->len > b->len;
+		}
+		default:
+			return (int) (a->i - b->i);
+	}
+}
+
+static int pred_qsort_cmp(const void * a, const void * b)
+{
+	return pred_cmp((const pred_const *) a, (const pred_const *) b);
+}
+
+/**
+ *	The value of a leaf's bin in v, which may be a record or a map keyed by
+ *	bin name, such as a projection of a record.
+ */
+static as_val * pred_field(const pred_node * n, const as_val * v)
+{
+	switch ( as_val_type(v) ) {
+		case AS_REC:
+			return as_rec_get((as_rec *) v, n->bin);
+		case AS_MAP:
+			return as_map_get((as_map *) v, (as_val *) &n->key);
+		default:
+			return NULL;
+	}
+}
+
+static bool pred_eval(const pred_node * n, const as_val * v)
+{
+	switch ( n->kind ) {
+		case PRED_AND:
+			for ( uint32_t i = 0; i < n->n; i++ ) {
+				if ( !pred_eval(n->children[i], v) ) {
+					return false;
+				}
+			}
+			return true;
+		case PRED_OR:
+			for ( uint32_t i = 0; i < n->n; i++ ) {
+				if ( pred_eval(n->children[i], v) ) {
+					return true;
+				}
+			}
+			return false;
+		case PRED_NOT:
+			return !pred_eval(n->children[0], v);
+		default:
+			break;
+	}
+
+	as_val * f = pred_field(n, v);
+
+	if ( n->kind == PRED_EXISTS ) {
+		return f != NULL && as_val_type(f) != AS_NIL;
+	}
+
+	pred_const x;
+
+	// A missing bin, or one that isn't a number, string or boolean, is only
+	// ever unequal - as nil is in Lua.
+	if ( f == NULL || !pred_value(f, &x) ) {
+		return n->kind == PRED_NE;
+	}
+
+	if ( n->kind == PRED_IN ) {
+		return bsearch(&x, n->consts, n->n, sizeof(pred_const),
+				pred_qsort_cmp) != NULL;
+	}
+
+	bool comparable = x.cls == n->consts[0].cls;
+	int c = comparable ? pred_cmp(&x, &n->consts[0]) : 0;
+
+	switch ( n->kind ) {
+		case PRED_EQ:
+			return comparable && c == 0;
+		case PRED_NE:
+			return !comparable || c != 0;
+		default:
+			break;
+	}
+
+	// Only numbers and strings are ordered.
+	if ( !comparable || x.cls == PRED_BOOLEAN ) {
+		return false;
+	}
+
+	switch ( n->kind ) {
+		case PRED_LT:
+			return c < 0;
+		case PRED_LE:
+			return c <= 0;
+		case PRED_GT:
+			return c > 0;
+		case PRED_GE:
+			return c >= 0;
+		case PRED_BETWEEN:
+			return c >= 0 && x.cls == n->consts[1].cls &&
+					pred_cmp(&x, &n->consts[1]) <= 0;
+		default:
+			return false;
+	}
+}
+
+/*******************************************************************************
+ * COMPILER
+ ******************************************************************************/
+
+static void * pred_alloc(lua_State * l, int anchor, size_t size)
+{
+	void * p = lua_newuserdatauv(l, size ? size : 1, 0);
+	memset(p, 0, size ? size : 1);
+	lua_rawseti(l, anchor, (lua_Integer) lua_rawlen(l, anchor) + 1);
+	return p;
+}
+
+static const char * pred_anchor_string(lua_State * l, int anchor, int index,
+		size_t * len)
+{
+	const char * s = lua_tolstring(l, index, len);
+	lua_pushvalue(l, index);
+	lua_rawseti(l, anchor, (lua_Integer) lua_rawlen(l, anchor) + 1);
+	return s;
+}
+
+static void pred_compile_const(lua_State * l, int anchor, int index,
+		pred_const * c)
+{
+	switch ( lua_type(l, index) ) {
+		case LUA_TNUMBER: {
+			int isint = 0;
+			c->cls = PRED_NUMBER;
+			c->i = (int64_t) lua_tointegerx(l, index, &isint);
+			c->is_int = isint != 0;
+			c->d = c->is_int ? (double) c->i : (double) lua_tonumber(l, index);
+			if ( c->d != c->d ) {
+				luaL_error(l, "predicate value is NaN");
+			}
+			break;
+		}
+		case LUA_TSTRING:
+			c->cls = PRED_STRING;
+			c->s = pred_anchor_string(l, anchor, index, &c->len);
+			break;
+		case LUA_TBOOLEAN:
+			c->cls = PRED_BOOLEAN;
+			c->i = lua_toboolean(l, index) ? 1 : 0;
+			break;
+		default:
+			luaL_error(l, "predicate value must be a number, string or boolean, got %s",
+					luaL_typename(l, index));
+	}
+}
+
+static pred_node * pred_compile(lua_State * l, int anchor, int index, int depth);
+
+static pred_node * pred_compile_logic(lua_State * l, int anchor, int index,
+		pred_kind kind, int first, int depth)
+{
+	uint32_t n = (uint32_t) lua_rawlen(l, index) - (uint32_t) (first - 1);
+
+	if ( n == 0 || (kind == PRED_NOT && n != 1) ) {
+		luaL_error(l, kind == PRED_NOT ? "predicate 'not' takes one predicate" :
+				"predicate 'and'/'or' takes at least one predicate");
+	}
+
+	pred_node * node = (pred_node *) pred_alloc(l, anchor, sizeof(pred_node));
+	node->kind = kind;
+	node->n = n;
+	node->children = (pred_node **) pred_alloc(l, anchor, n * sizeof(pred_node *));
+
+	for ( uint32_t i = 0; i < n; i++ ) {
+		lua_rawgeti(l, index, (lua_Integer) (first + i));
+		node->children[i] = pred_compile(l, anchor, lua_gettop(l), depth + 1);
+		lua_pop(l, 1);
+	}
+	return node;
+}
+
+static pred_node * pred_compile_leaf(lua_State * l, int anchor, int index)
+{
+	pred_node * node = (pred_node *) pred_alloc(l, anchor, sizeof(pred_node));
+
+	lua_rawgeti(l, index, 1);
+	node->bin = pred_anchor_string(l, anchor, -1, NULL);
+	as_string_init(&node->key, (char *) node->bin, false);
+	lua_pop(l, 1);
+
+	lua_rawgeti(l, index, 2);
+	const char * op = lua_tostring(l, -1);
+	int nargs = -1;
+
+	for ( size_t i = 0; i < sizeof(pred_ops) / sizeof(pred_ops[0]); i++ ) {
+		if ( strcmp(op, pred_ops[i].name) == 0 ) {
+			node->kind = pred_ops[i].kind;
+			nargs = pred_ops[i].nargs;
+			break;
+		}
+	}
+	if ( nargs < 0 ) {
+		luaL_error(l, "unknown predicate operator '%s'", op);
+	}
+	// op stays alive in the spec table
+	lua_pop(l, 1);
+
+	if ( (int) lua_rawlen(l, index) != 2 + nargs ) {
+		luaL_error(l, "predicate operator '%s' takes %d value(s)", op, nargs);
+	}
+
+	if ( node->kind == PRED_IN ) {
+		lua_rawgeti(l, index, 3);
+		int values = lua_gettop(l);
+		luaL_argcheck(l, lua_type(l, values) == LUA_TTABLE, 1,
+				"predicate operator 'in' takes a table of values");
+
+		node->n = (uint32_t) lua_rawlen(l, values);
+		node->consts = (pred_const *) pred_alloc(l, anchor,
+				node->n * sizeof(pred_const));
+
+		for ( uint32_t i = 0; i < node->n; i++ ) {
+			lua_rawgeti(l, values, (lua_Integer) i + 1);
+			pred_compile_const(l, anchor, lua_gettop(l), &node->consts[i]);
+			lua_pop(l, 1);
+		}
+		qsort(node->consts, node->n, sizeof(pred_const), pred_qsort_cmp);
+		lua_pop(l, 1);
+		return node;
+	}
+
+	node->n = (uint32_t) nargs;
+	node->consts = (pred_const *) pred_alloc(l, anchor,
+			(size_t) nargs * sizeof(pred_const));
+
+	for ( int i = 0; i < nargs; i++ ) {
+		lua_rawgeti(l, index, 3 + i);
+		pred_compile_const(l, anchor, lua_gettop(l), &node->consts[i]);
+		lua_pop(l, 1);
+	}
+	return node;
+}
+
+/**
+ *	Compile the spec at index. A spec is one of
+ *
+ *	----------{.lua}
+ *	{ bin, op, value... }           -- op is ==, ~=, <, <=, >, >=, between,
+ *	                                -- in (with a table of values) or exists
+ *	{ "and", spec, spec... }
+ *	{ "or", spec, spec... }
+ *	{ "not", spec }
+ *	{ spec, spec... }               -- same as "and"
+ *	----------
+ */
+static pred_node * pred_compile(lua_State * l, int anchor, int index, int depth)
+{
+	if ( lua_type(l, index) != LUA_TTABLE ) {
+		luaL_error(l, "predicate must be a table, got %s", luaL_typename(l, index));
+	}
+	if ( depth > PRED_MAX_DEPTH ) {
+		luaL_error(l, "predicate is nested too deeply");
+	}
+
+	int t1 = lua_rawgeti(l, index, 1);
+	int t2 = lua_rawgeti(l, index, 2);
+	const char * name = t1 == LUA_TSTRING ? lua_tostring(l, -2) : NULL;
+	lua_pop(l, 2);
+
+	if ( t1 == LUA_TTABLE ) {
+		return pred_compile_logic(l, anchor, index, PRED_AND, 1, depth);
+	}
+	if ( name != NULL && t2 == LUA_TTABLE ) {
+		if ( strcmp(name, "and") == 0 ) {
+			return pred_compile_logic(l, anchor, index, PRED_AND, 2, depth);
+		}
+		if ( strcmp(name, "or") == 0 ) {
+			return pred_compile_logic(l, anchor, index, PRED_OR, 2, depth);
+		}
+		if ( strcmp(name, "not") == 0 ) {
+			return pred_compile_logic(l, anchor, index, PRED_NOT, 2, depth);
+		}
+		luaL_error(l, "unknown predicate '%s'", name);
+	}
+	if ( name != NULL && t2 == LUA_TSTRING ) {
+		return pred_compile_leaf(l, anchor, index);
+	}
+
+	luaL_error(l, "predicate must be { bin, op, value... } or { \"and\"|\"or\"|\"not\", ... }");
+	return NULL;
+}
+
+/*******************************************************************************
+ * BOX FUNCTIONS
+ ******************************************************************************/
+
+mod_lua_predicate * mod_lua_topredicate(lua_State * l, int index)
+{
+	return (mod_lua_predicate *) luaL_testudata(l, index, CLASS_NAME);
+}
+
+bool mod_lua_predicate_match(const mod_lua_predicate * p, const as_val * v)
+{
+	return v != NULL && pred_eval(p->root, v);
+}
+
+/*******************************************************************************
+ * FUNCTIONS
+ ******************************************************************************/
+
+/**
+ *	Compile a spec into a predicate, which can be matched against records and
+ *	maps without calling into Lua.
+ *
+ *	----------{.c}
+ *	Predicate predicate(table spec)
+ *	----------
+ */
+static int mod_lua_predicate_new(lua_State * l)
+{
+	luaL_checktype(l, 2, LUA_TTABLE);
+
+	mod_lua_predicate * p = (mod_lua_predicate *) lua_newuserdatauv(l,
+			sizeof(mod_lua_predicate), 1);
+	p->box.scope = MOD_LUA_SCOPE_LUA;
+	p->box.value = NULL;
+	p->root = NULL;
+	int udata = lua_gettop(l);
+
+	lua_newtable(l);
+	int anchor = lua_gettop(l);
+
+	p->root = pred_compile(l, anchor, 2, 0);
+
+	lua_setiuservalue(l, udata, 1);
+
+	luaL_getmetatable(l, CLASS_NAME);
+	lua_setmetatable(l, udata);
+	return 1;
+}
+
+/**
+ *	Whether a record or map satisfies the predicate. Any other value doesn't.
+ *
+ *	----------{.c}
+ *	boolean predicate.match(Predicate p, value v)
+ *	----------
+ */
+static int mod_lua_predicate_match_value(lua_State * l)
+{
+	mod_lua_predicate * p = (mod_lua_predicate *) luaL_checkudata(l, 1, CLASS_NAME);
+	mod_lua_tmpval tmp;
+	as_val * v = mod_lua_toval_tmp(l, 2, &tmp);
+
+	lua_pushboolean(l, mod_lua_predicate_match(p, v));
+	as_val_destroy(v);
+	return 1;
+}
+
+/******************************************************************************
+ * OBJECT TABLE
+ *****************************************************************************/
+
+static const luaL_Reg object_table[] = {
+	{"match",           mod_lua_predicate_match_value},
+	{0, 0}
+};
+
+static const luaL_Reg object_metatable[] = {
+	{"__call",          mod_lua_predicate_new},
+	{0, 0}
+};
+
+/******************************************************************************
+ * CLASS TABLE
+ *****************************************************************************/
+
+static const luaL_Reg class_metatable[] = {
+	{0, 0}
+};
+
+/******************************************************************************
+ * REGISTER
+ *****************************************************************************/
+
+int mod_lua_predicate_register(lua_State * l) {
+	mod_lua_reg_object(l, OBJECT_NAME, object_table, object_metatable);
+	mod_lua_reg_class(l, CLASS_NAME, NULL, class_metatable);
+	return 1;
+}
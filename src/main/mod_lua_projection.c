@@ -0,0 +1,238 @@
+/*
+ * Copyright 2008-2024 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#include <aerospike/mod_lua_projection.h>
+#include <aerospike/as_hashmap.h>
+#include <aerospike/as_list.h>
+#include <aerospike/as_map.h>
+#include <aerospike/as_rec.h>
+#include <aerospike/as_string.h>
+#include <aerospike/as_val.h>
+#include <aerospike/mod_lua_list.h>
+#include <aerospike/mod_lua_map.h>
+#include <aerospike/mod_lua_val.h>
+#include <aerospike/mod_lua_reg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "internal.h"
+
+/*******************************************************************************
+ * MACROS
+ ******************************************************************************/
+
+#define OBJECT_NAME "projection"
+#define CLASS_NAME  "Projection"
+#define LIST_CLASS_NAME "List"
+
+#define PROJECTION_MAX_BINS 1024
+
+/*******************************************************************************
+ * TYPES
+ ******************************************************************************/
+
+/**
+ *	The bins to keep. Each name is kept as an as_string, which every map made
+ *	shares a reference to, so projecting a record allocates only the map. The
+ *	box has no value, as a projection isn't an as_val.
+ */
+struct mod_lua_projection_s {
+	mod_lua_box	box;		// value is always NULL
+	uint32_t	n;
+	as_string *	keys[];
+};
+
+/*******************************************************************************
+ * BOX FUNCTIONS
+ ******************************************************************************/
+
+mod_lua_projection * mod_lua_toprojection(lua_State * l, int index)
+{
+	return (mod_lua_projection * ) luaL_testudata(l, index, CLASS_NAME);
+}
+
+as_map * mod_lua_projection_apply(const mod_lua_projection * p, const as_val * v)
+{
+	as_hashmap * map = as_hashmap_new(p->n ? p->n : 1);
+
+	for ( uint32_t i = 0; i < p->n; i++ ) {
+		as_val * value = NULL;
+
+		switch ( as_val_type(v) ) {
+			case AS_REC:
+				value = as_rec_get((as_rec *) v, p->keys[i]->value);
+				break;
+			case AS_MAP:
+				value = as_map_get((as_map *) v, (as_val *) p->keys[i]);
+				break;
+			default:
+				break;
+		}
+
+		if ( value != NULL && as_val_type(value) != AS_NIL ) {
+			as_val_reserve(p->keys[i]);
+			as_val_reserve(value);
+			as_hashmap_set(map, (as_val *) p->keys[i], value);
+		}
+	}
+	return (as_map *) map;
+}
+
+/*******************************************************************************
+ * FUNCTIONS
+ ******************************************************************************/
+
+static void mod_lua_projection_add(lua_State * l, mod_lua_projection * p,
+		int index)
+{
+	if ( lua_type(l, index) != LUA_TSTRING ) {
+		luaL_error(l, "projection bin name must be a string, got %s",
+				luaL_typename(l, index));
+	}
+
+	const char * name = lua_tostring(l, index);
+
+	for ( uint32_t i = 0; i < p->n; i++ ) {
+		if ( strcmp(p->keys[i]->value, name) == 0 ) {
+			return;
+		}
+	}
+	p->keys[p->n++] = as_string_new_strdup(name);
+}
+
+/**
+ *	Make a projection keeping the named bins, from a table or List of names.
+ *
+ *	----------{.c}
+ *	Projection projection(table|List bins)
+ *	----------
+ */
+static int mod_lua_projection_new(lua_State * l)
+{
+	as_list * list = NULL;
+	lua_Integer n;
+
+	if ( lua_type(l, 2) == LUA_TTABLE ) {
+		n = (lua_Integer) lua_rawlen(l, 2);
+	}
+	else {
+		list = luaL_testudata(l, 2, LIST_CLASS_NAME) ? mod_lua_tolist(l, 2) : NULL;
+
+		if ( !list ) {
+			return luaL_argerror(l, 2, "expected a table or list");
+		}
+		n = (lua_Integer) as_list_size(list);
+	}
+
+	luaL_argcheck(l, n <= PROJECTION_MAX_BINS, 2, "too many bins");
+
+	mod_lua_projection * p = (mod_lua_projection *) lua_newuserdatauv(l,
+			sizeof(mod_lua_projection) + (size_t) n * sizeof(as_string *), 0);
+	p->box.scope = MOD_LUA_SCOPE_LUA;
+	p->box.value = NULL;
+	p->n = 0;
+
+	// Set the metatable first, so __gc frees the names if a later one errors.
+	luaL_getmetatable(l, CLASS_NAME);
+	lua_setmetatable(l, -2);
+
+	for ( lua_Integer i = 1; i <= n; i++ ) {
+		if ( list == NULL ) {
+			lua_rawgeti(l, 2, i);
+		}
+		else {
+			mod_lua_pushval(l, as_list_get(list, (uint32_t) i - 1));
+		}
+		mod_lua_projection_add(l, p, -1);
+		lua_pop(l, 1);
+	}
+	return 1;
+}
+
+/**
+ *	A map of the projected bins of a record, or keys of a map, leaving out
+ *	any which are missing. Any other value gives an empty map.
+ *
+ *	----------{.c}
+ *	Map projection.apply(Projection p, value v)
+ *	----------
+ */
+static int mod_lua_projection_apply_value(lua_State * l)
+{
+	mod_lua_projection * p = (mod_lua_projection *) luaL_checkudata(l, 1, CLASS_NAME);
+	mod_lua_tmpval tmp;
+	as_val * v = mod_lua_toval_tmp(l, 2, &tmp);
+
+	as_map * map = mod_lua_projection_apply(p, v ? v : (as_val *) &as_nil);
+	as_val_destroy(v);
+
+	mod_lua_pushmap(l, map);
+	return 1;
+}
+
+static int mod_lua_projection_size(lua_State * l)
+{
+	mod_lua_projection * p = (mod_lua_projection *) luaL_checkudata(l, 1, CLASS_NAME);
+	lua_pushinteger(l, p->n);
+	return 1;
+}
+
+static int mod_lua_projection_gc(lua_State * l)
+{
+	mod_lua_projection * p = (mod_lua_projection *) luaL_checkudata(l, 1, CLASS_NAME);
+
+	for ( uint32_t i = 0; i < p->n; i++ ) {
+		as_string_destroy(p->keys[i]);
+	}
+	p->n = 0;
+	return 0;
+}
+
+/******************************************************************************
+ * OBJECT TABLE
+ *****************************************************************************/
+
+static const luaL_Reg object_table[] = {
+	{"apply",           mod_lua_projection_apply_value},
+	{"size",            mod_lua_projection_size},
+	{0, 0}
+};
+
+static const luaL_Reg object_metatable[] = {
+	{"__call",          mod_lua_projection_new},
+	{0, 0}
+};
+
+/******************************************************************************
+ * CLASS TABLE
+ *****************************************************************************/
+
+static const luaL_Reg class_metatable[] = {
+	{"__len",           mod_lua_projection_size},
+	{"__gc",            mod_lua_projection_gc},
+	{0, 0}
+};
+
+/******************************************************************************
+ * REGISTER
+ *****************************************************************************/
+
+int mod_lua_projection_register(lua_State * l) {
+	mod_lua_reg_object(l, OBJECT_NAME, object_table, object_metatable);
+	mod_lua_reg_class(l, CLASS_NAME, NULL, class_metatable);
+	return 1;
+}
@@ -24,6 +24,8 @@
 #include <aerospike/mod_lua_reg.h>
 #include <aerospike/mod_lua_list.h>
 
+#include <string.h>
+
 #include "internal.h"
 
 /*******************************************************************************
@@ -32,6 +34,63 @@
 
 #define OBJECT_NAME "record"
 #define CLASS_NAME  "Record"
+#define BIN_CLASS_NAME "Bin"
+
+// Max number of as_rec_hooks with bin id hooks registered.
+#define BIN_HOOKS_MAX 8
+
+// Max number of bin handles kept per state before the cache is reset.
+#define BIN_CACHE_MAX 256
+
+/*******************************************************************************
+ * TYPES
+ ******************************************************************************/
+
+/**
+ * A bin handle, as returned by record.bin(r, name). Remembers how the name was
+ * last resolved, so repeated access skips the name lookup.
+ */
+typedef struct {
+    mod_lua_box                 box;        // value is always NULL, so mod_lua_toval() rejects handles
+    const as_rec_hooks *        rec_hooks;  // hooks of the record last resolved against
+    const mod_lua_bin_hooks *   bin_hooks;  // NULL if resolved to name lookup
+    const void *                space;      // id space if stable, otherwise NULL
+    lua_Integer                 seq;        // push of the record resolved against, if not stable
+    uint32_t                    epoch;      // g_bin_hooks_epoch when resolved
+    uint32_t                    id;
+    char                        name[];
+} mod_lua_bin;
+
+/**
+ * A record as pushed on to the stack. Each push gets a new sequence number
+ * from the state, since the host may free a record and allocate the next one
+ * at the same address within one invocation.
+ */
+typedef struct {
+    mod_lua_box                 box;
+    lua_Integer                 seq;
+} mod_lua_record_box;
+
+typedef struct {
+    const as_rec_hooks *        rec_hooks;
+    const mod_lua_bin_hooks *   bin_hooks;
+} bin_hooks_entry;
+
+/*******************************************************************************
+ * VARIABLES
+ ******************************************************************************/
+
+static bin_hooks_entry g_bin_hooks[BIN_HOOKS_MAX];
+static uint32_t g_bin_hooks_count = 0;
+
+// Bumped whenever the registered bin hooks change, invalidating all handles.
+static uint32_t g_bin_hooks_epoch = 0;
+
+// Registry key for the per-state table of bin handles.
+static const char g_bin_cache_key = 0;
+
+// Registry key for the per-state count of records pushed.
+static const char g_record_seq_key = 0;
 
 /*******************************************************************************
  * FUNCTIONS
@@ -49,9 +108,19 @@ as_rec * mod_lua_torecord(lua_State * l, int index) {
  * Push a record on to the lua stack
  */
 as_rec * mod_lua_pushrecord(lua_State * l, as_rec * r) {
+    lua_rawgetp(l, LUA_REGISTRYINDEX, &g_record_seq_key);
+    lua_Integer seq = lua_tointeger(l, -1) + 1;
+    lua_pop(l, 1);
+    lua_pushinteger(l, seq);
+    lua_rawsetp(l, LUA_REGISTRYINDEX, &g_record_seq_key);
+
+    mod_lua_record_box * box = (mod_lua_record_box *) lua_newuserdatauv(l, sizeof(mod_lua_record_box), 0);
     // I am hoping the following is correct use of the free flag
-    mod_lua_box * box = mod_lua_pushbox(l, r->_.free ? MOD_LUA_SCOPE_LUA : MOD_LUA_SCOPE_HOST, r, CLASS_NAME);
-    return (as_rec *) mod_lua_box_value(box);
+    box->box.scope = r->_.free ? MOD_LUA_SCOPE_LUA : MOD_LUA_SCOPE_HOST;
+    box->box.value = r;
+    box->seq = seq;
+    luaL_setmetatable(l, CLASS_NAME);
+    return r;
 }
 
 /**
@@ -242,12 +311,187 @@ static int mod_lua_record_drop_key(lua_State * l) {
     return 0;
 }
 
+/**
+ * Associate bin id hooks with records using rec_hooks
+ */
+bool mod_lua_record_set_bin_hooks(const as_rec_hooks * rec_hooks, const mod_lua_bin_hooks * bin_hooks) {
+    for ( uint32_t i = 0; i < g_bin_hooks_count; i++ ) {
+        if ( g_bin_hooks[i].rec_hooks == rec_hooks ) {
+            if ( bin_hooks != NULL ) {
+                g_bin_hooks[i].bin_hooks = bin_hooks;
+            }
+            else {
+                g_bin_hooks[i] = g_bin_hooks[--g_bin_hooks_count];
+            }
+            g_bin_hooks_epoch++;
+            return true;
+        }
+    }
+    if ( bin_hooks == NULL ) {
+        return true;
+    }
+    if ( g_bin_hooks_count == BIN_HOOKS_MAX ) {
+        return false;
+    }
+    g_bin_hooks[g_bin_hooks_count].rec_hooks = rec_hooks;
+    g_bin_hooks[g_bin_hooks_count].bin_hooks = bin_hooks;
+    g_bin_hooks_count++;
+    g_bin_hooks_epoch++;
+    return true;
+}
+
+static const mod_lua_bin_hooks * mod_lua_bin_hooks_get(const as_rec_hooks * rec_hooks) {
+    for ( uint32_t i = 0; i < g_bin_hooks_count; i++ ) {
+        if ( g_bin_hooks[i].rec_hooks == rec_hooks ) {
+            return g_bin_hooks[i].bin_hooks;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Read the item at index as a bin handle, or NULL if it isn't one
+ */
+static mod_lua_bin * mod_lua_tobin(lua_State * l, int index) {
+    if ( lua_type(l, index) != LUA_TUSERDATA ) {
+        return NULL;
+    }
+    return (mod_lua_bin *) luaL_testudata(l, index, BIN_CLASS_NAME);
+}
+
+/**
+ * Whether the handle's last resolution applies to the record
+ */
+static bool mod_lua_bin_valid(const mod_lua_bin * bin, const mod_lua_record_box * box) {
+    const as_rec * rec = (const as_rec *) box->box.value;
+    if ( bin->rec_hooks != rec->hooks || bin->epoch != g_bin_hooks_epoch ) {
+        return false;
+    }
+    if ( bin->space != NULL ) {
+        return bin->bin_hooks->id_space(rec) == bin->space;
+    }
+    return bin->seq == box->seq;
+}
+
+/**
+ * Resolve the handle's name against the record, falling back to name lookup
+ * if the record has no bin id hooks or the host can't resolve the name.
+ */
+static void mod_lua_bin_resolve(mod_lua_bin * bin, const mod_lua_record_box * box) {
+    const as_rec * rec = (const as_rec *) box->box.value;
+    const mod_lua_bin_hooks * hooks = mod_lua_bin_hooks_get(rec->hooks);
+
+    bin->rec_hooks = rec->hooks;
+    bin->bin_hooks = NULL;
+    bin->space = NULL;
+    bin->seq = box->seq;
+    bin->epoch = g_bin_hooks_epoch;
+
+    if ( hooks != NULL && hooks->resolve(rec, bin->name, &bin->id) ) {
+        bin->bin_hooks = hooks;
+        bin->space = hooks->id_space != NULL ? hooks->id_space(rec) : NULL;
+    }
+}
+
+static as_val * mod_lua_bin_get(mod_lua_bin * bin, const mod_lua_record_box * box) {
+    const as_rec * rec = (const as_rec *) box->box.value;
+    if ( ! mod_lua_bin_valid(bin, box) ) {
+        mod_lua_bin_resolve(bin, box);
+    }
+    if ( bin->bin_hooks != NULL ) {
+        return bin->bin_hooks->get(rec, bin->id);
+    }
+    return as_rec_get(rec, bin->name);
+}
+
+static int mod_lua_bin_set(mod_lua_bin * bin, const mod_lua_record_box * box, const as_val * value) {
+    as_rec * rec = (as_rec *) box->box.value;
+    if ( ! mod_lua_bin_valid(bin, box) ) {
+        mod_lua_bin_resolve(bin, box);
+    }
+    if ( bin->bin_hooks != NULL ) {
+        return bin->bin_hooks->set(rec, bin->id, value);
+    }
+    return as_rec_set(rec, bin->name, value);
+}
+
+/**
+ * Get a handle for a bin, to index the record with in place of its name:
+ *      local h = record.bin(r, name)
+ *      r[h] = r[h] + 1
+ *
+ * Handles are kept per state, so if the host says the bin id mapping is
+ * stable the name is resolved once, not once per invocation.
+ */
+static int mod_lua_record_bin(lua_State * l) {
+    mod_lua_record_box *    box     = (mod_lua_record_box *) mod_lua_checkbox(l, 1, CLASS_NAME);
+    const char *            name    = luaL_checkstring(l, 2);
+
+    if ( lua_rawgetp(l, LUA_REGISTRYINDEX, &g_bin_cache_key) != LUA_TTABLE ) {
+        lua_pop(l, 1);
+        lua_newtable(l);
+        lua_pushvalue(l, -1);
+        lua_rawsetp(l, LUA_REGISTRYINDEX, &g_bin_cache_key);
+    }
+
+    int cache = lua_gettop(l);
+    mod_lua_bin * bin = NULL;
+
+    lua_pushvalue(l, 2);
+    if ( lua_rawget(l, cache) == LUA_TUSERDATA ) {
+        bin = (mod_lua_bin *) lua_touserdata(l, -1);
+    }
+    else {
+        lua_pop(l, 1);
+
+        // Names may come from data, so don't let the cache grow unbounded.
+        lua_rawgeti(l, cache, 0);
+        lua_Integer count = lua_tointeger(l, -1);
+        lua_pop(l, 1);
+        if ( count >= BIN_CACHE_MAX ) {
+            lua_newtable(l);
+            lua_replace(l, cache);
+            lua_pushvalue(l, cache);
+            lua_rawsetp(l, LUA_REGISTRYINDEX, &g_bin_cache_key);
+            count = 0;
+        }
+
+        size_t len = strlen(name);
+        bin = (mod_lua_bin *) lua_newuserdatauv(l, sizeof(mod_lua_bin) + len + 1, 0);
+        memset(bin, 0, sizeof(mod_lua_bin));
+        memcpy(bin->name, name, len + 1);
+        luaL_setmetatable(l, BIN_CLASS_NAME);
+
+        lua_pushvalue(l, 2);
+        lua_pushvalue(l, -2);
+        lua_rawset(l, cache);
+        lua_pushinteger(l, count + 1);
+        lua_rawseti(l, cache, 0);
+    }
+
+    if ( ! mod_lua_bin_valid(bin, box) ) {
+        mod_lua_bin_resolve(bin, box);
+    }
+    return 1;
+}
+
 /**
  * Get a value from the named bin
  */
 static int mod_lua_record_index(lua_State * l) {
     mod_lua_box *   box     = mod_lua_checkbox(l, 1, CLASS_NAME);
     as_rec *        rec     = (as_rec *) mod_lua_box_value(box);
+    mod_lua_bin *   bin     = mod_lua_tobin(l, 2);
+    if ( bin != NULL ) {
+        as_val * value  = mod_lua_bin_get(bin, (mod_lua_record_box *) box);
+        if ( value != NULL ) {
+            mod_lua_pushval(l, value);
+        }
+        else {
+            lua_pushnil(l);
+        }
+        return 1;
+    }
     const char *    name    = luaL_optstring(l, 2, 0);
     if ( name != NULL ) {
         as_val * value  = (as_val *) as_rec_get(rec, name);
@@ -271,7 +515,17 @@ static int mod_lua_record_index(lua_State * l) {
  * Set a value in the named bin
  */
 static int mod_lua_record_newindex(lua_State * l) {
-    as_rec *        rec     = mod_lua_checkrecord(l, 1);
+    mod_lua_box *   box     = mod_lua_checkbox(l, 1, CLASS_NAME);
+    as_rec *        rec     = (as_rec *) mod_lua_box_value(box);
+    mod_lua_bin *   bin     = mod_lua_tobin(l, 2);
+    if ( bin != NULL ) {
+        as_val * value = (as_val *) mod_lua_toval(l, 3);
+        if ( value == NULL ) {
+            return luaL_error(l, "can't set bin %s to unsupported type", bin->name);
+        }
+        mod_lua_bin_set(bin, (mod_lua_record_box *) box, value);
+        return 0;
+    }
     const char *    name    = luaL_optstring(l, 2, 0);
     if ( name != NULL ) {
         // reference to this value is created by mod_lua_toval
@@ -304,6 +558,7 @@ static const luaL_Reg object_table[] = {
     {"set_ttl",    mod_lua_record_set_ttl},
     {"drop_key",   mod_lua_record_drop_key},
     {"bin_names",  mod_lua_record_bin_names},
+    {"bin",        mod_lua_record_bin},
     {0, 0}
 };
 
@@ -328,6 +583,20 @@ static const luaL_Reg class_metatable[] = {
     {0, 0}
 };
 
+/**
+ * Bin handle's name, for debugging
+ */
+static int mod_lua_bin_tostring(lua_State * l) {
+    mod_lua_bin * bin = (mod_lua_bin *) luaL_checkudata(l, 1, BIN_CLASS_NAME);
+    lua_pushfstring(l, "Bin(%s)", bin->name);
+    return 1;
+}
+
+static const luaL_Reg bin_class_metatable[] = {
+    {"__tostring",      mod_lua_bin_tostring},
+    {0, 0}
+};
+
 /*******************************************************************************
  * ~~~ Register ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
  ******************************************************************************/
@@ -335,5 +604,6 @@ static const luaL_Reg class_metatable[] = {
 int mod_lua_record_register(lua_State * l) {
     mod_lua_reg_object(l, OBJECT_NAME, object_table, object_metatable);
     mod_lua_reg_class(l, CLASS_NAME, NULL, class_metatable);
+    mod_lua_reg_class(l, BIN_CLASS_NAME, NULL, bin_class_metatable);
     return 1;
 }
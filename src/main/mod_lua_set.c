@@ -0,0 +1,806 @@
+/*
+ * Copyright 2008-2024 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#include <aerospike/mod_lua_set.h>
+#include <aerospike/as_arraylist.h>
+#include <aerospike/as_boolean.h>
+#include <aerospike/as_bytes.h>
+#include <aerospike/as_double.h>
+#include <aerospike/as_integer.h>
+#include <aerospike/as_list.h>
+#include <aerospike/as_string.h>
+#include <aerospike/as_val.h>
+#include <aerospike/mod_lua_bytes.h>
+#include <aerospike/mod_lua_list.h>
+#include <aerospike/mod_lua_val.h>
+#include <aerospike/mod_lua_reg.h>
+#include <citrusleaf/alloc.h>
+#include <citrusleaf/cf_hash_math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "internal.h"
+
+/*******************************************************************************
+ * MACROS
+ ******************************************************************************/
+
+#define OBJECT_NAME "set"
+#define CLASS_NAME  "Set"
+#define LIST_CLASS_NAME "List"
+
+#define SET_MIN_CAPACITY 8
+
+/*******************************************************************************
+ * TYPES
+ ******************************************************************************/
+
+typedef struct {
+	uint32_t	hash;
+	as_val *	val;	// NULL if the slot is empty
+} set_entry;
+
+/**
+ *	An open addressing hash set, with linear probing and backward shift
+ *	deletion. Elements are integers, doubles, strings, booleans or bytes, and
+ *	the set holds its own reference to each. The box has no value, as a set
+ *	isn't an as_val - it is stored as a list of its elements.
+ */
+typedef struct {
+	mod_lua_box	box;		// value is always NULL
+	uint32_t	count;
+	uint32_t	mask;		// capacity - 1, capacity is a power of 2
+	set_entry *	entries;	// NULL until the first element is added
+} mod_lua_set;
+
+/*******************************************************************************
+ * ELEMENTS
+ ******************************************************************************/
+
+static inline uint32_t set_hash_int(uint64_t v)
+{
+	// splitmix64 finalizer
+	v ^= v >> 30;
+	v *= 0xbf58476d1ce4e5b9ULL;
+	v ^= v >> 27;
+	v *= 0x94d049bb133111ebULL;
+	v ^= v >> 31;
+	return (uint32_t) v;
+}
+
+static uint32_t set_hash(const as_val * v)
+{
+	switch ( as_val_type(v) ) {
+		case AS_INTEGER:
+			return set_hash_int((uint64_t) ((as_integer *) v)->value);
+		case AS_DOUBLE: {
+			double d = ((as_double *) v)->value;
+			uint64_t bits = 0;
+			// -0.0 and 0.0 are equal, so must hash the same
+			if ( d != 0 ) {
+				memcpy(&bits, &d, sizeof(bits));
+			}
+			return set_hash_int(bits ^ 0x5555555555555555ULL);
+		}
+		case AS_STRING: {
+			as_string * s = (as_string *) v;
+			return cf_wyhash32((const uint8_t *) s->value, as_string_len(s));
+		}
+		case AS_BYTES: {
+			as_bytes * b = (as_bytes *) v;
+			return ~cf_wyhash32(b->value, b->size);
+		}
+		default:
+			return ((as_boolean *) v)->value ? 0x9e3779b9 : 0x7f4a7c15;
+	}
+}
+
+static bool set_equal(const as_val * a, const as_val * b)
+{
+	if ( as_val_type(a) != as_val_type(b) ) {
+		return false;
+	}
+
+	switch ( as_val_type(a) ) {
+		case AS_INTEGER:
+			return ((as_integer *) a)->value == ((as_integer *) b)->value;
+		case AS_DOUBLE:
+			return ((as_double *) a)->value == ((as_double *) b)->value;
+		case AS_STRING: {
+			size_t len = as_string_len((as_string *) a);
+			return len == as_string_len((as_string *) b) &&
+					memcmp(((as_string *) a)->value, ((as_string *) b)->value, len) == 0;
+		}
+		case AS_BYTES: {
+			as_bytes * x = (as_bytes *) a;
+			as_bytes * y = (as_bytes *) b;
+			return x->size == y->size && memcmp(x->value, y->value, x->size) == 0;
+		}
+		default:
+			return ((as_boolean *) a)->value == ((as_boolean *) b)->value;
+	}
+}
+
+static bool set_supported(const as_val * v)
+{
+	switch ( v ? as_val_type(v) : AS_UNDEF ) {
+		case AS_INTEGER:
+		case AS_STRING:
+		case AS_BYTES:
+		case AS_BOOLEAN:
+			return true;
+		case AS_DOUBLE: {
+			double d = ((as_double *) v)->value;
+			return d == d;
+		}
+		default:
+			return false;
+	}
+}
+
+/**
+ *	A reference to v to be held by a set or handed out of one. Bytes are
+ *	copied, since a UDF could otherwise change an element in place.
+ */
+static as_val * set_share(as_val * v)
+{
+	if ( as_val_type(v) != AS_BYTES ) {
+		return as_val_reserve(v);
+	}
+
+	as_bytes * src = (as_bytes *) v;
+	as_bytes * b = as_bytes_new(src->size);
+
+	if ( b ) {
+		memcpy(b->value, src->value, src->size);
+		b->size = src->size;
+		b->type = src->type;
+	}
+	return (as_val *) b;
+}
+
+/**
+ *	An element to be held by a set, made from a key borrowed from Lua.
+ */
+static as_val * set_own(const as_val * key)
+{
+	switch ( as_val_type(key) ) {
+		case AS_INTEGER:
+			return (as_val *) as_integer_new(((as_integer *) key)->value);
+		case AS_DOUBLE:
+			return (as_val *) as_double_new(((as_double *) key)->value);
+		case AS_STRING:
+			return (as_val *) as_string_new_strdup(((as_string *) key)->value);
+		case AS_BOOLEAN:
+			return (as_val *) as_boolean_new(((as_boolean *) key)->value);
+		default:
+			return set_share((as_val *) key);
+	}
+}
+
+/**
+ *	The element at the stack index, borrowed for the duration of the call
+ *	without allocating. Raises an error if it can't be a set element.
+ */
+static as_val * set_checkkey(lua_State * l, int index, mod_lua_tmpval * tmp)
+{
+	as_val * v = NULL;
+
+	switch ( lua_type(l, index) ) {
+		case LUA_TNUMBER:
+		case LUA_TSTRING:
+			v = mod_lua_toval_tmp(l, index, tmp);
+			break;
+		case LUA_TBOOLEAN:
+			v = (as_val *) as_boolean_init(&tmp->boolean, lua_toboolean(l, index));
+			break;
+		case LUA_TUSERDATA:
+			v = (as_val *) mod_lua_toview(l, index);
+			break;
+	}
+
+	if ( !set_supported(v) ) {
+		luaL_argerror(l, index, "set element must be a number, string, boolean or bytes");
+	}
+	return v;
+}
+
+/*******************************************************************************
+ * HASH TABLE
+ ******************************************************************************/
+
+/**
+ *	The slot holding key, or the empty slot where it would go.
+ */
+static uint32_t set_slot(const mod_lua_set * s, const as_val * key, uint32_t hash)
+{
+	uint32_t i = hash & s->mask;
+
+	while ( s->entries[i].val ) {
+		if ( s->entries[i].hash == hash && set_equal(s->entries[i].val, key) ) {
+			break;
+		}
+		i = (i + 1) & s->mask;
+	}
+	return i;
+}
+
+static bool set_contains(const mod_lua_set * s, const as_val * key, uint32_t hash)
+{
+	return s->count != 0 && s->entries[set_slot(s, key, hash)].val != NULL;
+}
+
+/**
+ *	Make room for n elements, keeping the load factor at most 3/4.
+ */
+static bool set_reserve(mod_lua_set * s, uint32_t n)
+{
+	uint64_t capacity = s->entries ? (uint64_t) s->mask + 1 : 0;
+
+	if ( (uint64_t) n * 4 <= capacity * 3 ) {
+		return true;
+	}
+
+	uint64_t new_capacity = SET_MIN_CAPACITY;
+
+	while ( (uint64_t) n * 4 > new_capacity * 3 ) {
+		new_capacity <<= 1;
+	}
+
+	if ( new_capacity > ((uint64_t) 1 << 31) ) {
+		return false;
+	}
+
+	set_entry * entries = (set_entry *) cf_calloc((size_t) new_capacity, sizeof(set_entry));
+
+	if ( !entries ) {
+		return false;
+	}
+
+	uint32_t mask = (uint32_t) new_capacity - 1;
+
+	for ( uint64_t i = 0; i < capacity; i++ ) {
+		set_entry * e = &s->entries[i];
+
+		if ( e->val ) {
+			uint32_t j = e->hash & mask;
+
+			while ( entries[j].val ) {
+				j = (j + 1) & mask;
+			}
+			entries[j] = *e;
+		}
+	}
+
+	cf_free(s->entries);
+	s->entries = entries;
+	s->mask = mask;
+	return true;
+}
+
+/**
+ *	Add an element not already in the set, taking its reference.
+ */
+static void set_put(mod_lua_set * s, as_val * v, uint32_t hash)
+{
+	uint32_t i = hash & s->mask;
+
+	while ( s->entries[i].val ) {
+		i = (i + 1) & s->mask;
+	}
+	s->entries[i].hash = hash;
+	s->entries[i].val = v;
+	s->count++;
+}
+
+static void set_delete(mod_lua_set * s, uint32_t i)
+{
+	as_val_destroy(s->entries[i].val);
+	s->count--;
+
+	// shift back any later entries that probed past slot i
+	uint32_t j = i;
+
+	while ( true ) {
+		j = (j + 1) & s->mask;
+
+		if ( !s->entries[j].val ) {
+			break;
+		}
+
+		uint32_t home = s->entries[j].hash & s->mask;
+
+		if ( ((j - home) & s->mask) >= ((j - i) & s->mask) ) {
+			s->entries[i] = s->entries[j];
+			i = j;
+		}
+	}
+	s->entries[i].val = NULL;
+}
+
+static void set_clear(mod_lua_set * s)
+{
+	if ( s->entries ) {
+		for ( uint32_t i = 0; i <= s->mask; i++ ) {
+			if ( s->entries[i].val ) {
+				as_val_destroy(s->entries[i].val);
+			}
+		}
+		cf_free(s->entries);
+	}
+	s->entries = NULL;
+	s->mask = 0;
+	s->count = 0;
+}
+
+/*******************************************************************************
+ * BOX FUNCTIONS
+ ******************************************************************************/
+
+static mod_lua_set * mod_lua_checkset(lua_State * l, int index)
+{
+	return (mod_lua_set *) luaL_checkudata(l, index, CLASS_NAME);
+}
+
+/**
+ *	Push a new empty set with room for n elements.
+ */
+static mod_lua_set * mod_lua_pushset(lua_State * l, uint32_t n)
+{
+	mod_lua_set * s = (mod_lua_set *) lua_newuserdata(l, sizeof(mod_lua_set));
+	s->box.scope = MOD_LUA_SCOPE_LUA;
+	s->box.value = NULL;
+	s->count = 0;
+	s->mask = 0;
+	s->entries = NULL;
+	luaL_getmetatable(l, CLASS_NAME);
+	lua_setmetatable(l, -2);
+
+	if ( n > 0 && !set_reserve(s, n) ) {
+		luaL_error(l, "set: out of memory");
+	}
+	return s;
+}
+
+/**
+ *	Add the element at the stack index, if it isn't already in the set.
+ */
+static bool mod_lua_set_add_arg(lua_State * l, mod_lua_set * s, int index)
+{
+	mod_lua_tmpval tmp;
+	as_val * key = set_checkkey(l, index, &tmp);
+	uint32_t hash = set_hash(key);
+
+	if ( set_contains(s, key, hash) ) {
+		return false;
+	}
+
+	as_val * v = NULL;
+
+	if ( !set_reserve(s, s->count + 1) || !(v = set_own(key)) ) {
+		luaL_error(l, "set: out of memory");
+	}
+
+	set_put(s, v, hash);
+	return true;
+}
+
+static void mod_lua_set_add_list(lua_State * l, mod_lua_set * s, as_list * list, int index)
+{
+	uint32_t n = as_list_size(list);
+
+	for ( uint32_t i = 0; i < n; i++ ) {
+		as_val * e = as_list_get(list, i);
+
+		if ( !set_supported(e) ) {
+			luaL_argerror(l, index, "set element must be a number, string, boolean or bytes");
+		}
+
+		uint32_t hash = set_hash(e);
+
+		if ( set_contains(s, e, hash) ) {
+			continue;
+		}
+
+		as_val * v = NULL;
+
+		if ( !set_reserve(s, s->count + 1) || !(v = set_share(e)) ) {
+			luaL_error(l, "set: out of memory");
+		}
+
+		set_put(s, v, hash);
+	}
+}
+
+as_list * mod_lua_set_tolist(lua_State * l, int index)
+{
+	mod_lua_set * s = (mod_lua_set *) luaL_testudata(l, index, CLASS_NAME);
+
+	if ( !s ) {
+		return NULL;
+	}
+
+	as_arraylist * list = as_arraylist_new(s->count, 10);
+
+	if ( list && s->count != 0 ) {
+		for ( uint32_t i = 0; i <= s->mask; i++ ) {
+			as_val * v = s->entries[i].val;
+
+			if ( v ) {
+				as_arraylist_append(list, set_share(v));
+			}
+		}
+	}
+	return (as_list *) list;
+}
+
+/*******************************************************************************
+ * FUNCTIONS
+ ******************************************************************************/
+
+static int mod_lua_set_gc(lua_State * l)
+{
+	set_clear(mod_lua_checkset(l, 1));
+	return 0;
+}
+
+/**
+ *	Create a set, optionally of the values in a table or list.
+ *
+ *	----------{.c}
+ *	Set set([table|List values])
+ *	----------
+ */
+static int mod_lua_set_cons(lua_State * l)
+{
+	if ( lua_type(l, 2) == LUA_TTABLE ) {
+		lua_Integer n = luaL_len(l, 2);
+		mod_lua_set * s = mod_lua_pushset(l, n > 0 && n <= UINT32_MAX ? (uint32_t) n : 0);
+
+		for ( lua_Integer i = 1; i <= n; i++ ) {
+			lua_rawgeti(l, 2, i);
+			mod_lua_set_add_arg(l, s, -1);
+			lua_pop(l, 1);
+		}
+		return 1;
+	}
+
+	if ( !lua_isnoneornil(l, 2) ) {
+		as_list * list = luaL_testudata(l, 2, LIST_CLASS_NAME) ? mod_lua_tolist(l, 2) : NULL;
+
+		if ( !list ) {
+			return luaL_argerror(l, 2, "expected a table or list");
+		}
+
+		mod_lua_set * s = mod_lua_pushset(l, as_list_size(list));
+		mod_lua_set_add_list(l, s, list, 2);
+		return 1;
+	}
+
+	mod_lua_pushset(l, 0);
+	return 1;
+}
+
+/**
+ *	Add an element to a set.
+ *
+ *	----------{.c}
+ *	boolean set.add(Set s, value v)
+ *	----------
+ *
+ *	@return true if v was added, false if it was already in the set.
+ */
+static int mod_lua_set_add(lua_State * l)
+{
+	mod_lua_set * s = mod_lua_checkset(l, 1);
+	lua_pushboolean(l, mod_lua_set_add_arg(l, s, 2));
+	return 1;
+}
+
+/**
+ *	Remove an element from a set.
+ *
+ *	----------{.c}
+ *	boolean set.remove(Set s, value v)
+ *	----------
+ *
+ *	@return true if v was removed, false if it wasn't in the set.
+ */
+static int mod_lua_set_remove(lua_State * l)
+{
+	mod_lua_set * s = mod_lua_checkset(l, 1);
+	mod_lua_tmpval tmp;
+	as_val * key = set_checkkey(l, 2, &tmp);
+
+	if ( s->count == 0 ) {
+		lua_pushboolean(l, false);
+		return 1;
+	}
+
+	uint32_t i = set_slot(s, key, set_hash(key));
+	bool found = s->entries[i].val != NULL;
+
+	if ( found ) {
+		set_delete(s, i);
+	}
+
+	lua_pushboolean(l, found);
+	return 1;
+}
+
+/**
+ *	Whether an element is in a set.
+ *
+ *	----------{.c}
+ *	boolean set.contains(Set s, value v)
+ *	----------
+ */
+static int mod_lua_set_contains(lua_State * l)
+{
+	mod_lua_set * s = mod_lua_checkset(l, 1);
+	mod_lua_tmpval tmp;
+	as_val * key = set_checkkey(l, 2, &tmp);
+
+	lua_pushboolean(l, set_contains(s, key, set_hash(key)));
+	return 1;
+}
+
+static int mod_lua_set_size(lua_State * l)
+{
+	lua_pushinteger(l, mod_lua_checkset(l, 1)->count);
+	return 1;
+}
+
+static int mod_lua_set_clear(lua_State * l)
+{
+	set_clear(mod_lua_checkset(l, 1));
+	return 0;
+}
+
+/**
+ *	A new set of the elements in either of two sets.
+ *
+ *	----------{.c}
+ *	Set set.union(Set a, Set b)
+ *	----------
+ */
+static int mod_lua_set_union(lua_State * l)
+{
+	mod_lua_set * a = mod_lua_checkset(l, 1);
+	mod_lua_set * b = mod_lua_checkset(l, 2);
+
+	// start from the larger, whose elements need no lookup
+	if ( a->count < b->count ) {
+		mod_lua_set * t = a;
+		a = b;
+		b = t;
+	}
+
+	mod_lua_set * s = mod_lua_pushset(l, a->count + b->count);
+
+	for ( uint32_t i = 0; a->count != 0 && i <= a->mask; i++ ) {
+		set_entry * e = &a->entries[i];
+
+		if ( e->val ) {
+			set_put(s, as_val_reserve(e->val), e->hash);
+		}
+	}
+
+	for ( uint32_t i = 0; b->count != 0 && i <= b->mask; i++ ) {
+		set_entry * e = &b->entries[i];
+
+		if ( e->val && !set_contains(s, e->val, e->hash) ) {
+			set_put(s, as_val_reserve(e->val), e->hash);
+		}
+	}
+
+	return 1;
+}
+
+/**
+ *	A new set of the elements in both of two sets.
+ *
+ *	----------{.c}
+ *	Set set.intersection(Set a, Set b)
+ *	----------
+ */
+static int mod_lua_set_intersection(lua_State * l)
+{
+	mod_lua_set * a = mod_lua_checkset(l, 1);
+	mod_lua_set * b = mod_lua_checkset(l, 2);
+
+	// walk the smaller, looking up in the larger
+	if ( a->count > b->count ) {
+		mod_lua_set * t = a;
+		a = b;
+		b = t;
+	}
+
+	mod_lua_set * s = mod_lua_pushset(l, a->count);
+
+	for ( uint32_t i = 0; a->count != 0 && i <= a->mask; i++ ) {
+		set_entry * e = &a->entries[i];
+
+		if ( e->val && set_contains(b, e->val, e->hash) ) {
+			set_put(s, as_val_reserve(e->val), e->hash);
+		}
+	}
+
+	return 1;
+}
+
+/**
+ *	A new set of the elements in the first of two sets but not the second.
+ *
+ *	----------{.c}
+ *	Set set.difference(Set a, Set b)
+ *	----------
+ */
+static int mod_lua_set_difference(lua_State * l)
+{
+	mod_lua_set * a = mod_lua_checkset(l, 1);
+	mod_lua_set * b = mod_lua_checkset(l, 2);
+	mod_lua_set * s = mod_lua_pushset(l, a->count);
+
+	for ( uint32_t i = 0; a->count != 0 && i <= a->mask; i++ ) {
+		set_entry * e = &a->entries[i];
+
+		if ( e->val && !set_contains(b, e->val, e->hash) ) {
+			set_put(s, as_val_reserve(e->val), e->hash);
+		}
+	}
+
+	return 1;
+}
+
+/**
+ *	A list of the elements of a set, in no particular order, to be stored in
+ *	a bin. A set is also converted to a list when returned from a UDF, or put
+ *	in a list, map or record.
+ *
+ *	----------{.c}
+ *	List set.to_list(Set s)
+ *	----------
+ */
+static int mod_lua_set_to_list(lua_State * l)
+{
+	mod_lua_checkset(l, 1);
+
+	as_list * list = mod_lua_set_tolist(l, 1);
+
+	if ( !list ) {
+		return 0;
+	}
+
+	mod_lua_pushlist(l, list);
+	return 1;
+}
+
+static int mod_lua_set_iterator_next(lua_State * l)
+{
+	mod_lua_set * s = (mod_lua_set *) lua_touserdata(l, lua_upvalueindex(1));
+	lua_Integer i = lua_tointeger(l, lua_upvalueindex(2));
+
+	for ( ; s->count != 0 && i <= s->mask; i++ ) {
+		as_val * v = s->entries[i].val;
+
+		if ( v ) {
+			lua_pushinteger(l, i + 1);
+			lua_replace(l, lua_upvalueindex(2));
+
+			if ( as_val_type(v) == AS_BYTES ) {
+				mod_lua_pushbytes(l, (as_bytes *) set_share(v));
+				return 1;
+			}
+			return mod_lua_pushval(l, v);
+		}
+	}
+	return 0;
+}
+
+/**
+ *	Iterate over the elements of a set, in no particular order. The set must
+ *	not be changed while iterating.
+ *
+ *	----------{.c}
+ *	for v in set.iterator(s) do ... end
+ *	----------
+ */
+static int mod_lua_set_iterator(lua_State * l)
+{
+	mod_lua_checkset(l, 1);
+	lua_pushvalue(l, 1);
+	lua_pushinteger(l, 0);
+	lua_pushcclosure(l, mod_lua_set_iterator_next, 2);
+	return 1;
+}
+
+static int mod_lua_set_tostring(lua_State * l)
+{
+	mod_lua_set * s = mod_lua_checkset(l, 1);
+	luaL_Buffer buf;
+	bool first = true;
+
+	luaL_buffinit(l, &buf);
+	luaL_addstring(&buf, "Set(");
+
+	for ( uint32_t i = 0; s->count != 0 && i <= s->mask; i++ ) {
+		as_val * v = s->entries[i].val;
+
+		if ( v ) {
+			char * str = as_val_tostring(v);
+
+			if ( !first ) {
+				luaL_addstring(&buf, ", ");
+			}
+			if ( str ) {
+				luaL_addstring(&buf, str);
+				cf_free(str);
+			}
+			first = false;
+		}
+	}
+
+	luaL_addstring(&buf, ")");
+	luaL_pushresult(&buf);
+	return 1;
+}
+
+/******************************************************************************
+ * OBJECT TABLE
+ *****************************************************************************/
+
+static const luaL_Reg object_table[] = {
+	{"add",             mod_lua_set_add},
+	{"remove",          mod_lua_set_remove},
+	{"contains",        mod_lua_set_contains},
+	{"size",            mod_lua_set_size},
+	{"clear",           mod_lua_set_clear},
+	{"union",           mod_lua_set_union},
+	{"intersection",    mod_lua_set_intersection},
+	{"difference",      mod_lua_set_difference},
+	{"to_list",         mod_lua_set_to_list},
+	{"iterator",        mod_lua_set_iterator},
+	{"tostring",        mod_lua_set_tostring},
+	{0, 0}
+};
+
+static const luaL_Reg object_metatable[] = {
+	{"__call",          mod_lua_set_cons},
+	{0, 0}
+};
+
+/******************************************************************************
+ * CLASS TABLE
+ *****************************************************************************/
+
+static const luaL_Reg class_metatable[] = {
+	{"__len",           mod_lua_set_size},
+	{"__tostring",      mod_lua_set_tostring},
+	{"__gc",            mod_lua_set_gc},
+	{0, 0}
+};
+
+/******************************************************************************
+ * REGISTER
+ *****************************************************************************/
+
+int mod_lua_set_register(lua_State * l) {
+	mod_lua_reg_object(l, OBJECT_NAME, object_table, object_metatable);
+	mod_lua_reg_class(l, CLASS_NAME, NULL, class_metatable);
+	return 1;
+}
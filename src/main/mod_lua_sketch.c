@@ -0,0 +1,886 @@
+/*
+ * Copyright 2008-2024 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#include <aerospike/mod_lua_sketch.h>
+#include <aerospike/as_bytes.h>
+#include <aerospike/mod_lua_bytes.h>
+#include <aerospike/mod_lua_hash.h>
+#include <aerospike/mod_lua_val.h>
+#include <aerospike/mod_lua_reg.h>
+#include <citrusleaf/alloc.h>
+#include <citrusleaf/cf_byte_order.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+/*******************************************************************************
+ * MACROS
+ ******************************************************************************/
+
+#define OBJECT_NAME "sketch"
+#define BYTES_CLASS_NAME "Bytes"
+
+#define SKETCH_VERSION 1
+
+// HyperLogLog: magic, precision, then one register per bucket.
+#define HLL_HEADER_SIZE 8
+#define HLL_MIN_PRECISION 4
+#define HLL_MAX_PRECISION 18
+#define HLL_DEFAULT_PRECISION 12
+
+// t-digest: magic, count, compression, min, max, then (mean, weight) pairs.
+#define TDIGEST_HEADER_SIZE 32
+#define TDIGEST_DEFAULT_COMPRESSION 100
+#define TDIGEST_MIN_COMPRESSION 10
+#define TDIGEST_MAX_COMPRESSION 10000
+
+// count-min: magic, width, depth, total, then depth rows of width counters.
+#define CMS_HEADER_SIZE 24
+#define CMS_DEFAULT_WIDTH 512
+#define CMS_DEFAULT_DEPTH 4
+#define CMS_MAX_WIDTH (1 << 20)
+#define CMS_MAX_DEPTH 16
+
+/*******************************************************************************
+ * TYPES
+ ******************************************************************************/
+
+/**
+ *	A sketch is a bytes value, so it is serialized as it stands, can be
+ *	stored in a bin, and passes through aggregate() and reduce() like any
+ *	other value. Its first four bytes identify it, and all of its fields are
+ *	little-endian, so a sketch built on the server can be merged by a client.
+ */
+typedef enum {
+	SKETCH_HLL,
+	SKETCH_TDIGEST,
+	SKETCH_CMS,
+	SKETCH_NONE
+} sketch_kind;
+
+static const char sketch_magic[][4] = {
+	{ 'H', 'L', 'L', SKETCH_VERSION },
+	{ 'T', 'D', 'G', SKETCH_VERSION },
+	{ 'C', 'M', 'S', SKETCH_VERSION }
+};
+
+static const char * const sketch_kind_names[] = { "hll", "tdigest", "cms" };
+
+typedef struct {
+	double	mean;
+	double	weight;
+} tdigest_centroid;
+
+/*******************************************************************************
+ * FIELDS
+ ******************************************************************************/
+
+static inline uint32_t sketch_get_u32(const uint8_t * p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return cf_swap_from_le32(v);
+}
+
+static inline void sketch_set_u32(uint8_t * p, uint32_t v)
+{
+	v = cf_swap_to_le32(v);
+	memcpy(p, &v, sizeof(v));
+}
+
+static inline uint64_t sketch_get_u64(const uint8_t * p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return cf_swap_from_le64(v);
+}
+
+static inline void sketch_set_u64(uint8_t * p, uint64_t v)
+{
+	v = cf_swap_to_le64(v);
+	memcpy(p, &v, sizeof(v));
+}
+
+static inline double sketch_get_f64(const uint8_t * p)
+{
+	uint64_t u = sketch_get_u64(p);
+	double d;
+	memcpy(&d, &u, sizeof(d));
+	return d;
+}
+
+static inline void sketch_set_f64(uint8_t * p, double d)
+{
+	uint64_t u;
+	memcpy(&u, &d, sizeof(u));
+	sketch_set_u64(p, u);
+}
+
+/*******************************************************************************
+ * BOX FUNCTIONS
+ ******************************************************************************/
+
+/**
+ *	The kind of sketch held by b, after checking that its header is within
+ *	the limits sketches are created with, and its size is consistent with
+ *	the header. Sketches may come from a bin, so this is all that stops a
+ *	malformed one from being used.
+ */
+static sketch_kind sketch_kind_of(const as_bytes * b)
+{
+	if ( !b || b->size < 8 ) {
+		return SKETCH_NONE;
+	}
+
+	const uint8_t * p = b->value;
+
+	if ( memcmp(p, sketch_magic[SKETCH_HLL], 4) == 0 ) {
+		uint8_t precision = p[4];
+		if ( precision >= HLL_MIN_PRECISION && precision <= HLL_MAX_PRECISION &&
+				b->size == HLL_HEADER_SIZE + ((uint32_t) 1 << precision) ) {
+			return SKETCH_HLL;
+		}
+	}
+	else if ( memcmp(p, sketch_magic[SKETCH_TDIGEST], 4) == 0 ) {
+		if ( b->size < TDIGEST_HEADER_SIZE ) {
+			return SKETCH_NONE;
+		}
+		// false for NaN too
+		double compression = sketch_get_f64(p + 8);
+		if ( compression >= TDIGEST_MIN_COMPRESSION &&
+				compression <= TDIGEST_MAX_COMPRESSION &&
+				b->size == TDIGEST_HEADER_SIZE +
+				(uint64_t) sketch_get_u32(p + 4) * sizeof(tdigest_centroid) ) {
+			return SKETCH_TDIGEST;
+		}
+	}
+	else if ( memcmp(p, sketch_magic[SKETCH_CMS], 4) == 0 ) {
+		if ( b->size < CMS_HEADER_SIZE ) {
+			return SKETCH_NONE;
+		}
+		uint32_t width = sketch_get_u32(p + 4);
+		uint32_t depth = sketch_get_u32(p + 8);
+		if ( width >= 1 && width <= CMS_MAX_WIDTH &&
+				depth >= 1 && depth <= CMS_MAX_DEPTH &&
+				b->size == CMS_HEADER_SIZE + (uint64_t) width * depth * 4 ) {
+			return SKETCH_CMS;
+		}
+	}
+	return SKETCH_NONE;
+}
+
+/**
+ *	The sketch of the given kind at the index. If writable, it must be bytes
+ *	rather than a slice. Raises an error otherwise.
+ */
+static as_bytes * sketch_check(lua_State * l, int index, sketch_kind kind, bool writable)
+{
+	as_bytes * b = NULL;
+
+	if ( writable ) {
+		b = (as_bytes *) mod_lua_box_value(
+				(mod_lua_box *) luaL_testudata(l, index, BYTES_CLASS_NAME));
+	}
+	else {
+		b = mod_lua_toview(l, index);
+	}
+
+	sketch_kind k = sketch_kind_of(b);
+
+	if ( k == SKETCH_NONE || (kind != SKETCH_NONE && k != kind) ) {
+		const char * msg = kind == SKETCH_HLL ? "expected a HyperLogLog sketch" :
+				kind == SKETCH_TDIGEST ? "expected a t-digest sketch" :
+				kind == SKETCH_CMS ? "expected a count-min sketch" :
+				"expected a sketch";
+		luaL_argerror(l, index, msg);
+	}
+	return b;
+}
+
+/**
+ *	Push a new sketch of size bytes, with its magic set and the rest zeroed.
+ */
+static uint8_t * sketch_push(lua_State * l, sketch_kind kind, uint32_t size)
+{
+	as_bytes * b = as_bytes_new(size);
+
+	if ( !b ) {
+		luaL_error(l, "sketch: out of memory");
+	}
+
+	memset(b->value, 0, size);
+	memcpy(b->value, sketch_magic[kind], 4);
+	b->size = size;
+	mod_lua_pushbytes(l, b);
+	return b->value;
+}
+
+/**
+ *	The 64-bit hash of the value at the index. Integral floats hash as the
+ *	equal integer, as they are the same Lua table key.
+ */
+static uint64_t sketch_hash(lua_State * l, int index)
+{
+	switch ( lua_type(l, index) ) {
+		case LUA_TNUMBER: {
+			int isint = 0;
+			lua_Integer i = lua_tointegerx(l, index, &isint);
+			uint8_t buf[8];
+
+			if ( isint ) {
+				sketch_set_u64(buf, (uint64_t) i);
+			}
+			else {
+				sketch_set_f64(buf, (double) lua_tonumber(l, index));
+			}
+			return mod_lua_wyhash64(buf, sizeof(buf), 0);
+		}
+		case LUA_TSTRING: {
+			size_t len;
+			const char * s = lua_tolstring(l, index, &len);
+			return mod_lua_wyhash64((const uint8_t *) s, len, 0);
+		}
+		default: {
+			as_bytes * b = mod_lua_toview(l, index);
+
+			if ( !b ) {
+				luaL_argerror(l, index, "expected a number, string or bytes");
+			}
+			return mod_lua_wyhash64(b->value, b->size, 0);
+		}
+	}
+}
+
+/*******************************************************************************
+ * HYPERLOGLOG
+ ******************************************************************************/
+
+static void hll_add(uint8_t * p, uint64_t hash)
+{
+	uint8_t precision = p[4];
+	uint8_t * reg = p + HLL_HEADER_SIZE;
+	uint32_t i = (uint32_t) (hash >> (64 - precision));
+	// the guard bit bounds the rank at 64 - precision + 1
+	uint64_t w = (hash << precision) | ((uint64_t) 1 << (precision - 1));
+	uint8_t rank = (uint8_t) (__builtin_clzll(w) + 1);
+
+	if ( rank > reg[i] ) {
+		reg[i] = rank;
+	}
+}
+
+static double hll_estimate(const uint8_t * p)
+{
+	uint8_t precision = p[4];
+	const uint8_t * reg = p + HLL_HEADER_SIZE;
+	uint32_t m = (uint32_t) 1 << precision;
+	double sum = 0;
+	uint32_t zeros = 0;
+
+	for ( uint32_t i = 0; i < m; i++ ) {
+		sum += ldexp(1.0, -(int) reg[i]);
+		zeros += reg[i] == 0;
+	}
+
+	double alpha = m == 16 ? 0.673 : m == 32 ? 0.697 : m == 64 ? 0.709 :
+			0.7213 / (1 + 1.079 / m);
+	double e = alpha * m * m / sum;
+
+	// small cardinalities are better counted from the empty registers
+	if ( e <= 2.5 * m && zeros != 0 ) {
+		e = m * log((double) m / zeros);
+	}
+	return e;
+}
+
+static void hll_merge(uint8_t * a, const uint8_t * b, uint32_t m)
+{
+	uint8_t * ra = a + HLL_HEADER_SIZE;
+	const uint8_t * rb = b + HLL_HEADER_SIZE;
+
+	for ( uint32_t i = 0; i < m; i++ ) {
+		ra[i] = ra[i] > rb[i] ? ra[i] : rb[i];
+	}
+}
+
+/*******************************************************************************
+ * T-DIGEST
+ ******************************************************************************/
+
+/**
+ *	A merging t-digest with the k1 scale function. Points are appended as
+ *	centroids of their own, and the whole list is sorted and merged once it
+ *	holds several times as many as the compression allows, so an add costs
+ *	amortized O(log n).
+ */
+
+static inline uint32_t tdigest_count(const uint8_t * p)
+{
+	return sketch_get_u32(p + 4);
+}
+
+static inline double tdigest_compression(const uint8_t * p)
+{
+	return sketch_get_f64(p + 8);
+}
+
+static inline uint32_t tdigest_limit(const uint8_t * p)
+{
+	return (uint32_t) (tdigest_compression(p) * 5) + 16;
+}
+
+static void tdigest_read(const uint8_t * p, tdigest_centroid * c, uint32_t n)
+{
+	p += TDIGEST_HEADER_SIZE;
+
+	for ( uint32_t i = 0; i < n; i++ ) {
+		c[i].mean = sketch_get_f64(p + i * sizeof(tdigest_centroid));
+		c[i].weight = sketch_get_f64(p + i * sizeof(tdigest_centroid) + 8);
+	}
+}
+
+static void tdigest_write(uint8_t * p, const tdigest_centroid * c, uint32_t n)
+{
+	sketch_set_u32(p + 4, n);
+	p += TDIGEST_HEADER_SIZE;
+
+	for ( uint32_t i = 0; i < n; i++ ) {
+		sketch_set_f64(p + i * sizeof(tdigest_centroid), c[i].mean);
+		sketch_set_f64(p + i * sizeof(tdigest_centroid) + 8, c[i].weight);
+	}
+}
+
+static int tdigest_cmp(const void * a, const void * b)
+{
+	double x = ((const tdigest_centroid *) a)->mean;
+	double y = ((const tdigest_centroid *) b)->mean;
+	return x < y ? -1 : x > y;
+}
+
+static inline double tdigest_k(double q, double compression)
+{
+	return compression / (2 * M_PI) * asin(2 * q - 1);
+}
+
+static inline double tdigest_q(double k, double compression)
+{
+	if ( k >= compression / 4 ) {
+		return 1;
+	}
+	return (sin(k * 2 * M_PI / compression) + 1) / 2;
+}
+
+/**
+ *	Sort and merge n centroids in place, returning how many remain.
+ */
+static uint32_t tdigest_compress(tdigest_centroid * c, uint32_t n, double compression)
+{
+	if ( n < 2 ) {
+		return n;
+	}
+
+	qsort(c, n, sizeof(tdigest_centroid), tdigest_cmp);
+
+	double total = 0;
+
+	for ( uint32_t i = 0; i < n; i++ ) {
+		total += c[i].weight;
+	}
+
+	double so_far = 0;
+	double limit = total * tdigest_q(tdigest_k(0, compression) + 1, compression);
+	uint32_t out = 0;
+
+	for ( uint32_t i = 1; i < n; i++ ) {
+		tdigest_centroid * cur = &c[out];
+
+		if ( so_far + cur->weight + c[i].weight <= limit ) {
+			cur->weight += c[i].weight;
+			cur->mean += (c[i].mean - cur->mean) * c[i].weight / cur->weight;
+		}
+		else {
+			so_far += cur->weight;
+			limit = total * tdigest_q(tdigest_k(so_far / total, compression) + 1,
+					compression);
+			c[++out] = c[i];
+		}
+	}
+	return out + 1;
+}
+
+/**
+ *	Compress the digest in place, after extra centroids are appended to it.
+ */
+static bool tdigest_flush(as_bytes * b, const tdigest_centroid * extra, uint32_t n_extra)
+{
+	uint8_t * p = b->value;
+	uint32_t n = tdigest_count(p);
+	tdigest_centroid * c = (tdigest_centroid *) cf_malloc(
+			((size_t) n + n_extra) * sizeof(tdigest_centroid));
+
+	if ( !c ) {
+		return false;
+	}
+
+	tdigest_read(p, c, n);
+	if ( n_extra > 0 ) {
+		memcpy(c + n, extra, n_extra * sizeof(tdigest_centroid));
+	}
+
+	uint32_t m = tdigest_compress(c, n + n_extra, tdigest_compression(p));
+	uint32_t size = TDIGEST_HEADER_SIZE + m * (uint32_t) sizeof(tdigest_centroid);
+
+	if ( !as_bytes_ensure(b, size, true) ) {
+		cf_free(c);
+		return false;
+	}
+
+	p = b->value;
+	tdigest_write(p, c, m);
+	b->size = size;
+	cf_free(c);
+	return true;
+}
+
+static void tdigest_bounds(uint8_t * p, double min, double max, bool empty)
+{
+	if ( empty || min < sketch_get_f64(p + 16) ) {
+		sketch_set_f64(p + 16, min);
+	}
+	if ( empty || max > sketch_get_f64(p + 24) ) {
+		sketch_set_f64(p + 24, max);
+	}
+}
+
+static bool tdigest_add(as_bytes * b, double x, double w)
+{
+	uint32_t n = tdigest_count(b->value);
+	uint32_t size = b->size + (uint32_t) sizeof(tdigest_centroid);
+
+	if ( n + 1 >= tdigest_limit(b->value) ) {
+		tdigest_centroid c = { x, w };
+		if ( !tdigest_flush(b, &c, 1) ) {
+			return false;
+		}
+	}
+	else {
+		if ( !as_bytes_ensure(b, size, true) ) {
+			return false;
+		}
+
+		uint8_t * e = b->value + b->size;
+		sketch_set_f64(e, x);
+		sketch_set_f64(e + 8, w);
+		sketch_set_u32(b->value + 4, n + 1);
+		b->size = size;
+	}
+
+	tdigest_bounds(b->value, x, x, n == 0);
+	return true;
+}
+
+static double tdigest_quantile(const tdigest_centroid * c, uint32_t n, double min,
+		double max, double q)
+{
+	if ( n == 1 || q <= 0 ) {
+		return n == 1 ? c[0].mean : min;
+	}
+	if ( q >= 1 ) {
+		return max;
+	}
+
+	double total = 0;
+
+	for ( uint32_t i = 0; i < n; i++ ) {
+		total += c[i].weight;
+	}
+
+	// each centroid's weight is centred on its mean
+	double index = q * total;
+	double so_far = c[0].weight / 2;
+
+	if ( index < so_far ) {
+		return min + (c[0].mean - min) * index / so_far;
+	}
+
+	for ( uint32_t i = 0; i + 1 < n; i++ ) {
+		double dw = (c[i].weight + c[i + 1].weight) / 2;
+
+		if ( so_far + dw > index ) {
+			return c[i].mean + (c[i + 1].mean - c[i].mean) * (index - so_far) / dw;
+		}
+		so_far += dw;
+	}
+
+	double last = c[n - 1].weight / 2;
+	double z = index - so_far;
+	return c[n - 1].mean + (max - c[n - 1].mean) * (z < last ? z / last : 1);
+}
+
+/*******************************************************************************
+ * COUNT-MIN
+ ******************************************************************************/
+
+/**
+ *	Counters are 32 bits and saturate. Row i counts at (h1 + i * h2) % width,
+ *	with h1 and h2 the halves of one 64-bit hash.
+ */
+
+static inline uint32_t cms_index(uint64_t hash, uint32_t row, uint32_t width)
+{
+	uint32_t h1 = (uint32_t) hash;
+	uint32_t h2 = (uint32_t) (hash >> 32) | 1;
+	return (uint32_t) ((h1 + (uint64_t) row * h2) % width);
+}
+
+static inline uint32_t cms_sat_add(uint32_t a, uint64_t b)
+{
+	uint64_t s = a + b;
+	return s > UINT32_MAX ? UINT32_MAX : (uint32_t) s;
+}
+
+static void cms_add(uint8_t * p, uint64_t hash, uint64_t count)
+{
+	uint32_t width = sketch_get_u32(p + 4);
+	uint32_t depth = sketch_get_u32(p + 8);
+	uint8_t * rows = p + CMS_HEADER_SIZE;
+
+	for ( uint32_t i = 0; i < depth; i++ ) {
+		uint8_t * c = rows + ((size_t) i * width + cms_index(hash, i, width)) * 4;
+		sketch_set_u32(c, cms_sat_add(sketch_get_u32(c), count));
+	}
+	sketch_set_u64(p + 16, sketch_get_u64(p + 16) + count);
+}
+
+static uint32_t cms_estimate(const uint8_t * p, uint64_t hash)
+{
+	uint32_t width = sketch_get_u32(p + 4);
+	uint32_t depth = sketch_get_u32(p + 8);
+	const uint8_t * rows = p + CMS_HEADER_SIZE;
+	uint32_t min = UINT32_MAX;
+
+	for ( uint32_t i = 0; i < depth; i++ ) {
+		uint32_t v = sketch_get_u32(rows +
+				((size_t) i * width + cms_index(hash, i, width)) * 4);
+		min = v < min ? v : min;
+	}
+	return min;
+}
+
+static void cms_merge(uint8_t * a, const uint8_t * b, size_t n)
+{
+	uint8_t * ca = a + CMS_HEADER_SIZE;
+	const uint8_t * cb = b + CMS_HEADER_SIZE;
+
+	for ( size_t i = 0; i < n; i++ ) {
+		sketch_set_u32(ca + i * 4, cms_sat_add(sketch_get_u32(ca + i * 4),
+				sketch_get_u32(cb + i * 4)));
+	}
+	sketch_set_u64(a + 16, sketch_get_u64(a + 16) + sketch_get_u64(b + 16));
+}
+
+/*******************************************************************************
+ * FUNCTIONS
+ ******************************************************************************/
+
+/**
+ *	Create an empty HyperLogLog sketch, for counting distinct values. It
+ *	takes 2^precision + 8 bytes, and its standard error is about
+ *	1.04 / sqrt(2^precision), so 1.6% at the default precision of 12.
+ *
+ *	----------{.c}
+ *	bytes sketch.hll([uint32 precision])
+ *	----------
+ */
+static int mod_lua_sketch_hll(lua_State * l)
+{
+	lua_Integer precision = luaL_optinteger(l, 1, HLL_DEFAULT_PRECISION);
+
+	luaL_argcheck(l, precision >= HLL_MIN_PRECISION && precision <= HLL_MAX_PRECISION,
+			1, "precision must be from 4 to 18");
+
+	uint8_t * p = sketch_push(l, SKETCH_HLL,
+			HLL_HEADER_SIZE + ((uint32_t) 1 << precision));
+	p[4] = (uint8_t) precision;
+	return 1;
+}
+
+/**
+ *	Create an empty t-digest sketch, for estimating quantiles. Larger
+ *	compression is more accurate, and a digest holds up to about that many
+ *	centroids of 16 bytes each once compressed.
+ *
+ *	----------{.c}
+ *	bytes sketch.tdigest([number compression])
+ *	----------
+ */
+static int mod_lua_sketch_tdigest(lua_State * l)
+{
+	lua_Number compression = luaL_optnumber(l, 1, TDIGEST_DEFAULT_COMPRESSION);
+
+	luaL_argcheck(l, compression >= TDIGEST_MIN_COMPRESSION &&
+			compression <= TDIGEST_MAX_COMPRESSION,
+			1, "compression must be from 10 to 10000");
+
+	uint8_t * p = sketch_push(l, SKETCH_TDIGEST, TDIGEST_HEADER_SIZE);
+	sketch_set_f64(p + 8, (double) compression);
+	return 1;
+}
+
+/**
+ *	Create an empty count-min sketch, for estimating how often values occur.
+ *	Estimates are never low, and are high by at most about
+ *	e / width * total with probability 1 - e^-depth.
+ *
+ *	----------{.c}
+ *	bytes sketch.cms([uint32 width [, uint32 depth]])
+ *	----------
+ */
+static int mod_lua_sketch_cms(lua_State * l)
+{
+	lua_Integer width = luaL_optinteger(l, 1, CMS_DEFAULT_WIDTH);
+	lua_Integer depth = luaL_optinteger(l, 2, CMS_DEFAULT_DEPTH);
+
+	luaL_argcheck(l, width >= 1 && width <= CMS_MAX_WIDTH, 1, "width must be from 1 to 2^20");
+	luaL_argcheck(l, depth >= 1 && depth <= CMS_MAX_DEPTH, 2, "depth must be from 1 to 16");
+
+	uint8_t * p = sketch_push(l, SKETCH_CMS,
+			CMS_HEADER_SIZE + (uint32_t) (width * depth * 4));
+	sketch_set_u32(p + 4, (uint32_t) width);
+	sketch_set_u32(p + 8, (uint32_t) depth);
+	return 1;
+}
+
+/**
+ *	Add a value to a sketch, and return the sketch, so this can be used as an
+ *	aggregate() function. A t-digest takes a number and an optional weight,
+ *	and a count-min sketch an optional count.
+ *
+ *	----------{.c}
+ *	bytes sketch.add(bytes s, value v [, number n])
+ *	----------
+ */
+static int mod_lua_sketch_add(lua_State * l)
+{
+	as_bytes * b = sketch_check(l, 1, SKETCH_NONE, true);
+
+	switch ( sketch_kind_of(b) ) {
+		case SKETCH_HLL:
+			hll_add(b->value, sketch_hash(l, 2));
+			break;
+		case SKETCH_TDIGEST: {
+			double x = (double) luaL_checknumber(l, 2);
+			double w = (double) luaL_optnumber(l, 3, 1);
+
+			luaL_argcheck(l, isfinite(x), 2, "value must be finite");
+			luaL_argcheck(l, w > 0 && isfinite(w), 3, "weight must be positive");
+
+			if ( !tdigest_add(b, x, w) ) {
+				return luaL_error(l, "sketch: out of memory");
+			}
+			break;
+		}
+		default: {
+			lua_Integer n = luaL_optinteger(l, 3, 1);
+
+			luaL_argcheck(l, n >= 0, 3, "count must not be negative");
+			cms_add(b->value, sketch_hash(l, 2), (uint64_t) n);
+			break;
+		}
+	}
+
+	lua_pushvalue(l, 1);
+	return 1;
+}
+
+/**
+ *	Merge the second sketch into the first, which is returned, so this can be
+ *	used as a reduce() function. The sketches must be of the same kind and
+ *	shape.
+ *
+ *	----------{.c}
+ *	bytes sketch.merge(bytes a, bytes b)
+ *	----------
+ */
+static int mod_lua_sketch_merge(lua_State * l)
+{
+	as_bytes * a = sketch_check(l, 1, SKETCH_NONE, true);
+	sketch_kind kind = sketch_kind_of(a);
+	as_bytes * b = sketch_check(l, 2, kind, false);
+
+	switch ( kind ) {
+		case SKETCH_HLL:
+			luaL_argcheck(l, a->value[4] == b->value[4], 2, "sketches differ in precision");
+			hll_merge(a->value, b->value, (uint32_t) 1 << a->value[4]);
+			break;
+		case SKETCH_TDIGEST: {
+			uint32_t n = tdigest_count(b->value);
+
+			if ( n == 0 ) {
+				break;
+			}
+
+			bool empty = tdigest_count(a->value) == 0;
+			double min = sketch_get_f64(b->value + 16);
+			double max = sketch_get_f64(b->value + 24);
+			// read b first, as a may be b, and moves when it grows
+			tdigest_centroid * c = (tdigest_centroid *) cf_malloc(
+					n * sizeof(tdigest_centroid));
+			bool ok = c != NULL;
+
+			if ( ok ) {
+				tdigest_read(b->value, c, n);
+				ok = tdigest_flush(a, c, n);
+				cf_free(c);
+			}
+
+			if ( !ok ) {
+				return luaL_error(l, "sketch: out of memory");
+			}
+
+			tdigest_bounds(a->value, min, max, empty);
+			break;
+		}
+		default:
+			luaL_argcheck(l, memcmp(a->value + 4, b->value + 4, 8) == 0, 2,
+					"sketches differ in width or depth");
+			cms_merge(a->value, b->value,
+					(size_t) sketch_get_u32(a->value + 4) * sketch_get_u32(a->value + 8));
+			break;
+	}
+
+	lua_pushvalue(l, 1);
+	return 1;
+}
+
+/**
+ *	The estimated number of distinct values added to a HyperLogLog sketch.
+ *
+ *	----------{.c}
+ *	int64 sketch.count(bytes s)
+ *	----------
+ */
+static int mod_lua_sketch_count(lua_State * l)
+{
+	as_bytes * b = sketch_check(l, 1, SKETCH_HLL, false);
+
+	lua_pushinteger(l, (lua_Integer) llround(hll_estimate(b->value)));
+	return 1;
+}
+
+/**
+ *	The estimated value at quantile q, from 0 to 1, of the values added to a
+ *	t-digest sketch. Returns nil if the digest is empty.
+ *
+ *	----------{.c}
+ *	number sketch.quantile(bytes s, number q)
+ *	----------
+ */
+static int mod_lua_sketch_quantile(lua_State * l)
+{
+	as_bytes * b = sketch_check(l, 1, SKETCH_TDIGEST, false);
+	double q = (double) luaL_checknumber(l, 2);
+	uint32_t n = tdigest_count(b->value);
+
+	if ( n == 0 || q != q ) {
+		return 0;
+	}
+
+	tdigest_centroid * c = (tdigest_centroid *) cf_malloc(n * sizeof(tdigest_centroid));
+
+	if ( !c ) {
+		return luaL_error(l, "sketch: out of memory");
+	}
+
+	tdigest_read(b->value, c, n);
+	n = tdigest_compress(c, n, tdigest_compression(b->value));
+
+	double v = tdigest_quantile(c, n, sketch_get_f64(b->value + 16),
+			sketch_get_f64(b->value + 24), q);
+
+	cf_free(c);
+	lua_pushnumber(l, v);
+	return 1;
+}
+
+/**
+ *	The estimated number of times a value was added to a count-min sketch.
+ *
+ *	----------{.c}
+ *	uint32 sketch.estimate(bytes s, value v)
+ *	----------
+ */
+static int mod_lua_sketch_estimate(lua_State * l)
+{
+	as_bytes * b = sketch_check(l, 1, SKETCH_CMS, false);
+
+	lua_pushinteger(l, (lua_Integer) cms_estimate(b->value, sketch_hash(l, 2)));
+	return 1;
+}
+
+/**
+ *	The kind of sketch, "hll", "tdigest" or "cms", or nil if the value isn't
+ *	a sketch.
+ *
+ *	----------{.c}
+ *	string sketch.kind(bytes s)
+ *	----------
+ */
+static int mod_lua_sketch_kind(lua_State * l)
+{
+	sketch_kind kind = sketch_kind_of(mod_lua_toview(l, 1));
+
+	if ( kind == SKETCH_NONE ) {
+		return 0;
+	}
+
+	lua_pushstring(l, sketch_kind_names[kind]);
+	return 1;
+}
+
+/******************************************************************************
+ * OBJECT TABLE
+ *****************************************************************************/
+
+static const luaL_Reg object_table[] = {
+	{"hll",             mod_lua_sketch_hll},
+	{"tdigest",         mod_lua_sketch_tdigest},
+	{"cms",             mod_lua_sketch_cms},
+	{"add",             mod_lua_sketch_add},
+	{"merge",           mod_lua_sketch_merge},
+	{"count",           mod_lua_sketch_count},
+	{"quantile",        mod_lua_sketch_quantile},
+	{"estimate",        mod_lua_sketch_estimate},
+	{"kind",            mod_lua_sketch_kind},
+	{0, 0}
+};
+
+static const luaL_Reg object_metatable[] = {
+	{0, 0}
+};
+
+/******************************************************************************
+ * REGISTER
+ *****************************************************************************/
+
+int mod_lua_sketch_register(lua_State * l) {
+	mod_lua_reg_object(l, OBJECT_NAME, object_table, object_metatable);
+	return 1;
+}
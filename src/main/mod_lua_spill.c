@@ -0,0 +1,793 @@
+/*
+ * Copyright 2008-2024 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#include <aerospike/mod_lua_spill.h>
+#include <aerospike/as_hashmap.h>
+#include <aerospike/as_map.h>
+#include <aerospike/as_msgpack.h>
+#include <aerospike/as_rec.h>
+#include <aerospike/as_serializer.h>
+#include <aerospike/as_val.h>
+#include <aerospike/mod_lua_map.h>
+#include <aerospike/mod_lua_val.h>
+#include <aerospike/mod_lua_reg.h>
+#include <citrusleaf/alloc.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+/*******************************************************************************
+ * MACROS
+ ******************************************************************************/
+
+#define OBJECT_NAME "spill"
+#define CLASS_NAME  "Spill"
+
+#define SPILL_MAX_KEYS (1 << 30)
+
+// Runs merged into one at a time, so at most SPILL_FANIN - 1 of each level
+// are open.
+#define SPILL_FANIN 8
+
+/*******************************************************************************
+ * TYPES
+ ******************************************************************************/
+
+typedef struct {
+	as_val *	key;
+	as_val *	value;
+	uint32_t	run;
+} spill_entry;
+
+typedef struct {
+	FILE *		f;		// NULL once read to its end
+	uint32_t	level;	// how many merges it is from a flush
+} spill_run;
+
+/**
+ *	A map which holds at most max_keys keys in memory. Adding a key to a full
+ *	spill sorts its entries by key and writes them to a temporary file, as a
+ *	run of msgpack key and value pairs, then empties it. A spilled key reads
+ *	as missing, so an aggregate starts it over, and the runs are combined by
+ *	a k-way merge at the end, which calls the merge function on the values
+ *	of a key found in more than one run.
+ *
+ *	Runs are merged in cascades as they are written: once SPILL_FANIN runs
+ *	of a level are open, they are merged into one run of the next level, so
+ *	only a few runs per level are ever open, and the levels grow with the
+ *	log of the number written.
+ *
+ *	The merge reads one entry of each run at a time, and gives the result as
+ *	maps of at most max_keys keys, in ascending key order, so the whole of a
+ *	large aggregation is never held in memory at once.
+ *
+ *	The box has no value, as a spill isn't an as_val - its map is its own.
+ */
+typedef struct {
+	mod_lua_box		box;	// value is always NULL
+	uint32_t		max_keys;
+	bool			merging;
+	bool			emitted;
+	as_map *		map;
+	spill_run *		runs;	// oldest first, by non-increasing level
+	uint32_t		n_runs;
+	uint32_t		runs_capacity;
+	spill_entry *	heap;	// the next entry of each run, lowest key first
+	uint32_t		heap_size;
+	uint32_t		heap_capacity;
+	uint8_t *		buf;
+	uint32_t		buf_capacity;
+} mod_lua_spill;
+
+/*******************************************************************************
+ * RUNS
+ ******************************************************************************/
+
+static int spill_cmp(const spill_entry * a, const spill_entry * b)
+{
+	msgpack_compare_t c = as_val_cmp(a->key, b->key);
+
+	if ( c == MSGPACK_COMPARE_LESS ) {
+		return -1;
+	}
+	if ( c == MSGPACK_COMPARE_GREATER ) {
+		return 1;
+	}
+	// equal keys merge in the order their runs were written
+	return a->run < b->run ? -1 : a->run > b->run;
+}
+
+static int spill_cmp_qsort(const void * a, const void * b)
+{
+	return spill_cmp((const spill_entry *) a, (const spill_entry *) b);
+}
+
+static bool spill_collect(const as_val * key, const as_val * value, void * udata)
+{
+	spill_entry ** next = (spill_entry **) udata;
+
+	(*next)->key = (as_val *) key;
+	(*next)->value = (as_val *) value;
+	(*next)->run = 0;
+	(*next)++;
+	return true;
+}
+
+static bool spill_reserve_buf(mod_lua_spill * s, uint32_t size)
+{
+	if ( size > s->buf_capacity ) {
+		uint8_t * buf = (uint8_t *) cf_realloc(s->buf, size);
+
+		if ( buf == NULL ) {
+			return false;
+		}
+		s->buf = buf;
+		s->buf_capacity = size;
+	}
+	return true;
+}
+
+static void spill_write_val(lua_State * l, mod_lua_spill * s, FILE * f, as_val * v)
+{
+	as_serializer ser;
+	as_msgpack_init(&ser);
+
+	uint32_t size = as_serializer_serialize_getsize(&ser, v);
+
+	if ( ! spill_reserve_buf(s, size) ) {
+		as_serializer_destroy(&ser);
+		luaL_error(l, "spill: out of memory");
+	}
+
+	as_serializer_serialize_presized(&ser, v, s->buf);
+	as_serializer_destroy(&ser);
+
+	if ( fwrite(&size, sizeof(size), 1, f) != 1 ||
+			fwrite(s->buf, 1, size, f) != size ) {
+		luaL_error(l, "spill: write failed: %s", strerror(errno));
+	}
+}
+
+/**
+ *	Read the next value of a run into v, which is NULL at its end. Returns
+ *	an error message rather than raising it, so the caller can let go of
+ *	what it holds first.
+ */
+static const char * spill_read_val(mod_lua_spill * s, FILE * f, as_val ** v)
+{
+	uint32_t size;
+
+	*v = NULL;
+
+	if ( fread(&size, sizeof(size), 1, f) != 1 ) {
+		return ferror(f) ? "spill: read failed" : NULL;
+	}
+
+	if ( ! spill_reserve_buf(s, size) ) {
+		return "spill: out of memory";
+	}
+
+	if ( fread(s->buf, 1, size, f) != size ) {
+		return "spill: run truncated";
+	}
+
+	as_buffer b = { .capacity = size, .size = size, .data = s->buf };
+	as_serializer ser;
+
+	as_msgpack_init(&ser);
+	int rc = as_serializer_deserialize(&ser, &b, v);
+	as_serializer_destroy(&ser);
+
+	if ( rc != 0 || *v == NULL ) {
+		as_val_destroy(*v);
+		*v = NULL;
+		return "spill: run corrupt";
+	}
+	return NULL;
+}
+
+/**
+ *	Read the next entry of a run into e, or close the run and return false
+ *	at its end. On an error, popped, the entry last taken from the run, if
+ *	any, is destroyed before raising it.
+ */
+static bool spill_read_entry(lua_State * l, mod_lua_spill * s, uint32_t run,
+		spill_entry * e, spill_entry * popped)
+{
+	FILE * f = s->runs[run].f;
+	as_val * key = NULL;
+	as_val * value = NULL;
+	const char * err = spill_read_val(s, f, &key);
+
+	if ( err == NULL && key == NULL ) {
+		fclose(f);
+		s->runs[run].f = NULL;
+		return false;
+	}
+
+	if ( err == NULL ) {
+		err = spill_read_val(s, f, &value);
+
+		if ( err == NULL && value == NULL ) {
+			err = "spill: run truncated";
+		}
+	}
+
+	if ( err != NULL ) {
+		as_val_destroy(key);
+
+		if ( popped != NULL ) {
+			as_val_destroy(popped->key);
+			as_val_destroy(popped->value);
+		}
+		luaL_error(l, "%s", err);
+	}
+
+	e->key = key;
+	e->value = value;
+	e->run = run;
+	return true;
+}
+
+static void spill_sift_up(mod_lua_spill * s, uint32_t i)
+{
+	spill_entry e = s->heap[i];
+
+	while ( i > 0 ) {
+		uint32_t parent = (i - 1) / 2;
+
+		if ( spill_cmp(&e, &s->heap[parent]) >= 0 ) {
+			break;
+		}
+		s->heap[i] = s->heap[parent];
+		i = parent;
+	}
+	s->heap[i] = e;
+}
+
+static void spill_sift_down(mod_lua_spill * s, uint32_t i)
+{
+	spill_entry e = s->heap[i];
+
+	while ( true ) {
+		uint32_t child = 2 * i + 1;
+
+		if ( child >= s->heap_size ) {
+			break;
+		}
+		if ( child + 1 < s->heap_size &&
+				spill_cmp(&s->heap[child + 1], &s->heap[child]) < 0 ) {
+			child++;
+		}
+		if ( spill_cmp(&s->heap[child], &e) >= 0 ) {
+			break;
+		}
+		s->heap[i] = s->heap[child];
+		i = child;
+	}
+	s->heap[i] = e;
+}
+
+/**
+ *	Take the lowest entry, and add the next entry of its run in its place.
+ *	The entry is off the heap before the read, so is destroyed only once if
+ *	the read fails.
+ */
+static spill_entry spill_pop(lua_State * l, mod_lua_spill * s)
+{
+	spill_entry e = s->heap[0];
+	spill_entry next;
+
+	s->heap[0] = s->heap[--s->heap_size];
+
+	if ( s->heap_size > 0 ) {
+		spill_sift_down(s, 0);
+	}
+
+	if ( spill_read_entry(l, s, e.run, &next, &e) ) {
+		s->heap[s->heap_size] = next;
+		spill_sift_up(s, s->heap_size++);
+	}
+	return e;
+}
+
+static void spill_clear_heap(mod_lua_spill * s)
+{
+	for ( uint32_t i = 0; i < s->heap_size; i++ ) {
+		as_val_destroy(s->heap[i].key);
+		as_val_destroy(s->heap[i].value);
+	}
+	s->heap_size = 0;
+}
+
+/**
+ *	Fill the heap with the first entry of each of the runs from first up to
+ *	last.
+ */
+static void spill_load_heap(lua_State * l, mod_lua_spill * s, uint32_t first,
+		uint32_t last)
+{
+	spill_clear_heap(s);
+
+	if ( last - first > s->heap_capacity ) {
+		spill_entry * heap = (spill_entry *) cf_realloc(s->heap,
+				(last - first) * sizeof(spill_entry));
+
+		if ( heap == NULL ) {
+			luaL_error(l, "spill: out of memory");
+		}
+		s->heap = heap;
+		s->heap_capacity = last - first;
+	}
+
+	for ( uint32_t i = first; i < last; i++ ) {
+		if ( fseek(s->runs[i].f, 0, SEEK_SET) != 0 ) {
+			luaL_error(l, "spill: seek failed: %s", strerror(errno));
+		}
+		if ( spill_read_entry(l, s, i, &s->heap[s->heap_size], NULL) ) {
+			s->heap_size++;
+		}
+	}
+
+	for ( uint32_t i = s->heap_size / 2; i-- > 0; ) {
+		spill_sift_down(s, i);
+	}
+}
+
+/**
+ *	Add a new, empty run at the given level. The file is anonymous, so it is
+ *	removed when it is closed, or if the process dies.
+ */
+static FILE * spill_new_run(lua_State * l, mod_lua_spill * s, uint32_t level)
+{
+	if ( s->n_runs == s->runs_capacity ) {
+		uint32_t capacity = s->runs_capacity ? s->runs_capacity * 2 : 8;
+		spill_run * runs = (spill_run *) cf_realloc(s->runs,
+				capacity * sizeof(spill_run));
+
+		if ( runs == NULL ) {
+			luaL_error(l, "spill: out of memory");
+		}
+		s->runs = runs;
+		s->runs_capacity = capacity;
+	}
+
+	FILE * f = tmpfile();
+
+	if ( f == NULL ) {
+		luaL_error(l, "spill: cannot create a temporary file: %s", strerror(errno));
+	}
+
+	s->runs[s->n_runs].f = f;
+	s->runs[s->n_runs].level = level;
+	s->n_runs++;
+	return f;
+}
+
+/**
+ *	Merge the runs from first on into one run, a level up, in their place.
+ *	Values of a key in more than one of them are kept, in run order, for the
+ *	final merge to combine.
+ */
+static void spill_merge_runs(lua_State * l, mod_lua_spill * s, uint32_t first)
+{
+	uint32_t last = s->n_runs;
+
+	// The output is a run too, so is closed if this fails part way.
+	FILE * out = spill_new_run(l, s, s->runs[last - 1].level + 1);
+
+	spill_load_heap(l, s, first, last);
+
+	while ( s->heap_size > 0 ) {
+		// Written while still on the heap, so an error leaks nothing.
+		spill_write_val(l, s, out, s->heap[0].key);
+		spill_write_val(l, s, out, s->heap[0].value);
+
+		spill_entry e = spill_pop(l, s);
+
+		as_val_destroy(e.key);
+		as_val_destroy(e.value);
+	}
+
+	if ( fflush(out) != 0 ) {
+		luaL_error(l, "spill: write failed: %s", strerror(errno));
+	}
+
+	// Each input was closed as it was read to its end.
+	s->runs[first] = s->runs[last];
+	s->n_runs = first + 1;
+}
+
+/**
+ *	Write the entries held in memory to a new run, in key order, and let them
+ *	go, then merge runs as need be.
+ */
+static void spill_flush(lua_State * l, mod_lua_spill * s)
+{
+	uint32_t n = as_map_size(s->map);
+
+	if ( n == 0 ) {
+		return;
+	}
+
+	FILE * f = spill_new_run(l, s, 0);
+
+	// The entries stay owned by the map until it is cleared, and the array
+	// is a userdata, so an error part way leaks nothing.
+	spill_entry * sorted = (spill_entry *) lua_newuserdatauv(l,
+			n * sizeof(spill_entry), 0);
+	spill_entry * next = sorted;
+
+	as_map_foreach(s->map, spill_collect, &next);
+	qsort(sorted, n, sizeof(spill_entry), spill_cmp_qsort);
+
+	for ( uint32_t i = 0; i < n; i++ ) {
+		spill_write_val(l, s, f, sorted[i].key);
+		spill_write_val(l, s, f, sorted[i].value);
+	}
+
+	if ( fflush(f) != 0 ) {
+		luaL_error(l, "spill: write failed: %s", strerror(errno));
+	}
+
+	lua_pop(l, 1);
+	as_map_clear(s->map);
+
+	while ( s->n_runs >= SPILL_FANIN &&
+			s->runs[s->n_runs - SPILL_FANIN].level ==
+					s->runs[s->n_runs - 1].level ) {
+		spill_merge_runs(l, s, s->n_runs - SPILL_FANIN);
+	}
+}
+
+/**
+ *	Let go of the entries, runs and map.
+ */
+static void spill_release(mod_lua_spill * s)
+{
+	spill_clear_heap(s);
+
+	for ( uint32_t i = 0; i < s->n_runs; i++ ) {
+		if ( s->runs[i].f != NULL ) {
+			fclose(s->runs[i].f);
+		}
+	}
+	s->n_runs = 0;
+
+	if ( s->map ) {
+		as_map_destroy(s->map);
+		s->map = NULL;
+	}
+
+	cf_free(s->heap);
+	cf_free(s->runs);
+	cf_free(s->buf);
+	s->heap = NULL;
+	s->heap_capacity = 0;
+	s->runs = NULL;
+	s->runs_capacity = 0;
+	s->buf = NULL;
+	s->buf_capacity = 0;
+}
+
+/*******************************************************************************
+ * BOX FUNCTIONS
+ ******************************************************************************/
+
+static mod_lua_spill * mod_lua_checkspill(lua_State * l, int index)
+{
+	return (mod_lua_spill *) luaL_checkudata(l, index, CLASS_NAME);
+}
+
+static mod_lua_spill * mod_lua_pushspill(lua_State * l, lua_Integer max_keys,
+		int merge)
+{
+	merge = lua_absindex(l, merge);
+
+	mod_lua_spill * s = (mod_lua_spill *) lua_newuserdatauv(l,
+			sizeof(mod_lua_spill), 1);
+
+	memset(s, 0, sizeof(mod_lua_spill));
+	s->box.scope = MOD_LUA_SCOPE_LUA;
+	s->box.value = NULL;
+	s->max_keys = (uint32_t) max_keys;
+	s->map = (as_map *) as_hashmap_new(max_keys < 32 ? (uint32_t) max_keys : 32);
+
+	luaL_getmetatable(l, CLASS_NAME);
+	lua_setmetatable(l, -2);
+
+	lua_pushvalue(l, merge);
+	lua_setiuservalue(l, -2, 1);
+	return s;
+}
+
+static int mod_lua_spill_gc(lua_State * l)
+{
+	spill_release(mod_lua_checkspill(l, 1));
+	return 0;
+}
+
+/*******************************************************************************
+ * FUNCTIONS
+ ******************************************************************************/
+
+/**
+ *	Create an empty spill, holding at most max_keys keys in memory. merge
+ *	combines two values of a key from different runs; without it, the later
+ *	value wins, as in map.merge().
+ *
+ *	----------{.c}
+ *	Spill spill(uint32 max_keys [, function merge])
+ *	----------
+ */
+static int mod_lua_spill_new(lua_State * l)
+{
+	lua_Integer max_keys = luaL_checkinteger(l, 2);
+
+	luaL_argcheck(l, max_keys >= 1 && max_keys <= SPILL_MAX_KEYS, 2,
+			"max_keys must be from 1 to 2^30");
+
+	if ( ! lua_isnoneornil(l, 3) ) {
+		luaL_checktype(l, 3, LUA_TFUNCTION);
+	}
+	lua_settop(l, 3);
+
+	mod_lua_pushspill(l, max_keys, 3);
+	return 1;
+}
+
+/**
+ *	An empty spill with the same max_keys and merge function as s.
+ *
+ *	----------{.c}
+ *	Spill spill.clone(Spill s)
+ *	----------
+ */
+static int mod_lua_spill_clone(lua_State * l)
+{
+	mod_lua_spill * s = mod_lua_checkspill(l, 1);
+
+	lua_getiuservalue(l, 1, 1);
+	mod_lua_pushspill(l, s->max_keys, -1);
+	return 1;
+}
+
+static int mod_lua_spill_index(lua_State * l)
+{
+	mod_lua_spill * s = mod_lua_checkspill(l, 1);
+	as_val * val = NULL;
+
+	if ( s->map ) {
+		mod_lua_tmpval tmp;
+		as_val * key = mod_lua_toval_tmp(l, 2, &tmp);
+		if ( key ) {
+			val = as_map_get(s->map, key);
+			as_val_destroy(key);
+		}
+	}
+
+	if ( val ) {
+		mod_lua_pushval(l, val);
+	}
+	else {
+		lua_pushnil(l);
+	}
+	return 1;
+}
+
+static int mod_lua_spill_newindex(lua_State * l)
+{
+	mod_lua_spill * s = mod_lua_checkspill(l, 1);
+
+	if ( s->merging ) {
+		return luaL_error(l, "spill: cannot set once merged");
+	}
+
+	// Spill before taking the key and value, as a failed write raises an
+	// error.
+	if ( ! lua_isnil(l, 3) && as_map_size(s->map) >= s->max_keys ) {
+		mod_lua_tmpval tmp;
+		as_val * key = mod_lua_toval_tmp(l, 2, &tmp);
+		bool found = key && as_map_get(s->map, key) != NULL;
+
+		as_val_destroy(key);
+
+		if ( ! found ) {
+			spill_flush(l, s);
+		}
+	}
+
+	as_val * key = mod_lua_takeval(l, 2);
+	as_val * val = mod_lua_takeval(l, 3);
+
+	if ( !key || as_val_type(val) == AS_REC ) {
+		as_val_destroy(key);
+		as_val_destroy(val);
+	}
+	else if ( !val ) {
+		as_map_remove(s->map, key);
+		as_val_destroy(key);
+	}
+	else if ( as_map_set(s->map, key, val) != 0 ) {
+		as_val_destroy(key);
+		as_val_destroy(val);
+	}
+	return 0;
+}
+
+/**
+ *	The number of keys held in memory.
+ *
+ *	----------{.c}
+ *	uint32 spill.size(Spill s)
+ *	----------
+ */
+static int mod_lua_spill_size(lua_State * l)
+{
+	mod_lua_spill * s = mod_lua_checkspill(l, 1);
+	lua_pushinteger(l, s->map ? as_map_size(s->map) : 0);
+	return 1;
+}
+
+/**
+ *	The number of runs written to disk.
+ *
+ *	----------{.c}
+ *	uint32 spill.runs(Spill s)
+ *	----------
+ */
+static int mod_lua_spill_runs(lua_State * l)
+{
+	lua_pushinteger(l, mod_lua_checkspill(l, 1)->n_runs);
+	return 1;
+}
+
+static int mod_lua_spill_next(lua_State * l)
+{
+	mod_lua_spill * s = mod_lua_checkspill(l, lua_upvalueindex(1));
+
+	if ( s->emitted && s->heap_size == 0 ) {
+		return 0;
+	}
+	s->emitted = true;
+
+	// Nothing was spilled, so the map is the whole result.
+	if ( s->n_runs == 0 ) {
+		mod_lua_pushmap(l, s->map);
+		s->map = NULL;
+		return 1;
+	}
+
+	as_map * chunk = mod_lua_pushmap(l,
+			(as_map *) as_hashmap_new(s->max_keys < 32 ? s->max_keys : 32));
+	int index = lua_gettop(l);
+
+	lua_getiuservalue(l, lua_upvalueindex(1), 1);
+	int merge = lua_gettop(l);
+
+	while ( s->heap_size > 0 && as_map_size(chunk) < s->max_keys ) {
+		spill_entry e = spill_pop(l, s);
+
+		// The chunk owns the entry from here, so a failed merge leaks nothing.
+		as_map_set(chunk, e.key, e.value);
+
+		while ( s->heap_size > 0 &&
+				as_val_cmp(s->heap[0].key, e.key) == MSGPACK_COMPARE_EQUAL ) {
+			spill_entry dup = spill_pop(l, s);
+
+			if ( lua_isnil(l, merge) ) {
+				as_map_set(chunk, as_val_reserve(e.key), dup.value);
+				as_val_destroy(dup.key);
+				continue;
+			}
+
+			lua_pushvalue(l, merge);
+			mod_lua_pushval(l, as_map_get(chunk, e.key));
+			mod_lua_pushval(l, dup.value);
+			as_val_destroy(dup.key);
+			as_val_destroy(dup.value);
+			lua_call(l, 2, 1);
+
+			as_val * merged = mod_lua_takeval(l, -1);
+			lua_pop(l, 1);
+
+			if ( merged != NULL ) {
+				as_map_set(chunk, as_val_reserve(e.key), merged);
+			}
+		}
+	}
+
+	// Every run has been read to its end, and closed.
+	if ( s->heap_size == 0 ) {
+		spill_release(s);
+	}
+
+	lua_settop(l, index);
+	return 1;
+}
+
+/**
+ *	Merge the runs and the keys still in memory, and return an iterator over
+ *	the result, as maps of at most max_keys keys each. The maps hold disjoint
+ *	keys, in ascending ranges, and there is always at least one. Nothing can
+ *	be set once the merge has begun.
+ *
+ *	----------{.c}
+ *	function spill.chunks(Spill s)
+ *	----------
+ */
+static int mod_lua_spill_chunks(lua_State * l)
+{
+	mod_lua_spill * s = mod_lua_checkspill(l, 1);
+
+	if ( s->merging ) {
+		return luaL_error(l, "spill: already merged");
+	}
+	s->merging = true;
+
+	if ( s->n_runs > 0 ) {
+		spill_flush(l, s);
+		spill_load_heap(l, s, 0, s->n_runs);
+	}
+
+	lua_settop(l, 1);
+	lua_pushcclosure(l, mod_lua_spill_next, 1);
+	return 1;
+}
+
+/******************************************************************************
+ * OBJECT TABLE
+ *****************************************************************************/
+
+static const luaL_Reg object_table[] = {
+	{"clone",           mod_lua_spill_clone},
+	{"size",            mod_lua_spill_size},
+	{"runs",            mod_lua_spill_runs},
+	{"chunks",          mod_lua_spill_chunks},
+	{0, 0}
+};
+
+static const luaL_Reg object_metatable[] = {
+	{"__call",          mod_lua_spill_new},
+	{0, 0}
+};
+
+/******************************************************************************
+ * CLASS TABLE
+ *****************************************************************************/
+
+static const luaL_Reg class_metatable[] = {
+	{"__index",         mod_lua_spill_index},
+	{"__newindex",      mod_lua_spill_newindex},
+	{"__len",           mod_lua_spill_size},
+	{"__gc",            mod_lua_spill_gc},
+	{0, 0}
+};
+
+/******************************************************************************
+ * REGISTER
+ *****************************************************************************/
+
+int mod_lua_spill_register(lua_State * l) {
+	mod_lua_reg_object(l, OBJECT_NAME, object_table, object_metatable);
+	mod_lua_reg_class(l, CLASS_NAME, NULL, class_metatable);
+	return 1;
+}
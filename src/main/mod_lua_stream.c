@@ -22,6 +22,8 @@
 #include <aerospike/as_val.h>
 
 #include <aerospike/mod_lua_val.h>
+#include <aerospike/mod_lua_predicate.h>
+#include <aerospike/mod_lua_projection.h>
 #include <aerospike/mod_lua_stream.h>
 #include <aerospike/mod_lua_reg.h>
 
@@ -35,6 +37,13 @@
 #define OBJECT_NAME "stream"
 #define CLASS_NAME "Stream"
 
+/*******************************************************************************
+ * GLOBALS
+ ******************************************************************************/
+
+// Never counted, so destroying it does nothing.
+const as_val mod_lua_stream_pending = { .type = AS_UNDEF, .free = false, .count = 0 };
+
 /*******************************************************************************
  * FUNCTIONS
  ******************************************************************************/
@@ -67,11 +76,43 @@ static int mod_lua_stream_tostring(lua_State * l) {
     return 1;
 }
 
-static int mod_lua_stream_read(lua_State * l) {
+/**
+ * Read the next value, or with a predicate the next value matching it, so
+ * values which don't match are skipped without being pushed into Lua. With a
+ * projection, the value is pushed as a map of the projected bins instead:
+ *      stream.read(s [, p [, projection]])
+ * When the stream has no value ready, yield if running on a coroutine, and
+ * read again once resumed.
+ */
+static int mod_lua_stream_read_k(lua_State * l, int status, lua_KContext ctx) {
+    (void) status;
     as_stream * stream = mod_lua_tostream(l, 1);
     if ( stream ) {
+        mod_lua_predicate * p = lua_isnoneornil(l, 2) ? NULL : mod_lua_topredicate(l, 2);
+        mod_lua_projection * proj = lua_isnoneornil(l, 3) ? NULL : mod_lua_toprojection(l, 3);
         as_val * val = as_stream_read(stream);
-        mod_lua_pushval(l, val );
+        while ( val == MOD_LUA_STREAM_PENDING ||
+                ( p != NULL && val != NULL && ! mod_lua_predicate_match(p, val) ) ) {
+            if ( val == MOD_LUA_STREAM_PENDING ) {
+                if ( lua_isyieldable(l) ) {
+                    return lua_yieldk(l, 0, ctx, mod_lua_stream_read_k);
+                }
+            }
+#ifdef AS_MOD_LUA_CLIENT
+            else {
+                as_val_destroy(val);
+            }
+#endif
+            val = as_stream_read(stream);
+        }
+        if ( proj != NULL && val != NULL ) {
+            as_map * map = mod_lua_projection_apply(proj, val);
+            mod_lua_pushval(l, (as_val *) map);
+            as_map_destroy(map);
+        }
+        else {
+            mod_lua_pushval(l, val );
+        }
 
 // Client aggregation queries read data from server nodes and populate this stream.  After that,
 // the client has no use for this value.  Therefore, destroy value after reading from this stream.
@@ -88,6 +129,10 @@ static int mod_lua_stream_read(lua_State * l) {
     }
 }
 
+static int mod_lua_stream_read(lua_State * l) {
+    return mod_lua_stream_read_k(l, LUA_OK, 0);
+}
+
 static int mod_lua_stream_readable(lua_State * l) {
     as_stream * stream = mod_lua_tostream(l, 1);
     if ( stream ) {
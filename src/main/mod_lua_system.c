@@ -97,6 +97,7 @@ const char as_lua_stream_ops[] =
 "	end\n"
 "	return out\n"
 "end\n"
+"local Spill = getmetatable(spill(1))\n"
 "local function clone(v)\n"
 "	local t = type(v)\n"
 "	if t == 'number' then\n"
@@ -112,6 +113,13 @@ const char as_lua_stream_ops[] =
 "			return map.clone(v)\n"
 "		elseif getmetatable(v) == List then\n"
 "			return list.clone(v)\n"
+"		elseif getmetatable(v) == Spill then\n"
+"			return spill.clone(v)\n"
+"		elseif getmetatable(v) == getmetatable(bytes()) then\n"
+"			local b = bytes(#v)\n"
+"			bytes.append_bytes(b, v, #v)\n"
+"			bytes.set_type(b, bytes.get_type(v))\n"
+"			return b\n"
 "		end\n"
 "		return nil\n"
 "	end\n"
@@ -158,7 +166,9 @@ const char as_lua_stream_ops[] =
 "end\n"
 "function aggregate( next, init, f )\n"
 "	local done = false\n"
+"	local chunks = nil\n"
 "	return function()\n"
+"		if chunks then return chunks() end\n"
 "		if done then return nil end\n"
 "		local a = clone(init)\n"
 "		for b in next do\n"
@@ -168,14 +178,58 @@ const char as_lua_stream_ops[] =
 "			end\n"
 "		end\n"
 "		done = true\n"
+"		if getmetatable(a) == Spill then\n"
+"			chunks = spill.chunks(a)\n"
+"			return chunks()\n"
+"		end\n"
+"		return a\n"
+"	end\n"
+"end\n"
+"function limit( next, n )\n"
+"	return function()\n"
+"		if n <= 0 then return nil end\n"
+"		local a = next()\n"
+"		n = a ~= nil and n - 1 or 0\n"
 "		return a\n"
 "	end\n"
 "end\n"
-"function stream_iterator(s)\n"
+"function where( next, p )\n"
 "	local done = false\n"
 "	return function()\n"
 "		if done then return nil end\n"
-"		local v = stream.read(s)\n"
+"		for a in next do\n"
+"			if predicate.match(p, a) then\n"
+"				return a\n"
+"			end\n"
+"		end\n"
+"		done = true\n"
+"		return nil\n"
+"	end\n"
+"end\n"
+"function project( next, proj )\n"
+"	local done = false\n"
+"	return function()\n"
+"		if done then return nil end\n"
+"		local a = next()\n"
+"		if a ~= nil then\n"
+"			return projection.apply(proj, a)\n"
+"		end\n"
+"		done = true\n"
+"		return nil\n"
+"	end\n"
+"end\n"
+"function stream_iterator(s, p, proj, n)\n"
+"	local done = false\n"
+"	return function()\n"
+"		if done then return nil end\n"
+"		if n then\n"
+"			if n <= 0 then\n"
+"				done = true\n"
+"				return nil\n"
+"			end\n"
+"			n = n - 1\n"
+"		end\n"
+"		local v = stream.read(s, p, proj)\n"
 "		if v == nil then\n"
 "			done = true\n"
 "		end\n"
@@ -188,6 +242,8 @@ const char as_lua_stream_ops[] =
 "local SCOPE_CLIENT = 2\n"
 "local SCOPE_EITHER = 3\n"
 "local SCOPE_BOTH = 4\n"
+"local SCOPE_MERGE = 5\n"
+"local SCOPE_PARTIAL = 6\n"
 "function StreamOps_create()\n"
 "	local self = {}\n"
 "	setmetatable(self, StreamOps_mt)\n"
@@ -216,12 +272,27 @@ const char as_lua_stream_ops[] =
 "				table.insert(server_ops, op)\n"
 "				table.insert(client_ops, op)\n"
 "				phase = SCOPE_CLIENT\n"
+"			elseif op.scope == SCOPE_CLIENT then\n"
+"				table.insert(client_ops, op)\n"
+"				phase = SCOPE_CLIENT\n"
 "			end\n"
 "		elseif phase == SCOPE_CLIENT then\n"
 "			table.insert(client_ops, op)\n"
 "		end\n"
 "	end\n"
-"	if scope == SCOPE_CLIENT then\n"
+"	if scope == SCOPE_MERGE then\n"
+"		local last = server_ops[#server_ops]\n"
+"		if last ~= nil and last.scope == SCOPE_BOTH then\n"
+"			return { last }\n"
+"		end\n"
+"		return {}\n"
+"	elseif scope == SCOPE_PARTIAL then\n"
+"		local first = client_ops[1]\n"
+"		if first ~= nil and first.scope == SCOPE_BOTH then\n"
+"			return { first }\n"
+"		end\n"
+"		return {}\n"
+"	elseif scope == SCOPE_CLIENT then\n"
 "		return client_ops\n"
 "	else\n"
 "		return server_ops\n"
@@ -243,7 +314,23 @@ const char as_lua_stream_ops[] =
 "	table.insert(self.ops, { scope = SCOPE_EITHER, name = \"filter\", func = filter, args = {...}})\n"
 "	return self\n"
 "end\n"
-"function StreamOps:groupby(f)\n"
+"function StreamOps:where(spec)\n"
+"	table.insert(self.ops, { scope = SCOPE_EITHER, name = \"where\", func = where, args = { predicate(spec) }})\n"
+"	return self\n"
+"end\n"
+"function StreamOps:select(bins)\n"
+"	table.insert(self.ops, { scope = SCOPE_EITHER, name = \"select\", func = project, args = { projection(bins) }})\n"
+"	return self\n"
+"end\n"
+"function StreamOps:limit(n)\n"
+"	local i = math.tointeger(n)\n"
+"	if i == nil or i < 0 then\n"
+"		error(\"limit must be a non-negative integer\", 2)\n"
+"	end\n"
+"	table.insert(self.ops, { scope = SCOPE_BOTH, name = \"limit\", func = limit, args = { i }})\n"
+"	return self\n"
+"end\n"
+"function StreamOps:groupby(f, max_keys)\n"
 "	local function _aggregate(m, v)\n"
 "		local k = f and f(v) or nil;\n"
 "		local l = m[k] or list()\n"
@@ -261,8 +348,103 @@ const char as_lua_stream_ops[] =
 "	function _reduce(m1, m2)\n"
 "		return map.merge(m1, m2, _merge)\n"
 "	end\n"
+"	if max_keys then\n"
+"		local function _fold(s, m)\n"
+"			for k, l in map.pairs(m) do\n"
+"				local l0 = s[k]\n"
+"				s[k] = l0 and _merge(l0, l) or l\n"
+"			end\n"
+"			return s\n"
+"		end\n"
+"		table.insert(self : aggregate(spill(max_keys, _merge), _aggregate).ops,\n"
+"			{ scope = SCOPE_CLIENT, name = \"aggregate\", func = aggregate, args = { spill(max_keys, _merge), _fold }})\n"
+"		return self\n"
+"	end\n"
 "	return self : aggregate(map(), _aggregate) : reduce(_reduce)\n"
 "end\n"
+"function StreamOps:topk(k, f)\n"
+"	local function _add(t, v)\n"
+"		if not f then\n"
+"			return topk.add(t, v, v)\n"
+"		end\n"
+"		local score = f(v)\n"
+"		if type(score) ~= \"number\" then\n"
+"			error(\"topk score must be a number\")\n"
+"		end\n"
+"		return topk.add(t, v, score)\n"
+"	end\n"
+"	local function _aggregate(t, v)\n"
+"		return _add(t or topk(k), v)\n"
+"	end\n"
+"	local function _list(t)\n"
+"		return t and topk.to_list(t) or list()\n"
+"	end\n"
+"	local function _reduce(l1, l2)\n"
+"		local t = topk(k)\n"
+"		for v in list.iterator(l1) do\n"
+"			_add(t, v)\n"
+"		end\n"
+"		for v in list.iterator(l2) do\n"
+"			_add(t, v)\n"
+"		end\n"
+"		return topk.to_list(t)\n"
+"	end\n"
+"	return self : aggregate(false, _aggregate) : map(_list) : reduce(_reduce)\n"
+"end\n"
+"function StreamOps:distinct(f)\n"
+"	local function _add(d, v)\n"
+"		local k = v\n"
+"		if f then\n"
+"			k = f(v)\n"
+"		end\n"
+"		if set.add(d.keys, k) then\n"
+"			list.append(d.values, v)\n"
+"		end\n"
+"		return d\n"
+"	end\n"
+"	local function _aggregate(d, v)\n"
+"		return _add(d or { keys = set(), values = list() }, v)\n"
+"	end\n"
+"	local function _list(d)\n"
+"		return d and d.values or list()\n"
+"	end\n"
+"	local function _reduce(l1, l2)\n"
+"		local d = { keys = set(), values = list() }\n"
+"		for v in list.iterator(l1) do\n"
+"			_add(d, v)\n"
+"		end\n"
+"		for v in list.iterator(l2) do\n"
+"			_add(d, v)\n"
+"		end\n"
+"		return d.values\n"
+"	end\n"
+"	return self : aggregate(false, _aggregate) : map(_list) : reduce(_reduce)\n"
+"end\n"
+"function StreamOps:sample(n, seed)\n"
+"	local function _aggregate(t, v)\n"
+"		return topk.add(t or topk.reservoir(n, seed, self.partial), v)\n"
+"	end\n"
+"	local function _list(t)\n"
+"		if not t then\n"
+"			return list{ list(), list() }\n"
+"		end\n"
+"		return list{ topk.to_list(t), topk.scores(t) }\n"
+"	end\n"
+"	local function _reduce(p1, p2)\n"
+"		local t = topk.reservoir(n, seed)\n"
+"		for _,p in ipairs({ p1, p2 }) do\n"
+"			local values, scores = p[1], p[2]\n"
+"			for i = 1, #values do\n"
+"				topk.add(t, values[i], scores[i])\n"
+"			end\n"
+"		end\n"
+"		return _list(t)\n"
+"	end\n"
+"	local function _values(p)\n"
+"		return p[1]\n"
+"	end\n"
+"	return self : aggregate(false, _aggregate) : map(_list) : reduce(_reduce) : map(_values)\n"
+"end\n"
 ;
 
 size_t as_lua_stream_ops_size = sizeof(as_lua_stream_ops);
@@ -292,16 +474,30 @@ const char as_lua_aerospike[] =
 "		return nil\n"
 "	end\n"
 "end\n"
-"function apply_stream(f, scope, istream, ostream, ...)\n"
+"function apply_stream(f, scope, partial, istream, ostream, ...)\n"
 "	if f == nil then\n"
 "		error(\"function not found\", 2)\n"
 "		return 2\n"
 "	end\n"
 "	local stream_ops = StreamOps_create();\n"
+"	stream_ops.partial = partial\n"
 "	success, result = pcall(f, stream_ops, ...)\n"
 "	if success then\n"
 "		local ops = StreamOps_select(result.ops, scope);\n"
-"		local values = StreamOps_apply(stream_iterator(istream), ops);\n"
+"		local i, p, proj, n = 1, nil, nil, nil\n"
+"		if ops[i] and ops[i].name == \"where\" then\n"
+"			p = ops[i].args[1]\n"
+"			i = i + 1\n"
+"		end\n"
+"		if ops[i] and ops[i].name == \"select\" then\n"
+"			proj = ops[i].args[1]\n"
+"			i = i + 1\n"
+"		end\n"
+"		if ops[i] and ops[i].name == \"limit\" then\n"
+"			n = ops[i].args[1]\n"
+"			i = i + 1\n"
+"		end\n"
+"		local values = StreamOps_apply(stream_iterator(istream, p, proj, n), ops, i);\n"
 "		for value in values do\n"
 "			if stream.write(ostream, value) ~= 0 then\n"
 "				break\n"
@@ -0,0 +1,441 @@
+/*
+ * Copyright 2008-2024 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#include <aerospike/mod_lua_topk.h>
+#include <aerospike/as_arraylist.h>
+#include <aerospike/as_nil.h>
+#include <aerospike/as_val.h>
+#include <aerospike/mod_lua_list.h>
+#include <aerospike/mod_lua_val.h>
+#include <aerospike/mod_lua_reg.h>
+#include <citrusleaf/alloc.h>
+#include <citrusleaf/cf_clock.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+/*******************************************************************************
+ * MACROS
+ ******************************************************************************/
+
+#define OBJECT_NAME "topk"
+#define CLASS_NAME  "TopK"
+
+#define TOPK_MAX_K (1 << 20)
+
+/*******************************************************************************
+ * TYPES
+ ******************************************************************************/
+
+typedef struct {
+	bool		is_int;
+	int64_t		i;
+	double		d;
+	uint64_t	tie;	// orders equal scores, drawn at random by a reservoir
+} topk_score;
+
+typedef struct {
+	topk_score	score;
+	uint32_t	slot;	// index of the value in the uservalue table
+} topk_entry;
+
+/**
+ *	The k values with the highest scores seen so far, as a binary min-heap on
+ *	score, so the lowest kept score is at the root and is the one replaced.
+ *	Values stay as Lua values, in a table held as the userdata's uservalue,
+ *	and are only converted when the result is taken as a list. The box has
+ *	no value, as a top-k isn't an as_val.
+ *
+ *	A reservoir is a top-k that scores each value it is offered with a
+ *	uniform random number, so what it holds is a uniform sample of k of the
+ *	values. Reservoirs from several nodes merge into a sample of the whole
+ *	by keeping the k highest of their scores. A reservoir also breaks ties
+ *	between equal scores at random, so none of the merged samples is favored.
+ */
+typedef struct {
+	mod_lua_box	box;		// value is always NULL
+	uint32_t	k;
+	uint32_t	size;
+	bool		random;
+	uint64_t	rng;
+	topk_entry	heap[];
+} mod_lua_topk;
+
+/*******************************************************************************
+ * HEAP
+ ******************************************************************************/
+
+static inline bool topk_less(const topk_score * a, const topk_score * b)
+{
+	if ( a->is_int && b->is_int ) {
+		if ( a->i != b->i ) {
+			return a->i < b->i;
+		}
+	}
+	else if ( a->d != b->d ) {
+		return a->d < b->d;
+	}
+	return a->tie < b->tie;
+}
+
+static void topk_sift_up(mod_lua_topk * t, uint32_t i)
+{
+	topk_entry e = t->heap[i];
+
+	while ( i > 0 ) {
+		uint32_t parent = (i - 1) / 2;
+
+		if ( !topk_less(&e.score, &t->heap[parent].score) ) {
+			break;
+		}
+		t->heap[i] = t->heap[parent];
+		i = parent;
+	}
+	t->heap[i] = e;
+}
+
+static void topk_sift_down(mod_lua_topk * t, uint32_t i)
+{
+	topk_entry e = t->heap[i];
+
+	while ( true ) {
+		uint32_t child = 2 * i + 1;
+
+		if ( child >= t->size ) {
+			break;
+		}
+		if ( child + 1 < t->size &&
+				topk_less(&t->heap[child + 1].score, &t->heap[child].score) ) {
+			child++;
+		}
+		if ( !topk_less(&t->heap[child].score, &e.score) ) {
+			break;
+		}
+		t->heap[i] = t->heap[child];
+		i = child;
+	}
+	t->heap[i] = e;
+}
+
+static inline uint64_t topk_mix(uint64_t z)
+{
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+static inline uint64_t topk_next(mod_lua_topk * t)
+{
+	// splitmix64
+	return topk_mix(t->rng += 0x9e3779b97f4a7c15ULL);
+}
+
+static inline double topk_random(mod_lua_topk * t)
+{
+	// 53 bits into [0, 1)
+	return (double) (topk_next(t) >> 11) * 0x1.0p-53;
+}
+
+static int topk_cmp_desc(const void * a, const void * b)
+{
+	const topk_score * x = &((const topk_entry *) a)->score;
+	const topk_score * y = &((const topk_entry *) b)->score;
+	return topk_less(y, x) ? -1 : topk_less(x, y);
+}
+
+/*******************************************************************************
+ * BOX FUNCTIONS
+ ******************************************************************************/
+
+static mod_lua_topk * mod_lua_checktopk(lua_State * l, int index)
+{
+	return (mod_lua_topk *) luaL_checkudata(l, index, CLASS_NAME);
+}
+
+static topk_score mod_lua_topk_checkscore(lua_State * l, int index)
+{
+	topk_score s = { false, 0, 0, 0 };
+	int isint = 0;
+
+	luaL_checktype(l, index, LUA_TNUMBER);
+	s.i = (int64_t) lua_tointegerx(l, index, &isint);
+	s.is_int = isint != 0;
+	s.d = s.is_int ? (double) s.i : (double) lua_tonumber(l, index);
+	luaL_argcheck(l, s.d == s.d, index, "score is NaN");
+	return s;
+}
+
+static mod_lua_topk * mod_lua_pushtopk(lua_State * l, int index)
+{
+	lua_Integer k = luaL_checkinteger(l, index);
+
+	luaL_argcheck(l, k >= 1 && k <= TOPK_MAX_K, index, "k must be from 1 to 2^20");
+
+	mod_lua_topk * t = (mod_lua_topk *) lua_newuserdatauv(l,
+			sizeof(mod_lua_topk) + (size_t) k * sizeof(topk_entry), 1);
+	t->box.scope = MOD_LUA_SCOPE_LUA;
+	t->box.value = NULL;
+	t->k = (uint32_t) k;
+	t->size = 0;
+	t->random = false;
+	t->rng = 0;
+
+	lua_createtable(l, (int) (k < 64 ? k : 64), 0);
+	lua_setiuservalue(l, -2, 1);
+
+	luaL_getmetatable(l, CLASS_NAME);
+	lua_setmetatable(l, -2);
+	return t;
+}
+
+/*******************************************************************************
+ * FUNCTIONS
+ ******************************************************************************/
+
+/**
+ *	Create an empty top-k.
+ *
+ *	----------{.c}
+ *	TopK topk(uint32 k)
+ *	----------
+ */
+static int mod_lua_topk_new(lua_State * l)
+{
+	mod_lua_pushtopk(l, 2);
+	return 1;
+}
+
+/**
+ *	Create an empty reservoir, which samples k of the values it is offered.
+ *	Without a seed, each reservoir draws a different sample. With one, each
+ *	stream number draws a different sample for the seed.
+ *
+ *	----------{.c}
+ *	TopK topk.reservoir(uint32 k [, integer seed [, integer stream]])
+ *	----------
+ */
+static int mod_lua_topk_reservoir(lua_State * l)
+{
+	lua_Integer seed = luaL_optinteger(l, 2, 0);
+	lua_Integer stream = luaL_optinteger(l, 3, 0);
+	bool seeded = !lua_isnoneornil(l, 2);
+
+	mod_lua_topk * t = mod_lua_pushtopk(l, 1);
+	t->random = true;
+	t->rng = seeded ? (uint64_t) seed ^ topk_mix((uint64_t) stream) :
+			cf_getns() ^ (uint64_t) (uintptr_t) t;
+	return 1;
+}
+
+/**
+ *	Offer a value with a score. It is kept if fewer than k values are held,
+ *	or its score is higher than the lowest held, which it replaces. Returns
+ *	the top-k, so this can be used as an aggregate() function. A reservoir
+ *	draws the score itself when none is given.
+ *
+ *	----------{.c}
+ *	TopK topk.add(TopK t, value v [, number score])
+ *	----------
+ */
+static int mod_lua_topk_add(lua_State * l)
+{
+	mod_lua_topk * t = mod_lua_checktopk(l, 1);
+	luaL_checkany(l, 2);
+	topk_score score = { false, 0, 0, 0 };
+	uint32_t i;
+
+	if ( t->random && lua_isnoneornil(l, 3) ) {
+		score.d = topk_random(t);
+	}
+	else {
+		score = mod_lua_topk_checkscore(l, 3);
+	}
+
+	if ( t->random ) {
+		score.tie = topk_next(t);
+	}
+
+	if ( t->size < t->k ) {
+		i = t->size++;
+		t->heap[i].slot = i + 1;
+	}
+	else if ( topk_less(&t->heap[0].score, &score) ) {
+		i = 0;
+	}
+	else {
+		lua_settop(l, 1);
+		return 1;
+	}
+
+	lua_getiuservalue(l, 1, 1);
+	lua_pushvalue(l, 2);
+	lua_rawseti(l, -2, t->heap[i].slot);
+	lua_pop(l, 1);
+
+	t->heap[i].score = score;
+
+	if ( i == 0 && t->size == t->k ) {
+		topk_sift_down(t, 0);
+	}
+	else {
+		topk_sift_up(t, i);
+	}
+
+	lua_settop(l, 1);
+	return 1;
+}
+
+/**
+ *	The lowest score a value must beat to be kept, or nil if fewer than k
+ *	values are held, so any value would be.
+ *
+ *	----------{.c}
+ *	number topk.threshold(TopK t)
+ *	----------
+ */
+static int mod_lua_topk_threshold(lua_State * l)
+{
+	mod_lua_topk * t = mod_lua_checktopk(l, 1);
+
+	if ( t->size < t->k ) {
+		return 0;
+	}
+
+	if ( t->heap[0].score.is_int ) {
+		lua_pushinteger(l, (lua_Integer) t->heap[0].score.i);
+	}
+	else {
+		lua_pushnumber(l, (lua_Number) t->heap[0].score.d);
+	}
+	return 1;
+}
+
+static int mod_lua_topk_size(lua_State * l)
+{
+	lua_pushinteger(l, mod_lua_checktopk(l, 1)->size);
+	return 1;
+}
+
+/**
+ *	The values held, highest score first, as a list. Values with equal
+ *	scores are in no particular order.
+ *
+ *	----------{.c}
+ *	List topk.to_list(TopK t)
+ *	----------
+ */
+static int mod_lua_topk_to_list(lua_State * l)
+{
+	mod_lua_topk * t = mod_lua_checktopk(l, 1);
+
+	// sort a copy, as the heap must stay a heap
+	topk_entry * sorted = (topk_entry *) lua_newuserdatauv(l,
+			(t->size ? t->size : 1) * sizeof(topk_entry), 0);
+
+	memcpy(sorted, t->heap, t->size * sizeof(topk_entry));
+	qsort(sorted, t->size, sizeof(topk_entry), topk_cmp_desc);
+
+	lua_getiuservalue(l, 1, 1);
+	int values = lua_gettop(l);
+
+	as_arraylist * list = as_arraylist_new(t->size, 10);
+
+	for ( uint32_t i = 0; i < t->size; i++ ) {
+		lua_rawgeti(l, values, sorted[i].slot);
+		as_val * v = mod_lua_toval(l, -1);
+		as_arraylist_append(list, v ? v : (as_val *) &as_nil);
+		lua_pop(l, 1);
+	}
+
+	lua_pop(l, 2);
+	mod_lua_pushlist(l, (as_list *) list);
+	return 1;
+}
+
+/**
+ *	The scores of the values held, highest first, in the same order as
+ *	topk.to_list(), so the pair can be merged into another top-k.
+ *
+ *	----------{.c}
+ *	List topk.scores(TopK t)
+ *	----------
+ */
+static int mod_lua_topk_scores(lua_State * l)
+{
+	mod_lua_topk * t = mod_lua_checktopk(l, 1);
+
+	topk_entry * sorted = (topk_entry *) lua_newuserdatauv(l,
+			(t->size ? t->size : 1) * sizeof(topk_entry), 0);
+
+	memcpy(sorted, t->heap, t->size * sizeof(topk_entry));
+	qsort(sorted, t->size, sizeof(topk_entry), topk_cmp_desc);
+
+	as_arraylist * list = as_arraylist_new(t->size, 10);
+
+	for ( uint32_t i = 0; i < t->size; i++ ) {
+		if ( sorted[i].score.is_int ) {
+			as_arraylist_append_int64(list, sorted[i].score.i);
+		}
+		else {
+			as_arraylist_append_double(list, sorted[i].score.d);
+		}
+	}
+
+	lua_pop(l, 1);
+	mod_lua_pushlist(l, (as_list *) list);
+	return 1;
+}
+
+/******************************************************************************
+ * OBJECT TABLE
+ *****************************************************************************/
+
+static const luaL_Reg object_table[] = {
+	{"reservoir",       mod_lua_topk_reservoir},
+	{"add",             mod_lua_topk_add},
+	{"threshold",       mod_lua_topk_threshold},
+	{"size",            mod_lua_topk_size},
+	{"to_list",         mod_lua_topk_to_list},
+	{"scores",          mod_lua_topk_scores},
+	{0, 0}
+};
+
+static const luaL_Reg object_metatable[] = {
+	{"__call",          mod_lua_topk_new},
+	{0, 0}
+};
+
+/******************************************************************************
+ * CLASS TABLE
+ *****************************************************************************/
+
+static const luaL_Reg class_metatable[] = {
+	{"__len",           mod_lua_topk_size},
+	{0, 0}
+};
+
+/******************************************************************************
+ * REGISTER
+ *****************************************************************************/
+
+int mod_lua_topk_register(lua_State * l) {
+	mod_lua_reg_object(l, OBJECT_NAME, object_table, object_metatable);
+	mod_lua_reg_class(l, CLASS_NAME, NULL, class_metatable);
+	return 1;
+}
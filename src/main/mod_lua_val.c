@@ -22,6 +22,7 @@
 #include <aerospike/mod_lua_record.h>
 #include <aerospike/mod_lua_bytes.h>
 #include <aerospike/mod_lua_geojson.h>
+#include <aerospike/mod_lua_set.h>
 #include <citrusleaf/alloc.h>
 #include <lua.h>
 #include <lauxlib.h>
@@ -31,6 +32,9 @@
 
 #include "internal.h"
 
+// Registry key for the per-invocation table of boxes, keyed by value.
+static const char g_box_cache_key = 0;
+
 as_val * mod_lua_takeval(lua_State * l, int i) {
     return mod_lua_toval(l, i);
 }
@@ -39,6 +43,23 @@ as_val * mod_lua_retval(lua_State * l) {
     return mod_lua_toval(l, -1);
 }
 
+/**
+ * Copy a string into an as_string allocated as a single block, rather than
+ * allocating the as_string and its value separately.
+ */
+static as_string * mod_lua_newstring(const char * str) {
+    size_t len = strlen(str);
+    as_string * s = (as_string *) cf_malloc(sizeof(as_string) + len + 1);
+    if ( s == NULL ) {
+        return NULL;
+    }
+    char * value = (char *) (s + 1);
+    memcpy(value, str, len + 1);
+    as_string_init_wlen(s, value, len, false);
+    s->_.free = true;
+    return s;
+}
+
 /**
  * Reads a val from the Lua stack
  * the val returned includes a refcount that must be freed later
@@ -54,9 +75,9 @@ as_val* mod_lua_toval(lua_State* l, int i) {
 				(as_val*)as_integer_new(lua_tointeger(l, i)) :
 				(as_val*)as_double_new(lua_tonumber(l, i));
 	case LUA_TBOOLEAN:
-		return (as_val*)as_boolean_new(lua_toboolean(l, i));
+		return (as_val*)(lua_toboolean(l, i) ? &as_true : &as_false);
 	case LUA_TSTRING:
-		return (as_val*)as_string_new(cf_strdup(lua_tostring(l, i)), true);
+		return (as_val*)mod_lua_newstring(lua_tostring(l, i));
 	case LUA_TUSERDATA : {
 		mod_lua_box* box = (mod_lua_box*)lua_touserdata(l, i);
 		if ( box && box->value ) {
@@ -82,7 +103,13 @@ as_val* mod_lua_toval(lua_State* l, int i) {
 			}
 		}
 		else {
-			return (as_val*)NULL;
+			// A slice only lives as long as its userdata, so copy it.
+			as_bytes* b = mod_lua_slice_tobytes(l, i);
+			if (b) {
+				return (as_val*)b;
+			}
+			// A set isn't an as_val, so store it as a list.
+			return (as_val*)mod_lua_set_tolist(l, i);
 		}
 	}
 	case LUA_TNIL :
@@ -96,6 +123,67 @@ as_val* mod_lua_toval(lua_State* l, int i) {
 }
 
 
+/**
+ * Reads a val from the Lua stack for use only until the calling function
+ * returns. Scalars are built in tmp, and strings refer to the Lua string,
+ * rather than being allocated. Release with as_val_destroy() as usual.
+ *
+ * @param l the lua_State to read the val from
+ * @param i the position of the val on the stack
+ * @param tmp storage for the val
+ * @returns the val if exists, otherwise NULL.
+ */
+as_val* mod_lua_toval_tmp(lua_State* l, int i, mod_lua_tmpval* tmp) {
+	switch (lua_type(l, i)) {
+	case LUA_TNUMBER:
+		return (lua_isinteger(l, i)) == 1 ?
+				(as_val*)as_integer_init(&tmp->integer, lua_tointeger(l, i)) :
+				(as_val*)as_double_init(&tmp->dbl, lua_tonumber(l, i));
+	case LUA_TSTRING:
+		// The Lua string stays on the stack for the duration of the call.
+		return (as_val*)as_string_init(&tmp->string, (char*)lua_tostring(l, i), false);
+	default:
+		return mod_lua_toval(l, i);
+	}
+}
+
+/**
+ * Push a list, map or bytes, reusing the box from an earlier push of the same
+ * value in this invocation if it is still alive.
+ */
+static int mod_lua_pushcollection(lua_State * l, const as_val * v) {
+    // Values are weak, so boxes the UDF has dropped are still collected.
+    mod_lua_pushcalltable(l, &g_box_cache_key, "v", NULL);
+    int cache = lua_gettop(l);
+
+    if ( lua_rawgetp(l, cache, v) == LUA_TUSERDATA ) {
+        mod_lua_box * box = (mod_lua_box *) lua_touserdata(l, -1);
+        if ( box->value == v ) {
+            lua_remove(l, cache);
+            return 1;
+        }
+    }
+    lua_pop(l, 1);
+
+    as_val_reserve(v);
+    switch( as_val_type(v) ) {
+        case AS_BYTES:
+            mod_lua_pushbytes(l, (as_bytes *) v);
+            break;
+        case AS_LIST:
+            mod_lua_pushlist(l, (as_list *) v);
+            break;
+        default:
+            mod_lua_pushmap(l, (as_map *) v);
+            break;
+    }
+
+    lua_pushvalue(l, -1);
+    lua_rawsetp(l, cache, v);
+    lua_remove(l, cache);
+    return 1;
+}
+
 /**
  * Pushes a val onto the Lua stack
  *
@@ -126,20 +214,10 @@ int mod_lua_pushval(lua_State * l, const as_val * v) {
             lua_pushstring(l, as_string_tostring((as_string *) v) );
             return 1;   
         }
-        case AS_BYTES: {
-            as_val_reserve(v);
-            mod_lua_pushbytes(l, (as_bytes *) v);
-            return 1;   
-        }
-        case AS_LIST: {
-            as_val_reserve(v);
-            mod_lua_pushlist(l, (as_list *) v);
-            return 1;   
-        }
+        case AS_BYTES:
+        case AS_LIST:
         case AS_MAP: {
-            as_val_reserve(v);
-            mod_lua_pushmap(l, (as_map *) v);
-            return 1;   
+            return mod_lua_pushcollection(l, v);
         }
         case AS_REC: {
             as_val_reserve(v);
@@ -0,0 +1,894 @@
+/*
+ * Copyright 2008-2024 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#include <aerospike/mod_lua_vector.h>
+#include <aerospike/as_arraylist.h>
+#include <aerospike/as_bytes.h>
+#include <aerospike/as_list.h>
+#include <aerospike/as_val.h>
+#include <aerospike/mod_lua_bytes.h>
+#include <aerospike/mod_lua_list.h>
+#include <aerospike/mod_lua_val.h>
+#include <aerospike/mod_lua_reg.h>
+#include <citrusleaf/alloc.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "internal.h"
+
+/*******************************************************************************
+ * MACROS
+ ******************************************************************************/
+
+#define OBJECT_NAME "vector"
+#define CLASS_NAME  "Vector"
+#define BYTES_CLASS_NAME "Bytes"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define VECTOR_AVX2 1
+#endif
+
+/*******************************************************************************
+ * TYPES
+ ******************************************************************************/
+
+typedef enum {
+	VECTOR_F32,
+	VECTOR_F64,
+	VECTOR_I64
+} vector_kind;
+
+/**
+ *	A packed vector of numbers. The elements are kept in an as_bytes, in
+ *	native byte order, so a vector is stored in a bin as plain bytes and
+ *	bytes read from a bin can be used as a vector without copying.
+ */
+typedef struct {
+	mod_lua_box	box;	// value is the as_bytes
+	vector_kind	kind;
+} mod_lua_vector;
+
+static const char * const vector_kind_names[] = { "f32", "f64", "i64", NULL };
+
+static const uint32_t vector_kind_sizes[] = { 4, 8, 8 };
+
+/*******************************************************************************
+ * KERNELS
+ ******************************************************************************/
+
+/**
+ *	Elements are loaded with memcpy(), as bytes from a bin need not be
+ *	aligned. The reductions keep 8 independent accumulators, which the
+ *	compiler turns into vector lanes. On x86_64 an AVX2 build of them is
+ *	chosen at runtime when the CPU has it.
+ *
+ *	Multiplies and adds must not be fused, or nodes with and without FMA
+ *	would score the same UDF differently. The AVX2 build leaves FMA out, and
+ *	the Makefile builds this file with -ffp-contract=off, which GCC needs as
+ *	it ignores the pragma.
+ */
+
+#ifdef __clang__
+#pragma STDC FP_CONTRACT OFF
+#endif
+
+#define VECTOR_LANES 8
+
+#define VECTOR_KERNELS(name, type, acc_type) \
+\
+static inline type vector_get_##name(const uint8_t * p, uint32_t i) \
+{ \
+	type v; \
+	memcpy(&v, p + (size_t) i * sizeof(type), sizeof(type)); \
+	return v; \
+} \
+\
+static inline void vector_set_##name(uint8_t * p, uint32_t i, type v) \
+{ \
+	memcpy(p + (size_t) i * sizeof(type), &v, sizeof(type)); \
+} \
+\
+static inline acc_type vector_dot_##name##_loop(const uint8_t * a, \
+		const uint8_t * b, uint32_t n) \
+{ \
+	acc_type acc[VECTOR_LANES] = { 0 }; \
+	uint32_t i = 0; \
+	for ( ; i + VECTOR_LANES <= n; i += VECTOR_LANES ) { \
+		for ( uint32_t j = 0; j < VECTOR_LANES; j++ ) { \
+			acc[j] += (acc_type) vector_get_##name(a, i + j) * \
+					(acc_type) vector_get_##name(b, i + j); \
+		} \
+	} \
+	for ( ; i < n; i++ ) { \
+		acc[0] += (acc_type) vector_get_##name(a, i) * \
+				(acc_type) vector_get_##name(b, i); \
+	} \
+	acc_type sum = 0; \
+	for ( uint32_t j = 0; j < VECTOR_LANES; j++ ) { \
+		sum += acc[j]; \
+	} \
+	return sum; \
+} \
+\
+static inline acc_type vector_sum_##name##_loop(const uint8_t * a, uint32_t n) \
+{ \
+	acc_type acc[VECTOR_LANES] = { 0 }; \
+	uint32_t i = 0; \
+	for ( ; i + VECTOR_LANES <= n; i += VECTOR_LANES ) { \
+		for ( uint32_t j = 0; j < VECTOR_LANES; j++ ) { \
+			acc[j] += (acc_type) vector_get_##name(a, i + j); \
+		} \
+	} \
+	for ( ; i < n; i++ ) { \
+		acc[0] += (acc_type) vector_get_##name(a, i); \
+	} \
+	acc_type sum = 0; \
+	for ( uint32_t j = 0; j < VECTOR_LANES; j++ ) { \
+		sum += acc[j]; \
+	} \
+	return sum; \
+} \
+\
+static inline void vector_axpy_##name##_loop(uint8_t * y, type alpha, \
+		const uint8_t * x, uint32_t n) \
+{ \
+	for ( uint32_t i = 0; i < n; i++ ) { \
+		vector_set_##name(y, i, (type) ((acc_type) vector_get_##name(y, i) + \
+				(acc_type) alpha * (acc_type) vector_get_##name(x, i))); \
+	} \
+}
+
+VECTOR_KERNELS(f32, float, float)
+VECTOR_KERNELS(f64, double, double)
+VECTOR_KERNELS(i64, int64_t, uint64_t)
+
+#ifdef VECTOR_AVX2
+
+#define VECTOR_KERNELS_AVX2(name, type, acc_type) \
+\
+__attribute__((target("avx2"))) \
+static acc_type vector_dot_##name##_avx2(const uint8_t * a, const uint8_t * b, \
+		uint32_t n) \
+{ \
+	return vector_dot_##name##_loop(a, b, n); \
+} \
+\
+__attribute__((target("avx2"))) \
+static acc_type vector_sum_##name##_avx2(const uint8_t * a, uint32_t n) \
+{ \
+	return vector_sum_##name##_loop(a, n); \
+} \
+\
+__attribute__((target("avx2"))) \
+static void vector_axpy_##name##_avx2(uint8_t * y, type alpha, \
+		const uint8_t * x, uint32_t n) \
+{ \
+	vector_axpy_##name##_loop(y, alpha, x, n); \
+}
+
+VECTOR_KERNELS_AVX2(f32, float, float)
+VECTOR_KERNELS_AVX2(f64, double, double)
+VECTOR_KERNELS_AVX2(i64, int64_t, uint64_t)
+
+#define VECTOR_DISPATCH(fn, name, ...) \
+	(__builtin_cpu_supports("avx2") ? \
+			vector_##fn##_##name##_avx2(__VA_ARGS__) : \
+			vector_##fn##_##name##_loop(__VA_ARGS__))
+
+#else
+
+#define VECTOR_DISPATCH(fn, name, ...) vector_##fn##_##name##_loop(__VA_ARGS__)
+
+#endif
+
+/*******************************************************************************
+ * BOX FUNCTIONS
+ ******************************************************************************/
+
+static mod_lua_vector * mod_lua_checkvector(lua_State * l, int index)
+{
+	return (mod_lua_vector *) mod_lua_checkbox(l, index, CLASS_NAME);
+}
+
+static as_bytes * mod_lua_vector_bytes(mod_lua_vector * v)
+{
+	return (as_bytes *) mod_lua_box_value(&v->box);
+}
+
+static uint32_t mod_lua_vector_len(mod_lua_vector * v)
+{
+	as_bytes * b = mod_lua_vector_bytes(v);
+	return b ? b->size / vector_kind_sizes[v->kind] : 0;
+}
+
+/**
+ *	Push a vector of the given kind over b, taking b's reference.
+ */
+static mod_lua_vector * mod_lua_pushvector(lua_State * l, vector_kind kind, as_bytes * b)
+{
+	mod_lua_vector * v = (mod_lua_vector *) lua_newuserdata(l, sizeof(mod_lua_vector));
+	v->box.scope = MOD_LUA_SCOPE_LUA;
+	v->box.value = b;
+	v->kind = kind;
+	luaL_getmetatable(l, CLASS_NAME);
+	lua_setmetatable(l, -2);
+	return v;
+}
+
+/**
+ *	Push a new zeroed vector of n elements.
+ */
+static mod_lua_vector * mod_lua_newvector(lua_State * l, vector_kind kind, uint32_t n)
+{
+	uint64_t size = (uint64_t) n * vector_kind_sizes[kind];
+
+	if ( size > UINT32_MAX ) {
+		return NULL;
+	}
+
+	as_bytes * b = as_bytes_new((uint32_t) size);
+
+	if ( !b ) {
+		return NULL;
+	}
+
+	memset(b->value, 0, (size_t) size);
+	b->size = (uint32_t) size;
+	return mod_lua_pushvector(l, kind, b);
+}
+
+static void mod_lua_vector_push(lua_State * l, mod_lua_vector * v, uint32_t i)
+{
+	const uint8_t * p = mod_lua_vector_bytes(v)->value;
+
+	switch ( v->kind ) {
+		case VECTOR_F32:
+			lua_pushnumber(l, (lua_Number) vector_get_f32(p, i));
+			break;
+		case VECTOR_F64:
+			lua_pushnumber(l, (lua_Number) vector_get_f64(p, i));
+			break;
+		case VECTOR_I64:
+			lua_pushinteger(l, (lua_Integer) vector_get_i64(p, i));
+			break;
+	}
+}
+
+/**
+ *	Store the number at stack index arg as element i.
+ */
+static void mod_lua_vector_store(lua_State * l, mod_lua_vector * v, uint32_t i, int arg)
+{
+	uint8_t * p = mod_lua_vector_bytes(v)->value;
+
+	switch ( v->kind ) {
+		case VECTOR_F32:
+			vector_set_f32(p, i, (float) luaL_checknumber(l, arg));
+			break;
+		case VECTOR_F64:
+			vector_set_f64(p, i, (double) luaL_checknumber(l, arg));
+			break;
+		case VECTOR_I64:
+			vector_set_i64(p, i, (int64_t) luaL_checkinteger(l, arg));
+			break;
+	}
+}
+
+/**
+ *	Two vectors of the same kind, or NULL if their lengths differ.
+ */
+static mod_lua_vector * mod_lua_vector_checkpair(lua_State * l, int ia, int ib,
+		mod_lua_vector ** b)
+{
+	mod_lua_vector * a = mod_lua_checkvector(l, ia);
+	*b = mod_lua_checkvector(l, ib);
+
+	if ( a->kind != (*b)->kind ) {
+		luaL_argerror(l, ib, "vectors differ in kind");
+	}
+
+	if ( mod_lua_vector_len(a) != mod_lua_vector_len(*b) ) {
+		return NULL;
+	}
+
+	return a;
+}
+
+/*******************************************************************************
+ * FUNCTIONS
+ ******************************************************************************/
+
+static int mod_lua_vector_gc(lua_State * l)
+{
+	mod_lua_freebox(l, 1, CLASS_NAME);
+	return 0;
+}
+
+/**
+ *	Create a zeroed vector.
+ *
+ *	----------{.c}
+ *	Vector vector.new(string kind, uint32 n)
+ *	----------
+ *
+ *	@param kind	"f32", "f64" or "i64".
+ *	@param n	The number of elements.
+ *
+ *	@return On success, the vector. Otherwise nil on failure.
+ */
+static int mod_lua_vector_new(lua_State * l)
+{
+	vector_kind	kind = (vector_kind) luaL_checkoption(l, 1, NULL, vector_kind_names);
+	lua_Integer	n = luaL_optinteger(l, 2, 0);
+
+	if ( n < 0 || n > UINT32_MAX ) {
+		return 0;
+	}
+
+	return mod_lua_newvector(l, kind, (uint32_t) n) ? 1 : 0;
+}
+
+/**
+ *	Create a vector from the numbers in a table or list.
+ *
+ *	----------{.c}
+ *	Vector vector(string kind, table|List values)
+ *	----------
+ */
+static int mod_lua_vector_cons(lua_State * l)
+{
+	vector_kind kind = (vector_kind) luaL_checkoption(l, 2, NULL, vector_kind_names);
+
+	if ( lua_type(l, 3) == LUA_TTABLE ) {
+		lua_Integer n = luaL_len(l, 3);
+		mod_lua_vector * v = n <= UINT32_MAX ?
+				mod_lua_newvector(l, kind, (uint32_t) n) : NULL;
+
+		if ( !v ) {
+			return 0;
+		}
+
+		for ( lua_Integer i = 1; i <= n; i++ ) {
+			lua_rawgeti(l, 3, i);
+			mod_lua_vector_store(l, v, (uint32_t) (i - 1), -1);
+			lua_pop(l, 1);
+		}
+		return 1;
+	}
+
+	as_list * list = luaL_testudata(l, 3, "List") ? mod_lua_tolist(l, 3) : NULL;
+
+	if ( !list ) {
+		return 0;
+	}
+
+	uint32_t n = as_list_size(list);
+	mod_lua_vector * v = mod_lua_newvector(l, kind, n);
+
+	if ( !v ) {
+		return 0;
+	}
+
+	uint8_t * p = mod_lua_vector_bytes(v)->value;
+
+	for ( uint32_t i = 0; i < n; i++ ) {
+		as_val * e = as_list_get(list, i);
+		as_integer * iv = as_integer_fromval(e);
+		as_double * dv = as_double_fromval(e);
+
+		if ( !iv && !dv ) {
+			return luaL_argerror(l, 3, "list element is not a number");
+		}
+
+		double d = iv ? (double) as_integer_get(iv) : as_double_get(dv);
+
+		switch ( kind ) {
+			case VECTOR_F32:
+				vector_set_f32(p, i, (float) d);
+				break;
+			case VECTOR_F64:
+				vector_set_f64(p, i, d);
+				break;
+			case VECTOR_I64:
+				vector_set_i64(p, i, iv ? as_integer_get(iv) : (int64_t) d);
+				break;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ *	View bytes as a vector, without copying. Changes through either are seen
+ *	by the other.
+ *
+ *	----------{.c}
+ *	Vector vector.from_bytes(bytes b, string kind)
+ *	----------
+ *
+ *	@param b	The bytes, whose size is a multiple of the element size.
+ *	@param kind	"f32", "f64" or "i64".
+ *
+ *	@return On success, the vector. Otherwise nil on failure.
+ */
+static int mod_lua_vector_from_bytes(lua_State * l)
+{
+	mod_lua_box *	box = (mod_lua_box *) luaL_testudata(l, 1, BYTES_CLASS_NAME);
+	vector_kind		kind = (vector_kind) luaL_checkoption(l, 2, NULL, vector_kind_names);
+	as_bytes *		b = (as_bytes *) mod_lua_box_value(box);
+
+	if ( !b || b->size % vector_kind_sizes[kind] != 0 ) {
+		return 0;
+	}
+
+	mod_lua_pushvector(l, kind, (as_bytes *) as_val_reserve(b));
+	return 1;
+}
+
+/**
+ *	The bytes holding a vector, without copying.
+ *
+ *	----------{.c}
+ *	bytes vector.to_bytes(Vector v)
+ *	----------
+ */
+static int mod_lua_vector_to_bytes(lua_State * l)
+{
+	as_bytes * b = mod_lua_vector_bytes(mod_lua_checkvector(l, 1));
+
+	if ( !b ) {
+		return 0;
+	}
+
+	mod_lua_pushval(l, (as_val *) b);
+	return 1;
+}
+
+static int mod_lua_vector_size(lua_State * l)
+{
+	lua_pushinteger(l, mod_lua_vector_len(mod_lua_checkvector(l, 1)));
+	return 1;
+}
+
+static int mod_lua_vector_kind(lua_State * l)
+{
+	lua_pushstring(l, vector_kind_names[mod_lua_checkvector(l, 1)->kind]);
+	return 1;
+}
+
+static int mod_lua_vector_index(lua_State * l)
+{
+	mod_lua_vector *	v = mod_lua_checkvector(l, 1);
+	lua_Integer			i = lua_isinteger(l, 2) ? lua_tointeger(l, 2) : 0;
+
+	if ( i < 1 || i > mod_lua_vector_len(v) ) {
+		return 0;
+	}
+
+	mod_lua_vector_push(l, v, (uint32_t) (i - 1));
+	return 1;
+}
+
+static int mod_lua_vector_newindex(lua_State * l)
+{
+	mod_lua_vector *	v = mod_lua_checkvector(l, 1);
+	lua_Integer			i = luaL_checkinteger(l, 2);
+
+	luaL_argcheck(l, i >= 1 && i <= mod_lua_vector_len(v), 2, "index out of range");
+	mod_lua_vector_store(l, v, (uint32_t) (i - 1), 3);
+	return 0;
+}
+
+static int mod_lua_vector_tostring(lua_State * l)
+{
+	mod_lua_vector * v = mod_lua_checkvector(l, 1);
+	lua_pushfstring(l, "Vector(%s, %d)", vector_kind_names[v->kind],
+			(int) mod_lua_vector_len(v));
+	return 1;
+}
+
+/**
+ *	Dot product of two vectors of the same kind and length.
+ *
+ *	----------{.c}
+ *	number vector.dot(Vector a, Vector b)
+ *	----------
+ *
+ *	@return On success, the dot product, an integer for i64 vectors. Otherwise
+ *			nil if the lengths differ.
+ */
+static int mod_lua_vector_dot(lua_State * l)
+{
+	mod_lua_vector * b;
+	mod_lua_vector * a = mod_lua_vector_checkpair(l, 1, 2, &b);
+
+	if ( !a ) {
+		return 0;
+	}
+
+	const uint8_t * pa = mod_lua_vector_bytes(a)->value;
+	const uint8_t * pb = mod_lua_vector_bytes(b)->value;
+	uint32_t n = mod_lua_vector_len(a);
+
+	switch ( a->kind ) {
+		case VECTOR_F32:
+			lua_pushnumber(l, (lua_Number) VECTOR_DISPATCH(dot, f32, pa, pb, n));
+			break;
+		case VECTOR_F64:
+			lua_pushnumber(l, (lua_Number) VECTOR_DISPATCH(dot, f64, pa, pb, n));
+			break;
+		case VECTOR_I64:
+			lua_pushinteger(l, (lua_Integer) VECTOR_DISPATCH(dot, i64, pa, pb, n));
+			break;
+	}
+	return 1;
+}
+
+static double mod_lua_vector_norm2(mod_lua_vector * v)
+{
+	const uint8_t * p = mod_lua_vector_bytes(v)->value;
+	uint32_t n = mod_lua_vector_len(v);
+
+	switch ( v->kind ) {
+		case VECTOR_F32:
+			return (double) VECTOR_DISPATCH(dot, f32, p, p, n);
+		case VECTOR_F64:
+			return VECTOR_DISPATCH(dot, f64, p, p, n);
+		default: {
+			double sum = 0;
+			for ( uint32_t i = 0; i < n; i++ ) {
+				double e = (double) vector_get_i64(p, i);
+				sum += e * e;
+			}
+			return sum;
+		}
+	}
+}
+
+/**
+ *	Euclidean norm.
+ *
+ *	----------{.c}
+ *	number vector.norm(Vector v)
+ *	----------
+ */
+static int mod_lua_vector_norm(lua_State * l)
+{
+	lua_pushnumber(l, (lua_Number) sqrt(mod_lua_vector_norm2(mod_lua_checkvector(l, 1))));
+	return 1;
+}
+
+/**
+ *	Cosine similarity of two vectors of the same kind and length.
+ *
+ *	----------{.c}
+ *	number vector.cosine(Vector a, Vector b)
+ *	----------
+ *
+ *	@return On success, the similarity. Otherwise nil if the lengths differ or
+ *			either vector is zero.
+ */
+static int mod_lua_vector_cosine(lua_State * l)
+{
+	mod_lua_vector * b;
+	mod_lua_vector * a = mod_lua_vector_checkpair(l, 1, 2, &b);
+
+	if ( !a ) {
+		return 0;
+	}
+
+	double na = mod_lua_vector_norm2(a);
+	double nb = mod_lua_vector_norm2(b);
+
+	if ( na == 0 || nb == 0 ) {
+		return 0;
+	}
+
+	mod_lua_vector_dot(l);
+	double dot = (double) lua_tonumber(l, -1);
+	lua_pop(l, 1);
+
+	lua_pushnumber(l, (lua_Number) (dot / sqrt(na * nb)));
+	return 1;
+}
+
+/**
+ *	y = y + alpha * x, in place.
+ *
+ *	----------{.c}
+ *	bool vector.axpy(Vector y, number alpha, Vector x)
+ *	----------
+ *
+ *	@return On success, true. Otherwise false if the lengths differ.
+ */
+static int mod_lua_vector_axpy(lua_State * l)
+{
+	mod_lua_vector * x;
+	mod_lua_vector * y = mod_lua_vector_checkpair(l, 1, 3, &x);
+
+	if ( !y ) {
+		lua_pushboolean(l, false);
+		return 1;
+	}
+
+	uint8_t * py = mod_lua_vector_bytes(y)->value;
+	const uint8_t * px = mod_lua_vector_bytes(x)->value;
+	uint32_t n = mod_lua_vector_len(y);
+
+	switch ( y->kind ) {
+		case VECTOR_F32:
+			VECTOR_DISPATCH(axpy, f32, py, (float) luaL_checknumber(l, 2), px, n);
+			break;
+		case VECTOR_F64:
+			VECTOR_DISPATCH(axpy, f64, py, (double) luaL_checknumber(l, 2), px, n);
+			break;
+		case VECTOR_I64:
+			VECTOR_DISPATCH(axpy, i64, py, (int64_t) luaL_checkinteger(l, 2), px, n);
+			break;
+	}
+
+	lua_pushboolean(l, true);
+	return 1;
+}
+
+/**
+ *	Sum of the elements.
+ *
+ *	----------{.c}
+ *	number vector.sum(Vector v)
+ *	----------
+ */
+static int mod_lua_vector_sum(lua_State * l)
+{
+	mod_lua_vector * v = mod_lua_checkvector(l, 1);
+	const uint8_t * p = mod_lua_vector_bytes(v)->value;
+	uint32_t n = mod_lua_vector_len(v);
+
+	switch ( v->kind ) {
+		case VECTOR_F32:
+			lua_pushnumber(l, (lua_Number) VECTOR_DISPATCH(sum, f32, p, n));
+			break;
+		case VECTOR_F64:
+			lua_pushnumber(l, (lua_Number) VECTOR_DISPATCH(sum, f64, p, n));
+			break;
+		case VECTOR_I64:
+			lua_pushinteger(l, (lua_Integer) VECTOR_DISPATCH(sum, i64, p, n));
+			break;
+	}
+	return 1;
+}
+
+/**
+ *	Whether element i is ordered before element j, for max (or min if
+ *	!greater). NaNs order last.
+ */
+static inline bool mod_lua_vector_before(mod_lua_vector * v, uint32_t i,
+		uint32_t j, bool greater)
+{
+	const uint8_t * p = mod_lua_vector_bytes(v)->value;
+
+	switch ( v->kind ) {
+		case VECTOR_F32: {
+			float a = vector_get_f32(p, i);
+			float b = vector_get_f32(p, j);
+			return greater ? a > b || (b != b && a == a) : a < b || (b != b && a == a);
+		}
+		case VECTOR_F64: {
+			double a = vector_get_f64(p, i);
+			double b = vector_get_f64(p, j);
+			return greater ? a > b || (b != b && a == a) : a < b || (b != b && a == a);
+		}
+		default: {
+			int64_t a = vector_get_i64(p, i);
+			int64_t b = vector_get_i64(p, j);
+			return greater ? a > b : a < b;
+		}
+	}
+}
+
+static int mod_lua_vector_extreme(lua_State * l, bool greater)
+{
+	mod_lua_vector * v = mod_lua_checkvector(l, 1);
+	uint32_t n = mod_lua_vector_len(v);
+
+	if ( n == 0 ) {
+		return 0;
+	}
+
+	uint32_t best = 0;
+
+	for ( uint32_t i = 1; i < n; i++ ) {
+		if ( mod_lua_vector_before(v, i, best, greater) ) {
+			best = i;
+		}
+	}
+
+	mod_lua_vector_push(l, v, best);
+	lua_pushinteger(l, (lua_Integer) best + 1);
+	return 2;
+}
+
+/**
+ *	Smallest element, and its index.
+ *
+ *	----------{.c}
+ *	number, uint32 vector.min(Vector v)
+ *	----------
+ *
+ *	@return The value and index, or nil if v is empty.
+ */
+static int mod_lua_vector_min(lua_State * l)
+{
+	return mod_lua_vector_extreme(l, false);
+}
+
+/**
+ *	Largest element, and its index.
+ *
+ *	----------{.c}
+ *	number, uint32 vector.max(Vector v)
+ *	----------
+ *
+ *	@return The value and index, or nil if v is empty.
+ */
+static int mod_lua_vector_max(lua_State * l)
+{
+	return mod_lua_vector_extreme(l, true);
+}
+
+/**
+ *	Restore the min-heap (by value) of indexes below heap[i].
+ */
+static void mod_lua_vector_sift(mod_lua_vector * v, uint32_t * heap, uint32_t n, uint32_t i)
+{
+	while ( true ) {
+		uint32_t least = i;
+		uint32_t c = 2 * i + 1;
+
+		if ( c < n && mod_lua_vector_before(v, heap[least], heap[c], true) ) {
+			least = c;
+		}
+		if ( c + 1 < n && mod_lua_vector_before(v, heap[least], heap[c + 1], true) ) {
+			least = c + 1;
+		}
+		if ( least == i ) {
+			return;
+		}
+
+		uint32_t t = heap[i];
+		heap[i] = heap[least];
+		heap[least] = t;
+		i = least;
+	}
+}
+
+/**
+ *	Indexes of the k largest elements, largest first.
+ *
+ *	----------{.c}
+ *	List vector.topk(Vector v, uint32 k)
+ *	----------
+ *
+ *	@return On success, a list of at most k indexes. Otherwise nil on failure.
+ */
+static int mod_lua_vector_topk(lua_State * l)
+{
+	mod_lua_vector *	v = mod_lua_checkvector(l, 1);
+	lua_Integer			k = luaL_optinteger(l, 2, 0);
+	uint32_t			n = mod_lua_vector_len(v);
+
+	if ( k < 0 ) {
+		return 0;
+	}
+
+	if ( k > n ) {
+		k = n;
+	}
+
+	uint32_t * heap = (uint32_t *) cf_malloc(sizeof(uint32_t) * (size_t) (k ? k : 1));
+
+	if ( !heap ) {
+		return 0;
+	}
+
+	// keep the k largest seen so far in a min-heap, smallest at the root
+	uint32_t size = 0;
+
+	for ( uint32_t i = 0; i < n; i++ ) {
+		if ( size < (uint32_t) k ) {
+			heap[size++] = i;
+			if ( size == (uint32_t) k ) {
+				for ( uint32_t j = size / 2; j-- > 0; ) {
+					mod_lua_vector_sift(v, heap, size, j);
+				}
+			}
+		}
+		else if ( size > 0 && mod_lua_vector_before(v, i, heap[0], true) ) {
+			heap[0] = i;
+			mod_lua_vector_sift(v, heap, size, 0);
+		}
+	}
+
+	// move the smallest to the back in turn, leaving the largest first
+	for ( uint32_t j = size; j > 1; j-- ) {
+		uint32_t t = heap[0];
+		heap[0] = heap[j - 1];
+		heap[j - 1] = t;
+		mod_lua_vector_sift(v, heap, j - 1, 0);
+	}
+
+	as_arraylist * list = as_arraylist_new(size ? size : 1, 0);
+
+	for ( uint32_t j = 0; j < size; j++ ) {
+		as_arraylist_append_int64(list, (int64_t) heap[j] + 1);
+	}
+
+	cf_free(heap);
+	mod_lua_pushlist(l, (as_list *) list);
+	return 1;
+}
+
+/******************************************************************************
+ * OBJECT TABLE
+ *****************************************************************************/
+
+static const luaL_Reg object_table[] = {
+	{"new",             mod_lua_vector_new},
+	{"from_bytes",      mod_lua_vector_from_bytes},
+	{"to_bytes",        mod_lua_vector_to_bytes},
+	{"size",            mod_lua_vector_size},
+	{"kind",            mod_lua_vector_kind},
+	{"dot",             mod_lua_vector_dot},
+	{"norm",            mod_lua_vector_norm},
+	{"cosine",          mod_lua_vector_cosine},
+	{"axpy",            mod_lua_vector_axpy},
+	{"sum",             mod_lua_vector_sum},
+	{"min",             mod_lua_vector_min},
+	{"max",             mod_lua_vector_max},
+	{"topk",            mod_lua_vector_topk},
+	{"tostring",        mod_lua_vector_tostring},
+	{0, 0}
+};
+
+static const luaL_Reg object_metatable[] = {
+	{"__call",          mod_lua_vector_cons},
+	{0, 0}
+};
+
+/******************************************************************************
+ * CLASS TABLE
+ *****************************************************************************/
+
+static const luaL_Reg class_metatable[] = {
+	{"__index",         mod_lua_vector_index},
+	{"__newindex",      mod_lua_vector_newindex},
+	{"__len",           mod_lua_vector_size},
+	{"__tostring",      mod_lua_vector_tostring},
+	{"__gc",            mod_lua_vector_gc},
+	{0, 0}
+};
+
+/******************************************************************************
+ * REGISTER
+ *****************************************************************************/
+
+int mod_lua_vector_register(lua_State * l) {
+	mod_lua_reg_object(l, OBJECT_NAME, object_table, object_metatable);
+	mod_lua_reg_class(l, CLASS_NAME, NULL, class_metatable);
+	return 1;
+}
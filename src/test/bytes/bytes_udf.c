@@ -0,0 +1,422 @@
+/*
+ * Copyright 2008-2024 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+#include <aerospike/as_module.h>
+#include <aerospike/as_types.h>
+#include <aerospike/mod_lua.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../test.h"
+#include "../util/map_rec.h"
+#include "../util/test_aerospike.h"
+#include "../util/test_logger.h"
+
+/******************************************************************************
+ * TEST CASES
+ *****************************************************************************/
+
+TEST(bytes_udf_1, "build bytes from a format string")
+{
+	as_rec * rec = map_rec_new();
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 0);
+
+	as_result * res = as_success_new(NULL);
+
+	int rc = as_module_apply_record(&mod_lua, &ctx, "bytes", "build", rec, (as_list *) &arglist, res);
+
+	assert_int_eq(rc, 0);
+	assert_true(res->is_success);
+	assert_not_null(res->value);
+	assert_int_eq(as_val_type(res->value), AS_BYTES);
+
+	const uint8_t expected[] = {
+		0x01, 0x00, 0x00, 0x00,								// <i4 1
+		0x00, 0x02,											// >h 2
+		0x03,												// B 3
+		0x00, 0x02, 'a', 'b',								// s2 "ab"
+		'z', 's', 0x00,										// z "zs"
+		0x3f, 0xf8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,		// d 1.5
+		0xac, 0x02,											// v 300
+		'q', 0x00, 0x00,									// c3 "q"
+		0x00												// x
+	};
+
+	as_bytes * b = (as_bytes *) res->value;
+	assert_int_eq(as_bytes_size(b), sizeof(expected));
+	assert_int_eq(memcmp(as_bytes_get(b), expected, sizeof(expected)), 0);
+
+	as_rec_destroy(rec);
+	as_arraylist_destroy(&arglist);
+	as_result_destroy(res);
+}
+
+TEST(bytes_udf_2, "a builder starts over after finish")
+{
+	as_rec * rec = map_rec_new();
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 0);
+
+	as_result * res = as_success_new(NULL);
+
+	int rc = as_module_apply_record(&mod_lua, &ctx, "bytes", "build_twice", rec, (as_list *) &arglist, res);
+
+	assert_int_eq(rc, 0);
+	assert_true(res->is_success);
+	assert_not_null(res->value);
+	assert_string_eq(as_string_get((as_string *) res->value), "5,2,0");
+
+	as_rec_destroy(rec);
+	as_arraylist_destroy(&arglist);
+	as_result_destroy(res);
+}
+
+TEST(bytes_udf_3, "an invalid format is an error")
+{
+	as_rec * rec = map_rec_new();
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 1);
+	as_arraylist_append_str(&arglist, "i4 Q");
+
+	as_result * res = as_success_new(NULL);
+
+	as_module_apply_record(&mod_lua, &ctx, "bytes", "put_format", rec, (as_list *) &arglist, res);
+
+	assert_false(res->is_success);
+
+	as_rec_destroy(rec);
+	as_arraylist_destroy(&arglist);
+	as_result_destroy(res);
+}
+
+TEST(bytes_udf_4, "slices view a range of their parent")
+{
+	as_rec * rec = map_rec_new();
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 0);
+
+	as_result * res = as_success_new(NULL);
+
+	int rc = as_module_apply_record(&mod_lua, &ctx, "bytes", "slices", rec, (as_list *) &arglist, res);
+
+	assert_int_eq(rc, 0);
+	assert_true(res->is_success);
+	assert_not_null(res->value);
+
+	as_list * rlist = (as_list *) res->value;
+	assert_int_eq(as_list_size(rlist), 6);
+	assert_int_eq(as_list_get_int64(rlist, 0), 42);
+	assert_string_eq(as_list_get_str(rlist, 1), "Ayz");
+	assert_int_eq(as_list_get_int64(rlist, 2), 8);
+	assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, 3)));
+	assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, 4)));
+
+	// A slice stored in a list is copied.
+	const uint8_t expected[] = { 3, 'A', 'y', 'z' };
+	as_bytes * b = (as_bytes *) as_list_get(rlist, 5);
+	assert_not_null(b);
+	assert_int_eq(as_val_type(b), AS_BYTES);
+	assert_int_eq(as_bytes_size(b), sizeof(expected));
+	assert_int_eq(memcmp(as_bytes_get(b), expected, sizeof(expected)), 0);
+
+	as_rec_destroy(rec);
+	as_arraylist_destroy(&arglist);
+	as_result_destroy(res);
+}
+
+TEST(bytes_udf_5, "pack and unpack many fields in one call")
+{
+	as_rec * rec = map_rec_new();
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 0);
+
+	as_result * res = as_success_new(NULL);
+
+	int rc = as_module_apply_record(&mod_lua, &ctx, "bytes", "pack_unpack", rec, (as_list *) &arglist, res);
+
+	assert_int_eq(rc, 0);
+	assert_true(res->is_success);
+	assert_not_null(res->value);
+
+	as_list * rlist = (as_list *) res->value;
+	assert_int_eq(as_list_size(rlist), 14);
+	assert_int_eq(as_list_get_int64(rlist, 0), -2);
+	assert_int_eq(as_list_get_int64(rlist, 1), 70000);
+	assert_int_eq(as_list_get_int64(rlist, 2), -1);
+	assert_true(as_list_get_double(rlist, 3) == 2.5);
+	assert_int_eq(as_list_get_int64(rlist, 4), 300);
+	assert_string_eq(as_list_get_str(rlist, 5), "ab");
+	assert_string_eq(as_list_get_str(rlist, 6), "zs");
+	assert_string_eq(as_list_get_str(rlist, 7), "cd");
+	assert_int_eq(as_list_get_int64(rlist, 8), 7);
+	// 2 + 3 + 1 + 8 + 2 + 3 + 3 + 2 + 1 + 1 bytes
+	assert_int_eq(as_list_get_int64(rlist, 9), 27);
+	assert_int_eq(as_list_get_int64(rlist, 10), 7);
+	assert_int_eq(as_list_get_int64(rlist, 11), 27);
+	assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, 12)));
+	assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, 13)));
+
+	as_rec_destroy(rec);
+	as_arraylist_destroy(&arglist);
+	as_result_destroy(res);
+}
+
+TEST(bytes_udf_6, "bitmap operations")
+{
+	as_rec * rec = map_rec_new();
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 0);
+
+	as_result * res = as_success_new(NULL);
+
+	int rc = as_module_apply_record(&mod_lua, &ctx, "bytes", "bits", rec, (as_list *) &arglist, res);
+
+	assert_int_eq(rc, 0);
+	assert_true(res->is_success);
+	assert_not_null(res->value);
+
+	as_list * rlist = (as_list *) res->value;
+	assert_int_eq(as_list_size(rlist), 21);
+	assert_int_eq(as_list_get_int64(rlist, 0), 5);
+	assert_int_eq(as_list_get_int64(rlist, 1), 1);
+	assert_int_eq(as_list_get_int64(rlist, 2), 0);
+	assert_int_eq(as_list_get_int64(rlist, 3), 3);
+	assert_int_eq(as_list_get_int64(rlist, 4), 3);
+	assert_int_eq(as_list_get_int64(rlist, 5), 240);
+	assert_int_eq(as_list_get_int64(rlist, 6), 12);
+	assert_int_eq(as_list_get_int64(rlist, 7), 4);
+	assert_int_eq(as_list_get_int64(rlist, 8), 9);
+	assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, 9)));
+	assert_int_eq(as_list_get_int64(rlist, 10), 13);
+	assert_int_eq(as_list_get_int64(rlist, 11), 32);
+	assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, 12)));
+	assert_int_eq(as_list_get_int64(rlist, 13), 1);
+	assert_int_eq(as_list_get_int64(rlist, 14), 32);
+	assert_int_eq(as_list_get_int64(rlist, 15), 1);
+	assert_int_eq(as_list_get_int64(rlist, 16), 32);
+	assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, 17)));
+	assert_int_eq(as_list_get_int64(rlist, 18), 4000);
+	assert_int_eq(as_list_get_int64(rlist, 19), 7999);
+	assert_int_eq(as_list_get_int64(rlist, 20), 4000);
+
+	as_rec_destroy(rec);
+	as_arraylist_destroy(&arglist);
+	as_result_destroy(res);
+}
+
+TEST(bytes_udf_7, "hex and base64 encodings")
+{
+	as_rec * rec = map_rec_new();
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 0);
+
+	as_result * res = as_success_new(NULL);
+
+	int rc = as_module_apply_record(&mod_lua, &ctx, "bytes", "encodings", rec, (as_list *) &arglist, res);
+
+	assert_int_eq(rc, 0);
+	assert_true(res->is_success);
+	assert_not_null(res->value);
+
+	as_list * rlist = (as_list *) res->value;
+	assert_int_eq(as_list_size(rlist), 17);
+	assert_string_eq(as_list_get_str(rlist, 0), "00017f80ff616263");
+	assert_string_eq(as_list_get_str(rlist, 1), "00017f80ff616263");
+	assert_string_eq(as_list_get_str(rlist, 2), "017f80");
+	assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, 3)));
+	assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, 4)));
+	assert_string_eq(as_list_get_str(rlist, 5), "");
+	assert_string_eq(as_list_get_str(rlist, 6), "Zg==");
+	assert_string_eq(as_list_get_str(rlist, 7), "Zm8=");
+	assert_string_eq(as_list_get_str(rlist, 8), "Zm9v");
+	assert_string_eq(as_list_get_str(rlist, 9), "Zm9vYmFy");
+	assert_string_eq(as_list_get_str(rlist, 10), "+/8=");
+	assert_string_eq(as_list_get_str(rlist, 11), "fooba");
+	assert_int_eq(as_list_get_int64(rlist, 12), 0);
+	assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, 13)));
+	assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, 14)));
+	assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, 15)));
+	assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, 16)));
+
+	as_rec_destroy(rec);
+	as_arraylist_destroy(&arglist);
+	as_result_destroy(res);
+}
+
+TEST(bytes_udf_8, "compress and decompress bytes")
+{
+	as_rec * rec = map_rec_new();
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 0);
+
+	as_result * res = as_success_new(NULL);
+
+	int rc = as_module_apply_record(&mod_lua, &ctx, "bytes", "compression", rec, (as_list *) &arglist, res);
+
+	assert_int_eq(rc, 0);
+	assert_true(res->is_success);
+	assert_not_null(res->value);
+
+	as_list * rlist = (as_list *) res->value;
+	assert_int_eq(as_list_size(rlist), 8);
+	assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, 0)));
+	assert_int_eq(as_list_get_int64(rlist, 1), AS_BYTES_BLOB);
+	assert_int_eq(as_list_get_int64(rlist, 2), AS_BYTES_BLOB);
+	assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, 3)));
+	assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, 4)));
+	assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, 5)));
+	assert_int_eq(as_list_get_int64(rlist, 6), 0);
+
+	// The header: magic, then the original size (200 records of 9 bytes).
+	const uint8_t header[] = { 'L', 'Z', '4', 0x01, 0x00, 0x00, 0x07, 0x08 };
+	as_bytes * c = (as_bytes *) as_list_get(rlist, 7);
+	assert_not_null(c);
+	assert_int_eq(as_bytes_get_type(c), AS_BYTES_BLOB);
+	assert_true(as_bytes_size(c) > sizeof(header));
+	assert_int_eq(memcmp(as_bytes_get(c), header, sizeof(header)), 0);
+
+	as_rec_destroy(rec);
+	as_arraylist_destroy(&arglist);
+	as_result_destroy(res);
+}
+
+TEST(bytes_udf_9, "unpack rejects truncated and oversized fields")
+{
+	as_rec * rec = map_rec_new();
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 0);
+
+	as_result * res = as_success_new(NULL);
+
+	int rc = as_module_apply_record(&mod_lua, &ctx, "bytes", "unpack_malformed", rec, (as_list *) &arglist, res);
+
+	assert_int_eq(rc, 0);
+	assert_true(res->is_success);
+	assert_not_null(res->value);
+
+	as_list * rlist = (as_list *) res->value;
+	assert_int_eq(as_list_size(rlist), 8);
+	for (uint32_t i = 0; i < 8; i++) {
+		assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, i)));
+	}
+
+	as_rec_destroy(rec);
+	as_arraylist_destroy(&arglist);
+	as_result_destroy(res);
+}
+
+TEST(bytes_udf_10, "a put which fails leaves the bytes as they were")
+{
+	as_rec * rec = map_rec_new();
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 0);
+
+	as_result * res = as_success_new(NULL);
+
+	int rc = as_module_apply_record(&mod_lua, &ctx, "bytes", "put_failed", rec, (as_list *) &arglist, res);
+
+	assert_int_eq(rc, 0);
+	assert_true(res->is_success);
+	assert_not_null(res->value);
+
+	as_list * rlist = (as_list *) res->value;
+	assert_int_eq(as_list_size(rlist), 7);
+	assert_false(as_boolean_get((as_boolean *) as_list_get(rlist, 0)));
+	assert_false(as_boolean_get((as_boolean *) as_list_get(rlist, 1)));
+	assert_int_eq(as_list_get_int64(rlist, 2), 5);
+	assert_int_eq(as_list_get_int64(rlist, 3), 2);
+	assert_int_eq(as_list_get_int64(rlist, 4), 3);
+	assert_int_eq(as_list_get_int64(rlist, 5), 3);
+	assert_int_eq(as_list_get_int64(rlist, 6), 3);
+
+	as_rec_destroy(rec);
+	as_arraylist_destroy(&arglist);
+	as_result_destroy(res);
+}
+
+/******************************************************************************
+ * TEST SUITE
+ *****************************************************************************/
+
+SUITE(bytes_udf, "bytes udf tests")
+{
+	suite_before(test_suite_before);
+	suite_after(test_suite_after);
+
+	suite_add(bytes_udf_1);
+	suite_add(bytes_udf_2);
+	suite_add(bytes_udf_3);
+	suite_add(bytes_udf_4);
+	suite_add(bytes_udf_5);
+	suite_add(bytes_udf_6);
+	suite_add(bytes_udf_7);
+	suite_add(bytes_udf_8);
+	suite_add(bytes_udf_9);
+	suite_add(bytes_udf_10);
+}
@@ -207,6 +207,73 @@ TEST(hash_udf_6, "replacing a key works and returns previous value, long keys ge
 	hash_udf_teardown_test();
 }
 
+TEST(hash_udf_7, "hash functions match their reference values")
+{
+	as_rec * rec = map_rec_new();
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 0);
+
+	as_result * res = as_success_new(NULL);
+
+	int rc = as_module_apply_record(&mod_lua, &ctx, "hashes", "known", rec, (as_list *) &arglist, res);
+
+	assert_int_eq(rc, 0);
+	assert_true(res->is_success);
+	assert_not_null(res->value);
+
+	as_list * rlist = (as_list *) res->value;
+	assert_int_eq(as_list_size(rlist), 9);
+	assert_int_eq(as_list_get_int64(rlist, 0), (int64_t) 0xc6945259e816a9cdULL);
+	assert_int_eq(as_list_get_int64(rlist, 1), 0xde57bc71);
+	assert_int_eq(as_list_get_int64(rlist, 2), 0x9d691465);
+	assert_int_eq(as_list_get_int64(rlist, 3), (int64_t) 0x457cd2650fe6aa94ULL);
+	assert_int_eq(as_list_get_int64(rlist, 4), 0x94956fb0);
+	assert_int_eq(as_list_get_int64(rlist, 5), 0xe3069283);
+	assert_int_eq(as_list_get_int64(rlist, 6), (int64_t) 0xef46db3751d8e999ULL);
+	assert_int_eq(as_list_get_int64(rlist, 7), 0xb3dd93fa);
+	assert_int_eq(as_list_get_int64(rlist, 8), 0x00c29bf3);
+
+	as_rec_destroy(rec);
+	as_arraylist_destroy(&arglist);
+	as_result_destroy(res);
+}
+
+TEST(hash_udf_8, "hash functions read strings, bytes and slices alike")
+{
+	as_rec * rec = map_rec_new();
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 0);
+
+	as_result * res = as_success_new(NULL);
+
+	int rc = as_module_apply_record(&mod_lua, &ctx, "hashes", "same_input", rec, (as_list *) &arglist, res);
+
+	assert_int_eq(rc, 0);
+	assert_true(res->is_success);
+	assert_not_null(res->value);
+
+	as_list * rlist = (as_list *) res->value;
+	assert_int_eq(as_list_size(rlist), 8);
+
+	for (uint32_t i = 0; i < 8; i++) {
+		assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, i)));
+	}
+
+	as_rec_destroy(rec);
+	as_arraylist_destroy(&arglist);
+	as_result_destroy(res);
+}
+
 /******************************************************************************
  * TEST SUITE
  *****************************************************************************/
@@ -221,4 +288,6 @@ SUITE(hash_udf, "list udf tests")
 	suite_add(hash_udf_4);
 	suite_add(hash_udf_5);
 	suite_add(hash_udf_6);
+	suite_add(hash_udf_7);
+	suite_add(hash_udf_8);
 }
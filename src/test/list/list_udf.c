@@ -575,6 +575,186 @@ TEST(list_udf_13, "merge two lists")
 	as_result_destroy(res);
 }
 
+TEST(list_udf_14, "repeated reads of a list bin return the same list")
+{
+	as_arraylist * list = as_arraylist_new(3, 0);
+	as_arraylist_append_int64(list, 1);
+	as_arraylist_append_int64(list, 2);
+	as_arraylist_append_int64(list, 3);
+
+	as_rec * rec = map_rec_new();
+	as_rec_set(rec, "listbin", (as_val *) list);
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 1);
+	as_arraylist_append_str(&arglist, "listbin");
+
+	as_result * res = as_success_new(NULL);
+
+	int rc = as_module_apply_record(&mod_lua, &ctx, "lists", "same_list", rec, (as_list *) &arglist, res);
+
+	assert_int_eq(rc, 0);
+	assert_true(res->is_success);
+	assert_not_null(res->value);
+	assert_true(as_boolean_get((as_boolean *) res->value));
+
+	as_rec_destroy(rec);
+	as_arraylist_destroy(&arglist);
+	as_result_destroy(res);
+}
+
+TEST(list_udf_15, "tracked nbytes of a list matches a full walk")
+{
+	as_rec * rec = map_rec_new();
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 0);
+
+	as_result * res = as_success_new(NULL);
+
+	int rc = as_module_apply_record(&mod_lua, &ctx, "lists", "nbytes_tracked", rec, (as_list *) &arglist, res);
+
+	assert_int_eq(rc, 0);
+	assert_true(res->is_success);
+	assert_not_null(res->value);
+	assert_true(as_boolean_get((as_boolean *) res->value));
+
+	as_rec_destroy(rec);
+	as_arraylist_destroy(&arglist);
+	as_result_destroy(res);
+}
+
+TEST(list_udf_16, "numeric reductions over a list")
+{
+	as_rec * rec = map_rec_new();
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 0);
+
+	as_result * res = as_success_new(NULL);
+
+	int rc = as_module_apply_record(&mod_lua, &ctx, "lists", "reductions", rec, (as_list *) &arglist, res);
+
+	assert_int_eq(rc, 0);
+	assert_true(res->is_success);
+	assert_not_null(res->value);
+	assert_true(as_boolean_get((as_boolean *) res->value));
+
+	as_rec_destroy(rec);
+	as_arraylist_destroy(&arglist);
+	as_result_destroy(res);
+}
+
+TEST(list_udf_17, "sort, search and slice a list")
+{
+	as_rec * rec = map_rec_new();
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 0);
+
+	as_result * res = as_success_new(NULL);
+
+	int rc = as_module_apply_record(&mod_lua, &ctx, "lists", "ordering", rec, (as_list *) &arglist, res);
+
+	assert_int_eq(rc, 0);
+	assert_true(res->is_success);
+	assert_not_null(res->value);
+	assert_true(as_boolean_get((as_boolean *) res->value));
+
+	as_rec_destroy(rec);
+	as_arraylist_destroy(&arglist);
+	as_result_destroy(res);
+}
+
+TEST(list_udf_18, "tracked nbytes releases a host list when the call ends")
+{
+	// a cached state outlives the call, so only the end of the call can
+	// release what it tracked
+	mod_lua_config config = {
+		.server_mode = true,
+		.cache_enabled = true,
+		.user_path = AS_START_DIR "src/test/lua"
+	};
+
+	assert_int_eq(as_module_configure(&mod_lua, &config), 0);
+
+	as_arraylist * list = as_arraylist_new(3, 1);
+	as_arraylist_append_int64(list, 1);
+	as_arraylist_append_int64(list, 2);
+	as_arraylist_append_int64(list, 3);
+
+	as_rec * rec = map_rec_new();
+	as_rec_set(rec, "listbin", (as_val *) list);
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 1);
+	as_arraylist_append_str(&arglist, "listbin");
+
+	as_result * res = as_success_new(NULL);
+
+	uint32_t count = list->_._.count;
+
+	int rc = as_module_apply_record(&mod_lua, &ctx, "lists", "nbytes_bin", rec, (as_list *) &arglist, res);
+
+	assert_int_eq(rc, 0);
+	assert_true(res->is_success);
+	assert_not_null(res->value);
+	assert_int_eq(as_integer_get((as_integer *) res->value), 5);
+	assert_int_eq(list->_._.count, count);
+
+	config.cache_enabled = false;
+	assert_int_eq(as_module_configure(&mod_lua, &config), 0);
+
+	as_rec_destroy(rec);
+	as_arraylist_destroy(&arglist);
+	as_result_destroy(res);
+}
+
+TEST(list_udf_19, "a comparison which changes the list")
+{
+	as_rec * rec = map_rec_new();
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 0);
+
+	as_result * res = as_success_new(NULL);
+
+	int rc = as_module_apply_record(&mod_lua, &ctx, "lists", "mutating_compare", rec, (as_list *) &arglist, res);
+
+	assert_int_eq(rc, 0);
+	assert_true(res->is_success);
+	assert_not_null(res->value);
+	assert_true(as_boolean_get((as_boolean *) res->value));
+
+	as_rec_destroy(rec);
+	as_arraylist_destroy(&arglist);
+	as_result_destroy(res);
+}
+
 /******************************************************************************
  * TEST SUITE
  *****************************************************************************/
@@ -597,4 +777,10 @@ SUITE(list_udf, "list udf tests")
 	suite_add(list_udf_11);
 	suite_add(list_udf_12);
 	suite_add(list_udf_13);
+	suite_add(list_udf_14);
+	suite_add(list_udf_15);
+	suite_add(list_udf_16);
+	suite_add(list_udf_17);
+	suite_add(list_udf_18);
+	suite_add(list_udf_19);
 }
@@ -57,4 +57,267 @@ function rollup2(s)
     end
 
     return s : aggregate(map(), _aggregate)
-end
\ No newline at end of file
+end
+
+function top3(s)
+    return s : topk(3)
+end
+
+function bottom3(s)
+
+    local function _score(a)
+        return -a
+    end
+
+    return s : topk(3, _score)
+end
+
+function bottom3_unscored(s)
+
+    local function _score(a)
+        return a % 2 == 0 and -a or nil
+    end
+
+    return s : topk(3, _score)
+end
+
+function residues(s)
+
+    local function _mod(a)
+        return a % 7
+    end
+
+    return s : map(_mod) : distinct()
+end
+
+function first_of_each_decade(s)
+
+    local function _decade(a)
+        return a // 10
+    end
+
+    return s : distinct(_decade)
+end
+
+function sample5(s, seed)
+    return s : sample(5, seed)
+end
+
+function sample100(s, seed)
+    return s : sample(100, seed)
+end
+
+function rollup_spill(s)
+
+    local function _aggregate(a,b)
+        a[b.campaign] = (a[b.campaign] or 0) + b.views
+        return a
+    end
+
+    return s : aggregate(spill(4, math.sum), _aggregate)
+end
+
+-- Count n values by key with one key in memory, so each value is a new run
+function spill_cascade(r, n)
+    local s = spill(1, math.sum)
+    local most = 0
+    for i = 1, n do
+        local k = i % 1000
+        s[k] = (s[k] or 0) + 1
+        most = math.max(most, spill.runs(s))
+    end
+    local keys, total = 0, 0
+    for m in spill.chunks(s) do
+        for k, v in map.pairs(m) do
+            keys = keys + 1
+            total = total + v
+        end
+    end
+    return list{ most, spill.runs(s), keys, total }
+end
+
+function residue_groups(s)
+
+    local function _mod(a)
+        return a % 10
+    end
+
+    return s : groupby(_mod, 4)
+end
+
+local campaign_specs = {
+    { "campaign", "==", 3 },
+    { "and", { "campaign", "in", { 1, 3 } }, { "views", ">=", 500 } },
+    { "or", { "id", "<", 5 }, { "id", "between", 96, 100 } },
+    { "not", { "views", "<=", 100 } },
+    { { "id", ">", 10 }, { "id", "<=", 20 } },
+    { "missing", "exists" },
+    { "missing", "~=", 1 },
+    { "id", "==", 50.0 },
+    { "campaign", "in", { "3", 3 } },
+    { "id", "<", "x" },
+    { "id", "like", 1 }
+}
+
+local function _count(n, r)
+    return n + 1
+end
+
+function count_where(s, i)
+    return s : where(campaign_specs[i]) : aggregate(0, _count)
+end
+
+function count_where_mapped(s, i)
+
+    local function _map(r)
+        return map{ id = r.id, campaign = r.campaign, views = r.views }
+    end
+
+    return s : map(_map) : where(campaign_specs[i]) : aggregate(0, _count)
+end
+
+function select_rollup(s)
+
+    local function _aggregate(a, b)
+        a[b.campaign] = (a[b.campaign] or 0) + b.views
+        return a
+    end
+
+    return s : select{ "campaign", "views" } : aggregate(map(), _aggregate)
+end
+
+function select_where(s)
+
+    local function _aggregate(n, m)
+        if m.campaign ~= nil or map.size(m) ~= 2 then
+            return -1
+        end
+        return n + m.id
+    end
+
+    return s : where{ "campaign", "==", 3 } : select{ "id", "views", "missing" } : aggregate(0, _aggregate)
+end
+
+function select_late(s)
+
+    local function _identity(r)
+        return r
+    end
+
+    local function _aggregate(n, m)
+        if m.views == nil then
+            return -1
+        end
+        return n + map.size(m)
+    end
+
+    return s : map(_identity) : select(list{ "views", "views" }) : aggregate(0, _aggregate)
+end
+
+function first(s, n)
+    return s : limit(n)
+end
+
+function first_of_campaign(s, n)
+    return s : where{ "campaign", "==", 3 } : select{ "id" } : limit(n)
+end
+
+function first_doubled(s, n)
+
+    local function _double(a)
+        return a * 2
+    end
+
+    return s : map(_double) : limit(n) : reduce(add)
+end
+
+-- A sum which spends long enough in each aggregate call for a job to yield
+-- within it, while a to-be-closed variable is open, which marks closed when
+-- it is closed
+function sum_guarded(s, closed)
+
+    local function _aggregate(a, b)
+        local guard <close> = setmetatable({}, { __close = function()
+            list.append(closed, b)
+        end })
+        local x = 0
+        for i = 1, 100000 do
+            x = x + i
+        end
+        return a + b
+    end
+
+    return s : aggregate(0, _aggregate)
+end
+
+-- A predicate isn't a value, so is left out of lists and maps
+function predicate_stored(r)
+    local p = predicate{ "campaign", "==", 3 }
+    local l = list{ 1 }
+    list.append(l, p)
+    local m = map{ a = 1 }
+    m.b = p
+    return list{ list.size(l), map.size(m) }
+end
+
+function predicate_returned(r)
+    return predicate{ "campaign", "==", 3 }
+end
+
+-- Nor is a projection, even of one bin, which stays usable once the list
+-- and map are freed
+function projection_stored(r)
+    local p = projection{ "campaign" }
+    local l = list{ 1 }
+    list.append(l, p)
+    list.append(l, p)
+    local m = map{ a = 1 }
+    m.b = p
+    local sizes = list{ list.size(l), map.size(m) }
+    l = nil
+    m = nil
+    collectgarbage()
+    list.append(sizes, projection.apply(p, map{ campaign = 3 }).campaign)
+    return sizes
+end
+
+-- Each native type which isn't a value, with its fields set as they would
+-- be in use
+local natives = {
+    topk = function()
+        local t = topk(1)
+        topk.add(t, "a", 1)
+        return t
+    end,
+    reservoir = function()
+        local t = topk.reservoir(1, 7)
+        topk.add(t, "a")
+        return t
+    end,
+    predicate = function()
+        return predicate{ "campaign", "==", 3 }
+    end,
+    projection = function()
+        return projection{ "campaign" }
+    end,
+    spill = function()
+        local s = spill(1, math.sum)
+        s.a = 1
+        s.b = 2
+        return s
+    end
+}
+
+function native_stored(r, kind)
+    local v = natives[kind]()
+    local l = list{ 1 }
+    list.append(l, v)
+    list.append(l, v)
+    local m = map{ a = 1 }
+    m.b = v
+    return list{ list.size(l), map.size(m) }
+end
+
+function native_returned(r, kind)
+    return natives[kind]()
+end
@@ -31,3 +31,163 @@ function newbytes(r,a,b,c)
     info("3 => %s",b[3] or "<nil>")
     return l[2]
 end
+
+function build(r)
+    local bb = bytes.builder(8)
+    bytes.put(bb, "<i4 >h B", 1, 2, 3)
+    bytes.put(bb, "s2 z d v c3 x", "ab", "zs", 1.5, 300, "q")
+    return bytes.finish(bb)
+end
+
+function build_twice(r)
+    local bb = bytes.builder()
+    bytes.put(bb, "i", 7)
+    local first = bytes.finish(bb)
+    bytes.put(bb, "h", 1)
+    local second = bytes.finish(bb)
+    bytes.put(first, "B", 9)
+    return bytes.size(first) .. "," .. bytes.size(second) .. "," .. #bb
+end
+
+function put_format(r, fmt)
+    return bytes.put(bytes(), fmt, 1, 2)
+end
+
+-- A put which fails on a later field leaves the bytes as they were
+function put_failed(r)
+    local b = bytes()
+    bytes.put(b, "B", 1)
+    local bb = bytes.builder()
+    bytes.put(bb, "B", 1)
+    local ok1 = pcall(bytes.put, b, "i4 z B", 2, "ab", 256)
+    local ok2 = pcall(bytes.put, bb, "i4 s1 i", 2, "ab", "x")
+    bytes.put(b, "B", 3)
+    bytes.put(bb, "B", 3)
+    local built = bytes.finish(bb)
+    -- a slice of the bytes put into them is read once they have grown
+    bytes.put(b, "s1", bytes.slice(b, 1, 2))
+    return list{ ok1, ok2, bytes.size(b), bytes.size(built), bytes.get_byte(b, 2),
+        bytes.get_byte(built, 2), bytes.get_byte(b, 5) }
+end
+
+function slices(r)
+    local bb = bytes.builder()
+    bytes.put(bb, "z i4 s1", "name", 42, "xyz")
+    local b = bytes.finish(bb)
+    local s = bytes.slice(b, 6, 8)
+    local inner = bytes.slice(s, 5, 4)
+    -- writes to the parent show through
+    bytes.set_byte(b, 11, 65)
+    return list{ bytes.get_int32(s, 1), bytes.get_string(inner, 2, 3), #s,
+        bytes.slice(b, 12, 5) == nil, bytes.get_string(b, 13, 2) == nil, inner }
+end
+
+function pack_unpack(r)
+    local b = bytes()
+    bytes.pack(b, "<i2 >I3 b d v s1 z c2 x B", -2, 70000, -1, 2.5, 300, "ab", "zs", "cd", 7)
+    local i2, i3, i1, d, v, s, z, c, B, pos = bytes.unpack(b, "<i2 >I3 b d v s1 z c2 x B")
+    local tail, next = bytes.unpack(b, "B", pos - 1)
+    return list{ i2, i3, i1, d, v, s, z, c, B, pos, tail, next,
+        bytes.unpack(b, "B", pos) == nil, bytes.unpack(b, "i4", pos - 2) == nil }
+end
+
+local function rawbytes(t)
+    local b = bytes(#t)
+    for i=1, #t do
+        bytes.append_byte(b, t[i])
+    end
+    return b
+end
+
+function unpack_malformed(r)
+    -- a length prefix near 2^64 must not wrap around the bounds check
+    local huge = bytes()
+    bytes.pack(huge, "<j c3", -16, "abc")
+    -- one byte short of its length prefix
+    local short = bytes()
+    bytes.pack(short, "<I4 c3", 4, "abc")
+    -- a var int continued past the end, past a slice's end, and past 5 bytes
+    local cont = rawbytes{ 0x80, 0x80 }
+    local parent = rawbytes{ 0x80, 0x01 }
+    local long = rawbytes{ 0x80, 0x80, 0x80, 0x80, 0x80, 0x01 }
+    return list{ bytes.unpack(huge, "<s8") == nil, bytes.unpack(short, "<s4") == nil,
+        bytes.unpack(short, "<s4", 5) == nil, bytes.unpack(cont, "v") == nil,
+        bytes.unpack(bytes.slice(parent, 1, 1), "v") == nil,
+        bytes.get_var_int(bytes.slice(parent, 1, 1), 1) == nil,
+        bytes.unpack(parent, "v") == 128, bytes.unpack(long, "v") == nil }
+end
+
+local function bitmap(t)
+    local b = bytes(#t)
+    for i=1, #t do
+        bytes.append_byte(b, t[i])
+    end
+    return b
+end
+
+function bits(r)
+    local a = bitmap{0xF0, 0x0F, 0x00, 0x01}
+
+    local x = bitmap{0xF0, 0x0F, 0x00, 0x01}
+    bytes.bit_and(x, bitmap{0xFF, 0x01})
+    local y = bitmap{0x01}
+    bytes.bit_or(y, bitmap{0x80, 0x00, 0x02})
+    local z = bitmap{0xFF}
+    bytes.bit_xor(z, bitmap{0x0F})
+    local w = bitmap{0xFF, 0xFF}
+    bytes.bit_andnot(w, bitmap{0x0F})
+
+    local big = bytes(1000)
+    for i=1, 1000 do
+        bytes.append_byte(big, 0xAA)
+    end
+
+    local first, last = bytes.bit_range(a)
+    return list{ bytes.bit_count(x), bytes.get_byte(x, 2), bytes.get_byte(x, 4),
+        bytes.size(y), bytes.bit_count(y), bytes.get_byte(z, 1), bytes.bit_count(w),
+        bytes.bit_rank(a, 12), bytes.bit_rank(a, 32), bytes.bit_rank(a, 33) == nil,
+        bytes.bit_select(a, 5), bytes.bit_select(a, 9), bytes.bit_select(a, 10) == nil,
+        bytes.bit_next(a), bytes.bit_next(a, 17), first, last,
+        bytes.bit_range(bitmap{0, 0}) == nil,
+        bytes.bit_count(big), bytes.bit_select(big, 4000), bytes.bit_rank(big, 7999) }
+end
+
+local function frombytes(s)
+    local b = bytes(#s)
+    bytes.set_string(b, 1, s)
+    return b
+end
+
+function encodings(r)
+    local all = bytes(256)
+    for i=0, 255 do
+        bytes.append_byte(all, i)
+    end
+    local b = frombytes("\0\1\127\128\255abc")
+    local again = bytes.from_base64(bytes.to_base64(all))
+    return list{
+        bytes.to_hex(b), bytes.to_hex(bytes.from_hex("00017F80ff616263")),
+        bytes.to_hex(bytes.slice(b, 2, 3)), bytes.from_hex("0g") == nil, bytes.from_hex("abc") == nil,
+        bytes.to_base64(bytes()), bytes.to_base64(frombytes("f")), bytes.to_base64(frombytes("fo")),
+        bytes.to_base64(frombytes("foo")), bytes.to_base64(frombytes("foobar")),
+        bytes.to_base64(bytes.from_hex("fbff")),
+        bytes.get_string(bytes.from_base64("Zm9vYmE="), 1, 5), bytes.size(bytes.from_base64("")),
+        bytes.from_base64("Zm9v!A==") == nil, bytes.from_base64("Zm9") == nil, bytes.from_base64("Z===") == nil,
+        bytes.size(again) == 256 and bytes.to_hex(again) == bytes.to_hex(all)
+    }
+end
+
+function compression(r)
+    local b = bytes()
+    for i=1, 200 do
+        bytes.append_string(b, "record " .. (i % 10) .. ";")
+    end
+    bytes.set_type(b, 4)
+    local c = bytes.compress(b)
+    local d = bytes.decompress(c)
+    local truncated = bytes.slice(c, 1, bytes.size(c) - 1)
+    local empty = bytes.decompress(bytes.compress(bytes()))
+    return list{ bytes.size(c) < bytes.size(b) / 4, bytes.get_type(c), bytes.get_type(d),
+        bytes.to_hex(d) == bytes.to_hex(b), bytes.decompress(b) == nil,
+        bytes.decompress(truncated) == nil, bytes.size(empty), c }
+end
@@ -0,0 +1,31 @@
+local text = "The quick brown fox jumps over the lazy dog, again and again and again!"
+
+local function tobytes(s)
+    local b = bytes(#s)
+    bytes.set_string(b, 1, s)
+    return b
+end
+
+function known(r)
+    return list{
+        hash.xxhash64(text, 7), hash.murmur3(text, 9), hash.crc32c(text),
+        hash.xxhash64(string.sub(text, 1, 20)), hash.murmur3(string.sub(text, 1, 7)),
+        hash.crc32c("123456789"), hash.xxhash64(""), hash.murmur3("abc"),
+        hash.crc32c(string.sub(text, 1, 3))
+    }
+end
+
+function same_input(r)
+    local b = tobytes("xx" .. text)
+    local s = bytes.slice(b, 3, #text)
+    local results = list()
+    for _, f in ipairs{ hash.wyhash32, hash.wyhash64, hash.murmur3, hash.xxhash64, hash.crc32c } do
+        local h = f(text)
+        results[#results + 1] = h == f(s) and h ~= f(string.sub(text, 2))
+    end
+    -- continue a crc over the rest of the data
+    results[#results + 1] = hash.crc32c(string.sub(text, 40), hash.crc32c(string.sub(text, 1, 39))) == hash.crc32c(text)
+    results[#results + 1] = hash.wyhash64(text, 1) ~= hash.wyhash64(text)
+    results[#results + 1] = pcall(hash.xxhash64, {}) == false
+    return results
+end
@@ -133,3 +133,195 @@ function merge(rec, bname, bname2)
 	return list.merge(l, l2)
 end
 
+
+function same_list(rec, bname)
+	return rec[bname] == rec[bname]
+end
+
+function nbytes_tracked(rec)
+	local l = list()
+	list.nbytes(l)
+	for i = 1, 40 do
+		list.append(l, i * 1000)
+		list.append(l, "value " .. i)
+	end
+	list.remove(l, 3)
+	list.prepend(l, 1.5)
+	list.insert(l, 5, true)
+	l[2] = "replaced"
+	l[list.size(l) + 1] = 7
+	-- a fresh copy is sized by walking it
+	return list.nbytes(l) == list.nbytes(list.take(l, list.size(l)))
+end
+
+function nbytes_bin(rec, bname)
+	local n = (function()
+		local l = rec[bname]
+		list.append(l, 4)
+		return list.nbytes(l)
+	end)()
+	collectgarbage()
+	return n
+end
+
+function mutating_compare(rec)
+	local function numbers(n)
+		local l = list()
+		for i = 1, n do
+			list.append(l, (i * 37) % 101)
+		end
+		return l
+	end
+	local less = function(a, b) return a < b end
+
+	-- growing the list moves its elements
+	local l = numbers(100)
+	local grow = function(a, b)
+		list.append(l, 0)
+		return a < b
+	end
+	local ok = pcall(list.sort, l, grow)
+	if ok or list.size(l) <= 100 or list.sum(list.take(l, 100)) ~= 5050 then
+		return false
+	end
+
+	-- trimming the list frees its elements
+	l = numbers(100)
+	ok = pcall(list.sort, l, function(a, b)
+		list.trim(l, 10)
+		return a < b
+	end)
+	if ok or list.size(l) >= 100 then
+		return false
+	end
+
+	-- replacing elements is allowed, and the sort puts the originals back
+	l = numbers(100)
+	list.sort(l, function(a, b)
+		l[1] = 1000
+		return a < b
+	end)
+	for i = 1, 100 do
+		if l[i] ~= i then
+			return false
+		end
+	end
+
+	l = numbers(100)
+	list.sort(l, less)
+	ok = pcall(list.bsearch, l, 50, function(a, b)
+		list.trim(l, 1)
+		return a < b
+	end)
+	return not ok and list.size(l) < 100
+end
+
+function reductions(rec)
+	local ints = list{3, -7, 12, 5}
+	if list.sum(ints) ~= 13 or math.type(list.sum(ints)) ~= "integer" then
+		return false
+	end
+	if list.min(ints) ~= -7 or list.max(ints) ~= 12 or list.mean(ints) ~= 3.25 then
+		return false
+	end
+	local lo, hi = list.minmax(ints)
+	if lo ~= -7 or hi ~= 12 then
+		return false
+	end
+
+	-- doubles promote the sum, and other types are skipped
+	local mixed = list{1, "skip", 2.5, true, -4}
+	if list.sum(mixed) ~= -0.5 or math.type(list.sum(mixed)) ~= "float" then
+		return false
+	end
+	if list.min(mixed) ~= -4 or list.max(mixed) ~= 2.5 then
+		return false
+	end
+
+	-- an integer sum that would overflow carries on in double
+	local big = list{math.maxinteger, 1}
+	if math.type(list.sum(big)) ~= "float" then
+		return false
+	end
+	-- large integers are compared exactly
+	if list.max(list{math.maxinteger - 1, math.maxinteger}) ~= math.maxinteger then
+		return false
+	end
+
+	local empty = list()
+	if list.sum(empty) ~= 0 or list.mean(empty) ~= nil or list.min(empty) ~= nil or list.minmax(empty) ~= nil then
+		return false
+	end
+
+	local h = list.histogram(list{-1, 0, 1, 5, 9.5, 10, 100}, {0, 5, 10})
+	if list.size(h) ~= 4 or h[1] ~= 1 or h[2] ~= 2 or h[3] ~= 2 or h[4] ~= 2 then
+		return false
+	end
+	h = list.histogram(ints, list{0, 10})
+	if h[1] ~= 1 or h[2] ~= 2 or h[3] ~= 1 then
+		return false
+	end
+	return list.histogram(ints, {10, 0}) == nil
+end
+
+function ordering(rec)
+	local l = list()
+	for i = 1, 100 do
+		list.append(l, (i * 37) % 101)
+	end
+	list.append(l, "b")
+	list.append(l, "a")
+	list.append(l, 2.5)
+	list.sort(l)
+	-- in the server's order, integers then strings then doubles
+	if l[1] ~= 1 or l[2] ~= 2 or l[100] ~= 100 or l[101] ~= "a" or l[102] ~= "b" or l[103] ~= 2.5 then
+		return false
+	end
+
+	local i, found = list.bsearch(l, 50)
+	if i ~= 50 or not found or l[i] ~= 50 then
+		return false
+	end
+	i, found = list.bsearch(l, "aa")
+	if i ~= 102 or found then
+		return false
+	end
+
+	-- a Lua comparison, stable for equal keys
+	local pairs = list()
+	for k = 1, 40 do
+		list.append(pairs, list{k % 4, k})
+	end
+	local by_key = function(a, b) return a[1] > b[1] end
+	list.sort(pairs, by_key)
+	for k = 2, 40 do
+		local a, b = pairs[k - 1], pairs[k]
+		if a[1] < b[1] or (a[1] == b[1] and a[2] > b[2]) then
+			return false
+		end
+	end
+	if list.bsearch(pairs, list{2}, by_key) ~= 11 then
+		return false
+	end
+
+	-- an error in the comparison leaves every element in the list
+	local ok = pcall(list.sort, l, function(a, b) return a < b end)
+	if ok or list.size(l) ~= 103 or list.sum(l) ~= 5052.5 then
+		return false
+	end
+
+	-- slices share elements
+	local s = list.slice(pairs, 2, 3)
+	if list.size(s) ~= 2 or s[1] ~= pairs[2] or s[2] ~= pairs[3] then
+		return false
+	end
+	list.append(s[1], "shared")
+	if pairs[2][3] ~= "shared" then
+		return false
+	end
+	s = list.slice(l, -2)
+	if list.size(s) ~= 2 or s[1] ~= "b" or s[2] ~= 2.5 then
+		return false
+	end
+	return list.size(list.slice(l, 5, 4)) == 0 and list.size(list.slice(l, 100, 200)) == 4
+end
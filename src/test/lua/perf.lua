@@ -0,0 +1,305 @@
+
+-- Convert n of each scalar type from Lua to as_val, by appending them to a
+-- list, then look each integer key up in a map
+function convert(r,n)
+    local l = list()
+    local m = map()
+    for i=1, n do
+        list.append(l, i)
+        list.append(l, i + 0.5)
+        list.append(l, "value")
+        list.append(l, i % 2 == 0)
+        m[i] = i
+    end
+    local hits = 0
+    for i=1, n do
+        if m[i] ~= nil then
+            hits = hits + 1
+        end
+    end
+    return list.size(l) + hits
+end
+
+-- Read the same list bin n times
+function reread(r,n)
+    local total = 0
+    for i=1, n do
+        total = total + list.size(r.listbin)
+    end
+    return total
+end
+
+-- Grow a list and a map to n entries, checking their size after each insert
+-- the way a UDF enforcing a size limit would
+function grow(r,n)
+    local l = list()
+    local m = map()
+    for i=1, n do
+        list.append(l, i)
+        m[i] = "value"
+        if list.nbytes(l) + map.nbytes(m) > 1000000 then
+            break
+        end
+    end
+    local copy = map()
+    for k, v in map.pairs(m) do
+        copy[k] = v
+    end
+    if map.nbytes(copy) ~= map.nbytes(m) then
+        return -1
+    end
+    return list.size(l) + map.size(m)
+end
+
+-- Append n small fields to a bytes, one call each, then again through a
+-- builder
+function append(r,n)
+    local b = bytes()
+    for i=1, n do
+        bytes.append_byte(b, i % 256)
+        bytes.append_int32_le(b, i)
+    end
+    local bb = bytes.builder()
+    for i=1, n do
+        bytes.put(bb, "<B i4", i % 256, i)
+    end
+    return bytes.size(b) + bytes.size(bytes.finish(bb))
+end
+
+-- Read n length-prefixed string fields out of a 4KB blob through slices
+function parse(r,n)
+    local bb = bytes.builder(4096)
+    for i=1, 256 do
+        bytes.put(bb, "s1", "field " .. i)
+    end
+    local b = bytes.finish(bb)
+    local total = 0
+    local size = bytes.size(b)
+    local pos = 1
+    for i=1, n do
+        local len = bytes.get_byte(b, pos)
+        local field = bytes.slice(b, pos + 1, len)
+        total = total + #bytes.get_string(field, 1, len)
+        pos = pos + 1 + len
+        if pos > size then
+            pos = 1
+        end
+    end
+    return total
+end
+
+-- Decode a fixed record header n times, one call per header
+function decode(r,n)
+    local b = bytes()
+    bytes.pack(b, "B I2 I4 l d s1", 1, 2, 3, 4, 5.0, "header")
+    local total = 0
+    for i=1, n do
+        local version, flags, gen, ttl, score, name = bytes.unpack(b, "B I2 I4 l d s1")
+        total = total + version + flags + gen + ttl + #name
+    end
+    return total
+end
+
+-- Union two 4KB bitmaps and count the result n times
+function bitmap(r,n)
+    local a = bytes(4096)
+    local b = bytes(4096)
+    for i=1, 4096 do
+        bytes.append_byte(a, i % 256)
+        bytes.append_byte(b, (i * 7) % 256)
+    end
+    local total = 0
+    for i=1, n do
+        bytes.bit_or(a, b)
+        total = total + bytes.bit_count(a)
+    end
+    return total
+end
+
+-- Bucket n keys by hash, as a partitioning UDF would
+function hashing(r,n)
+    local buckets = {}
+    for i=0, 15 do
+        buckets[i] = 0
+    end
+    for i=1, n do
+        local h = hash.xxhash64("user:" .. i)
+        buckets[h & 15] = buckets[h & 15] + 1
+    end
+    local total = 0
+    for i=0, 15 do
+        total = total + buckets[i]
+    end
+    return total
+end
+
+-- Encode a 1KB blob as hex and base64 n times
+function encode(r,n)
+    local b = bytes(1024)
+    for i=1, 1024 do
+        bytes.append_byte(b, i % 256)
+    end
+    local total = 0
+    for i=1, n do
+        total = total + #bytes.to_hex(b) + #bytes.to_base64(b)
+    end
+    return total
+end
+
+-- Compress and decompress a 4KB blob of repetitive records n times
+function compress(r,n)
+    local b = bytes(4096)
+    for i=1, 256 do
+        bytes.append_string(b, string.format("user:%06d;", i * 37 % 1000))
+    end
+    local total = 0
+    for i=1, n do
+        total = total + bytes.size(bytes.decompress(bytes.compress(b)))
+    end
+    return total
+end
+
+-- Score a 256-dimension embedding against a query n times
+function score(r,n)
+    local e = vector.new("f32", 256)
+    local q = vector.new("f32", 256)
+    for i=1, 256 do
+        e[i] = 1
+        q[i] = i % 4
+    end
+    local total = 0
+    for i=1, n do
+        total = total + vector.dot(e, q)
+    end
+    return math.tointeger(total)
+end
+
+-- Sum a 256-element list bin n times
+function reduce(r,n)
+    local l = list()
+    for i=1, 256 do
+        list.append(l, i)
+    end
+    local total = 0
+    for i=1, n do
+        total = total + list.sum(l)
+    end
+    return total
+end
+
+-- Insert n scores into an ordered list holding the top 256, the way a
+-- leaderboard bin is updated on each write
+function order(r,n)
+    local l = list()
+    for i=1, 256 do
+        list.append(l, i * 4)
+    end
+    local total = 0
+    for i=1, n do
+        list.append(l, (i * 7919) % 1024)
+        list.sort(l)
+        l = list.slice(l, 2)
+        local pos = list.bsearch(l, 512)
+        total = total + list.size(l) + (pos > 0 and 1 or 0)
+    end
+    return total
+end
+
+-- Dedupe n ids drawn from 5000 distinct values, as integers and as strings
+function dedupe(r,n)
+    local s = set()
+    local added = 0
+    for i=1, n do
+        local id = (i * 7919) % 5000
+        if set.add(s, id) then
+            added = added + 1
+        end
+        if set.add(s, "id:" .. id) then
+            added = added + 1
+        end
+    end
+    return added + set.size(s)
+end
+
+-- Feed n values to a HyperLogLog, a t-digest and a count-min sketch
+function sketching(r,n)
+    local h = sketch.hll()
+    local td = sketch.tdigest()
+    local c = sketch.cms()
+    for i=1, n do
+        local id = "user:" .. (i % 1000)
+        sketch.add(h, id)
+        sketch.add(c, id)
+        sketch.add(td, i)
+    end
+    return math.tointeger(sketch.quantile(td, 1))
+end
+
+-- Keep the 10 highest of n scores, as a leaderboard aggregation would
+function ranking(r,n)
+    local t = topk(10)
+    for i=1, n do
+        topk.add(t, "user:" .. i, (i * 7919) % n)
+    end
+    return math.tointeger(topk.threshold(t)) + #topk.to_list(t)
+end
+
+-- Sample 100 of n values through a reservoir
+function sampling(r,n)
+    local t = topk.reservoir(100, 7)
+    for i=1, n do
+        topk.add(t, "user:" .. i)
+    end
+    return list.size(topk.to_list(t))
+end
+
+-- Match n rows against a compiled predicate, as where() does per record
+function matching(r,n)
+    local p = predicate{ "and", { "views", ">=", 0 }, { "campaign", "in", { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 } },
+        { "not", { "name", "==", "spam" } } }
+    local rows = list()
+    for i=1, 100 do
+        list.append(rows, map{ views = i * 7, campaign = i % 10 + 1, name = "row" .. i })
+    end
+    local total = 0
+    for i=1, n do
+        if predicate.match(p, rows[i % 100 + 1]) then
+            total = total + 1
+        end
+    end
+    return total
+end
+
+-- Project 3 of 6 fields out of n rows, as select() does per record
+function projecting(r,n)
+    local p = projection{ "id", "campaign", "views" }
+    local rows = list()
+    for i=1, 100 do
+        list.append(rows, map{ id = i, campaign = i % 10, views = i * 7, a = 1, b = 2, c = 3 })
+    end
+    local total = 0
+    for i=1, n do
+        local m = projection.apply(p, rows[i % 100 + 1])
+        if map.size(m) == 3 then
+            total = total + 1
+        end
+    end
+    return total
+end
+
+-- Count n values over 10000 keys with at most 1000 in memory, as a group-by
+-- which spills to disk does
+function spilling(r,n)
+    local s = spill(1000, math.sum)
+    for i=1, n do
+        local k = (i * 7919) % 10000
+        s[k] = (s[k] or 0) + 1
+    end
+    local total = 0
+    for m in spill.chunks(s) do
+        for k, v in map.pairs(m) do
+            total = total + v
+        end
+    end
+    return total
+end
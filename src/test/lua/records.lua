@@ -105,3 +105,19 @@ function delete_record(r,name)
 -- end
 
 
+
+-- Increment a bin n times through a bin handle
+function incr_by_handle(r,name,n)
+    local h = record.bin(r,name)
+    for i=1, n do
+        r[h] = r[h] + 1
+    end
+    return r[h]
+end
+
+-- Read a bin from each record in the stream through a bin handle
+function map_by_handle(s,name)
+    return s : map(function(r)
+        return r[record.bin(r,name)]
+    end)
+end
@@ -0,0 +1,60 @@
+
+function algebra(r)
+    local a = set{1, 2, 3, "x", 2.5}
+    local b = set(list{3, 4, "x", "y"})
+    local added = set.add(a, 1)
+    local removed = set.remove(a, 2.5)
+    local u = set.union(a, b)
+    local i = set.intersection(a, b)
+    local d = set.difference(a, b)
+    return list{ #a, set.size(b), added, removed, set.remove(a, 2.5),
+        set.size(u), set.size(i), set.contains(i, 3), set.contains(i, "x"), set.contains(i, 1),
+        set.size(d), set.contains(d, 1), set.contains(d, 3),
+        set.contains(a, true), set.contains(a, 1.5) }
+end
+
+function elements(r)
+    local s = set()
+    local b = bytes()
+    bytes.append_string(b, "key")
+    local c = bytes()
+    bytes.append_string(c, "key")
+    set.add(s, b)
+    set.add(s, true)
+    set.add(s, 0.0)
+    -- bytes are compared by content, and -0.0 equals 0.0
+    local dups = set.add(s, c) or set.add(s, -0.0) or set.add(s, true)
+    -- changing bytes after adding them doesn't change the set
+    bytes.append_string(b, "more")
+    local count = 0
+    for v in set.iterator(s) do
+        count = count + 1
+    end
+    local ok = pcall(set.add, s, map())
+    return list{ dups, set.contains(s, c), set.contains(s, b), count, ok }
+end
+
+-- Add n integers to a set, removing every third, then check growth and
+-- shrinking kept everything reachable
+function churn(r, n)
+    local s = set()
+    for i=1, n do
+        set.add(s, i)
+        set.add(s, "k" .. i)
+    end
+    for i=3, n, 3 do
+        set.remove(s, i)
+        set.remove(s, "k" .. i)
+    end
+    local found = 0
+    for i=1, n do
+        if set.contains(s, i) and set.contains(s, "k" .. i) then
+            found = found + 1
+        end
+    end
+    return found
+end
+
+function stored(r)
+    return set{5, "five", 5, "five"}
+end
@@ -0,0 +1,88 @@
+
+-- Count distinct values in a stream
+function distinct(s)
+    return s : aggregate(sketch.hll(), sketch.add) : reduce(sketch.merge)
+end
+
+function count(r, h)
+    return sketch.count(h)
+end
+
+-- Estimate quantiles of a stream
+function digest(s)
+    return s : aggregate(sketch.tdigest(), sketch.add) : reduce(sketch.merge)
+end
+
+function quantiles(r, td)
+    return list{ sketch.quantile(td, 0.5), sketch.quantile(td, 0.99),
+        sketch.quantile(td, 0.001), sketch.quantile(td, 0), sketch.quantile(td, 1) }
+end
+
+-- Merge sketches built from two halves of the same data
+function merged(r)
+    local h1 = sketch.hll(10)
+    local h2 = sketch.hll(10)
+    local c1 = sketch.cms(256, 4)
+    local c2 = sketch.cms(256, 4)
+    local t1 = sketch.tdigest(50)
+    local t2 = sketch.tdigest(50)
+    for i = 1, 2000 do
+        local key = "user:" .. (i % 700)
+        if i % 2 == 0 then
+            sketch.add(h1, key)
+            sketch.add(c1, key)
+            sketch.add(t1, i)
+        else
+            sketch.add(h2, key)
+            sketch.add(c2, key, 2)
+            sketch.add(t2, i)
+        end
+    end
+    sketch.add(c1, "heavy", 500)
+    local size = bytes.size(h1)
+    sketch.merge(h1, h2)
+    sketch.merge(c1, c2)
+    sketch.merge(t1, t2)
+    local ok = pcall(sketch.merge, h1, sketch.hll(11))
+    return list{ size, bytes.size(h1), sketch.count(h1), sketch.estimate(c1, "heavy"),
+        sketch.estimate(c1, "user:5"), sketch.estimate(c1, "missing"),
+        sketch.quantile(t1, 0.5), sketch.kind(h1), sketch.kind(c1), sketch.kind(t1),
+        sketch.kind(bytes()) == nil, ok, sketch.count(sketch.hll()), sketch.quantile(sketch.tdigest(), 0.5) == nil }
+end
+
+-- Sketches with headers outside the limits they are created with
+function malformed(r)
+    local bad = {}
+
+    -- no width, in a blob sized to match
+    local c = bytes.get_bytes(sketch.cms(1, 1), 1, 24)
+    bytes.set_int32_le(c, 5, 0)
+    bad[#bad + 1] = c
+    -- no depth
+    c = bytes.get_bytes(sketch.cms(1, 1), 1, 24)
+    bytes.set_int32_le(c, 9, 0)
+    bad[#bad + 1] = c
+    -- too deep
+    c = sketch.cms(1, 1)
+    bytes.set_int32_le(c, 9, 17)
+    bytes.set_size(c, 24 + 17 * 4)
+    bad[#bad + 1] = c
+
+    -- no compression, and a compression which isn't a number
+    local t = sketch.tdigest()
+    bytes.set_int64_le(t, 9, 0)
+    bad[#bad + 1] = t
+    t = sketch.tdigest()
+    bytes.set_int64_le(t, 9, 0x7ff8000000000000)
+    bad[#bad + 1] = t
+
+    local rejected = 0
+    for _, b in ipairs(bad) do
+        if sketch.kind(b) == nil and not pcall(sketch.add, b, "key")
+                and not pcall(sketch.estimate, b, "key")
+                and not pcall(sketch.quantile, b, 0.5) then
+            rejected = rejected + 1
+        end
+    end
+    return rejected
+end
@@ -0,0 +1,55 @@
+
+function math_ops(r)
+    local v = vector("f32", {1, 2, 3})
+    local w = vector("f32", list{4, 5, 6})
+    local minv, mini = vector.min(w)
+    local maxv, maxi = vector.max(w)
+    local cos = vector.cosine(v, v)
+    local dot = vector.dot(v, w)
+    vector.axpy(v, 2, w)
+    local n = 1000
+    local big = vector.new("f32", n)
+    local ones = vector.new("f32", n)
+    for i=1, n do
+        big[i] = i
+        ones[i] = 1
+    end
+    local ints = vector("i64", {1, 2, 3})
+    return list{ dot, vector.norm(vector("f64", {3, 4})), vector.sum(w), #w, w[2], vector.kind(w),
+        minv, mini, maxv, maxi, math.abs(cos - 1) < 1e-6, v[1], v[3],
+        vector.dot(ints, ints), math.type(vector.dot(ints, ints)),
+        vector.dot(v, vector.new("f32", 2)) == nil, vector.dot(big, ones), vector.sum(big), w[4] == nil }
+end
+
+function topk(r, k)
+    return vector.topk(vector("f64", {5, 1, 9, 3, 8, 7}), k)
+end
+
+function from_bytes(r)
+    local b = bytes()
+    bytes.put(b, "= f f", 1.5, 2.5)
+    local v = vector.from_bytes(b, "f32")
+    v[1] = 3
+    local first = bytes.unpack(b, "= f")
+    -- growing the bytes grows the vector
+    bytes.put(vector.to_bytes(v), "= f", 4)
+    local odd = bytes()
+    bytes.append_byte(odd, 1)
+    return list{ v[1], v[2], first, #v == 3 and v[3] == 4,
+        vector.from_bytes(odd, "f32") == nil, v }
+end
+
+function unfused(r)
+    -- x * x rounds to 1 + 2^-29, so subtracting 1 gives 2^-29 unless the
+    -- multiply and add are fused, keeping the 2^-60 rounded off
+    local x = 1 + 2^-30
+    local a = vector.new("f64", 9)
+    local b = vector.new("f64", 9)
+    a[1] = -1
+    b[1] = 1
+    a[9] = x
+    b[9] = x
+    local y = vector("f64", {-1})
+    vector.axpy(y, x, vector("f64", {x}))
+    return list{ vector.dot(a, b) == 2^-29, y[1] == 2^-29 }
+end
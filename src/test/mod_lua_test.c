@@ -27,9 +27,13 @@ PLAN(mod_lua_test)
 {
 	plan_before(before);
 
+	plan_add(bytes_udf);
 	plan_add(hash_udf);
 	plan_add(list_udf);
 	plan_add(record_udf);
+	plan_add(set_udf);
+	plan_add(sketch_udf);
 	plan_add(stream_udf);
 	plan_add(validation_basics);
+	plan_add(vector_udf);
 }
@@ -0,0 +1,221 @@
+/*
+ * Copyright 2008-2024 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+#include <aerospike/as_atomic.h>
+#include <aerospike/as_module.h>
+#include <aerospike/as_stream.h>
+#include <aerospike/as_types.h>
+#include <aerospike/mod_lua.h>
+#include <citrusleaf/cf_clock.h>
+#include <inttypes.h>
+
+#include "../test.h"
+#include "../util/consumer_stream.h"
+#include "../util/map_rec.h"
+#include "../util/producer_stream.h"
+#include "../util/test_aerospike.h"
+#include "../util/test_logger.h"
+
+/******************************************************************************
+ * CONSTANTS
+ *****************************************************************************/
+
+#define PERF_N 10000
+
+/******************************************************************************
+ * TYPES
+ *****************************************************************************/
+
+/**
+ * A record udf in perf.lua, called with PERF_N as its only argument on a
+ * record with a three element list in bin "listbin".
+ */
+typedef struct {
+	const char *	function;
+	const char *	desc;
+} perf_record_case;
+
+/**
+ * An aggr.lua sum over 100 * PERF_N values, split across 8 streams and run
+ * on the given number of threads, or read from one stream in slices of budget
+ * instructions if budget is non-zero.
+ */
+typedef struct {
+	const char *	desc;
+	uint32_t		threads;
+	uint32_t		budget;
+} perf_stream_case;
+
+/******************************************************************************
+ * CASES
+ *****************************************************************************/
+
+static const perf_record_case record_cases[] = {
+	{ "convert",	"convert scalars between Lua and as_val" },
+	{ "reread",		"push the same host list repeatedly" },
+	{ "grow",		"check nbytes while growing a list and a map" },
+	{ "append",		"append small fields to bytes" },
+	{ "parse",		"read fields out of a blob" },
+	{ "decode",		"unpack a record header" },
+	{ "bitmap",		"union and count bitmaps" },
+	{ "hashing",	"hash keys into buckets" },
+	{ "encode",		"encode a blob as hex and base64" },
+	{ "compress",	"compress and decompress a blob" },
+	{ "score",		"dot products over packed vectors" },
+	{ "reduce",		"numeric reductions over a list" },
+	{ "order",		"ordered inserts into a bounded list" },
+	{ "dedupe",		"membership tests against a set" },
+	{ "sketching",	"adds to probabilistic sketches" },
+	{ "ranking",	"keep the top scores of a stream" },
+	{ "sampling",	"sample a stream through a reservoir" },
+	{ "matching",	"match rows against a predicate" },
+	{ "projecting",	"project fields out of rows" },
+	{ "spilling",	"count values by key, spilling to disk" }
+};
+
+static const perf_stream_case stream_cases[] = {
+	{ "sum on 1 thread",						1, 0 },
+	{ "sum on 8 threads",						8, 0 },
+	{ "sum in slices of 10,000 instructions",	1, 10000 }
+};
+
+/******************************************************************************
+ * STREAMS
+ *****************************************************************************/
+
+static volatile uint32_t produced = 0;
+static as_val * result = NULL;
+
+static as_val * produce(void)
+{
+	uint32_t i = as_aaf_uint32(&produced, 1);
+
+	if (i > 100 * PERF_N) {
+		return AS_STREAM_END;
+	}
+
+	return (as_val *) as_integer_new(i);
+}
+
+static as_stream_status consume(as_val * v)
+{
+	if (v != AS_STREAM_END) {
+		result = v;
+	}
+
+	return AS_STREAM_OK;
+}
+
+/******************************************************************************
+ * TEST CASES
+ *
+ * Results are checked by the functional suites - these only time the calls.
+ *****************************************************************************/
+
+TEST(perf_udf_record, "record udfs")
+{
+	for ( size_t c = 0; c < sizeof(record_cases) / sizeof(record_cases[0]); c++ ) {
+		as_arraylist * list = as_arraylist_new(3, 0);
+		as_arraylist_append_int64(list, 1);
+		as_arraylist_append_int64(list, 2);
+		as_arraylist_append_int64(list, 3);
+
+		as_rec * rec = map_rec_new();
+		as_rec_set(rec, "listbin", (as_val *) list);
+
+		// as_module_apply_record() will decrement ref count and attempt to free,
+		// so add extra reserve and free later.
+		as_val_reserve(rec);
+
+		as_arraylist arglist;
+		as_arraylist_inita(&arglist, 1);
+		as_arraylist_append_int64(&arglist, PERF_N);
+
+		as_result * res = as_success_new(NULL);
+
+		uint64_t start = cf_getus();
+		int rc = as_module_apply_record(&mod_lua, &ctx, "perf", record_cases[c].function, rec, (as_list *) &arglist, res);
+		uint64_t elapsed = cf_getus() - start;
+
+		assert_int_eq(rc, 0);
+		assert_true(res->is_success);
+
+		info("%-12s %8" PRIu64 " us  %s", record_cases[c].function, elapsed, record_cases[c].desc);
+
+		as_rec_destroy(rec);
+		as_arraylist_destroy(&arglist);
+		as_result_destroy(res);
+	}
+}
+
+TEST(perf_udf_stream, "stream udfs")
+{
+	for ( size_t c = 0; c < sizeof(stream_cases) / sizeof(stream_cases[0]); c++ ) {
+		as_stream * istreams[8];
+
+		for ( int i = 0; i < 8; i++ ) {
+			istreams[i] = producer_stream_new(produce);
+		}
+
+		as_stream * ostream = consumer_stream_new(consume);
+
+		produced = 0;
+		result = NULL;
+
+		uint64_t start = cf_getus();
+		int rc;
+
+		if (stream_cases[c].budget != 0) {
+			mod_lua_job * job = NULL;
+
+			rc = mod_lua_apply_stream_begin(&ctx, "aggr", "sum", istreams[0], NULL, ostream, NULL, stream_cases[c].budget, &job);
+
+			while (rc == MOD_LUA_IN_PROGRESS) {
+				rc = mod_lua_resume(job);
+			}
+		}
+		else {
+			rc = mod_lua_apply_stream_parallel(&ctx, "aggr", "sum", istreams, 8, NULL, ostream, NULL, stream_cases[c].threads);
+		}
+		uint64_t elapsed = cf_getus() - start;
+
+		assert_int_eq(rc, 0);
+		assert_not_null(result);
+
+		info("%8" PRIu64 " us  %s", elapsed, stream_cases[c].desc);
+
+		as_val_destroy(result);
+		as_stream_destroy(ostream);
+
+		for ( int i = 0; i < 8; i++ ) {
+			as_stream_destroy(istreams[i]);
+		}
+	}
+}
+
+/******************************************************************************
+ * TEST SUITE
+ *****************************************************************************/
+
+SUITE(perf_udf, "udf micro-benchmarks")
+{
+	suite_before(test_suite_before);
+	suite_after(test_suite_after);
+
+	suite_add(perf_udf_record);
+	suite_add(perf_udf_stream);
+}
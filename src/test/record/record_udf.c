@@ -24,10 +24,155 @@
 #include <aerospike/as_module.h>
 #include <aerospike/mod_lua.h>
 #include <aerospike/mod_lua_config.h>
+#include <aerospike/mod_lua_record.h>
+#include <citrusleaf/alloc.h>
 
 #include "../util/test_aerospike.h"
 #include "../util/test_logger.h"
 #include "../util/map_rec.h"
+#include "../util/consumer_stream.h"
+#include "../util/producer_stream.h"
+
+/******************************************************************************
+ * ID RECORD
+ *
+ * A record with a fixed set of bins, addressable by name or by id, which
+ * counts how often names are looked up. Ids are rotated by id_rec_offset, so
+ * records with different offsets map the same name to different ids.
+ *****************************************************************************/
+
+#define ID_REC_NBINS 3
+
+static const char * id_rec_names[ID_REC_NBINS] = { "a", "b", "c" };
+
+static uint32_t id_rec_name_lookups = 0;
+static uint32_t id_rec_resolves = 0;
+static bool id_rec_stable = true;
+static uint32_t id_rec_offset = 0;
+
+static int id_rec_find(const char * name)
+{
+    for (int i = 0; i < ID_REC_NBINS; i++) {
+        if (strcmp(id_rec_names[i], name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static as_val * id_rec_get_by_id(const as_rec * r, uint32_t id)
+{
+    as_val ** bins = (as_val **) r->data;
+    return bins[(id + ID_REC_NBINS - id_rec_offset) % ID_REC_NBINS];
+}
+
+static int id_rec_set_by_id(const as_rec * r, uint32_t id, const as_val * v)
+{
+    as_val ** bins = (as_val **) r->data;
+    id = (id + ID_REC_NBINS - id_rec_offset) % ID_REC_NBINS;
+    if (bins[id] != NULL) {
+        as_val_destroy(bins[id]);
+    }
+    bins[id] = (as_val *) v;
+    return 0;
+}
+
+static as_val * id_rec_get(const as_rec * r, const char * name)
+{
+    id_rec_name_lookups++;
+    int i = id_rec_find(name);
+    return i < 0 ? NULL : id_rec_get_by_id(r, (i + id_rec_offset) % ID_REC_NBINS);
+}
+
+static int id_rec_set(const as_rec * r, const char * name, const as_val * v)
+{
+    id_rec_name_lookups++;
+    int i = id_rec_find(name);
+    return i < 0 ? 1 : id_rec_set_by_id(r, (i + id_rec_offset) % ID_REC_NBINS, v);
+}
+
+static bool id_rec_destroy(as_rec * r)
+{
+    as_val ** bins = (as_val **) r->data;
+    for (int i = 0; i < ID_REC_NBINS; i++) {
+        if (bins[i] != NULL) {
+            as_val_destroy(bins[i]);
+        }
+    }
+    cf_free(bins);
+    r->data = NULL;
+    return true;
+}
+
+static const void * id_rec_id_space(const as_rec * r)
+{
+    return id_rec_stable ? id_rec_names : NULL;
+}
+
+static bool id_rec_resolve(const as_rec * r, const char * name, uint32_t * id)
+{
+    id_rec_resolves++;
+    int i = id_rec_find(name);
+    if (i < 0) {
+        return false;
+    }
+    *id = (i + id_rec_offset) % ID_REC_NBINS;
+    return true;
+}
+
+static const as_rec_hooks id_rec_hooks = {
+    .get        = id_rec_get,
+    .set        = id_rec_set,
+    .destroy    = id_rec_destroy
+};
+
+static const mod_lua_bin_hooks id_rec_bin_hooks = {
+    .id_space   = id_rec_id_space,
+    .resolve    = id_rec_resolve,
+    .get        = id_rec_get_by_id,
+    .set        = id_rec_set_by_id
+};
+
+static as_rec * id_rec_new()
+{
+    return as_rec_new(cf_calloc(ID_REC_NBINS, sizeof(as_val *)), &id_rec_hooks);
+}
+
+/**
+ * Hands out the same as_rec struct for every record, as a host freeing each
+ * record before reading the next may do, with a different id offset each time.
+ */
+
+static as_rec id_rec_reused;
+static uint32_t id_rec_limit = 0;
+static uint32_t id_rec_produced = 0;
+static int64_t id_rec_consumed = 0;
+
+static as_val * id_rec_produce(void)
+{
+    if (id_rec_produced > 0) {
+        as_rec_destroy(&id_rec_reused);
+    }
+    if (id_rec_produced >= id_rec_limit) {
+        return AS_STREAM_END;
+    }
+    id_rec_offset = id_rec_produced % ID_REC_NBINS;
+    as_rec_init(&id_rec_reused, cf_calloc(ID_REC_NBINS, sizeof(as_val *)), &id_rec_hooks);
+    as_rec_set(&id_rec_reused, "a", (as_val *) as_integer_new(-1));
+    as_rec_set(&id_rec_reused, "b", (as_val *) as_integer_new(id_rec_produced + 1));
+    as_rec_set(&id_rec_reused, "c", (as_val *) as_integer_new(-1));
+    id_rec_produced++;
+    return (as_val *) &id_rec_reused;
+}
+
+static as_stream_status id_rec_consume(as_val * v)
+{
+    if (v != AS_STREAM_END) {
+        id_rec_consumed += as_integer_get((as_integer *) v);
+    }
+    as_val_destroy(v);
+    return AS_STREAM_OK;
+}
 
 /******************************************************************************
  * TEST CASES
@@ -89,6 +234,125 @@ TEST(record_udf_2, "concat bins a and b of {a = 'abc', b = 'def' }")
     as_result_destroy(res);
 }
 
+TEST(record_udf_3, "increment bin a of {a = 1} through a bin handle")
+{
+    as_rec * rec = map_rec_new();
+    as_rec_set(rec, "a", (as_val *) as_integer_new(1));
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+    as_arraylist arglist;
+    as_arraylist_inita(&arglist, 2);
+    as_arraylist_append_str(&arglist, "a");
+    as_arraylist_append_int64(&arglist, 10);
+
+    as_result * res = as_success_new(NULL);
+
+    int rc = as_module_apply_record(&mod_lua, &ctx, "records", "incr_by_handle", rec, (as_list *) &arglist, res);
+
+    assert_int_eq(rc, 0);
+    assert_true(res->is_success);
+    assert_not_null(res->value);
+    assert_int_eq(as_integer_toint((as_integer *) res->value), 11);
+    assert_int_eq(as_integer_toint((as_integer *) as_rec_get(rec, "a")), 11);
+
+    as_rec_destroy(rec);
+    as_arraylist_destroy(&arglist);
+    as_result_destroy(res);
+}
+
+TEST(record_udf_4, "bin handles resolve bin ids once per invocation")
+{
+    assert_true(mod_lua_record_set_bin_hooks(&id_rec_hooks, &id_rec_bin_hooks));
+
+    as_rec * rec = id_rec_new();
+    as_rec_set(rec, "b", (as_val *) as_integer_new(1));
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+	as_val_reserve(rec);
+
+    as_arraylist arglist;
+    as_arraylist_inita(&arglist, 2);
+    as_arraylist_append_str(&arglist, "b");
+    as_arraylist_append_int64(&arglist, 10);
+
+    // Stable ids.
+    id_rec_stable = true;
+    id_rec_name_lookups = 0;
+    id_rec_resolves = 0;
+
+    as_result * res = as_success_new(NULL);
+
+    int rc = as_module_apply_record(&mod_lua, &ctx, "records", "incr_by_handle", rec, (as_list *) &arglist, res);
+
+    assert_int_eq(rc, 0);
+    assert_true(res->is_success);
+    assert_not_null(res->value);
+    assert_int_eq(as_integer_toint((as_integer *) res->value), 11);
+    assert_int_eq(id_rec_resolves, 1);
+    assert_int_eq(id_rec_name_lookups, 0);
+
+    as_result_destroy(res);
+
+    // Ids only valid for the record during the invocation.
+    id_rec_stable = false;
+    id_rec_name_lookups = 0;
+    id_rec_resolves = 0;
+
+    res = as_success_new(NULL);
+
+    rc = as_module_apply_record(&mod_lua, &ctx, "records", "incr_by_handle", rec, (as_list *) &arglist, res);
+
+    assert_int_eq(rc, 0);
+    assert_true(res->is_success);
+    assert_not_null(res->value);
+    assert_int_eq(as_integer_toint((as_integer *) res->value), 21);
+    assert_int_eq(id_rec_resolves, 1);
+    assert_int_eq(id_rec_name_lookups, 0);
+
+    assert_true(mod_lua_record_set_bin_hooks(&id_rec_hooks, NULL));
+
+    as_rec_destroy(rec);
+    as_arraylist_destroy(&arglist);
+    as_result_destroy(res);
+}
+
+TEST(record_udf_5, "bin handles re-resolve for a new record at the same address")
+{
+    assert_true(mod_lua_record_set_bin_hooks(&id_rec_hooks, &id_rec_bin_hooks));
+
+    id_rec_stable = false;
+    id_rec_resolves = 0;
+    id_rec_limit = 6;
+    id_rec_produced = 0;
+    id_rec_consumed = 0;
+
+    as_arraylist arglist;
+    as_arraylist_inita(&arglist, 1);
+    as_arraylist_append_str(&arglist, "b");
+
+    as_stream * istream = producer_stream_new(id_rec_produce);
+    as_stream * ostream = consumer_stream_new(id_rec_consume);
+
+    int rc = as_module_apply_stream(&mod_lua, &ctx, "records", "map_by_handle", istream, (as_list *) &arglist, ostream, NULL);
+
+    assert_int_eq(rc, 0);
+    assert_int_eq(id_rec_consumed, 1 + 2 + 3 + 4 + 5 + 6);
+    assert_int_eq(id_rec_resolves, 6);
+
+    id_rec_stable = true;
+    id_rec_offset = 0;
+    assert_true(mod_lua_record_set_bin_hooks(&id_rec_hooks, NULL));
+
+    as_stream_destroy(istream);
+    as_stream_destroy(ostream);
+    as_arraylist_destroy(&arglist);
+}
+
 /******************************************************************************
  * TEST SUITE
  *****************************************************************************/
@@ -100,4 +364,7 @@ SUITE(record_udf, "stream udf tests")
     
     suite_add(record_udf_1);
     suite_add(record_udf_2);
+    suite_add(record_udf_3);
+    suite_add(record_udf_4);
+    suite_add(record_udf_5);
 }
@@ -0,0 +1,188 @@
+/*
+ * Copyright 2008-2024 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+#include <aerospike/as_module.h>
+#include <aerospike/as_types.h>
+#include <aerospike/mod_lua.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../test.h"
+#include "../util/map_rec.h"
+#include "../util/test_aerospike.h"
+#include "../util/test_logger.h"
+
+/******************************************************************************
+ * TEST CASES
+ *****************************************************************************/
+
+TEST(set_udf_1, "set membership and algebra")
+{
+	as_rec * rec = map_rec_new();
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 0);
+
+	as_result * res = as_success_new(NULL);
+
+	int rc = as_module_apply_record(&mod_lua, &ctx, "sets", "algebra", rec, (as_list *) &arglist, res);
+
+	assert_int_eq(rc, 0);
+	assert_true(res->is_success);
+	assert_not_null(res->value);
+
+	as_list * rlist = (as_list *) res->value;
+	assert_int_eq(as_list_size(rlist), 15);
+	assert_int_eq(as_list_get_int64(rlist, 0), 4);
+	assert_int_eq(as_list_get_int64(rlist, 1), 4);
+	assert_false(as_boolean_get((as_boolean *) as_list_get(rlist, 2)));
+	assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, 3)));
+	assert_false(as_boolean_get((as_boolean *) as_list_get(rlist, 4)));
+	// union
+	assert_int_eq(as_list_get_int64(rlist, 5), 6);
+	// intersection
+	assert_int_eq(as_list_get_int64(rlist, 6), 2);
+	assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, 7)));
+	assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, 8)));
+	assert_false(as_boolean_get((as_boolean *) as_list_get(rlist, 9)));
+	// difference
+	assert_int_eq(as_list_get_int64(rlist, 10), 2);
+	assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, 11)));
+	assert_false(as_boolean_get((as_boolean *) as_list_get(rlist, 12)));
+	assert_false(as_boolean_get((as_boolean *) as_list_get(rlist, 13)));
+	assert_false(as_boolean_get((as_boolean *) as_list_get(rlist, 14)));
+
+	as_rec_destroy(rec);
+	as_arraylist_destroy(&arglist);
+	as_result_destroy(res);
+}
+
+TEST(set_udf_2, "set elements of each type")
+{
+	as_rec * rec = map_rec_new();
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 0);
+
+	as_result * res = as_success_new(NULL);
+
+	int rc = as_module_apply_record(&mod_lua, &ctx, "sets", "elements", rec, (as_list *) &arglist, res);
+
+	assert_int_eq(rc, 0);
+	assert_true(res->is_success);
+	assert_not_null(res->value);
+
+	as_list * rlist = (as_list *) res->value;
+	assert_int_eq(as_list_size(rlist), 5);
+	assert_false(as_boolean_get((as_boolean *) as_list_get(rlist, 0)));
+	assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, 1)));
+	assert_false(as_boolean_get((as_boolean *) as_list_get(rlist, 2)));
+	assert_int_eq(as_list_get_int64(rlist, 3), 3);
+	// a map can't be a set element
+	assert_false(as_boolean_get((as_boolean *) as_list_get(rlist, 4)));
+
+	as_rec_destroy(rec);
+	as_arraylist_destroy(&arglist);
+	as_result_destroy(res);
+}
+
+TEST(set_udf_3, "sets stay consistent as they grow and shrink")
+{
+	as_rec * rec = map_rec_new();
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 1);
+	as_arraylist_append_int64(&arglist, 3000);
+
+	as_result * res = as_success_new(NULL);
+
+	int rc = as_module_apply_record(&mod_lua, &ctx, "sets", "churn", rec, (as_list *) &arglist, res);
+
+	assert_int_eq(rc, 0);
+	assert_true(res->is_success);
+	assert_not_null(res->value);
+	assert_int_eq(as_integer_toint((as_integer *) res->value), 2000);
+
+	as_rec_destroy(rec);
+	as_arraylist_destroy(&arglist);
+	as_result_destroy(res);
+}
+
+TEST(set_udf_4, "a set is stored as a list")
+{
+	as_rec * rec = map_rec_new();
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 0);
+
+	as_result * res = as_success_new(NULL);
+
+	int rc = as_module_apply_record(&mod_lua, &ctx, "sets", "stored", rec, (as_list *) &arglist, res);
+
+	assert_int_eq(rc, 0);
+	assert_true(res->is_success);
+	assert_not_null(res->value);
+	assert_int_eq(as_val_type(res->value), AS_LIST);
+
+	as_list * rlist = (as_list *) res->value;
+	assert_int_eq(as_list_size(rlist), 2);
+
+	as_val * a = as_list_get(rlist, 0);
+	as_val * b = as_list_get(rlist, 1);
+	as_integer * i = as_integer_fromval(as_val_type(a) == AS_INTEGER ? a : b);
+	as_string * s = as_string_fromval(as_val_type(a) == AS_STRING ? a : b);
+	assert_not_null(i);
+	assert_not_null(s);
+	assert_int_eq(as_integer_get(i), 5);
+	assert_string_eq(as_string_get(s), "five");
+
+	as_rec_destroy(rec);
+	as_arraylist_destroy(&arglist);
+	as_result_destroy(res);
+}
+
+/******************************************************************************
+ * TEST SUITE
+ *****************************************************************************/
+
+SUITE(set_udf, "set udf tests")
+{
+	suite_before(test_suite_before);
+	suite_after(test_suite_after);
+
+	suite_add(set_udf_1);
+	suite_add(set_udf_2);
+	suite_add(set_udf_3);
+	suite_add(set_udf_4);
+}
@@ -0,0 +1,243 @@
+/*
+ * Copyright 2008-2024 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+#include <aerospike/as_module.h>
+#include <aerospike/as_stream.h>
+#include <aerospike/as_types.h>
+#include <aerospike/mod_lua.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../test.h"
+#include "../util/map_rec.h"
+#include "../util/producer_stream.h"
+#include "../util/consumer_stream.h"
+#include "../util/test_aerospike.h"
+#include "../util/test_logger.h"
+
+/******************************************************************************
+ * TEST CASES
+ *****************************************************************************/
+
+static uint32_t limit = 0;
+static uint32_t produced = 0;
+static as_val * result = NULL;
+
+// 1 to limit / 2, twice over
+static as_val * produce(void)
+{
+	if (produced >= limit) {
+		return AS_STREAM_END;
+	}
+
+	produced++;
+
+	return (as_val *) as_integer_new(produced % (limit / 2) + 1);
+}
+
+static as_stream_status consume(as_val * v)
+{
+	if (v != AS_STREAM_END) {
+		as_val_destroy(result);
+		result = v;
+	}
+
+	return AS_STREAM_OK;
+}
+
+/**
+ * Apply a record UDF to a sketch, returning its result.
+ */
+static as_val * apply_to(const char * function, as_val * sketch)
+{
+	as_rec * rec = map_rec_new();
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 1);
+	as_arraylist_append(&arglist, as_val_reserve(sketch));
+
+	as_result * res = as_success_new(NULL);
+	as_val * v = NULL;
+
+	int rc = as_module_apply_record(&mod_lua, &ctx, "sketches", function, rec, (as_list *) &arglist, res);
+
+	if ( rc == 0 && res->is_success ) {
+		v = as_val_reserve(res->value);
+	}
+
+	as_rec_destroy(rec);
+	as_arraylist_destroy(&arglist);
+	as_result_destroy(res);
+	return v;
+}
+
+TEST(sketch_udf_1, "distinct count of a stream")
+{
+	limit = 200000;
+	produced = 0;
+	result = NULL;
+
+	as_stream * istream = producer_stream_new(produce);
+	as_stream * ostream = consumer_stream_new(consume);
+
+	int rc = as_module_apply_stream(&mod_lua, &ctx, "sketches", "distinct", istream, NULL, ostream, NULL);
+
+	assert_int_eq(rc, 0);
+	assert_int_eq(produced, limit);
+	assert_not_null(result);
+
+	// the aggregate is a fixed-size sketch, however many values went in
+	as_bytes * b = as_bytes_fromval(result);
+	assert_not_null(b);
+	assert_int_eq(as_bytes_size(b), 4096 + 8);
+
+	as_val * count = apply_to("count", result);
+	assert_not_null(count);
+
+	// within 4 standard errors at precision 12
+	assert_true(llabs(as_integer_get((as_integer *) count) - 100000) < 100000 * 4 * 0.0163);
+
+	as_val_destroy(count);
+	as_val_destroy(result);
+	as_stream_destroy(istream);
+	as_stream_destroy(ostream);
+}
+
+TEST(sketch_udf_2, "quantiles of a stream")
+{
+	limit = 200000;
+	produced = 0;
+	result = NULL;
+
+	as_stream * istream = producer_stream_new(produce);
+	as_stream * ostream = consumer_stream_new(consume);
+
+	int rc = as_module_apply_stream(&mod_lua, &ctx, "sketches", "digest", istream, NULL, ostream, NULL);
+
+	assert_int_eq(rc, 0);
+	assert_int_eq(produced, limit);
+	assert_not_null(result);
+
+	// the digest stays small, however many values went in
+	as_bytes * b = as_bytes_fromval(result);
+	assert_not_null(b);
+	assert_true(as_bytes_size(b) < 16 * 1024);
+
+	as_list * rlist = (as_list *) apply_to("quantiles", result);
+	assert_not_null(rlist);
+	assert_int_eq(as_list_size(rlist), 5);
+	assert_true(fabs(as_list_get_double(rlist, 0) - 50000) < 500);
+	assert_true(fabs(as_list_get_double(rlist, 1) - 99000) < 100);
+	assert_true(fabs(as_list_get_double(rlist, 2) - 100) < 20);
+	assert_true(as_list_get_double(rlist, 3) == 1);
+	assert_true(as_list_get_double(rlist, 4) == 100000);
+
+	as_val_destroy(rlist);
+	as_val_destroy(result);
+	as_stream_destroy(istream);
+	as_stream_destroy(ostream);
+}
+
+TEST(sketch_udf_3, "merge sketches of each kind")
+{
+	as_rec * rec = map_rec_new();
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 0);
+
+	as_result * res = as_success_new(NULL);
+
+	int rc = as_module_apply_record(&mod_lua, &ctx, "sketches", "merged", rec, (as_list *) &arglist, res);
+
+	assert_int_eq(rc, 0);
+	assert_true(res->is_success);
+	assert_not_null(res->value);
+
+	as_list * rlist = (as_list *) res->value;
+	assert_int_eq(as_list_size(rlist), 14);
+	// merging doesn't grow a HyperLogLog
+	assert_int_eq(as_list_get_int64(rlist, 0), 1024 + 8);
+	assert_int_eq(as_list_get_int64(rlist, 1), 1024 + 8);
+	assert_true(llabs(as_list_get_int64(rlist, 2) - 700) < 700 * 4 * 0.0325);
+	// count-min estimates are never low
+	assert_true(as_list_get_int64(rlist, 3) >= 500);
+	assert_true(as_list_get_int64(rlist, 3) < 520);
+	assert_true(as_list_get_int64(rlist, 4) >= 4);
+	assert_true(as_list_get_int64(rlist, 5) < 30);
+	assert_true(fabs(as_list_get_double(rlist, 6) - 1000) < 25);
+	assert_string_eq(as_list_get_str(rlist, 7), "hll");
+	assert_string_eq(as_list_get_str(rlist, 8), "cms");
+	assert_string_eq(as_list_get_str(rlist, 9), "tdigest");
+	assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, 10)));
+	// sketches of different precision can't be merged
+	assert_false(as_boolean_get((as_boolean *) as_list_get(rlist, 11)));
+	assert_int_eq(as_list_get_int64(rlist, 12), 0);
+	assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, 13)));
+
+	as_rec_destroy(rec);
+	as_arraylist_destroy(&arglist);
+	as_result_destroy(res);
+}
+
+TEST(sketch_udf_4, "sketches with malformed headers are rejected")
+{
+	as_rec * rec = map_rec_new();
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 0);
+
+	as_result * res = as_success_new(NULL);
+
+	int rc = as_module_apply_record(&mod_lua, &ctx, "sketches", "malformed", rec, (as_list *) &arglist, res);
+
+	assert_int_eq(rc, 0);
+	assert_true(res->is_success);
+	assert_int_eq(as_integer_get((as_integer *) res->value), 5);
+
+	as_rec_destroy(rec);
+	as_arraylist_destroy(&arglist);
+	as_result_destroy(res);
+}
+
+/******************************************************************************
+ * TEST SUITE
+ *****************************************************************************/
+
+SUITE(sketch_udf, "sketch udf tests")
+{
+	suite_before(test_suite_before);
+	suite_after(test_suite_after);
+
+	suite_add(sketch_udf_1);
+	suite_add(sketch_udf_2);
+	suite_add(sketch_udf_3);
+	suite_add(sketch_udf_4);
+}
@@ -15,15 +15,19 @@
  * the License.
  */
 #include "../test.h"
+#include <aerospike/as_atomic.h>
 #include <aerospike/as_stream.h>
+#include <aerospike/as_timer.h>
 #include <aerospike/as_types.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <aerospike/as_module.h>
 #include <aerospike/mod_lua.h>
 #include <aerospike/mod_lua_config.h>
+#include <aerospike/mod_lua_stream.h>
 
 #include "../util/test_aerospike.h"
 #include "../util/test_logger.h"
@@ -279,6 +283,1304 @@ TEST(stream_udf_6, "campaign rollup w/ aggregate")
     as_stream_destroy(ostream);
 }
 
+static as_list * result7 = NULL;
+
+static as_stream_status consume7(as_val * v)
+{
+	if (v != AS_STREAM_END) {
+		consumed++;
+		result7 = (as_list *) v;
+	}
+
+	return AS_STREAM_OK;
+}
+
+TEST(stream_udf_7, "top 3 of range (1-100,000)")
+{
+	limit = 100000;
+	produced = 0;
+	consumed = 0;
+
+	result7 = NULL;
+
+	as_stream * istream = producer_stream_new(produce3);
+	as_stream * ostream = consumer_stream_new(consume7);
+	as_list *   arglist = NULL;
+
+	int rc = as_module_apply_stream(&mod_lua, &ctx, "aggr", "top3", istream, arglist, ostream, NULL);
+
+	assert_int_eq(rc, 0);
+	assert_int_eq(produced, limit);
+	assert_int_eq(consumed, 1);
+	assert_not_null(result7);
+	assert_int_eq(as_list_size(result7), 3);
+	assert_int_eq(as_list_get_int64(result7, 0), 100000);
+	assert_int_eq(as_list_get_int64(result7, 1), 99999);
+	assert_int_eq(as_list_get_int64(result7, 2), 99998);
+
+	as_list_destroy(result7);
+	as_stream_destroy(istream);
+	as_stream_destroy(ostream);
+
+	// an empty stream has an empty top 3
+	limit = 0;
+	produced = 0;
+	consumed = 0;
+
+	result7 = NULL;
+
+	istream = producer_stream_new(produce3);
+	ostream = consumer_stream_new(consume7);
+
+	rc = as_module_apply_stream(&mod_lua, &ctx, "aggr", "top3", istream, arglist, ostream, NULL);
+
+	assert_int_eq(rc, 0);
+	assert_int_eq(consumed, 1);
+	assert_not_null(result7);
+	assert_int_eq(as_list_size(result7), 0);
+
+	as_list_destroy(result7);
+	as_stream_destroy(istream);
+	as_stream_destroy(ostream);
+}
+
+TEST(stream_udf_8, "bottom 3 of range (1-100,000) by key")
+{
+	limit = 100000;
+	produced = 0;
+	consumed = 0;
+
+	result7 = NULL;
+
+	as_stream * istream = producer_stream_new(produce3);
+	as_stream * ostream = consumer_stream_new(consume7);
+	as_list *   arglist = NULL;
+
+	int rc = as_module_apply_stream(&mod_lua, &ctx, "aggr", "bottom3", istream, arglist, ostream, NULL);
+
+	assert_int_eq(rc, 0);
+	assert_int_eq(produced, limit);
+	assert_int_eq(consumed, 1);
+	assert_not_null(result7);
+	assert_int_eq(as_list_size(result7), 3);
+	assert_int_eq(as_list_get_int64(result7, 0), 1);
+	assert_int_eq(as_list_get_int64(result7, 1), 2);
+	assert_int_eq(as_list_get_int64(result7, 2), 3);
+
+	as_list_destroy(result7);
+	as_stream_destroy(istream);
+	as_stream_destroy(ostream);
+
+	// a score which isn't a number is an error, not the value itself
+	limit = 100;
+	produced = 0;
+	consumed = 0;
+
+	result7 = NULL;
+
+	as_result * res = as_success_new(NULL);
+
+	istream = producer_stream_new(produce3);
+	ostream = consumer_stream_new(consume7);
+
+	rc = as_module_apply_stream(&mod_lua, &ctx, "aggr", "bottom3_unscored", istream, arglist, ostream, res);
+
+	assert_int_ne(rc, 0);
+	assert_false(res->is_success);
+	assert_null(result7);
+
+	as_result_destroy(res);
+	as_stream_destroy(istream);
+	as_stream_destroy(ostream);
+}
+
+TEST(stream_udf_9, "distinct values of range (1-100)")
+{
+	const char * functions[] = { "residues", "first_of_each_decade" };
+	const int64_t expected[][11] = {
+		{ 1, 2, 3, 4, 5, 6, 0 },
+		{ 1, 10, 20, 30, 40, 50, 60, 70, 80, 90, 100 }
+	};
+	const uint32_t sizes[] = { 7, 11 };
+
+	for ( int t = 0; t < 2; t++ ) {
+		limit = 100;
+		produced = 0;
+		consumed = 0;
+
+		result7 = NULL;
+
+		as_stream * istream = producer_stream_new(produce3);
+		as_stream * ostream = consumer_stream_new(consume7);
+		as_list *   arglist = NULL;
+
+		int rc = as_module_apply_stream(&mod_lua, &ctx, "aggr", functions[t], istream, arglist, ostream, NULL);
+
+		assert_int_eq(rc, 0);
+		assert_int_eq(produced, limit);
+		assert_int_eq(consumed, 1);
+		assert_not_null(result7);
+		assert_int_eq(as_list_size(result7), sizes[t]);
+		for ( uint32_t i = 0; i < sizes[t]; i++ ) {
+			assert_int_eq(as_list_get_int64(result7, i), expected[t][i]);
+		}
+
+		as_list_destroy(result7);
+		as_stream_destroy(istream);
+		as_stream_destroy(ostream);
+	}
+}
+
+TEST(stream_udf_10, "sample of range (1-10,000)")
+{
+	int64_t first[5];
+
+	for ( int t = 0; t < 2; t++ ) {
+		limit = 10000;
+		produced = 0;
+		consumed = 0;
+
+		result7 = NULL;
+
+		as_stream * istream = producer_stream_new(produce3);
+		as_stream * ostream = consumer_stream_new(consume7);
+
+		as_arraylist arglist;
+		as_arraylist_inita(&arglist, 1);
+		as_arraylist_append_int64(&arglist, 42);
+
+		int rc = as_module_apply_stream(&mod_lua, &ctx, "aggr", "sample5", istream, (as_list *) &arglist, ostream, NULL);
+
+		assert_int_eq(rc, 0);
+		assert_int_eq(produced, limit);
+		assert_int_eq(consumed, 1);
+		assert_not_null(result7);
+
+		// The server emits the sampled values and their scores, for the
+		// client to merge.
+		assert_int_eq(as_list_size(result7), 2);
+		as_list * values = (as_list *) as_list_get(result7, 0);
+		as_list * scores = (as_list *) as_list_get(result7, 1);
+		assert_int_eq(as_list_size(values), 5);
+		assert_int_eq(as_list_size(scores), 5);
+
+		for ( uint32_t i = 0; i < 5; i++ ) {
+			int64_t v = as_list_get_int64(values, i);
+			double score = as_list_get_double(scores, i);
+			assert_true(v >= 1 && v <= 10000);
+			assert_true(score >= 0 && score < 1);
+			if ( i > 0 ) {
+				assert_true(score <= as_list_get_double(scores, i - 1));
+			}
+			// the same seed draws the same sample
+			if ( t == 0 ) {
+				first[i] = v;
+			}
+			else {
+				assert_int_eq(v, first[i]);
+			}
+		}
+
+		as_list_destroy(result7);
+		as_arraylist_destroy(&arglist);
+		as_stream_destroy(istream);
+		as_stream_destroy(ostream);
+	}
+}
+
+TEST(stream_udf_11, "campaign counts w/ where")
+{
+	const char * functions[] = { "count_where", "count_where_mapped" };
+	const int64_t expected[] = { 10, 9, 9, 90, 10, 0, 100, 1, 10, 0 };
+
+	for ( int f = 0; f < 2; f++ ) {
+		for ( int i = 0; i < 10; i++ ) {
+			limit = 100;
+			produced = 0;
+			consumed = 0;
+
+			result3 = NULL;
+
+			as_stream * istream = producer_stream_new(produce5);
+			as_stream * ostream = consumer_stream_new(consume3);
+
+			as_arraylist arglist;
+			as_arraylist_inita(&arglist, 1);
+			as_arraylist_append_int64(&arglist, i + 1);
+
+			int rc = as_module_apply_stream(&mod_lua, &ctx, "aggr", functions[f], istream, (as_list *) &arglist, ostream, NULL);
+
+			assert_int_eq(rc, 0);
+			assert_int_eq(produced, limit);
+			assert_int_eq(consumed, 1);
+			assert_not_null(result3);
+			assert_int_eq(as_integer_get(result3), expected[i]);
+
+			as_integer_destroy(result3);
+			as_arraylist_destroy(&arglist);
+			as_stream_destroy(istream);
+			as_stream_destroy(ostream);
+		}
+	}
+
+	// an unknown operator fails to compile
+	as_stream * istream = producer_stream_new(produce5);
+	as_stream * ostream = consumer_stream_new(consume3);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 1);
+	as_arraylist_append_int64(&arglist, 11);
+
+	int rc = as_module_apply_stream(&mod_lua, &ctx, "aggr", "count_where", istream, (as_list *) &arglist, ostream, NULL);
+
+	assert_int_ne(rc, 0);
+
+	as_arraylist_destroy(&arglist);
+	as_stream_destroy(istream);
+	as_stream_destroy(ostream);
+}
+
+TEST(stream_udf_12, "campaign rollup w/ select")
+{
+	limit = 100;
+	produced = 0;
+	consumed = 0;
+
+	result5 = NULL;
+
+	as_stream * istream = producer_stream_new(produce5);
+	as_stream * ostream = consumer_stream_new(consume5);
+	as_list *   arglist = NULL;
+
+	int rc = as_module_apply_stream(&mod_lua, &ctx, "aggr", "select_rollup", istream, arglist, ostream, NULL);
+
+	assert_int_eq(rc, 0);
+	assert_int_eq(produced, limit);
+	assert_int_eq(consumed, 1);
+
+	as_integer i;
+
+	assert_int_eq(as_integer_get((as_integer *) as_map_get(result5, (as_val *) as_integer_init(&i, 0))), 5450);
+	assert_int_eq(as_integer_get((as_integer *) as_map_get(result5, (as_val *) as_integer_init(&i, 3))), 5120);
+	assert_int_eq(as_integer_get((as_integer *) as_map_get(result5, (as_val *) as_integer_init(&i, 9))), 5260);
+
+	as_map_destroy(result5);
+	as_stream_destroy(istream);
+	as_stream_destroy(ostream);
+
+	// after where, and after another op
+	const char * functions[] = { "select_where", "select_late" };
+	const int64_t expected[] = { 480, 100 };
+
+	for ( int f = 0; f < 2; f++ ) {
+		limit = 100;
+		produced = 0;
+		consumed = 0;
+
+		result3 = NULL;
+
+		istream = producer_stream_new(produce5);
+		ostream = consumer_stream_new(consume3);
+
+		rc = as_module_apply_stream(&mod_lua, &ctx, "aggr", functions[f], istream, arglist, ostream, NULL);
+
+		assert_int_eq(rc, 0);
+		assert_int_eq(produced, limit);
+		assert_int_eq(consumed, 1);
+		assert_not_null(result3);
+		assert_int_eq(as_integer_get(result3), expected[f]);
+
+		as_integer_destroy(result3);
+		as_stream_destroy(istream);
+		as_stream_destroy(ostream);
+	}
+}
+
+// Shared by all streams of a parallel apply, so together they produce 1 to
+// limit once between them.
+static volatile uint32_t produced_shared = 0;
+
+static as_val * produce_shared(void)
+{
+	uint32_t i = as_aaf_uint32(&produced_shared, 1);
+
+	if (i > limit) {
+		return AS_STREAM_END;
+	}
+
+	return (as_val *) as_integer_new(i);
+}
+
+TEST(stream_udf_13, "sum and top 3 of range (1-400,000) over 4 streams")
+{
+	const uint32_t threads[] = { 1, 4 };
+
+	for ( int t = 0; t < 2; t++ ) {
+		as_stream * istreams[4];
+
+		for ( int i = 0; i < 4; i++ ) {
+			istreams[i] = producer_stream_new(produce_shared);
+		}
+
+		limit = 400000;
+		produced_shared = 0;
+		consumed = 0;
+
+		result3 = NULL;
+
+		as_stream * ostream = consumer_stream_new(consume3);
+
+		int rc = mod_lua_apply_stream_parallel(&ctx, "aggr", "sum", istreams, 4, NULL, ostream, NULL, threads[t]);
+
+		assert_int_eq(rc, 0);
+		assert_int_eq(consumed, 1);
+		assert_not_null(result3);
+		assert_int_eq(as_integer_get(result3), 80000200000L);
+
+		as_integer_destroy(result3);
+		as_stream_destroy(ostream);
+
+		// the partial top 3 of each stream are merged
+		produced_shared = 0;
+		consumed = 0;
+
+		result7 = NULL;
+
+		ostream = consumer_stream_new(consume7);
+
+		rc = mod_lua_apply_stream_parallel(&ctx, "aggr", "top3", istreams, 4, NULL, ostream, NULL, threads[t]);
+
+		assert_int_eq(rc, 0);
+		assert_int_eq(consumed, 1);
+		assert_not_null(result7);
+		assert_int_eq(as_list_size(result7), 3);
+		assert_int_eq(as_list_get_int64(result7, 0), 400000);
+		assert_int_eq(as_list_get_int64(result7, 1), 399999);
+		assert_int_eq(as_list_get_int64(result7, 2), 399998);
+
+		as_list_destroy(result7);
+		as_stream_destroy(ostream);
+
+		for ( int i = 0; i < 4; i++ ) {
+			as_stream_destroy(istreams[i]);
+		}
+	}
+}
+
+// A node's sample, of one value scored by its size.
+static as_val * produce_sample(void)
+{
+	uint32_t i = as_aaf_uint32(&produced_shared, 1);
+
+	if (i > limit) {
+		return AS_STREAM_END;
+	}
+
+	as_arraylist * values = as_arraylist_new(1, 1);
+	as_arraylist_append_int64(values, i);
+
+	as_arraylist * scores = as_arraylist_new(1, 1);
+	as_arraylist_append_double(scores, i / 1000.0);
+
+	as_arraylist * sample = as_arraylist_new(2, 2);
+	as_arraylist_append(sample, (as_val *) values);
+	as_arraylist_append(sample, (as_val *) scores);
+
+	return (as_val *) sample;
+}
+
+TEST(stream_udf_14, "client reduces the results of 40 nodes concurrently")
+{
+	mod_lua_config config = {
+		.server_mode = false,
+		.cache_enabled = false,
+		.user_path = AS_START_DIR "src/test/lua"
+	};
+
+	assert_int_eq(as_module_configure(&mod_lua, &config), 0);
+
+	as_stream * istreams[40];
+
+	for ( int i = 0; i < 40; i++ ) {
+		istreams[i] = producer_stream_new(produce_shared);
+	}
+
+	limit = 4000;
+	produced_shared = 0;
+	consumed = 0;
+
+	result3 = NULL;
+
+	as_stream * ostream = consumer_stream_new(consume3);
+
+	int rc = mod_lua_apply_stream_parallel(&ctx, "aggr", "sum", istreams, 40, NULL, ostream, NULL, 8);
+
+	assert_int_eq(rc, 0);
+	assert_int_eq(consumed, 1);
+	assert_not_null(result3);
+	assert_int_eq(as_integer_get(result3), 8002000);
+
+	as_integer_destroy(result3);
+	as_stream_destroy(ostream);
+
+	for ( int i = 0; i < 40; i++ ) {
+		as_stream_destroy(istreams[i]);
+		istreams[i] = producer_stream_new(produce_sample);
+	}
+
+	// the map after the reduce runs once, on the merged sample
+	limit = 200;
+	produced_shared = 0;
+	consumed = 0;
+
+	result7 = NULL;
+
+	ostream = consumer_stream_new(consume7);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 1);
+	as_arraylist_append_int64(&arglist, 42);
+
+	rc = mod_lua_apply_stream_parallel(&ctx, "aggr", "sample5", istreams, 40, (as_list *) &arglist, ostream, NULL, 8);
+
+	assert_int_eq(rc, 0);
+	assert_int_eq(consumed, 1);
+	assert_not_null(result7);
+	assert_int_eq(as_list_size(result7), 5);
+	for ( uint32_t i = 0; i < 5; i++ ) {
+		assert_int_eq(as_list_get_int64(result7, i), 200 - i);
+	}
+
+	as_list_destroy(result7);
+	as_arraylist_destroy(&arglist);
+	as_stream_destroy(ostream);
+
+	for ( int i = 0; i < 40; i++ ) {
+		as_stream_destroy(istreams[i]);
+	}
+
+	config.server_mode = true;
+	assert_int_eq(as_module_configure(&mod_lua, &config), 0);
+}
+
+#define CHUNKS_MAX 8
+
+static as_map * chunks[CHUNKS_MAX];
+
+static as_stream_status consume_chunk(as_val * v)
+{
+	if (v != AS_STREAM_END) {
+		if (consumed < CHUNKS_MAX) {
+			chunks[consumed] = (as_map *) v;
+		}
+		else {
+			as_val_destroy(v);
+		}
+		consumed++;
+	}
+
+	return AS_STREAM_OK;
+}
+
+static void chunks_destroy(void)
+{
+	for ( uint32_t i = 0; i < consumed && i < CHUNKS_MAX; i++ ) {
+		as_map_destroy(chunks[i]);
+	}
+}
+
+// The entry for key in whichever chunk holds it, checking no other does.
+static as_val * chunks_get(int64_t key)
+{
+	as_integer k;
+	as_val * found = NULL;
+	uint32_t n = 0;
+
+	for ( uint32_t i = 0; i < consumed && i < CHUNKS_MAX; i++ ) {
+		as_val * v = as_map_get(chunks[i], (as_val *) as_integer_init(&k, key));
+		if (v) {
+			found = v;
+			n++;
+		}
+	}
+	return n == 1 ? found : NULL;
+}
+
+// A node's groups, of one value grouped by its last digit.
+static as_val * produce_group(void)
+{
+	uint32_t i = as_aaf_uint32(&produced_shared, 1);
+
+	if (i > limit) {
+		return AS_STREAM_END;
+	}
+
+	as_arraylist * group = as_arraylist_new(1, 1);
+	as_arraylist_append_int64(group, i);
+
+	as_hashmap * groups = as_hashmap_new(1);
+	as_hashmap_set(groups, (as_val *) as_integer_new(i % 10), (as_val *) group);
+
+	return (as_val *) groups;
+}
+
+TEST(stream_udf_15, "group-by spilled to disk and merged")
+{
+	// 10 campaigns, at most 4 in memory, so the result comes in 3 maps
+	limit = 100;
+	produced = 0;
+	consumed = 0;
+
+	as_stream * istream = producer_stream_new(produce5);
+	as_stream * ostream = consumer_stream_new(consume_chunk);
+	as_list *   arglist = (as_list *) as_arraylist_new(0, 0);
+
+	int rc = as_module_apply_stream(&mod_lua, &ctx, "aggr", "rollup_spill", istream, arglist, ostream, NULL);
+
+	assert_int_eq(rc, 0);
+	assert_int_eq(produced, limit);
+	assert_int_eq(consumed, 3);
+	assert_int_eq(as_map_size(chunks[0]) + as_map_size(chunks[1]) + as_map_size(chunks[2]), 10);
+
+	const int64_t views[] = { 5450, 4740, 4930, 5120, 4310, 5500, 4690, 4880, 5070, 5260 };
+
+	for ( int64_t i = 0; i < 10; i++ ) {
+		as_integer * v = (as_integer *) chunks_get(i);
+		assert_not_null(v);
+		assert_int_eq(as_integer_get(v), views[i]);
+	}
+
+	chunks_destroy();
+	as_stream_destroy(istream);
+	as_stream_destroy(ostream);
+
+	limit = 1000;
+	produced = 0;
+	consumed = 0;
+
+	istream = producer_stream_new(produce3);
+	ostream = consumer_stream_new(consume_chunk);
+
+	rc = as_module_apply_stream(&mod_lua, &ctx, "aggr", "residue_groups", istream, arglist, ostream, NULL);
+
+	assert_int_eq(rc, 0);
+	assert_int_eq(consumed, 3);
+
+	for ( int64_t i = 0; i < 10; i++ ) {
+		as_list * l = (as_list *) chunks_get(i);
+		assert_not_null(l);
+		assert_int_eq(as_list_size(l), 100);
+		assert_int_eq(as_list_get_int64(l, 0) % 10, i);
+	}
+
+	chunks_destroy();
+	as_list_destroy(arglist);
+	as_stream_destroy(istream);
+	as_stream_destroy(ostream);
+
+	// the client merges the groups of 4 nodes into a spill of its own
+	mod_lua_config config = {
+		.server_mode = false,
+		.cache_enabled = false,
+		.user_path = AS_START_DIR "src/test/lua"
+	};
+
+	assert_int_eq(as_module_configure(&mod_lua, &config), 0);
+
+	as_stream * istreams[4];
+
+	for ( int i = 0; i < 4; i++ ) {
+		istreams[i] = producer_stream_new(produce_group);
+	}
+
+	limit = 400;
+	produced_shared = 0;
+	consumed = 0;
+
+	ostream = consumer_stream_new(consume_chunk);
+
+	rc = mod_lua_apply_stream_parallel(&ctx, "aggr", "residue_groups", istreams, 4, NULL, ostream, NULL, 4);
+
+	assert_int_eq(rc, 0);
+	assert_int_eq(consumed, 3);
+
+	for ( int64_t i = 0; i < 10; i++ ) {
+		as_list * l = (as_list *) chunks_get(i);
+		assert_not_null(l);
+		assert_int_eq(as_list_size(l), 40);
+	}
+
+	chunks_destroy();
+	as_stream_destroy(ostream);
+
+	for ( int i = 0; i < 4; i++ ) {
+		as_stream_destroy(istreams[i]);
+	}
+
+	config.server_mode = true;
+	assert_int_eq(as_module_configure(&mod_lua, &config), 0);
+}
+
+#define TAKEN_MAX 16
+
+static as_val * taken[TAKEN_MAX];
+
+static as_stream_status consume_taken(as_val * v)
+{
+	if (v != AS_STREAM_END) {
+		if (consumed < TAKEN_MAX) {
+			taken[consumed] = v;
+		}
+		else {
+			as_val_destroy(v);
+		}
+		consumed++;
+	}
+
+	return AS_STREAM_OK;
+}
+
+static void taken_destroy(void)
+{
+	for ( uint32_t i = 0; i < consumed && i < TAKEN_MAX; i++ ) {
+		as_val_destroy(taken[i]);
+	}
+}
+
+TEST(stream_udf_16, "limit stops reading the stream early")
+{
+	const char * functions[] = { "first", "first", "first_of_campaign", "first_doubled" };
+	const int64_t n[] = { 5, 0, 4, 3 };
+	const uint32_t expected_produced[] = { 5, 0, 33, 3 };
+
+	for ( int f = 0; f < 4; f++ ) {
+		limit = f == 2 ? 100 : 100000;
+		produced = 0;
+		consumed = 0;
+
+		as_stream * istream = producer_stream_new(f == 2 ? produce5 : produce3);
+		as_stream * ostream = consumer_stream_new(consume_taken);
+
+		as_arraylist arglist;
+		as_arraylist_inita(&arglist, 1);
+		as_arraylist_append_int64(&arglist, n[f]);
+
+		int rc = as_module_apply_stream(&mod_lua, &ctx, "aggr", functions[f], istream, (as_list *) &arglist, ostream, NULL);
+
+		assert_int_eq(rc, 0);
+		assert_int_eq(consumed, n[f]);
+		assert_int_eq(produced, expected_produced[f]);
+
+		if (f == 2) {
+			as_string id;
+			as_string_init(&id, "id", false);
+
+			for ( uint32_t i = 0; i < consumed; i++ ) {
+				as_map * m = (as_map *) taken[i];
+				assert_int_eq(as_map_size(m), 1);
+				assert_int_eq(as_integer_get((as_integer *) as_map_get(m, (as_val *) &id)), 10 * i + 3);
+			}
+		}
+		else if (f == 3) {
+			for ( uint32_t i = 0; i < consumed; i++ ) {
+				assert_int_eq(as_integer_get((as_integer *) taken[i]), 2 * (i + 1));
+			}
+		}
+
+		taken_destroy();
+		as_arraylist_destroy(&arglist);
+		as_stream_destroy(istream);
+		as_stream_destroy(ostream);
+	}
+
+	// each of 4 streams stops at 10, and the merge keeps 10 of their 40
+	as_stream * istreams[4];
+
+	for ( int i = 0; i < 4; i++ ) {
+		istreams[i] = producer_stream_new(produce_shared);
+	}
+
+	limit = 400000;
+	produced_shared = 0;
+	consumed = 0;
+
+	as_stream * ostream = consumer_stream_new(consume_taken);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 1);
+	as_arraylist_append_int64(&arglist, 10);
+
+	int rc = mod_lua_apply_stream_parallel(&ctx, "aggr", "first", istreams, 4, (as_list *) &arglist, ostream, NULL, 4);
+
+	assert_int_eq(rc, 0);
+	assert_int_eq(consumed, 10);
+	assert_int_eq(produced_shared, 40);
+
+	taken_destroy();
+	as_stream_destroy(ostream);
+
+	// the client limits each node's results, then the merged results,
+	// before reducing them
+	mod_lua_config config = {
+		.server_mode = false,
+		.cache_enabled = false,
+		.user_path = AS_START_DIR "src/test/lua"
+	};
+
+	assert_int_eq(as_module_configure(&mod_lua, &config), 0);
+
+	produced_shared = 0;
+	consumed = 0;
+
+	ostream = consumer_stream_new(consume_taken);
+
+	as_arraylist arglist3;
+	as_arraylist_inita(&arglist3, 1);
+	as_arraylist_append_int64(&arglist3, 3);
+
+	rc = mod_lua_apply_stream_parallel(&ctx, "aggr", "first_doubled", istreams, 4, (as_list *) &arglist3, ostream, NULL, 1);
+
+	assert_int_eq(rc, 0);
+	assert_int_eq(consumed, 1);
+	assert_int_eq(produced_shared, 12);
+	assert_int_eq(as_integer_get((as_integer *) taken[0]), 6);
+
+	taken_destroy();
+	as_arraylist_destroy(&arglist);
+	as_arraylist_destroy(&arglist3);
+	as_stream_destroy(ostream);
+
+	for ( int i = 0; i < 4; i++ ) {
+		as_stream_destroy(istreams[i]);
+	}
+
+	config.server_mode = true;
+	assert_int_eq(as_module_configure(&mod_lua, &config), 0);
+}
+
+static uint32_t pending = 0;
+
+// Has no value ready at first, on each read of a value.
+static as_val * produce_pending(void)
+{
+	static bool ready = false;
+
+	if (produced >= limit) {
+		return AS_STREAM_END;
+	}
+
+	if (! ready) {
+		ready = true;
+		pending++;
+		return MOD_LUA_STREAM_PENDING;
+	}
+
+	ready = false;
+	produced++;
+
+	return (as_val *) as_integer_new(produced);
+}
+
+typedef struct {
+	mod_lua_job * job;
+	int rc;
+} resume_args;
+
+static void * resume_worker(void * udata)
+{
+	resume_args * args = (resume_args *) udata;
+	args->rc = mod_lua_resume(args->job);
+	return NULL;
+}
+
+TEST(stream_udf_17, "resumable apply yields and is resumed")
+{
+	// sum range (1-100,000), yielding every 10,000 instructions
+	limit = 100000;
+	produced = 0;
+	consumed = 0;
+
+	result3 = NULL;
+
+	as_stream * istream = producer_stream_new(produce3);
+	as_stream * ostream = consumer_stream_new(consume3);
+	as_list *   arglist = (as_list *) as_arraylist_new(0, 0);
+	mod_lua_job * job = NULL;
+
+	int rc = mod_lua_apply_stream_begin(&ctx, "aggr", "sum", istream, arglist, ostream, NULL, 10000, &job);
+	uint32_t slices = 1;
+
+	while (rc == MOD_LUA_IN_PROGRESS) {
+		assert_not_null(job);
+
+		// any worker may resume a job
+		if (slices % 2 == 1) {
+			pthread_t thread;
+			resume_args args = { .job = job };
+			assert_int_eq(pthread_create(&thread, NULL, resume_worker, &args), 0);
+			pthread_join(thread, NULL);
+			rc = args.rc;
+		}
+		else {
+			rc = mod_lua_resume(job);
+		}
+		slices++;
+	}
+
+	assert_int_eq(rc, 0);
+	assert_true(slices > 10);
+	assert_int_eq(produced, limit);
+	assert_int_eq(consumed, 1);
+	assert_not_null(result3);
+	assert_int_eq(as_integer_get(result3), 5000050000L);
+
+	as_integer_destroy(result3);
+	as_stream_destroy(istream);
+	as_stream_destroy(ostream);
+
+	// without a budget, yield only while the stream has nothing ready
+	limit = 10;
+	produced = 0;
+	consumed = 0;
+	pending = 0;
+
+	result3 = NULL;
+
+	istream = producer_stream_new(produce_pending);
+	ostream = consumer_stream_new(consume3);
+
+	rc = mod_lua_apply_stream_begin(&ctx, "aggr", "sum", istream, arglist, ostream, NULL, 0, &job);
+	slices = 1;
+
+	while (rc == MOD_LUA_IN_PROGRESS) {
+		rc = mod_lua_resume(job);
+		slices++;
+	}
+
+	assert_int_eq(rc, 0);
+	assert_int_eq(pending, 10);
+	assert_int_eq(slices, 11);
+	assert_int_eq(as_integer_get(result3), 55);
+
+	as_integer_destroy(result3);
+	as_stream_destroy(istream);
+	as_stream_destroy(ostream);
+
+	// an ordinary apply just reads again
+	produced = 0;
+	consumed = 0;
+	pending = 0;
+
+	result3 = NULL;
+
+	istream = producer_stream_new(produce_pending);
+	ostream = consumer_stream_new(consume3);
+
+	rc = as_module_apply_stream(&mod_lua, &ctx, "aggr", "sum", istream, arglist, ostream, NULL);
+
+	assert_int_eq(rc, 0);
+	assert_int_eq(pending, 10);
+	assert_int_eq(as_integer_get(result3), 55);
+
+	as_integer_destroy(result3);
+	as_stream_destroy(istream);
+	as_stream_destroy(ostream);
+
+	// an error ends the job
+	as_arraylist bad;
+	as_arraylist_inita(&bad, 1);
+	as_arraylist_append_int64(&bad, 11);
+
+	as_result * res = as_success_new(NULL);
+
+	istream = producer_stream_new(produce5);
+	ostream = consumer_stream_new(consume3);
+
+	rc = mod_lua_apply_stream_begin(&ctx, "aggr", "count_where", istream, (as_list *) &bad, ostream, res, 0, &job);
+
+	assert_int_eq(rc, 2);
+	assert_false(res->is_success);
+	assert_not_null(res->value);
+
+	as_result_destroy(res);
+	as_arraylist_destroy(&bad);
+	as_stream_destroy(istream);
+	as_stream_destroy(ostream);
+
+	// a job given up on reads no further
+	limit = 100000;
+	produced = 0;
+	consumed = 0;
+
+	istream = producer_stream_new(produce3);
+	ostream = consumer_stream_new(consume3);
+
+	rc = mod_lua_apply_stream_begin(&ctx, "aggr", "sum", istream, arglist, ostream, NULL, 10000, &job);
+
+	assert_int_eq(rc, MOD_LUA_IN_PROGRESS);
+	mod_lua_job_destroy(job);
+
+	assert_true(produced < limit);
+	assert_int_eq(consumed, 0);
+
+	as_list_destroy(arglist);
+	as_stream_destroy(istream);
+	as_stream_destroy(ostream);
+}
+
+// Each stream read in turn produces 1 to limit, plus limit times its number.
+static uint32_t produced_stream = 0;
+
+static as_val * produce_each(void)
+{
+	if (produced >= limit) {
+		produced = 0;
+		produced_stream++;
+		return AS_STREAM_END;
+	}
+
+	produced++;
+
+	return (as_val *) as_integer_new(produced_stream * limit + produced);
+}
+
+TEST(stream_udf_18, "samples of 4 streams merge into a sample of all")
+{
+	as_stream * istreams[4];
+
+	for ( int i = 0; i < 4; i++ ) {
+		istreams[i] = producer_stream_new(produce_each);
+	}
+
+	limit = 1000;
+	produced = 0;
+	produced_stream = 0;
+	consumed = 0;
+
+	result7 = NULL;
+
+	as_stream * ostream = consumer_stream_new(consume7);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 1);
+	as_arraylist_append_int64(&arglist, 42);
+
+	// one thread reads the streams in order
+	int rc = mod_lua_apply_stream_parallel(&ctx, "aggr", "sample100", istreams, 4, (as_list *) &arglist, ostream, NULL, 1);
+
+	assert_int_eq(rc, 0);
+	assert_int_eq(produced_stream, 4);
+	assert_int_eq(consumed, 1);
+	assert_not_null(result7);
+
+	as_list * values = (as_list *) as_list_get(result7, 0);
+	assert_int_eq(as_list_size(values), 100);
+
+	// The same seed on each stream mustn't draw the same scores, which
+	// would sample the same positions of every stream.
+	uint32_t counts[4] = { 0 };
+	bool sampled[1000] = { false };
+	uint32_t positions = 0;
+
+	for ( uint32_t i = 0; i < 100; i++ ) {
+		int64_t v = as_list_get_int64(values, i);
+		assert_true(v >= 1 && v <= 4 * limit);
+		counts[(v - 1) / limit]++;
+
+		if ( !sampled[(v - 1) % limit] ) {
+			sampled[(v - 1) % limit] = true;
+			positions++;
+		}
+	}
+
+	for ( int i = 0; i < 4; i++ ) {
+		assert_true(counts[i] >= 5 && counts[i] <= 50);
+	}
+	assert_true(positions >= 80);
+
+	as_list_destroy(result7);
+	as_arraylist_destroy(&arglist);
+	as_stream_destroy(ostream);
+
+	for ( int i = 0; i < 4; i++ ) {
+		as_stream_destroy(istreams[i]);
+	}
+}
+
+// A timer which has timed out once its source is set.
+static bool timer_expired(const as_timer * timer)
+{
+	return timer->source != NULL && *(const bool *) timer->source;
+}
+
+static uint64_t timer_slice(const as_timer * timer)
+{
+	(void) timer;
+	return 1000;
+}
+
+static const as_timer_hooks expired_timer_hooks = {
+	.destroy = NULL,
+	.timedout = timer_expired,
+	.timeslice = timer_slice
+};
+
+TEST(stream_udf_19, "a timeout stops every worker of a parallel apply")
+{
+	as_stream * istreams[4];
+
+	for ( int i = 0; i < 4; i++ ) {
+		istreams[i] = producer_stream_new(produce_shared);
+	}
+
+	limit = 4000000;
+	produced_shared = 0;
+
+	bool expired = true;
+	as_timer timer;
+	as_timer_init(&timer, &expired, &expired_timer_hooks);
+
+	as_udf_context timed = ctx;
+	timed.timer = &timer;
+
+	as_result * res = as_success_new(NULL);
+	as_stream * ostream = consumer_stream_new(consume3);
+
+	int rc = mod_lua_apply_stream_parallel(&timed, "aggr", "sum", istreams, 4, NULL, ostream, res, 4);
+
+	assert_int_ne(rc, 0);
+	assert_false(res->is_success);
+	assert_true(produced_shared < limit);
+
+	as_result_destroy(res);
+	as_stream_destroy(ostream);
+
+	for ( int i = 0; i < 4; i++ ) {
+		as_stream_destroy(istreams[i]);
+	}
+}
+
+TEST(stream_udf_20, "a spill merges its runs as it writes them")
+{
+	as_rec * rec = map_rec_new();
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 1);
+	as_arraylist_append_int64(&arglist, 30000);
+
+	as_result * res = as_success_new(NULL);
+
+	int rc = as_module_apply_record(&mod_lua, &ctx, "aggr", "spill_cascade", rec, (as_list *) &arglist, res);
+
+	assert_int_eq(rc, 0);
+	assert_true(res->is_success);
+	assert_not_null(res->value);
+
+	// 30,000 runs are written, but only a few of each level are kept open,
+	// and none once the merge is read
+	as_list * rlist = (as_list *) res->value;
+	assert_int_eq(as_list_size(rlist), 4);
+	assert_true(as_list_get_int64(rlist, 0) < 64);
+	assert_int_eq(as_list_get_int64(rlist, 1), 0);
+	assert_int_eq(as_list_get_int64(rlist, 2), 1000);
+	assert_int_eq(as_list_get_int64(rlist, 3), 30000);
+
+	as_rec_destroy(rec);
+	as_arraylist_destroy(&arglist);
+	as_result_destroy(res);
+}
+
+TEST(stream_udf_21, "a job given up on is closed and its state used again")
+{
+	mod_lua_config config = {
+		.server_mode = true,
+		.cache_enabled = true,
+		.user_path = AS_START_DIR "src/test/lua"
+	};
+
+	assert_int_eq(as_module_configure(&mod_lua, &config), 0);
+
+	limit = 100;
+	produced = 0;
+	consumed = 0;
+
+	as_arraylist * closed = as_arraylist_new(1, 1);
+	as_arraylist * arglist = as_arraylist_new(1, 1);
+	as_arraylist_append(arglist, as_val_reserve(closed));
+
+	as_stream * istream = producer_stream_new(produce3);
+	as_stream * ostream = consumer_stream_new(consume3);
+	mod_lua_job * job = NULL;
+
+	int rc = mod_lua_apply_stream_begin(&ctx, "aggr", "sum_guarded", istream, (as_list *) arglist, ostream, NULL, 1000, &job);
+
+	// well into the first aggregate call
+	for ( int i = 0; i < 10; i++ ) {
+		assert_int_eq(rc, MOD_LUA_IN_PROGRESS);
+		rc = mod_lua_resume(job);
+	}
+
+	assert_int_eq(rc, MOD_LUA_IN_PROGRESS);
+	assert_int_eq(produced, 1);
+	assert_int_eq(as_list_size((as_list *) closed), 0);
+
+	mod_lua_job_destroy(job);
+
+	// the call's to-be-closed variable is closed with the job
+	assert_int_eq(as_list_size((as_list *) closed), 1);
+	assert_int_eq(as_list_get_int64((as_list *) closed, 0), 1);
+
+	as_stream_destroy(istream);
+	as_stream_destroy(ostream);
+
+	// every cached state is used, so the job's is too
+	for ( int i = 0; i < 12; i++ ) {
+		limit = 100;
+		produced = 0;
+		consumed = 0;
+
+		result3 = NULL;
+
+		istream = producer_stream_new(produce3);
+		ostream = consumer_stream_new(consume3);
+
+		rc = as_module_apply_stream(&mod_lua, &ctx, "aggr", "sum", istream, NULL, ostream, NULL);
+
+		assert_int_eq(rc, 0);
+		assert_int_eq(consumed, 1);
+		assert_not_null(result3);
+		assert_int_eq(as_integer_get(result3), 5050);
+
+		as_integer_destroy(result3);
+		as_stream_destroy(istream);
+		as_stream_destroy(ostream);
+	}
+
+	as_arraylist_destroy(arglist);
+	as_arraylist_destroy(closed);
+
+	config.cache_enabled = false;
+	assert_int_eq(as_module_configure(&mod_lua, &config), 0);
+}
+
+TEST(stream_udf_22, "a predicate is neither stored nor returned")
+{
+	as_rec * rec = map_rec_new();
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 0);
+
+	as_result * res = as_success_new(NULL);
+
+	int rc = as_module_apply_record(&mod_lua, &ctx, "aggr", "predicate_stored", rec, (as_list *) &arglist, res);
+
+	assert_int_eq(rc, 0);
+	assert_true(res->is_success);
+	assert_not_null(res->value);
+
+	as_list * rlist = (as_list *) res->value;
+	assert_int_eq(as_list_size(rlist), 2);
+	assert_int_eq(as_list_get_int64(rlist, 0), 1);
+	assert_int_eq(as_list_get_int64(rlist, 1), 1);
+
+	as_result_destroy(res);
+	res = as_success_new(NULL);
+	as_val_reserve(rec);
+
+	rc = as_module_apply_record(&mod_lua, &ctx, "aggr", "predicate_returned", rec, (as_list *) &arglist, res);
+
+	assert_int_eq(rc, 0);
+	assert_true(res->is_success);
+	assert_null(res->value);
+
+	as_rec_destroy(rec);
+	as_arraylist_destroy(&arglist);
+	as_result_destroy(res);
+}
+
+TEST(stream_udf_23, "a projection is not stored")
+{
+	as_rec * rec = map_rec_new();
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 0);
+
+	as_result * res = as_success_new(NULL);
+
+	int rc = as_module_apply_record(&mod_lua, &ctx, "aggr", "projection_stored", rec, (as_list *) &arglist, res);
+
+	assert_int_eq(rc, 0);
+	assert_true(res->is_success);
+	assert_not_null(res->value);
+
+	as_list * rlist = (as_list *) res->value;
+	assert_int_eq(as_list_size(rlist), 3);
+	assert_int_eq(as_list_get_int64(rlist, 0), 1);
+	assert_int_eq(as_list_get_int64(rlist, 1), 1);
+	assert_int_eq(as_list_get_int64(rlist, 2), 3);
+
+	as_rec_destroy(rec);
+	as_arraylist_destroy(&arglist);
+	as_result_destroy(res);
+}
+
+TEST(stream_udf_24, "native types which aren't values are neither stored nor returned")
+{
+	// Every userdata type which isn't an as_val belongs here.
+	static const char * kinds[] = { "topk", "reservoir", "predicate", "projection", "spill" };
+
+	for ( size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++ ) {
+		as_rec * rec = map_rec_new();
+
+		// as_module_apply_record() will decrement ref count and attempt to free,
+		// so add extra reserve and free later.
+		as_val_reserve(rec);
+		as_val_reserve(rec);
+
+		as_arraylist arglist;
+		as_arraylist_inita(&arglist, 1);
+		as_arraylist_append_str(&arglist, kinds[k]);
+
+		as_result * res = as_success_new(NULL);
+
+		int rc = as_module_apply_record(&mod_lua, &ctx, "aggr", "native_stored", rec, (as_list *) &arglist, res);
+
+		assert_int_eq(rc, 0);
+		assert_true(res->is_success);
+		assert_not_null(res->value);
+
+		as_list * rlist = (as_list *) res->value;
+		assert_int_eq(as_list_size(rlist), 2);
+		assert_int_eq(as_list_get_int64(rlist, 0), 1);
+		assert_int_eq(as_list_get_int64(rlist, 1), 1);
+
+		as_result_destroy(res);
+		res = as_success_new(NULL);
+
+		rc = as_module_apply_record(&mod_lua, &ctx, "aggr", "native_returned", rec, (as_list *) &arglist, res);
+
+		assert_int_eq(rc, 0);
+		assert_true(res->is_success);
+		assert_null(res->value);
+
+		as_rec_destroy(rec);
+		as_arraylist_destroy(&arglist);
+		as_result_destroy(res);
+	}
+}
+
 /******************************************************************************
  * TEST SUITE
  *****************************************************************************/
@@ -294,4 +1596,22 @@ SUITE(stream_udf, "stream udf tests")
     suite_add(stream_udf_4);
     suite_add(stream_udf_5);
     suite_add(stream_udf_6);
+    suite_add(stream_udf_7);
+    suite_add(stream_udf_8);
+    suite_add(stream_udf_9);
+    suite_add(stream_udf_10);
+    suite_add(stream_udf_11);
+    suite_add(stream_udf_12);
+    suite_add(stream_udf_13);
+    suite_add(stream_udf_14);
+    suite_add(stream_udf_15);
+    suite_add(stream_udf_16);
+    suite_add(stream_udf_17);
+    suite_add(stream_udf_18);
+    suite_add(stream_udf_19);
+    suite_add(stream_udf_20);
+    suite_add(stream_udf_21);
+    suite_add(stream_udf_22);
+    suite_add(stream_udf_23);
+    suite_add(stream_udf_24);
 }
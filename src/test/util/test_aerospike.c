@@ -98,7 +98,8 @@ test_suite_before(atf_suite* suite)
 	mod_lua_config config = {
 		.server_mode = true,
 		.cache_enabled = false,
-		.user_path = AS_START_DIR "src/test/lua"
+		.user_path = AS_START_DIR "src/test/lua",
+		.node_id = 1
 	};
 
 	as_lua_log_init();
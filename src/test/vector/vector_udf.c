@@ -0,0 +1,200 @@
+/*
+ * Copyright 2008-2024 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+#include <aerospike/as_module.h>
+#include <aerospike/as_types.h>
+#include <aerospike/mod_lua.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../test.h"
+#include "../util/map_rec.h"
+#include "../util/test_aerospike.h"
+#include "../util/test_logger.h"
+
+/******************************************************************************
+ * TEST CASES
+ *****************************************************************************/
+
+TEST(vector_udf_1, "vector arithmetic")
+{
+	as_rec * rec = map_rec_new();
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 0);
+
+	as_result * res = as_success_new(NULL);
+
+	int rc = as_module_apply_record(&mod_lua, &ctx, "vectors", "math_ops", rec, (as_list *) &arglist, res);
+
+	assert_int_eq(rc, 0);
+	assert_true(res->is_success);
+	assert_not_null(res->value);
+
+	as_list * rlist = (as_list *) res->value;
+	assert_int_eq(as_list_size(rlist), 19);
+	assert_true(as_list_get_double(rlist, 0) == 32);
+	assert_true(as_list_get_double(rlist, 1) == 5);
+	assert_true(as_list_get_double(rlist, 2) == 15);
+	assert_int_eq(as_list_get_int64(rlist, 3), 3);
+	assert_true(as_list_get_double(rlist, 4) == 5);
+	assert_string_eq(as_list_get_str(rlist, 5), "f32");
+	assert_true(as_list_get_double(rlist, 6) == 4);
+	assert_int_eq(as_list_get_int64(rlist, 7), 1);
+	assert_true(as_list_get_double(rlist, 8) == 6);
+	assert_int_eq(as_list_get_int64(rlist, 9), 3);
+	assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, 10)));
+	// axpy: v + 2 * w
+	assert_true(as_list_get_double(rlist, 11) == 9);
+	assert_true(as_list_get_double(rlist, 12) == 15);
+	assert_int_eq(as_list_get_int64(rlist, 13), 14);
+	assert_string_eq(as_list_get_str(rlist, 14), "integer");
+	assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, 15)));
+	assert_true(as_list_get_double(rlist, 16) == 500500);
+	assert_true(as_list_get_double(rlist, 17) == 500500);
+	assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, 18)));
+
+	as_rec_destroy(rec);
+	as_arraylist_destroy(&arglist);
+	as_result_destroy(res);
+}
+
+TEST(vector_udf_2, "indexes of the largest elements")
+{
+	const int64_t k[] = { 3, 10, 0 };
+	const int64_t expected[] = { 3, 5, 6, 1, 4, 2 };
+	const uint32_t sizes[] = { 3, 6, 0 };
+
+	for ( int t = 0; t < 3; t++ ) {
+		as_rec * rec = map_rec_new();
+
+		// as_module_apply_record() will decrement ref count and attempt to free,
+		// so add extra reserve and free later.
+		as_val_reserve(rec);
+
+		as_arraylist arglist;
+		as_arraylist_inita(&arglist, 1);
+		as_arraylist_append_int64(&arglist, k[t]);
+
+		as_result * res = as_success_new(NULL);
+
+		int rc = as_module_apply_record(&mod_lua, &ctx, "vectors", "topk", rec, (as_list *) &arglist, res);
+
+		assert_int_eq(rc, 0);
+		assert_true(res->is_success);
+		assert_not_null(res->value);
+
+		as_list * rlist = (as_list *) res->value;
+		assert_int_eq(as_list_size(rlist), sizes[t]);
+		for ( uint32_t i = 0; i < sizes[t]; i++ ) {
+			assert_int_eq(as_list_get_int64(rlist, i), expected[i]);
+		}
+
+		as_rec_destroy(rec);
+		as_arraylist_destroy(&arglist);
+		as_result_destroy(res);
+	}
+}
+
+TEST(vector_udf_3, "vectors share storage with bytes")
+{
+	as_rec * rec = map_rec_new();
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 0);
+
+	as_result * res = as_success_new(NULL);
+
+	int rc = as_module_apply_record(&mod_lua, &ctx, "vectors", "from_bytes", rec, (as_list *) &arglist, res);
+
+	assert_int_eq(rc, 0);
+	assert_true(res->is_success);
+	assert_not_null(res->value);
+
+	as_list * rlist = (as_list *) res->value;
+	assert_int_eq(as_list_size(rlist), 6);
+	assert_true(as_list_get_double(rlist, 0) == 3);
+	assert_true(as_list_get_double(rlist, 1) == 2.5);
+	assert_true(as_list_get_double(rlist, 2) == 3);
+	assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, 3)));
+	assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, 4)));
+
+	// A vector is stored as its bytes.
+	const float expected[] = { 3, 2.5, 4 };
+	as_bytes * b = (as_bytes *) as_list_get(rlist, 5);
+	assert_not_null(b);
+	assert_int_eq(as_val_type(b), AS_BYTES);
+	assert_int_eq(as_bytes_size(b), sizeof(expected));
+	assert_int_eq(memcmp(as_bytes_get(b), expected, sizeof(expected)), 0);
+
+	as_rec_destroy(rec);
+	as_arraylist_destroy(&arglist);
+	as_result_destroy(res);
+}
+
+TEST(vector_udf_4, "products and sums are not fused")
+{
+	as_rec * rec = map_rec_new();
+
+	// as_module_apply_record() will decrement ref count and attempt to free,
+	// so add extra reserve and free later.
+	as_val_reserve(rec);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 0);
+
+	as_result * res = as_success_new(NULL);
+
+	int rc = as_module_apply_record(&mod_lua, &ctx, "vectors", "unfused", rec, (as_list *) &arglist, res);
+
+	assert_int_eq(rc, 0);
+	assert_true(res->is_success);
+	assert_not_null(res->value);
+
+	as_list * rlist = (as_list *) res->value;
+	assert_int_eq(as_list_size(rlist), 2);
+	assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, 0)));
+	assert_true(as_boolean_get((as_boolean *) as_list_get(rlist, 1)));
+
+	as_rec_destroy(rec);
+	as_arraylist_destroy(&arglist);
+	as_result_destroy(res);
+}
+
+/******************************************************************************
+ * TEST SUITE
+ *****************************************************************************/
+
+SUITE(vector_udf, "vector udf tests")
+{
+	suite_before(test_suite_before);
+	suite_after(test_suite_after);
+
+	suite_add(vector_udf_1);
+	suite_add(vector_udf_2);
+	suite_add(vector_udf_3);
+	suite_add(vector_udf_4);
+}